@@ -1,14 +1,20 @@
 
 #include "ApplicationUtilities.h"
 #include "GlobalDefinitions.h"
+#include "BinaryLogWriter.h"
+#include "LogFile.h"
+#include "TimestampFormatter.h"
 #include <csignal>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <iomanip>
 #include <iostream>
-#include <forward_list>
+#include <algorithm>
 #include <fstream>
+#include <mutex>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
 
 
 namespace ApplicationUtilities
@@ -58,79 +64,304 @@ void displayHelp()
     std::cout << "    -h, --help: Display this help text" << std::endl;
     std::cout << "    -v, --version: Display the version" << std::endl;
     std::cout << "    -e, --verbose: Enable verbose output" << std::endl;
-    std::cout << "    -p, --port: Set the port (Ex: /dev/ttyUSB0)" << std::endl;
+    std::cout << "    -p, --port: Add a port, optionally with its own settings (Ex: /dev/ttyUSB0,115200,8,even,1)" << std::endl;
     std::cout << "    -b, --baud-rate: Set the baud rate (Ex: 115200)" << std::endl;
     std::cout << "    -s, --stop-bits: Set the stop bits (Ex: 1)" << std::endl;
     std::cout << "    -d, --data-bits: Set the data bits (Ex: 8)" << std::endl;
     std::cout << "    -a, --parity: Set the parity (Ex: even)" << std::endl;
     std::cout << "    -n, --line-ending: Set the line ending (Ex: \\n)" << std::endl;
+    std::cout << "    --auto: Listen to each port first and use the baud rate, data bits and parity it turns out to talk with, instead of those given" << std::endl;
+    std::cout << "    -t, --threads: Set the number of worker threads serving the ports (Ex: 4)" << std::endl;
+    std::cout << "    --log-overflow: Set what happens when the log queue is full, block, drop-oldest or drop-newest (Ex: drop-oldest)" << std::endl;
+    std::cout << "    --log-queue-size: Set the number of queued log messages (Ex: 8192)" << std::endl;
+    std::cout << "    --log-level: Set log levels, globally or per subsystem (Ex: info,serial=debug)" << std::endl;
+    std::cout << "    --log-level-file: Read log levels from a file, re-read on SIGUSR2 (Ex: /etc/serial-levels)" << std::endl;
+    std::cout << "    --log-file-size: Rotate the log file when it reaches this size, 0 never (default 64M)" << std::endl;
+    std::cout << "    --log-file-count: Log files kept, the current one plus rotated <log>.1, <log>.2... (default 5)" << std::endl;
+    std::cout << "    --log-rotate-interval: Also rotate the log file every N seconds (Ex: 3600)" << std::endl;
+    std::cout << "    --log-sync: Flush the log file to disk never, always, or at most every N milliseconds (default 1000)" << std::endl;
+    std::cout << "    --log-format: Write the log file as text or as compact binary records, read back with --decode-log (default text)" << std::endl;
+    std::cout << "    --decode-log: Print a binary log file (and its rotated files) as text, then exit (Ex: /tmp/SerialCommunication/<log>.blog)" << std::endl;
+    std::cout << "    --lines: Split received data on the line ending and print each line with its port name" << std::endl;
+    std::cout << "    --framing: Frame received data and stdin lines with a codec (Ex: line, cobs, slip, length:u16le)" << std::endl;
+    std::cout << "    --capture: Record all RX/TX traffic to numbered capture files (Ex: /tmp/trace)" << std::endl;
+    std::cout << "    --capture-size: Set the size at which capture files roll over (Ex: 64M)" << std::endl;
+    std::cout << "    --replay: Play the RX data of a capture back instead of opening ports (Ex: /tmp/trace)" << std::endl;
+    std::cout << "    --replay-speed: Replay at a multiple of the recorded speed, or as fast as possible (Ex: 2, max)" << std::endl;
+    std::cout << "    --replay-pty: Replay out of one pseudo-terminal per captured port instead of to stdout" << std::endl;
+    std::cout << "    --sink: Also copy received data to a file or FIFO without ever blocking the port; drop what it cannot take, or buffer up to a size (Ex: /tmp/rx.fifo,drop or /tmp/rx.bin,buffer,64M)" << std::endl;
+    std::cout << "    --daemon: Share every port with local programs on a Unix socket named after the port in this directory, instead of the console (Ex: /run/serial gives /run/serial/ttyUSB0.sock)" << std::endl;
+    std::cout << "    --client-queue-size: Disconnect a daemon client once this much received data is waiting for it (Ex: 4M, default 1M)" << std::endl;
+    std::cout << "    --reconnect: Reopen ports that go away (or are not there yet) as soon as they are back, holding up to 1M of data sent to each meanwhile" << std::endl;
+    std::cout << "    --low-latency: Ask the serial driver for low latency (ASYNC_LOW_LATENCY, shortens the latency timer of FTDI and similar USB adapters)" << std::endl;
+    std::cout << "    --timestamps: Prefix each received line (or frame) with the monotonic time in seconds at which its last byte was read" << std::endl;
+    std::cout << "    --flow-control: Flow control for every port: none (default), hardware (RTS/CTS) or software (XON/XOFF)" << std::endl;
+    std::cout << "    --send: Stream a file (or - for stdin) to every port once it is open, as fast as the port takes it" << std::endl;
+    std::cout << "    --send-byte-delay: Microseconds between bytes sent by --send" << std::endl;
+    std::cout << "    --send-line-delay: Milliseconds to wait after each line sent by --send" << std::endl;
+    std::cout << "    --script: Run the commands in a file (one per line, # comments) on every port, print each result with its round trip, then exit" << std::endl;
+    std::cout << "    --window: Commands from --script in flight at once, 1 waits for each response (default 1)" << std::endl;
+    std::cout << "    --command-timeout: Milliseconds to wait for a response before retrying or failing a command (default 1000)" << std::endl;
+    std::cout << "    --command-retries: Times to resend a command that timed out (default 0)" << std::endl;
+    std::cout << "    --response-pattern: Regex for the line that ends a response (default ^(OK|ERROR|\\+CM[ES] ERROR.*)$)" << std::endl;
+    std::cout << "    --error-pattern: Regex for a line ending a response that fails the command, empty for none (default ^(ERROR|\\+CM[ES] ERROR.*)$)" << std::endl;
+    std::cout << "    --command-tags: Tag each command (T1, T2...; replacing {tag} or prepended) and match responses by their first word, for devices that answer out of order" << std::endl;
+    std::cout << "    --triggers: Act on patterns in received data, one \"<pattern> => log|mark|respond|run [argument]\" per line of a file (Ex: /etc/serial-triggers)" << std::endl;
+    std::cout << "    --hex: Show received data as offset, hex bytes and ASCII (one dump per read, or per frame with --framing), also written to the log file" << std::endl;
+    std::cout << "    --tui: Show received data, port settings and rates in an interactive terminal UI (F10 quits)" << std::endl;
+    std::cout << "    --metrics-interval: Log a metrics snapshot every N seconds, as SIGUSR1 does on demand (Ex: 60)" << std::endl;
+    std::cout << "    --jitter-interval: Log each port's histogram of the gaps between reads every N seconds (Ex: 10)" << std::endl;
 }
 
 
 void globalLogHandler(LogLevel logLevel, LogContext logContext, const std::string &str)
 {
-    using namespace ApplicationUtilities;
-    std::string logPrefix{""};
-    auto *outputStream = &std::cout;
+    /* Synchronous path, used until an AsyncLogHandler is installed (and
+     * after it is shut down), so it shares the one sink and log file */
+    static std::mutex globalLogMutex{};
+    {
+        std::lock_guard<std::mutex> globalLogLock{globalLogMutex};
+        auto sink = globalLogSink();
+        sink->append(logLevel, logContext, str);
+        sink->commit();
+    }
+    if (logLevel == LogLevel::Fatal) {
+        abort();
+    }
+}
+
+void formatLogRecord(std::string &output, LogLevel logLevel, const LogContext &logContext, uint64_t realtimeNanoseconds, const char *message, size_t length)
+{
+    const char *logPrefix{""};
     switch (logLevel) {
         case LogLevel::Debug:
-            if (!ApplicationUtilities::verboseLogging) {
-                return;
-            }
             logPrefix = "{  Debug }: ";
-            outputStream = &std::clog;
             break;
         case LogLevel::Info:
             logPrefix = "{  Info  }: ";
-            outputStream = &std::cout;
             break;
         case LogLevel::Warn:
             logPrefix = "{  Warn  }: ";
-            outputStream = &std::cout;
             break;
         case LogLevel::Fatal:
             logPrefix = "{  Fatal }: ";
-            outputStream = &std::cerr;
+            break;
     }
-    std::string logMessage{""};
-    std::string coreLogMessage{str};
-    if (coreLogMessage.find('\"') == 0) {
-        coreLogMessage = coreLogMessage.substr(1);
+    /* Messages built with a quoted format lose the enclosing quotes */
+    if ( (length > 0) && (message[0] == '\"') ) {
+        message++;
+        length--;
     }
-    if (coreLogMessage.find_last_of('\"') == coreLogMessage.length() - 1) {
-        coreLogMessage = coreLogMessage.substr(0, coreLogMessage.length() - 1);
+    if ( (length > 0) && (message[length - 1] == '\"') ) {
+        length--;
     }
+    char timeText[TimestampFormatter::LENGTH];
+    TimestampFormatter::format(realtimeNanoseconds, timeText);
+    output.push_back('[');
+    output.append(timeText, sizeof(timeText));
+    output.append("] - ");
+    output.append(logPrefix);
+    output.push_back(' ');
+    output.append(message, length);
     if (logLevel == LogLevel::Fatal) {
-        std::string logTime{currentTime()};
-        logTime.replace(logTime.begin(), logTime.end(), '-', ':');
-        logMessage = TStringFormat("[{0}] - {1} {2} ({3}:{4}, {5})", currentTime(), logPrefix, coreLogMessage, logContext.fileName, logContext.sourceFileLine, logContext.functionName);
+        output.append(" (");
+        appendFormatted(output, logContext.fileName);
+        output.push_back(':');
+        appendFormatted(output, logContext.sourceFileLine);
+        output.append(", ");
+        appendFormatted(output, logContext.functionName);
+        output.push_back(')');
+    }
+    if ( (output.back() != '\n') && (output.back() != '\r') ) {
+        output.push_back('\n');
+    }
+}
+
+void registerLogSubsystems()
+{
+    MessageLogger::setSubsystemName(GENERAL_LOG_SUBSYSTEM, "general");
+    MessageLogger::setSubsystemName(SESSION_LOG_SUBSYSTEM, "session");
+    MessageLogger::setSubsystemName(SERIAL_LOG_SUBSYSTEM, "serial");
+    MessageLogger::setSubsystemName(LOGGING_LOG_SUBSYSTEM, "logging");
+    MessageLogger::setSubsystemName(CAPTURE_LOG_SUBSYSTEM, "capture");
+    MessageLogger::setSubsystemName(METRICS_LOG_SUBSYSTEM, "metrics");
+    MessageLogger::setSubsystemName(TRIGGER_LOG_SUBSYSTEM, "trigger");
+}
+
+LogLevel tryParseLogLevel(const std::string &name)
+{
+    std::string nameCopy{name};
+    toLower(nameCopy);
+    if (startsWith(nameCopy, "debug")) {
+        return LogLevel::Debug;
+    } else if (startsWith(nameCopy, "info")) {
+        return LogLevel::Info;
+    } else if (startsWith(nameCopy, "warn")) {
+        return LogLevel::Warn;
+    } else if (startsWith(nameCopy, "fatal")) {
+        return LogLevel::Fatal;
     } else {
-        logMessage = TStringFormat("[{0}] - {1} {2}", currentTime(), logPrefix, coreLogMessage);
+        throw std::runtime_error(TStringFormat("{0} is not a valid value for parameter \"log level\"", name));
+    }
+}
+
+void applyLogLevels(const std::string &specification)
+{
+    /* Comma separated entries, either a bare level applied to every
+     * subsystem or subsystem=level, for example "info,serial=debug" */
+    for (auto &it : split<','>(specification)) {
+        std::string entry{it};
+        entry.erase(std::remove_if(entry.begin(), entry.end(), ::isspace), entry.end());
+        if (entry.empty()) {
+            continue;
+        }
+        auto equalsPosition = entry.find('=');
+        if (equalsPosition == std::string::npos) {
+            MessageLogger::setLogLevel(tryParseLogLevel(entry));
+            continue;
+        }
+        std::string subsystemName{entry.substr(0, equalsPosition)};
+        toLower(subsystemName);
+        LogSubsystem subsystem{DEFAULT_LOG_SUBSYSTEM};
+        if (!MessageLogger::findSubsystem(subsystemName, &subsystem)) {
+            throw std::runtime_error(TStringFormat("Unknown log subsystem {0}", subsystemName));
+        }
+        MessageLogger::setLogLevel(subsystem, tryParseLogLevel(entry.substr(equalsPosition + 1)));
+    }
+}
+
+void reloadLogLevels(const std::string &logLevelFilePath)
+{
+    if (logLevelFilePath.empty()) {
+        LogLevel logLevel{(MessageLogger::logLevel(GENERAL_LOG_SUBSYSTEM) == LogLevel::Debug) ? LogLevel::Info : LogLevel::Debug};
+        MessageLogger::setLogLevel(logLevel);
+        verboseLogging = (logLevel == LogLevel::Debug);
+        LOG_INFO(LOGGING_LOG_SUBSYSTEM) << TStringFormat("Verbose logging {0}", verboseLogging ? "enabled" : "disabled");
+        return;
+    }
+    std::ifstream logLevelFile{logLevelFilePath.c_str()};
+    if (!logLevelFile.is_open()) {
+        LOG_WARN(LOGGING_LOG_SUBSYSTEM) << TStringFormat(R"(Unable to open log level file "{0}", keeping current levels)", logLevelFilePath);
+        return;
     }
+    std::stringstream specification{};
+    specification << logLevelFile.rdbuf();
+    std::string specificationString{specification.str()};
+    std::replace(specificationString.begin(), specificationString.end(), '\n', ',');
+    try {
+        applyLogLevels(specificationString);
+        LOG_INFO(LOGGING_LOG_SUBSYSTEM) << TStringFormat("Applied log levels from {0}", logLevelFilePath);
+    } catch (std::exception &e) {
+        LOG_WARN(LOGGING_LOG_SUBSYSTEM) << TStringFormat("Invalid log level file {0} ({1})", logLevelFilePath, e.what());
+    }
+}
+
+std::shared_ptr<GlobalLogSink> globalLogSink()
+{
+    static std::shared_ptr<GlobalLogSink> sink{std::make_shared<GlobalLogSink>()};
+    return sink;
+}
+
+GlobalLogSink::GlobalLogSink() :
+    m_standardOutputBuffer{""},
+    m_standardErrorBuffer{""},
+    m_logFileBuffer{""},
+    m_recordBuffer{""},
+    m_logFile{nullptr},
+    m_binaryLogWriter{nullptr},
+    m_logFileFailed{false},
+    m_consoleEnabled{true}
+{
+
+}
 
+GlobalLogSink::~GlobalLogSink()
+{
+
+}
 
-    bool addLineEnding{true};
-    static const std::forward_list<const char *> LINE_ENDINGS{"\r\n", "\r", "\n", "\n\r"};
-    for (const auto &it : LINE_ENDINGS) {
-        if (endsWith(logMessage, it)) {
-            addLineEnding = false;
+void GlobalLogSink::append(LogLevel logLevel, const LogContext &logContext, const std::string &str)
+{
+    bool consoleEnabled{this->m_consoleEnabled.load(std::memory_order_relaxed)};
+    uint64_t timestamp{BinaryLogWriter::realtimeNanoseconds()};
+    if (this->m_binaryLogWriter) {
+        this->m_binaryLogWriter->append(logLevel, logContext, timestamp, str);
+        if (!consoleEnabled) {
+            return;
         }
     }
-    if (addLineEnding) {
-        logMessage.append("\n");
+    this->m_recordBuffer.clear();
+    formatLogRecord(this->m_recordBuffer, logLevel, logContext, timestamp, str.data(), str.size());
+    bool toStandardError{ (logLevel == LogLevel::Debug) || (logLevel == LogLevel::Fatal) };
+    (toStandardError ? this->m_standardErrorBuffer : this->m_standardOutputBuffer).append(this->m_recordBuffer);
+    if ( (logLevel != LogLevel::Fatal) && (!this->m_binaryLogWriter) ) {
+        this->m_logFileBuffer.append(this->m_recordBuffer);
     }
-    if (outputStream) {
-        *outputStream << logMessage;
+}
+
+void GlobalLogSink::commit()
+{
+    if (!this->m_consoleEnabled.load(std::memory_order_relaxed)) {
+        this->m_standardOutputBuffer.clear();
     }
-    if (logLevel != LogLevel::Fatal) {
-        logToFile(logMessage, ApplicationUtilities::getLogFilePath());
+    if (!this->m_standardOutputBuffer.empty()) {
+        writeAll(STDOUT_FILENO, this->m_standardOutputBuffer.data(), this->m_standardOutputBuffer.size());
+        this->m_standardOutputBuffer.clear();
     }
-    outputStream->flush();
-    if (logLevel == LogLevel::Fatal) {
-        abort();
+    if (!this->m_logFileBuffer.empty()) {
+        this->openLogFile();
+        if (this->m_logFile) {
+            if (!this->m_logFile->write(this->m_logFileBuffer.data(), this->m_logFileBuffer.size())) {
+                this->m_standardErrorBuffer.append(TStringFormat("Failed to write to log file ({0})\n", strerror(errno)));
+            }
+        }
+        this->m_logFileBuffer.clear();
+    }
+    if ( (this->m_binaryLogWriter) && (!this->m_binaryLogWriter->commit()) ) {
+        this->m_standardErrorBuffer.append(TStringFormat("Failed to write to binary log file ({0})\n", strerror(errno)));
+    }
+    if (!this->m_consoleEnabled.load(std::memory_order_relaxed)) {
+        this->m_standardErrorBuffer.clear();
+    }
+    if (!this->m_standardErrorBuffer.empty()) {
+        writeAll(STDERR_FILENO, this->m_standardErrorBuffer.data(), this->m_standardErrorBuffer.size());
+        this->m_standardErrorBuffer.clear();
+    }
+}
+
+void GlobalLogSink::setConsoleEnabled(bool consoleEnabled)
+{
+    this->m_consoleEnabled.store(consoleEnabled, std::memory_order_relaxed);
+}
+
+void GlobalLogSink::setBinaryLogWriter(const std::shared_ptr<BinaryLogWriter> &binaryLogWriter)
+{
+    this->m_binaryLogWriter = binaryLogWriter;
+}
+
+void GlobalLogSink::openLogFile()
+{
+    if ( (this->m_logFile) || (this->m_logFileFailed) ) {
+        return;
+    }
+    try {
+        this->m_logFile = globalLogFile();
+    } catch (std::exception &e) {
+        this->m_standardErrorBuffer.append(TStringFormat("{0}, not logging to file\n", e.what()));
+        this->m_logFileFailed = true;
     }
 }
 
+std::shared_ptr<LogFile> globalLogFile()
+{
+    static std::mutex logFileMutex{};
+    static std::shared_ptr<LogFile> logFile{nullptr};
+    std::lock_guard<std::mutex> logFileLock{logFileMutex};
+    if (!logFile) {
+        logFile = std::make_shared<LogFile>(getLogFilePath());
+    }
+    return logFile;
+}
 
     std::string getTempDirectory() {
 #ifdef _MSC_VER
@@ -142,16 +373,19 @@ void globalLogHandler(LogLevel logLevel, LogContext logContext, const std::strin
     }
 
     std::string getLogFilePath() {
+        /* Resolved once, so the whole session logs to one file named after
+         * the time it started */
+        static std::mutex logFileNameMutex{};
         static std::string logFileName{""};
-        if (logFileName.length() > 0) {
-            return logFileName;
-        } else {
+        std::lock_guard<std::mutex> logFileNameLock{logFileNameMutex};
+        if (logFileName.length() == 0) {
             auto mkdirResult = createDirectory(getTempDirectory());
             if ( (mkdirResult == -1) && (errno != EEXIST) ) {
                 throw std::runtime_error(TStringFormat("Unable to create directory {0}", getTempDirectory()));
             }
-            return TStringFormat("{0}/{1}_{2}_{3}", getTempDirectory(), PROGRAM_NAME, currentDate, currentTime());
+            logFileName = TStringFormat("{0}/{1}_{2}_{3}", getTempDirectory(), PROGRAM_NAME, currentDate(), currentTime());
         }
+        return logFileName;
     }
 
 void installSignalHandlers(void (*signalHandler)(int))
@@ -204,16 +438,43 @@ int deleteFile(const std::string &filePath)
     return std::remove(filePath.c_str());
 }
 
+bool writeAll(int fileDescriptor, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written{write(fileDescriptor, data, length)};
+        if (written > 0) {
+            data += written;
+            length -= static_cast<size_t>(written);
+        } else if ( (written == -1) && (errno == EINTR) ) {
+            continue;
+        } else if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+            pollfd pollDescriptor{fileDescriptor, POLLOUT, 0};
+            poll(&pollDescriptor, 1, -1);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* localtime() shares one buffer between threads, so both go through
+ * localtime_r() and a stack buffer instead */
+static std::string formatCurrentLocalTime(const char *format)
+{
+    time_t now{std::time(nullptr)};
+    struct tm localTime{};
+    localtime_r(&now, &localTime);
+    char text[32];
+    size_t length{strftime(text, sizeof(text), format, &localTime)};
+    return std::string(text, length);
+}
+
 std::string currentTime() {
-    auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-    return dynamic_cast<std::ostringstream &>(std::ostringstream{} << std::put_time(&tm, "%H-%M-%S")).str();
+    return formatCurrentLocalTime("%H-%M-%S");
 }
 
 std::string currentDate() {
-    auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-    return dynamic_cast<std::ostringstream &>(std::ostringstream{} << std::put_time(&tm, "%d-%m-%Y")).str();
+    return formatCurrentLocalTime("%d-%m-%Y");
 }
 
 } //namespace ApplicationUtilities
\ No newline at end of file
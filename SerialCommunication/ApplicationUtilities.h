@@ -1,6 +1,7 @@
 #ifndef PROJECTTEMPLATE_APPLICATIONUTILITIES_H
 #define PROJECTTEMPLATE_APPLICATIONUTILITIES_H
 
+#include <atomic>
 #include <string>
 #include <regex>
 #include <vector>
@@ -8,7 +9,12 @@
 #include <utility>
 #include <tuple>
 #include <fstream>
+#include <memory>
 #include "MessageLogger.h"
+#include "AsyncLogHandler.h"
+
+class BinaryLogWriter;
+class LogFile;
 
 namespace ApplicationUtilities
 {
@@ -31,6 +37,55 @@ bool endsWith(const std::string &str, const std::string &ending);
 bool endsWith(const std::string &str, char ending);
 void globalLogHandler(TMessageLogger::LogLevel logLevel, TMessageLogger::LogContext logContext, const std::string &str);
 
+/* Appends one record the way it appears on the console and in a text log
+ * file, realtimeNanoseconds being when it was logged (CLOCK_REALTIME), shown
+ * as local HH-MM-SS.uuuuuu (see TimestampFormatter) */
+void formatLogRecord(std::string &output, TMessageLogger::LogLevel logLevel, const TMessageLogger::LogContext &logContext,
+                     uint64_t realtimeNanoseconds, const char *message, size_t length);
+
+void registerLogSubsystems();
+TMessageLogger::LogLevel tryParseLogLevel(const std::string &name);
+void applyLogLevels(const std::string &specification);
+void reloadLogLevels(const std::string &logLevelFilePath);
+
+/* Formats records the way globalLogHandler always has, but collects each
+ * batch in memory and hands it to the console and to the global LogFile,
+ * one write() per destination */
+class GlobalLogSink : public TMessageLogger::LogSink
+{
+public:
+    GlobalLogSink();
+    ~GlobalLogSink() override;
+    GlobalLogSink(const GlobalLogSink &) = delete;
+    GlobalLogSink &operator=(const GlobalLogSink &) = delete;
+
+    void append(TMessageLogger::LogLevel logLevel, const TMessageLogger::LogContext &logContext, const std::string &str) override;
+    void commit() override;
+    /* While disabled, records only go to the log file, for when something
+     * else (the terminal UI) owns the console */
+    void setConsoleEnabled(bool consoleEnabled);
+    /* Sends log file records to binaryLogWriter instead of the text log
+     * file, Fatal ones included; set before the sink is handed to an
+     * AsyncLogHandler */
+    void setBinaryLogWriter(const std::shared_ptr<BinaryLogWriter> &binaryLogWriter);
+
+private:
+    std::string m_standardOutputBuffer;
+    std::string m_standardErrorBuffer;
+    std::string m_logFileBuffer;
+    std::string m_recordBuffer;
+    std::shared_ptr<LogFile> m_logFile;
+    std::shared_ptr<BinaryLogWriter> m_binaryLogWriter;
+    bool m_logFileFailed;
+    std::atomic<bool> m_consoleEnabled;
+
+    void openLogFile();
+};
+
+std::shared_ptr<GlobalLogSink> globalLogSink();
+/* Opened at getLogFilePath() on first use, throws if that fails */
+std::shared_ptr<LogFile> globalLogFile();
+
 template <typename StringType, typename FileStringType>
 void logToFile(const StringType &str, const FileStringType &filePath)
 {
@@ -51,7 +106,7 @@ void logToFile(const StringType &str, const FileStringType &filePath)
 }
 
 
-template <typename T> static inline std::string toStdString(T t) { return dynamic_cast<std::ostringstream &>(std::ostringstream{} << t).str(); }
+template <typename T> static inline std::string toStdString(T t) { return dynamic_cast<std::ostringstream &>(std::ostringstream{}.flush() << t).str(); }
 
 template <char Delimiter>
 std::vector<std::string> split(const std::string &str)
@@ -67,6 +122,7 @@ std::vector<std::string> split(std::string str, const std::string &delimiter);
 
 int createDirectory(const std::string &filePath, mode_t mode = 0777);
 int deleteFile(const std::string &filePath);
+bool writeAll(int fileDescriptor, const char *data, size_t length);
 
 };
 
@@ -0,0 +1,379 @@
+#include "AsyncLogHandler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace TMessageLogger {
+
+namespace {
+    const size_t MAXIMUM_BATCH_SIZE{256};
+    const size_t INITIAL_MESSAGE_CAPACITY{256};
+    const int BLOCKING_SPIN_COUNT{64};
+    const std::chrono::microseconds BLOCKING_SLEEP_INTERVAL{50};
+    const std::chrono::milliseconds WRITER_IDLE_TIMEOUT{100};
+
+    size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result{2};
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+} //Global namespace
+
+class AsyncLogHandler::Implementation
+{
+public:
+    Implementation(const std::shared_ptr<LogSink> &logSink, size_t capacity, OverflowPolicy overflowPolicy);
+    ~Implementation();
+
+    void log(LogLevel logLevel, const LogContext &logContext, const std::string &str);
+    void flush();
+    void shutdown();
+
+    std::atomic<uint64_t> m_droppedCount;
+    OverflowPolicy m_overflowPolicy;
+
+private:
+    /* Bounded multi-producer queue after Dmitry Vyukov's design: each slot
+     * carries a sequence number that tells producers and the consumer whose
+     * turn it is, so neither side ever takes a lock. Slots keep their string
+     * storage between uses, so steady-state logging does not allocate */
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        LogLevel logLevel;
+        LogContext logContext;
+        std::string message;
+    };
+
+    std::shared_ptr<LogSink> m_logSink;
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    std::atomic<size_t> m_enqueuePosition;
+    std::atomic<size_t> m_dequeuePosition;
+    std::atomic<size_t> m_completedPosition;
+
+    std::thread m_writerThread;
+    std::thread::id m_writerThreadId;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stopRequested;
+    std::atomic<bool> m_writerSleeping;
+    std::mutex m_writerMutex;
+    std::condition_variable m_writerCondition;
+    std::atomic<int> m_flushWaiters;
+    std::mutex m_flushMutex;
+    std::condition_variable m_flushCondition;
+    std::mutex m_synchronousMutex;
+    uint64_t m_reportedDroppedCount;
+
+    bool tryEnqueue(LogLevel logLevel, const LogContext &logContext, const std::string &str);
+    Slot *tryClaim(size_t &position, bool keepFatal = false);
+    void release(Slot *slot, size_t position);
+    bool discardOldest();
+    void wakeWriter();
+    void runWriter();
+    size_t drainBatch();
+    void reportDrops();
+    void writeSynchronously(LogLevel logLevel, const LogContext &logContext, const std::string &str);
+};
+
+AsyncLogHandler::Implementation::Implementation(const std::shared_ptr<LogSink> &logSink, size_t capacity, OverflowPolicy overflowPolicy) :
+    m_droppedCount{0},
+    m_overflowPolicy{overflowPolicy},
+    m_logSink{logSink},
+    m_slots(roundUpToPowerOfTwo(capacity)),
+    m_mask{m_slots.size() - 1},
+    m_enqueuePosition{0},
+    m_dequeuePosition{0},
+    m_completedPosition{0},
+    m_writerThread{},
+    m_writerThreadId{},
+    m_running{true},
+    m_stopRequested{false},
+    m_writerSleeping{false},
+    m_writerMutex{},
+    m_writerCondition{},
+    m_flushWaiters{0},
+    m_flushMutex{},
+    m_flushCondition{},
+    m_synchronousMutex{},
+    m_reportedDroppedCount{0}
+{
+    if (!this->m_logSink) {
+        throw std::runtime_error("AsyncLogHandler requires a log sink");
+    }
+    for (size_t i = 0; i < this->m_slots.size(); i++) {
+        this->m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        this->m_slots[i].message.reserve(INITIAL_MESSAGE_CAPACITY);
+    }
+    this->m_writerThread = std::thread{[this]() { this->runWriter(); }};
+    this->m_writerThreadId = this->m_writerThread.get_id();
+}
+
+AsyncLogHandler::Implementation::~Implementation()
+{
+    this->shutdown();
+}
+
+void AsyncLogHandler::Implementation::log(LogLevel logLevel, const LogContext &logContext, const std::string &str)
+{
+    if ( (!this->m_running.load()) || (std::this_thread::get_id() == this->m_writerThreadId) ) {
+        this->writeSynchronously(logLevel, logContext, str);
+        if (logLevel == LogLevel::Fatal) {
+            abort();
+        }
+        return;
+    }
+    OverflowPolicy overflowPolicy{(logLevel == LogLevel::Fatal) ? OverflowPolicy::Block : this->m_overflowPolicy};
+    int attempt{0};
+    while (!this->tryEnqueue(logLevel, logContext, str)) {
+        if (overflowPolicy == OverflowPolicy::DropNewest) {
+            this->m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else if (overflowPolicy == OverflowPolicy::DropOldest) {
+            if (this->discardOldest()) {
+                this->m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                this->wakeWriter();
+                std::this_thread::yield();
+            }
+        } else {
+            this->wakeWriter();
+            if (attempt++ < BLOCKING_SPIN_COUNT) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(BLOCKING_SLEEP_INTERVAL);
+            }
+        }
+    }
+    /* Pairs with the fence in runWriter(): either the writer sees this record
+     * before it goes to sleep, or this thread sees it sleeping and wakes it */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->m_writerSleeping.load(std::memory_order_relaxed)) {
+        this->wakeWriter();
+    }
+    if (logLevel == LogLevel::Fatal) {
+        this->flush();
+        abort();
+    }
+}
+
+void AsyncLogHandler::Implementation::flush()
+{
+    if ( (!this->m_running.load()) || (std::this_thread::get_id() == this->m_writerThreadId) ) {
+        return;
+    }
+    size_t target{this->m_enqueuePosition.load()};
+    this->m_flushWaiters.fetch_add(1);
+    this->wakeWriter();
+    {
+        std::unique_lock<std::mutex> flushLock{this->m_flushMutex};
+        this->m_flushCondition.wait(flushLock, [this, target]() {
+            return (this->m_completedPosition.load() >= target) || (!this->m_running.load());
+        });
+    }
+    this->m_flushWaiters.fetch_sub(1);
+}
+
+void AsyncLogHandler::Implementation::shutdown()
+{
+    if (!this->m_writerThread.joinable()) {
+        return;
+    }
+    this->m_stopRequested.store(true);
+    this->wakeWriter();
+    this->m_writerThread.join();
+}
+
+bool AsyncLogHandler::Implementation::tryEnqueue(LogLevel logLevel, const LogContext &logContext, const std::string &str)
+{
+    size_t position{this->m_enqueuePosition.load(std::memory_order_relaxed)};
+    Slot *slot{nullptr};
+    while (true) {
+        slot = &this->m_slots[position & this->m_mask];
+        size_t sequence{slot->sequence.load(std::memory_order_acquire)};
+        intptr_t difference{static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position)};
+        if (difference == 0) {
+            if (this->m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = this->m_enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+    slot->logLevel = logLevel;
+    slot->logContext = logContext;
+    slot->message.assign(str);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+AsyncLogHandler::Implementation::Slot *AsyncLogHandler::Implementation::tryClaim(size_t &position, bool keepFatal)
+{
+    position = this->m_dequeuePosition.load(std::memory_order_relaxed);
+    while (true) {
+        Slot *slot{&this->m_slots[position & this->m_mask]};
+        size_t sequence{slot->sequence.load(std::memory_order_acquire)};
+        intptr_t difference{static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1)};
+        if (difference == 0) {
+            /* The record is complete once its sequence says so, and it is
+             * still the one at position if the claim below succeeds */
+            if ( (keepFatal) && (slot->logLevel == LogLevel::Fatal) ) {
+                return nullptr;
+            }
+            if (this->m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return slot;
+            }
+        } else if (difference < 0) {
+            return nullptr;
+        } else {
+            position = this->m_dequeuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLogHandler::Implementation::release(Slot *slot, size_t position)
+{
+    slot->sequence.store(position + this->m_mask + 1, std::memory_order_release);
+}
+
+bool AsyncLogHandler::Implementation::discardOldest()
+{
+    /* A Fatal record is never dropped, it is what the process is about to
+     * abort over; the producer waits for the writer to take it instead */
+    size_t position{0};
+    Slot *slot{this->tryClaim(position, true)};
+    if (!slot) {
+        return false;
+    }
+    this->release(slot, position);
+    return true;
+}
+
+void AsyncLogHandler::Implementation::wakeWriter()
+{
+    std::lock_guard<std::mutex> writerLock{this->m_writerMutex};
+    this->m_writerCondition.notify_one();
+}
+
+void AsyncLogHandler::Implementation::runWriter()
+{
+    while (true) {
+        size_t drained{this->drainBatch()};
+        if (drained > 0) {
+            this->m_logSink->commit();
+        }
+        this->m_completedPosition.store(this->m_dequeuePosition.load());
+        if (this->m_flushWaiters.load() > 0) {
+            std::lock_guard<std::mutex> flushLock{this->m_flushMutex};
+            this->m_flushCondition.notify_all();
+        }
+        if (drained > 0) {
+            continue;
+        }
+        this->reportDrops();
+        if (this->m_stopRequested.load()) {
+            break;
+        }
+        std::unique_lock<std::mutex> writerLock{this->m_writerMutex};
+        this->m_writerSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t position{this->m_dequeuePosition.load(std::memory_order_relaxed)};
+        bool recordReady{this->m_slots[position & this->m_mask].sequence.load(std::memory_order_acquire) == position + 1};
+        if ( (!recordReady) && (!this->m_stopRequested.load()) && (this->m_flushWaiters.load() == 0) ) {
+            this->m_writerCondition.wait_for(writerLock, WRITER_IDLE_TIMEOUT);
+        }
+        this->m_writerSleeping.store(false, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> flushLock{this->m_flushMutex};
+        this->m_running.store(false);
+    }
+    /* Producers that raced with shutdown may still have left records behind,
+     * and from here on producers write synchronously under the same lock */
+    {
+        std::lock_guard<std::mutex> synchronousLock{this->m_synchronousMutex};
+        if (this->drainBatch() > 0) {
+            this->m_logSink->commit();
+        }
+    }
+    this->m_flushCondition.notify_all();
+}
+
+size_t AsyncLogHandler::Implementation::drainBatch()
+{
+    size_t drained{0};
+    while (drained < MAXIMUM_BATCH_SIZE) {
+        size_t position{0};
+        Slot *slot{this->tryClaim(position)};
+        if (!slot) {
+            break;
+        }
+        this->m_logSink->append(slot->logLevel, slot->logContext, slot->message);
+        this->release(slot, position);
+        drained++;
+    }
+    return drained;
+}
+
+void AsyncLogHandler::Implementation::reportDrops()
+{
+    uint64_t droppedCount{this->m_droppedCount.load(std::memory_order_relaxed)};
+    if (droppedCount == this->m_reportedDroppedCount) {
+        return;
+    }
+    LogContext logContext{__FILE__, __func__, __LINE__};
+    this->m_logSink->append(LogLevel::Warn, logContext, TStringFormat("Log queue overflowed, {0} message(s) dropped", droppedCount - this->m_reportedDroppedCount));
+    this->m_logSink->commit();
+    this->m_reportedDroppedCount = droppedCount;
+}
+
+void AsyncLogHandler::Implementation::writeSynchronously(LogLevel logLevel, const LogContext &logContext, const std::string &str)
+{
+    std::lock_guard<std::mutex> synchronousLock{this->m_synchronousMutex};
+    this->m_logSink->append(logLevel, logContext, str);
+    this->m_logSink->commit();
+}
+
+AsyncLogHandler::AsyncLogHandler(const std::shared_ptr<LogSink> &logSink, size_t capacity, OverflowPolicy overflowPolicy) :
+    m_implementation{std::make_shared<Implementation>(logSink, capacity, overflowPolicy)}
+{
+
+}
+
+void AsyncLogHandler::operator()(LogLevel logLevel, LogContext logContext, const std::string &str) const
+{
+    this->m_implementation->log(logLevel, logContext, str);
+}
+
+void AsyncLogHandler::flush() const
+{
+    this->m_implementation->flush();
+}
+
+void AsyncLogHandler::shutdown() const
+{
+    this->m_implementation->shutdown();
+}
+
+uint64_t AsyncLogHandler::droppedCount() const
+{
+    return this->m_implementation->m_droppedCount.load(std::memory_order_relaxed);
+}
+
+OverflowPolicy AsyncLogHandler::overflowPolicy() const
+{
+    return this->m_implementation->m_overflowPolicy;
+}
+
+} //namespace TMessageLogger
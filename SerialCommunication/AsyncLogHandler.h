@@ -0,0 +1,56 @@
+#ifndef SERIALCOMMUNICATION_ASYNCLOGHANDLER_H
+#define SERIALCOMMUNICATION_ASYNCLOGHANDLER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "MessageLogger.h"
+
+namespace TMessageLogger {
+
+/* Destination for log records drained by an AsyncLogHandler. append() is
+ * called once per record and commit() once per drained batch, always from
+ * the single writer thread, so implementations need no locking of their own */
+class LogSink
+{
+public:
+    virtual ~LogSink() = default;
+    virtual void append(LogLevel logLevel, const LogContext &logContext, const std::string &str) = 0;
+    virtual void commit() = 0;
+};
+
+enum class OverflowPolicy {
+    Block,
+    DropOldest,
+    DropNewest
+};
+
+/* Log handler that moves formatting and I/O off the logging thread. Records
+ * are copied into a fixed ring of reusable slots (a bounded lock-free queue,
+ * so any number of producers can log concurrently) and a background thread
+ * drains them into a LogSink in batches. Copies of an AsyncLogHandler share
+ * the same queue and writer thread, so one can be passed straight to
+ * MessageLogger::installLogHandler() while another is kept for shutdown() */
+class AsyncLogHandler
+{
+public:
+    AsyncLogHandler(const std::shared_ptr<LogSink> &logSink, size_t capacity = DEFAULT_CAPACITY, OverflowPolicy overflowPolicy = OverflowPolicy::Block);
+
+    void operator()(LogLevel logLevel, LogContext logContext, const std::string &str) const;
+
+    void flush() const;
+    void shutdown() const;
+    uint64_t droppedCount() const;
+    OverflowPolicy overflowPolicy() const;
+
+    static const size_t DEFAULT_CAPACITY{8192};
+
+private:
+    class Implementation;
+    std::shared_ptr<Implementation> m_implementation;
+};
+
+} //namespace TMessageLogger
+
+#endif //SERIALCOMMUNICATION_ASYNCLOGHANDLER_H
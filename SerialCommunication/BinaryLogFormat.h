@@ -0,0 +1,120 @@
+#ifndef SERIALCOMMUNICATION_BINARYLOGFORMAT_H
+#define SERIALCOMMUNICATION_BINARYLOGFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* On-disk layout of a binary log file (--log-format binary), version 1.1
+ *
+ *     offset 0             BinaryLogFileHeader (24 bytes)
+ *     offset headerSize    records
+ *
+ * Every record starts with a tag byte: the low four bits are its
+ * BinaryLogRecordType, the high four bits the LogLevel of a message. The
+ * rest of a record is unsigned LEB128 varints and raw bytes:
+ *
+ *     CallSite         tag, id, sourceFileLine, fileName length, fileName,
+ *                      functionName length, functionName
+ *     Message          tag, timestamp delta, call site id, payload length,
+ *                      payload
+ *     Template         tag, id, call site id, text length, text, one base
+ *                      value per field
+ *     TemplateMessage  tag, timestamp delta, template id, one zigzag encoded
+ *                      difference per field
+ *
+ * A call site (the LogContext of a log statement) is written once per file,
+ * before the first message or template that refers to it, and a template
+ * before the first message that refers to it. Message timestamps are
+ * CLOCK_REALTIME nanoseconds, each stored as the zigzag encoded difference
+ * from the previous message's (the first one from baseRealtimeNs). The
+ * payload of a Message is the message exactly as it was logged.
+ *
+ * A template is a message with every number in it (a run of at most 19
+ * ASCII digits, without a leading zero unless it is a lone 0) replaced by
+ * BINARY_LOG_FIELD_MARKER. A TemplateMessage is the template with each
+ * marker replaced by its field's value in decimal: the previous value of
+ * that field plus the stored difference, starting from the base value the
+ * template was defined with. Messages that hold the marker byte themselves
+ * are written as Message records.
+ *
+ * A header can appear again between records, when a later session appends
+ * to the same file or a write failed; it starts with BINARY_LOG_MAGIC, whose
+ * first byte is no valid tag, and resets the call site and template tables
+ * and the timestamp base. All integers in the header are little endian. Readers must reject a different
+ * versionMajor; minor versions only add record types, which a reader that
+ * does not know them cannot skip, so they also bump the minor version */
+
+static const char BINARY_LOG_MAGIC[8]{'S', 'E', 'R', 'B', 'L', 'O', 'G', '\0'};
+static const uint16_t BINARY_LOG_VERSION_MAJOR{1};
+static const uint16_t BINARY_LOG_VERSION_MINOR{1};
+static const char BINARY_LOG_FIELD_MARKER{'\0'};
+static const size_t BINARY_LOG_MAXIMUM_FIELD_DIGITS{19};
+
+enum class BinaryLogRecordType : uint8_t {
+    CallSite = 1,
+    Message = 2,
+    Template = 3,
+    TemplateMessage = 4
+};
+
+struct BinaryLogFileHeader
+{
+    char magic[8];
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    uint32_t headerSize;
+    uint64_t baseRealtimeNs;
+};
+
+static_assert(sizeof(BinaryLogFileHeader) == 24, "BinaryLogFileHeader layout changed");
+
+inline void appendVarint(std::string &output, uint64_t value)
+{
+    while (value >= 0x80) {
+        output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+static const size_t MAXIMUM_VARINT_LENGTH{10};
+
+/* Writes a varint to output, which must have room for MAXIMUM_VARINT_LENGTH
+ * bytes, and returns where it ends */
+inline char *writeVarint(char *output, uint64_t value)
+{
+    while (value >= 0x80) {
+        *output++ = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    *output++ = static_cast<char>(value);
+    return output;
+}
+
+/* False if the varint runs past end or is longer than 64 bits */
+inline bool readVarint(const unsigned char *&position, const unsigned char *end, uint64_t *value)
+{
+    uint64_t result{0};
+    for (unsigned int shift = 0; (shift < 64) && (position < end); shift += 7) {
+        unsigned char byte{*position++};
+        result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint64_t zigzagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+#endif //SERIALCOMMUNICATION_BINARYLOGFORMAT_H
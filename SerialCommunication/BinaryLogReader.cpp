@@ -0,0 +1,245 @@
+#include "BinaryLogReader.h"
+#include "ApplicationUtilities.h"
+#include "BinaryLogFormat.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+const size_t BinaryLogReader::OUTPUT_CHUNK_SIZE{1024 * 1024};
+
+BinaryLogReader::BinaryLogReader(const std::string &logPath) :
+    m_filePaths{findLogFiles(logPath)},
+    m_callSites{},
+    m_templates{},
+    m_message{""},
+    m_output{""},
+    m_truncatedFileCount{0}
+{
+    if (this->m_filePaths.empty()) {
+        throw std::runtime_error(TStringFormat(R"(No binary log file at "{0}")", logPath));
+    }
+    this->m_output.reserve(OUTPUT_CHUNK_SIZE + 4096);
+}
+
+uint64_t BinaryLogReader::renderText(const OutputHandler &outputHandler)
+{
+    uint64_t messageCount{0};
+    for (const auto &it : this->m_filePaths) {
+        int fileDescriptor{open(it.c_str(), O_RDONLY | O_CLOEXEC)};
+        if (fileDescriptor == -1) {
+            throw std::runtime_error(TStringFormat(R"(Unable to open binary log "{0}" ({1}))", it, strerror(errno)));
+        }
+        struct stat fileStatus{};
+        fstat(fileDescriptor, &fileStatus);
+        size_t length{static_cast<size_t>(fileStatus.st_size)};
+        if (length == 0) {
+            close(fileDescriptor);
+            continue;
+        }
+        void *mapping{mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0)};
+        close(fileDescriptor);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error(TStringFormat(R"(Unable to map binary log "{0}" ({1}))", it, strerror(errno)));
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        try {
+            messageCount += this->renderFile(it, static_cast<const char *>(mapping), length, outputHandler);
+        } catch (...) {
+            munmap(mapping, length);
+            throw;
+        }
+        munmap(mapping, length);
+    }
+    if (!this->m_output.empty()) {
+        outputHandler(this->m_output.data(), this->m_output.size());
+        this->m_output.clear();
+    }
+    return messageCount;
+}
+
+const std::vector<std::string> &BinaryLogReader::filePaths() const
+{
+    return this->m_filePaths;
+}
+
+uint64_t BinaryLogReader::truncatedFileCount() const
+{
+    return this->m_truncatedFileCount;
+}
+
+uint64_t BinaryLogReader::renderFile(const std::string &filePath, const char *data, size_t length, const OutputHandler &outputHandler)
+{
+    const unsigned char *position{reinterpret_cast<const unsigned char *>(data)};
+    const unsigned char *end{position + length};
+    uint64_t previousTimestampNs{0};
+    uint64_t messageCount{0};
+    bool headerSeen{false};
+    while (position < end) {
+        if (*position == static_cast<unsigned char>(BINARY_LOG_MAGIC[0])) {
+            BinaryLogFileHeader fileHeader{};
+            if (static_cast<size_t>(end - position) < sizeof(fileHeader)) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            memcpy(&fileHeader, position, sizeof(fileHeader));
+            if (memcmp(fileHeader.magic, BINARY_LOG_MAGIC, sizeof(fileHeader.magic)) != 0) {
+                throw std::runtime_error(TStringFormat(R"("{0}" is not a binary log file)", filePath));
+            }
+            if (fileHeader.versionMajor != BINARY_LOG_VERSION_MAJOR) {
+                throw std::runtime_error(TStringFormat(R"("{0}" is binary log version {1}.{2}, only {3}.x is supported)",
+                                                       filePath, fileHeader.versionMajor, fileHeader.versionMinor, BINARY_LOG_VERSION_MAJOR));
+            }
+            if ( (fileHeader.headerSize < sizeof(fileHeader)) || (fileHeader.headerSize > static_cast<size_t>(end - position)) ) {
+                throw std::runtime_error(TStringFormat(R"("{0}" has a corrupt binary log header)", filePath));
+            }
+            position += fileHeader.headerSize;
+            previousTimestampNs = fileHeader.baseRealtimeNs;
+            this->m_callSites.clear();
+            this->m_templates.clear();
+            headerSeen = true;
+            continue;
+        }
+        if (!headerSeen) {
+            throw std::runtime_error(TStringFormat(R"("{0}" is not a binary log file)", filePath));
+        }
+        const unsigned char *recordStart{position};
+        uint8_t tag{*position++};
+        BinaryLogRecordType recordType{static_cast<BinaryLogRecordType>(tag & 0x0F)};
+        bool complete{true};
+        if (recordType == BinaryLogRecordType::CallSite) {
+            uint64_t callSiteId{0};
+            uint64_t sourceFileLine{0};
+            complete = (readVarint(position, end, &callSiteId)) && (readVarint(position, end, &sourceFileLine));
+            CallSite callSite{"", "", static_cast<int>(sourceFileLine)};
+            for (std::string *name : {&callSite.fileName, &callSite.functionName}) {
+                uint64_t nameLength{0};
+                complete = (complete) && (readVarint(position, end, &nameLength)) && (nameLength <= static_cast<uint64_t>(end - position));
+                if (complete) {
+                    name->assign(reinterpret_cast<const char *>(position), static_cast<size_t>(nameLength));
+                    position += nameLength;
+                }
+            }
+            if (!complete) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            if (callSiteId >= this->m_callSites.size()) {
+                this->m_callSites.resize(static_cast<size_t>(callSiteId) + 1, CallSite{"", "", 0});
+            }
+            this->m_callSites[static_cast<size_t>(callSiteId)] = std::move(callSite);
+            continue;
+        }
+        if (recordType == BinaryLogRecordType::Template) {
+            uint64_t templateId{0};
+            uint64_t callSiteId{0};
+            uint64_t textLength{0};
+            complete = (readVarint(position, end, &templateId)) && (readVarint(position, end, &callSiteId)) &&
+                       (readVarint(position, end, &textLength)) && (textLength <= static_cast<uint64_t>(end - position));
+            if (!complete) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            if (callSiteId >= this->m_callSites.size()) {
+                throw std::runtime_error(TStringFormat(R"("{0}" refers to an undefined call site at offset {1})", filePath, recordStart - reinterpret_cast<const unsigned char *>(data)));
+            }
+            MessageTemplate messageTemplate{true, callSiteId, std::string{reinterpret_cast<const char *>(position), static_cast<size_t>(textLength)}, {}};
+            position += textLength;
+            messageTemplate.fieldValues.resize(static_cast<size_t>(std::count(messageTemplate.text.begin(), messageTemplate.text.end(), BINARY_LOG_FIELD_MARKER)), 0);
+            for (auto &it : messageTemplate.fieldValues) {
+                complete = (complete) && (readVarint(position, end, &it));
+            }
+            if (!complete) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            if (templateId >= this->m_templates.size()) {
+                this->m_templates.resize(static_cast<size_t>(templateId) + 1, MessageTemplate{false, 0, "", {}});
+            }
+            this->m_templates[static_cast<size_t>(templateId)] = std::move(messageTemplate);
+            continue;
+        }
+        if ( ( (recordType != BinaryLogRecordType::Message) && (recordType != BinaryLogRecordType::TemplateMessage) ) ||
+             ((tag >> 4) > static_cast<uint8_t>(LogLevel::Fatal)) ) {
+            throw std::runtime_error(TStringFormat(R"("{0}" has an unknown record at offset {1})", filePath, recordStart - reinterpret_cast<const unsigned char *>(data)));
+        }
+        uint64_t timestampDelta{0};
+        uint64_t id{0};
+        complete = (readVarint(position, end, &timestampDelta)) && (readVarint(position, end, &id));
+        const char *message{nullptr};
+        size_t messageLength{0};
+        uint64_t callSiteId{id};
+        if (recordType == BinaryLogRecordType::Message) {
+            uint64_t payloadLength{0};
+            complete = (complete) && (readVarint(position, end, &payloadLength)) && (payloadLength <= static_cast<uint64_t>(end - position));
+            if (!complete) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            message = reinterpret_cast<const char *>(position);
+            messageLength = static_cast<size_t>(payloadLength);
+            position += payloadLength;
+        } else {
+            if ( (complete) && ( (id >= this->m_templates.size()) || (!this->m_templates[static_cast<size_t>(id)].defined) ) ) {
+                throw std::runtime_error(TStringFormat(R"("{0}" refers to an undefined template at offset {1})", filePath, recordStart - reinterpret_cast<const unsigned char *>(data)));
+            }
+            MessageTemplate *messageTemplate{complete ? &this->m_templates[static_cast<size_t>(id)] : nullptr};
+            for (size_t i = 0; (complete) && (i < messageTemplate->fieldValues.size()); i++) {
+                uint64_t difference{0};
+                complete = readVarint(position, end, &difference);
+                messageTemplate->fieldValues[i] += static_cast<uint64_t>(zigzagDecode(difference));
+            }
+            if (!complete) {
+                this->m_truncatedFileCount++;
+                break;
+            }
+            /* Numbers go back in where the writer took them out */
+            this->m_message.clear();
+            const char *text{messageTemplate->text.data()};
+            const char *textEnd{text + messageTemplate->text.size()};
+            for (uint64_t fieldValue : messageTemplate->fieldValues) {
+                const char *marker{static_cast<const char *>(memchr(text, BINARY_LOG_FIELD_MARKER, static_cast<size_t>(textEnd - text)))};
+                this->m_message.append(text, static_cast<size_t>(marker - text));
+                appendFormattedUnsigned(this->m_message, fieldValue);
+                text = marker + 1;
+            }
+            this->m_message.append(text, static_cast<size_t>(textEnd - text));
+            callSiteId = messageTemplate->callSiteId;
+            message = this->m_message.data();
+            messageLength = this->m_message.size();
+        }
+        if (callSiteId >= this->m_callSites.size()) {
+            throw std::runtime_error(TStringFormat(R"("{0}" refers to an undefined call site at offset {1})", filePath, recordStart - reinterpret_cast<const unsigned char *>(data)));
+        }
+        previousTimestampNs += static_cast<uint64_t>(zigzagDecode(timestampDelta));
+        const CallSite &callSite = this->m_callSites[static_cast<size_t>(callSiteId)];
+        LogContext logContext{callSite.fileName.c_str(), callSite.functionName.c_str(), callSite.sourceFileLine};
+        ApplicationUtilities::formatLogRecord(this->m_output, static_cast<LogLevel>(tag >> 4), logContext, previousTimestampNs, message, messageLength);
+        messageCount++;
+        if (this->m_output.size() >= OUTPUT_CHUNK_SIZE) {
+            outputHandler(this->m_output.data(), this->m_output.size());
+            this->m_output.clear();
+        }
+    }
+    return messageCount;
+}
+
+std::vector<std::string> BinaryLogReader::findLogFiles(const std::string &logPath)
+{
+    std::vector<std::string> filePaths{};
+    struct stat fileStatus{};
+    for (size_t index = 1; stat((logPath + "." + std::to_string(index)).c_str(), &fileStatus) == 0; index++) {
+        filePaths.push_back(logPath + "." + std::to_string(index));
+    }
+    std::reverse(filePaths.begin(), filePaths.end());
+    if (stat(logPath.c_str(), &fileStatus) == 0) {
+        filePaths.push_back(logPath);
+    }
+    return filePaths;
+}
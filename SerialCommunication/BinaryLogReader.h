@@ -0,0 +1,62 @@
+#ifndef SERIALCOMMUNICATION_BINARYLOGREADER_H
+#define SERIALCOMMUNICATION_BINARYLOGREADER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Turns binary log files back into the text GlobalLogSink writes. Given a
+ * log path it reads the rotated files first, oldest (<path>.N) to newest,
+ * then <path> itself, each one mapped read-only. Text is produced in large
+ * chunks, and times go through the same TimestampFormatter the live log
+ * uses */
+class BinaryLogReader
+{
+public:
+    using OutputHandler = std::function<void(const char *, size_t)>;
+
+    explicit BinaryLogReader(const std::string &logPath);
+    BinaryLogReader(const BinaryLogReader &) = delete;
+    BinaryLogReader(BinaryLogReader &&) = delete;
+    BinaryLogReader &operator=(const BinaryLogReader &) = delete;
+    BinaryLogReader &operator=(BinaryLogReader &&) = delete;
+
+    /* Returns the number of messages rendered; throws on a file that is not
+     * a binary log or is corrupt. A record cut short at the end of a file
+     * (the writer was killed mid-write) ends that file quietly */
+    uint64_t renderText(const OutputHandler &outputHandler);
+
+    const std::vector<std::string> &filePaths() const;
+    uint64_t truncatedFileCount() const;
+
+    static const size_t OUTPUT_CHUNK_SIZE;
+
+private:
+    struct CallSite
+    {
+        std::string fileName;
+        std::string functionName;
+        int sourceFileLine;
+    };
+
+    struct MessageTemplate
+    {
+        bool defined;
+        uint64_t callSiteId;
+        std::string text;
+        std::vector<uint64_t> fieldValues;
+    };
+
+    std::vector<std::string> m_filePaths;
+    std::vector<CallSite> m_callSites;
+    std::vector<MessageTemplate> m_templates;
+    std::string m_message;
+    std::string m_output;
+    uint64_t m_truncatedFileCount;
+
+    uint64_t renderFile(const std::string &filePath, const char *data, size_t length, const OutputHandler &outputHandler);
+    static std::vector<std::string> findLogFiles(const std::string &logPath);
+};
+
+#endif //SERIALCOMMUNICATION_BINARYLOGREADER_H
@@ -0,0 +1,317 @@
+#include "BinaryLogWriter.h"
+#include "BinaryLogFormat.h"
+#include "LogFile.h"
+
+#include <cstring>
+#include <functional>
+#include <time.h>
+
+using namespace TMessageLogger;
+
+const size_t BinaryLogWriter::MAXIMUM_TEMPLATES_PER_CALL_SITE{64};
+const size_t BinaryLogWriter::CALL_SITE_CACHE_SIZE{256};
+
+/* internTemplate() result for a message that is written whole */
+static const uint32_t NO_TEMPLATE{UINT32_MAX};
+
+BinaryLogWriter::BinaryLogWriter(const std::shared_ptr<LogFile> &logFile) :
+    m_logFile{logFile},
+    m_callSiteIds{},
+    m_callSiteCache(CALL_SITE_CACHE_SIZE, CallSiteCacheEntry{CallSiteKey{nullptr, nullptr, 0}, 0}),
+    m_callSites{},
+    m_templateIds{},
+    m_templates{},
+    m_fieldValues{},
+    m_pendingRecords{""},
+    m_batchCallSites{},
+    m_batchTemplates{},
+    m_batchBaseValues{},
+    m_batch{0},
+    m_batchBaseTimestampNs{0},
+    m_templateBuffer{""},
+    m_valueBuffer{},
+    m_fileGeneration{0},
+    m_headers{0},
+    m_headerNeeded{true},
+    m_previousTimestampNs{0}
+{
+
+}
+
+void BinaryLogWriter::append(LogLevel logLevel, const LogContext &logContext, uint64_t timestampNs, const std::string &str)
+{
+    if (this->m_pendingRecords.empty()) {
+        /* A new file starts its timestamps where this batch does */
+        this->m_batch++;
+        this->m_batchBaseTimestampNs = (this->m_previousTimestampNs != 0) ? this->m_previousTimestampNs : timestampNs;
+        this->m_previousTimestampNs = this->m_batchBaseTimestampNs;
+    }
+    uint32_t callSiteId{this->internCallSite(logContext)};
+    this->useCallSite(callSiteId);
+    uint64_t timestampDelta{zigzagEncode(static_cast<int64_t>(timestampNs - this->m_previousTimestampNs))};
+    this->m_previousTimestampNs = timestampNs;
+    uint32_t templateId{this->findTemplate(callSiteId, str)};
+    if (templateId == NO_TEMPLATE) {
+        this->m_pendingRecords.push_back(static_cast<char>(static_cast<uint8_t>(BinaryLogRecordType::Message) | (static_cast<uint8_t>(logLevel) << 4)));
+        appendVarint(this->m_pendingRecords, timestampDelta);
+        appendVarint(this->m_pendingRecords, callSiteId);
+        appendVarint(this->m_pendingRecords, str.size());
+        this->m_pendingRecords.append(str);
+        return;
+    }
+
+    MessageTemplate &messageTemplate = this->m_templates[templateId];
+    uint64_t *fieldValues{this->m_fieldValues.data() + messageTemplate.fieldOffset};
+    if (messageTemplate.usedIn != this->m_batch) {
+        /* Kept in case the batch lands in a new file, whose definition of
+         * the template has to start from these values */
+        messageTemplate.usedIn = this->m_batch;
+        messageTemplate.baseValuesOffset = this->m_batchBaseValues.size();
+        this->m_batchBaseValues.insert(this->m_batchBaseValues.end(), fieldValues, fieldValues + messageTemplate.fieldCount);
+        this->m_batchTemplates.push_back(templateId);
+    }
+    /* Written in place, the string is only grown once per record */
+    size_t recordOffset{this->m_pendingRecords.size()};
+    this->m_pendingRecords.resize(recordOffset + 1 + ((2 + messageTemplate.fieldCount) * MAXIMUM_VARINT_LENGTH));
+    char *output{&this->m_pendingRecords[recordOffset]};
+    *output++ = static_cast<char>(static_cast<uint8_t>(BinaryLogRecordType::TemplateMessage) | (static_cast<uint8_t>(logLevel) << 4));
+    output = writeVarint(output, timestampDelta);
+    output = writeVarint(output, templateId);
+    for (size_t i = 0; i < messageTemplate.fieldCount; i++) {
+        output = writeVarint(output, zigzagEncode(static_cast<int64_t>(this->m_valueBuffer[i] - fieldValues[i])));
+        fieldValues[i] = this->m_valueBuffer[i];
+    }
+    this->m_pendingRecords.resize(static_cast<size_t>(output - this->m_pendingRecords.data()));
+}
+
+bool BinaryLogWriter::commit()
+{
+    if (this->m_pendingRecords.empty()) {
+        return true;
+    }
+    /* Definitions only add a little to the records */
+    size_t sizeHint{sizeof(BinaryLogFileHeader) + this->m_pendingRecords.size()};
+    bool written{this->m_logFile->write(sizeHint, [this](uint64_t fileGeneration, std::string &output) {
+        this->encode(fileGeneration, output);
+    })};
+    if (!written) {
+        /* The reader never saw where this batch left the timestamps and the
+         * field values, so the next batch starts over with a header */
+        this->m_headerNeeded = true;
+    }
+    this->m_pendingRecords.clear();
+    this->m_batchCallSites.clear();
+    this->m_batchTemplates.clear();
+    this->m_batchBaseValues.clear();
+    return written;
+}
+
+const std::string &BinaryLogWriter::path() const
+{
+    return this->m_logFile->path();
+}
+
+uint64_t BinaryLogWriter::realtimeNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+bool BinaryLogWriter::CallSiteKey::operator==(const CallSiteKey &other) const
+{
+    return (this->fileName == other.fileName) && (this->functionName == other.functionName) && (this->sourceFileLine == other.sourceFileLine);
+}
+
+size_t BinaryLogWriter::CallSiteKeyHash::operator()(const CallSiteKey &callSiteKey) const
+{
+    size_t hash{std::hash<const char *>{}(callSiteKey.fileName)};
+    hash ^= std::hash<const char *>{}(callSiteKey.functionName) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<int>{}(callSiteKey.sourceFileLine) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+uint32_t BinaryLogWriter::internCallSite(const LogContext &logContext)
+{
+    CallSiteKey callSiteKey{logContext.fileName, logContext.functionName, logContext.sourceFileLine};
+    CallSiteCacheEntry &cacheEntry = this->m_callSiteCache[CallSiteKeyHash{}(callSiteKey) & (CALL_SITE_CACHE_SIZE - 1)];
+    if (cacheEntry.key == callSiteKey) {
+        return cacheEntry.callSiteId;
+    }
+    auto found = this->m_callSiteIds.find(callSiteKey);
+    if (found != this->m_callSiteIds.end()) {
+        cacheEntry = CallSiteCacheEntry{callSiteKey, found->second};
+        return found->second;
+    }
+    uint32_t callSiteId{static_cast<uint32_t>(this->m_callSites.size())};
+    cacheEntry = CallSiteCacheEntry{callSiteKey, callSiteId};
+    this->m_callSiteIds.emplace(callSiteKey, callSiteId);
+    this->m_callSites.push_back(CallSite{callSiteKey, 0, 0, 0, 0});
+    return callSiteId;
+}
+
+uint32_t BinaryLogWriter::findTemplate(uint32_t callSiteId, const std::string &str)
+{
+    /* A call site nearly always logs the same text, so the template it used
+     * last is matched in place before anything is copied or hashed */
+    CallSite &callSite = this->m_callSites[callSiteId];
+    if ( (callSite.templateCount > 0) && (this->matchTemplate(this->m_templates[callSite.lastTemplateId], str)) ) {
+        return callSite.lastTemplateId;
+    }
+    if (!this->splitMessage(callSiteId, str)) {
+        return NO_TEMPLATE;
+    }
+    auto found = this->m_templateIds.find(this->m_templateBuffer);
+    if (found != this->m_templateIds.end()) {
+        callSite.lastTemplateId = found->second;
+        return found->second;
+    }
+    if (callSite.templateCount >= MAXIMUM_TEMPLATES_PER_CALL_SITE) {
+        return NO_TEMPLATE;
+    }
+    uint32_t templateId{static_cast<uint32_t>(this->m_templates.size())};
+    this->m_templates.push_back(MessageTemplate{callSiteId, this->m_templateBuffer, {}, this->m_fieldValues.size(), this->m_valueBuffer.size(), 0, 0, 0});
+    size_t literalStart{sizeof(uint32_t)};
+    for (size_t i = sizeof(uint32_t); i <= this->m_templateBuffer.size(); i++) {
+        if ( (i == this->m_templateBuffer.size()) || (this->m_templateBuffer[i] == BINARY_LOG_FIELD_MARKER) ) {
+            this->m_templates.back().literalLengths.push_back(i - literalStart);
+            literalStart = i + 1;
+        }
+    }
+    this->m_fieldValues.resize(this->m_fieldValues.size() + this->m_valueBuffer.size(), 0);
+    this->m_templateIds.emplace(this->m_templateBuffer, templateId);
+    callSite.templateCount++;
+    callSite.lastTemplateId = templateId;
+    return templateId;
+}
+
+void BinaryLogWriter::useCallSite(uint32_t callSiteId)
+{
+    CallSite &callSite = this->m_callSites[callSiteId];
+    if (callSite.usedIn != this->m_batch) {
+        callSite.usedIn = this->m_batch;
+        this->m_batchCallSites.push_back(callSiteId);
+    }
+}
+
+bool BinaryLogWriter::matchTemplate(const MessageTemplate &messageTemplate, const std::string &str)
+{
+    /* Splits str the way splitMessage() does, comparing instead of copying.
+     * Literal digits in the template are always whole runs and a field is
+     * never next to another digit, so a match splits the same */
+    const char *text{messageTemplate.key.data() + sizeof(uint32_t)};
+    const char *position{str.data()};
+    const char *end{position + str.size()};
+    if (this->m_valueBuffer.size() < messageTemplate.fieldCount) {
+        this->m_valueBuffer.resize(messageTemplate.fieldCount);
+    }
+    for (size_t i = 0; i <= messageTemplate.fieldCount; i++) {
+        size_t literalLength{messageTemplate.literalLengths[i]};
+        if ( (literalLength > static_cast<size_t>(end - position)) || (memcmp(position, text, literalLength) != 0) ) {
+            return false;
+        }
+        position += literalLength;
+        if (i == messageTemplate.fieldCount) {
+            break;
+        }
+        text += literalLength + 1;
+        const char *digits{position};
+        uint64_t value{0};
+        while ( (position < end) && (*position >= '0') && (*position <= '9') ) {
+            value = (value * 10) + static_cast<uint64_t>(*position - '0');
+            position++;
+        }
+        size_t digitCount{static_cast<size_t>(position - digits)};
+        if ( (digitCount == 0) || (digitCount > BINARY_LOG_MAXIMUM_FIELD_DIGITS) || ( (digitCount > 1) && (*digits == '0') ) ) {
+            return false;
+        }
+        this->m_valueBuffer[i] = value;
+    }
+    return position == end;
+}
+
+bool BinaryLogWriter::splitMessage(uint32_t callSiteId, const std::string &str)
+{
+    this->m_templateBuffer.assign(reinterpret_cast<const char *>(&callSiteId), sizeof(callSiteId));
+    this->m_valueBuffer.clear();
+    const char *position{str.data()};
+    const char *end{position + str.size()};
+    while (position < end) {
+        const char *text{position};
+        while ( (position < end) && ( (*position < '0') || (*position > '9') ) ) {
+            if (*position == BINARY_LOG_FIELD_MARKER) {
+                return false;
+            }
+            position++;
+        }
+        this->m_templateBuffer.append(text, static_cast<size_t>(position - text));
+        const char *digits{position};
+        uint64_t value{0};
+        while ( (position < end) && (*position >= '0') && (*position <= '9') ) {
+            value = (value * 10) + static_cast<uint64_t>(*position - '0');
+            position++;
+        }
+        size_t digitCount{static_cast<size_t>(position - digits)};
+        if (digitCount == 0) {
+            continue;
+        }
+        /* Only numbers that print back the same way become fields */
+        if ( (digitCount > BINARY_LOG_MAXIMUM_FIELD_DIGITS) || ( (digitCount > 1) && (*digits == '0') ) ) {
+            this->m_templateBuffer.append(digits, digitCount);
+        } else {
+            this->m_templateBuffer.push_back(BINARY_LOG_FIELD_MARKER);
+            this->m_valueBuffer.push_back(value);
+        }
+    }
+    return true;
+}
+
+void BinaryLogWriter::encode(uint64_t fileGeneration, std::string &output)
+{
+    if ( (fileGeneration != this->m_fileGeneration) || (this->m_headerNeeded) ) {
+        /* A new file (or one another session wrote to) starts with a header
+         * and its own definitions */
+        this->m_fileGeneration = fileGeneration;
+        this->m_headerNeeded = false;
+        this->m_headers++;
+        BinaryLogFileHeader fileHeader{};
+        memcpy(fileHeader.magic, BINARY_LOG_MAGIC, sizeof(fileHeader.magic));
+        fileHeader.versionMajor = BINARY_LOG_VERSION_MAJOR;
+        fileHeader.versionMinor = BINARY_LOG_VERSION_MINOR;
+        fileHeader.headerSize = sizeof(BinaryLogFileHeader);
+        fileHeader.baseRealtimeNs = this->m_batchBaseTimestampNs;
+        output.append(reinterpret_cast<const char *>(&fileHeader), sizeof(fileHeader));
+    }
+    for (uint32_t callSiteId : this->m_batchCallSites) {
+        CallSite &callSite = this->m_callSites[callSiteId];
+        if (callSite.definedIn == this->m_headers) {
+            continue;
+        }
+        size_t fileNameLength{callSite.key.fileName ? strlen(callSite.key.fileName) : 0};
+        size_t functionNameLength{callSite.key.functionName ? strlen(callSite.key.functionName) : 0};
+        output.push_back(static_cast<char>(BinaryLogRecordType::CallSite));
+        appendVarint(output, callSiteId);
+        appendVarint(output, static_cast<uint64_t>(callSite.key.sourceFileLine));
+        appendVarint(output, fileNameLength);
+        output.append(callSite.key.fileName ? callSite.key.fileName : "", fileNameLength);
+        appendVarint(output, functionNameLength);
+        output.append(callSite.key.functionName ? callSite.key.functionName : "", functionNameLength);
+        callSite.definedIn = this->m_headers;
+    }
+    for (uint32_t templateId : this->m_batchTemplates) {
+        MessageTemplate &messageTemplate = this->m_templates[templateId];
+        if (messageTemplate.definedIn == this->m_headers) {
+            continue;
+        }
+        output.push_back(static_cast<char>(BinaryLogRecordType::Template));
+        appendVarint(output, templateId);
+        appendVarint(output, messageTemplate.callSiteId);
+        appendVarint(output, messageTemplate.key.size() - sizeof(uint32_t));
+        output.append(messageTemplate.key, sizeof(uint32_t), std::string::npos);
+        for (size_t i = 0; i < messageTemplate.fieldCount; i++) {
+            appendVarint(output, this->m_batchBaseValues[messageTemplate.baseValuesOffset + i]);
+        }
+        messageTemplate.definedIn = this->m_headers;
+    }
+    output.append(this->m_pendingRecords);
+}
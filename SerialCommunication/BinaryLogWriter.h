@@ -0,0 +1,124 @@
+#ifndef SERIALCOMMUNICATION_BINARYLOGWRITER_H
+#define SERIALCOMMUNICATION_BINARYLOGWRITER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MessageLogger.h"
+
+class LogFile;
+
+/* Writes log records to a LogFile in the layout of BinaryLogFormat.h. Call
+ * sites are interned by the address of their file and function names plus
+ * the line. Each message is split into its text and the numbers in it; the
+ * text is interned per call site as a template, and a record costs a tag
+ * byte, a timestamp delta, the template id and one short varint per number,
+ * the difference from the last value that number had. Records are encoded
+ * as they are appended and nothing is formatted. Used from one thread (the
+ * log sink's), like GlobalLogSink itself */
+class BinaryLogWriter
+{
+public:
+    explicit BinaryLogWriter(const std::shared_ptr<LogFile> &logFile);
+    BinaryLogWriter(const BinaryLogWriter &) = delete;
+    BinaryLogWriter(BinaryLogWriter &&) = delete;
+    BinaryLogWriter &operator=(const BinaryLogWriter &) = delete;
+    BinaryLogWriter &operator=(BinaryLogWriter &&) = delete;
+
+    void append(TMessageLogger::LogLevel logLevel, const TMessageLogger::LogContext &logContext, uint64_t timestampNs, const std::string &str);
+    /* Writes everything appended since the last commit with one write() */
+    bool commit();
+
+    const std::string &path() const;
+
+    static uint64_t realtimeNanoseconds();
+
+    /* Past this many templates a call site's messages are written whole, so
+     * a message that is different every time cannot fill the table */
+    static const size_t MAXIMUM_TEMPLATES_PER_CALL_SITE;
+    /* A power of two */
+    static const size_t CALL_SITE_CACHE_SIZE;
+
+private:
+    struct CallSiteKey
+    {
+        const char *fileName;
+        const char *functionName;
+        int sourceFileLine;
+
+        bool operator==(const CallSiteKey &other) const;
+    };
+
+    struct CallSiteKeyHash
+    {
+        size_t operator()(const CallSiteKey &callSiteKey) const;
+    };
+
+    struct CallSiteCacheEntry
+    {
+        CallSiteKey key;
+        uint32_t callSiteId;
+    };
+
+    struct CallSite
+    {
+        CallSiteKey key;
+        size_t templateCount;
+        uint32_t lastTemplateId;
+        /* Header written count when last defined, and the last batch that
+         * used it, 0 for none */
+        uint64_t definedIn;
+        uint64_t usedIn;
+    };
+
+    struct MessageTemplate
+    {
+        uint32_t callSiteId;
+        /* The call site id followed by the text, the key of m_templateIds */
+        std::string key;
+        /* Length of the text before each field and after the last one */
+        std::vector<size_t> literalLengths;
+        size_t fieldOffset;
+        size_t fieldCount;
+        uint64_t definedIn;
+        uint64_t usedIn;
+        /* Where the field values this batch starts from are kept */
+        size_t baseValuesOffset;
+    };
+
+    std::shared_ptr<LogFile> m_logFile;
+    std::unordered_map<CallSiteKey, uint32_t, CallSiteKeyHash> m_callSiteIds;
+    /* Direct mapped in front of m_callSiteIds */
+    std::vector<CallSiteCacheEntry> m_callSiteCache;
+    std::vector<CallSite> m_callSites;
+    std::unordered_map<std::string, uint32_t> m_templateIds;
+    std::vector<MessageTemplate> m_templates;
+    /* The last value of every template's fields, back to back */
+    std::vector<uint64_t> m_fieldValues;
+    /* Encoded records, and the call sites and templates they use */
+    std::string m_pendingRecords;
+    std::vector<uint32_t> m_batchCallSites;
+    std::vector<uint32_t> m_batchTemplates;
+    std::vector<uint64_t> m_batchBaseValues;
+    uint64_t m_batch;
+    uint64_t m_batchBaseTimestampNs;
+    std::string m_templateBuffer;
+    std::vector<uint64_t> m_valueBuffer;
+    uint64_t m_fileGeneration;
+    /* Headers written; a header resets the reader's tables */
+    uint64_t m_headers;
+    bool m_headerNeeded;
+    uint64_t m_previousTimestampNs;
+
+    uint32_t internCallSite(const TMessageLogger::LogContext &logContext);
+    uint32_t findTemplate(uint32_t callSiteId, const std::string &str);
+    void useCallSite(uint32_t callSiteId);
+    bool matchTemplate(const MessageTemplate &messageTemplate, const std::string &str);
+    bool splitMessage(uint32_t callSiteId, const std::string &str);
+    void encode(uint64_t fileGeneration, std::string &output);
+};
+
+#endif //SERIALCOMMUNICATION_BINARYLOGWRITER_H
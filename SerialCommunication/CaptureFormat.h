@@ -0,0 +1,99 @@
+#ifndef SERIALCOMMUNICATION_CAPTUREFORMAT_H
+#define SERIALCOMMUNICATION_CAPTUREFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* On-disk layout of a traffic capture file, version 1.2
+ *
+ *     offset 0             CaptureFileHeader (64 bytes)
+ *     offset 64            CapturePortEntry[portCount] (64 bytes each)
+ *     offset dataOffset    records, dataLength bytes in total
+ *
+ * Each record is a CaptureRecordHeader followed by length bytes of payload,
+ * zero padded so that the next record starts on an 8 byte boundary. All
+ * integers are little endian. Timestamps are CLOCK_MONOTONIC nanoseconds;
+ * startRealtimeNs and startMonotonicNs were sampled together when the file
+ * was opened, so wall clock time = timestampNs - startMonotonicNs +
+ * startRealtimeNs.
+ *
+ * Captures roll over into numbered files (<path>.0, <path>.1, ...), each
+ * one self contained. dataLength is kept current while the file is being
+ * written; a reader should trust it rather than the file size, which
+ * includes preallocated space until CAPTURE_FILE_COMPLETE is set and the
+ * file is truncated on close.
+ *
+ * Readers must reject a different versionMajor, and should skip records
+ * with a direction they do not know (length still tells them how far).
+ * Minor versions only add fields in reserved space or new directions */
+
+static const char CAPTURE_FILE_MAGIC[8]{'S', 'E', 'R', 'C', 'A', 'P', 'T', '\0'};
+static const uint16_t CAPTURE_VERSION_MAJOR{1};
+static const uint16_t CAPTURE_VERSION_MINOR{2};
+static const size_t CAPTURE_RECORD_ALIGNMENT{8};
+
+/* CaptureFileHeader::flags */
+static const uint32_t CAPTURE_FILE_COMPLETE{0x1};
+
+enum class CaptureDirection : uint8_t {
+    Receive = 0,
+    Transmit = 1,
+    /* Payload is one uint64_t: the number of bytes on this port that could
+     * not be captured since the previous record, because the writer fell
+     * behind. Traffic itself was not affected */
+    Dropped = 2,
+    /* Since 1.1. The port went away (see PortSupervisor); payload is one
+     * uint32_t, the errno it failed with */
+    Disconnected = 3,
+    /* Since 1.1. The port was reopened; payload is one uint64_t, how many
+     * nanoseconds it was away */
+    Reconnected = 4,
+    /* Since 1.2. A trigger matched what the port received (see
+     * TriggerEngine); payload is the trigger's label, and the timestamp is
+     * that of the read which completed the match */
+    Marker = 5
+};
+
+struct CaptureFileHeader
+{
+    char magic[8];
+    uint16_t versionMajor;
+    uint16_t versionMinor;
+    uint32_t headerSize;
+    uint32_t fileIndex;
+    uint32_t portCount;
+    uint64_t dataOffset;
+    uint64_t dataLength;
+    uint64_t startRealtimeNs;
+    uint64_t startMonotonicNs;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+struct CapturePortEntry
+{
+    uint16_t portId;
+    uint16_t reserved;
+    char portName[60];
+};
+
+struct CaptureRecordHeader
+{
+    uint64_t timestampNs;
+    uint32_t length;
+    uint16_t portId;
+    uint8_t direction;
+    uint8_t flags;
+};
+
+/* Bytes a record with this much payload occupies, header and padding included */
+inline size_t captureRecordLength(size_t payloadLength)
+{
+    return (sizeof(CaptureRecordHeader) + payloadLength + CAPTURE_RECORD_ALIGNMENT - 1) & ~(CAPTURE_RECORD_ALIGNMENT - 1);
+}
+
+static_assert(sizeof(CaptureFileHeader) == 64, "CaptureFileHeader layout changed");
+static_assert(sizeof(CapturePortEntry) == 64, "CapturePortEntry layout changed");
+static_assert(sizeof(CaptureRecordHeader) == 16, "CaptureRecordHeader layout changed");
+
+#endif //SERIALCOMMUNICATION_CAPTUREFORMAT_H
@@ -0,0 +1,152 @@
+#include "CaptureReader.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+CaptureReader::CaptureReader(const std::string &capturePath) :
+    m_filePaths{findCaptureFiles(capturePath)},
+    m_portNames{},
+    m_nextFile{0},
+    m_mapping{nullptr},
+    m_mappingLength{0},
+    m_readOffset{0},
+    m_dataEnd{0},
+    m_portCount{0},
+    m_filesRead{0}
+{
+    if (this->m_filePaths.empty()) {
+        throw std::runtime_error(TStringFormat("No capture files found at {0}", capturePath));
+    }
+    /* The port table is needed before the first record is asked for */
+    if (!this->openNextFile()) {
+        throw std::runtime_error(TStringFormat("{0} is not a readable capture file", this->m_filePaths.front()));
+    }
+}
+
+CaptureReader::~CaptureReader()
+{
+    this->closeCurrentFile();
+}
+
+bool CaptureReader::next(CaptureRecord &record)
+{
+    while (true) {
+        if ( (this->m_mapping) && (this->m_readOffset + sizeof(CaptureRecordHeader) <= this->m_dataEnd) ) {
+            const CaptureRecordHeader *recordHeader{reinterpret_cast<const CaptureRecordHeader *>(this->m_mapping + this->m_readOffset)};
+            if (recordHeader->portId >= this->m_portCount) {
+                LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Record for unknown port {0} in {1}, skipping the rest of the file", recordHeader->portId, this->m_filePaths[this->m_nextFile - 1]);
+            } else if (this->m_readOffset + sizeof(CaptureRecordHeader) + recordHeader->length <= this->m_dataEnd) {
+                record.header = recordHeader;
+                record.payload = this->m_mapping + this->m_readOffset + sizeof(CaptureRecordHeader);
+                this->m_readOffset += captureRecordLength(recordHeader->length);
+                return true;
+            } else {
+                LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Truncated record in {0}, skipping the rest of the file", this->m_filePaths[this->m_nextFile - 1]);
+            }
+        }
+        this->closeCurrentFile();
+        if (!this->openNextFile()) {
+            return false;
+        }
+    }
+}
+
+const std::vector<std::string> &CaptureReader::portNames() const
+{
+    return this->m_portNames;
+}
+
+uint32_t CaptureReader::filesRead() const
+{
+    return this->m_filesRead;
+}
+
+bool CaptureReader::openNextFile()
+{
+    while (this->m_nextFile < this->m_filePaths.size()) {
+        const std::string &filePath = this->m_filePaths[this->m_nextFile++];
+        int fileDescriptor{open(filePath.c_str(), O_RDONLY | O_CLOEXEC)};
+        if (fileDescriptor == -1) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Unable to open capture file {0} ({1})", filePath, strerror(errno));
+            continue;
+        }
+        struct stat fileStatus{};
+        if ( (fstat(fileDescriptor, &fileStatus) == -1) || (static_cast<size_t>(fileStatus.st_size) < sizeof(CaptureFileHeader)) ) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Capture file {0} is too short", filePath);
+            close(fileDescriptor);
+            continue;
+        }
+        size_t fileLength{static_cast<size_t>(fileStatus.st_size)};
+        void *mapping{mmap(nullptr, fileLength, PROT_READ, MAP_PRIVATE, fileDescriptor, 0)};
+        close(fileDescriptor);
+        if (mapping == MAP_FAILED) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Unable to map capture file {0} ({1})", filePath, strerror(errno));
+            continue;
+        }
+        madvise(mapping, fileLength, MADV_SEQUENTIAL);
+
+        const CaptureFileHeader *fileHeader{static_cast<const CaptureFileHeader *>(mapping)};
+        uint64_t portTableEnd{sizeof(CaptureFileHeader) + static_cast<uint64_t>(fileHeader->portCount) * sizeof(CapturePortEntry)};
+        if ( (memcmp(fileHeader->magic, CAPTURE_FILE_MAGIC, sizeof(fileHeader->magic)) != 0) ||
+             (fileHeader->versionMajor != CAPTURE_VERSION_MAJOR) ||
+             (portTableEnd > fileLength) ||
+             (fileHeader->dataOffset < portTableEnd) ||
+             (fileHeader->dataOffset > fileLength) ) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("{0} is not a version {1} capture file, skipping", filePath, CAPTURE_VERSION_MAJOR);
+            munmap(mapping, fileLength);
+            continue;
+        }
+        if (!(fileHeader->flags & CAPTURE_FILE_COMPLETE)) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Capture file {0} was not closed cleanly, reading what was recorded", filePath);
+        }
+        if (this->m_portNames.empty()) {
+            const CapturePortEntry *portEntries{reinterpret_cast<const CapturePortEntry *>(static_cast<const char *>(mapping) + sizeof(CaptureFileHeader))};
+            for (uint32_t i = 0; i < fileHeader->portCount; i++) {
+                this->m_portNames.emplace_back(portEntries[i].portName, strnlen(portEntries[i].portName, sizeof(portEntries[i].portName)));
+            }
+        }
+        this->m_mapping = static_cast<const char *>(mapping);
+        this->m_mappingLength = fileLength;
+        this->m_readOffset = fileHeader->dataOffset;
+        this->m_dataEnd = std::min<uint64_t>(fileHeader->dataOffset + fileHeader->dataLength, fileLength);
+        this->m_portCount = std::min<uint32_t>(fileHeader->portCount, static_cast<uint32_t>(this->m_portNames.size()));
+        this->m_filesRead++;
+        return true;
+    }
+    return false;
+}
+
+void CaptureReader::closeCurrentFile()
+{
+    if (this->m_mapping) {
+        munmap(const_cast<char *>(this->m_mapping), this->m_mappingLength);
+        this->m_mapping = nullptr;
+        this->m_mappingLength = 0;
+    }
+}
+
+std::vector<std::string> CaptureReader::findCaptureFiles(const std::string &capturePath)
+{
+    std::vector<std::string> filePaths{};
+    struct stat fileStatus{};
+    if ( (stat(capturePath.c_str(), &fileStatus) == 0) && (S_ISREG(fileStatus.st_mode)) ) {
+        filePaths.push_back(capturePath);
+        return filePaths;
+    }
+    for (uint32_t fileIndex = 0; ; fileIndex++) {
+        std::string filePath{TStringFormat("{0}.{1}", capturePath, fileIndex)};
+        if (stat(filePath.c_str(), &fileStatus) != 0) {
+            break;
+        }
+        filePaths.push_back(filePath);
+    }
+    return filePaths;
+}
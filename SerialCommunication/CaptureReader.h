@@ -0,0 +1,53 @@
+#ifndef SERIALCOMMUNICATION_CAPTUREREADER_H
+#define SERIALCOMMUNICATION_CAPTUREREADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CaptureFormat.h"
+
+struct CaptureRecord
+{
+    const CaptureRecordHeader *header;
+    const char *payload;
+};
+
+/* Sequential reader for the files written by CaptureWriter. Given the base
+ * path it walks <path>.0, <path>.1, ... in order (or just <path>, when that
+ * names a single capture file), mapping one file at a time read-only, so the
+ * records handed out point straight into the page cache and stay valid until
+ * the next call to next() */
+class CaptureReader
+{
+public:
+    explicit CaptureReader(const std::string &capturePath);
+    ~CaptureReader();
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader(CaptureReader &&) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+    CaptureReader &operator=(CaptureReader &&) = delete;
+
+    bool next(CaptureRecord &record);
+
+    const std::vector<std::string> &portNames() const;
+    uint32_t filesRead() const;
+
+private:
+    std::vector<std::string> m_filePaths;
+    std::vector<std::string> m_portNames;
+    size_t m_nextFile;
+    const char *m_mapping;
+    size_t m_mappingLength;
+    uint64_t m_readOffset;
+    uint64_t m_dataEnd;
+    /* Ports of the current file that the port table from the first one names */
+    uint32_t m_portCount;
+    uint32_t m_filesRead;
+
+    bool openNextFile();
+    void closeCurrentFile();
+    static std::vector<std::string> findCaptureFiles(const std::string &capturePath);
+};
+
+#endif //SERIALCOMMUNICATION_CAPTUREREADER_H
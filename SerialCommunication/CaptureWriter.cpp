@@ -0,0 +1,336 @@
+#include "CaptureWriter.h"
+#include "GlobalDefinitions.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+/* How long the capture thread sleeps when no producer wakes it, which also
+ * bounds how stale dataLength in the file header can get */
+static const int IDLE_POLL_TIMEOUT_MILLISECONDS{100};
+
+/* Upper bound on what one drainPort() call copies, so a busy port cannot
+ * starve the others */
+static const size_t MAXIMUM_DRAIN_BYTES_PER_PORT{256 * 1024};
+
+const uint64_t CaptureWriter::DEFAULT_FILE_SIZE_LIMIT;
+const uint64_t CaptureWriter::MINIMUM_FILE_SIZE_LIMIT;
+const size_t CaptureWriter::DEFAULT_RING_SIZE;
+
+CaptureWriter::CapturePort::CapturePort(const std::string &name, size_t ringSize) :
+    portName{name},
+    ring{ringSize},
+    droppedBytes{0},
+    reportedDroppedBytes{0}
+{
+
+}
+
+CaptureWriter::CaptureWriter(const std::string &basePath, uint64_t fileSizeLimit, size_t ringSize) :
+    m_basePath{basePath},
+    m_fileSizeLimit{fileSizeLimit},
+    m_ringSize{ringSize},
+    m_ports{},
+    m_writerThread{},
+    m_running{false},
+    m_writerSleeping{false},
+    m_wakeDescriptor{-1},
+    m_fileDescriptor{-1},
+    m_mapping{nullptr},
+    m_writeOffset{0},
+    m_fileIndex{0},
+    m_capturedBytes{0},
+    m_fileCount{0}
+{
+    if (this->m_fileSizeLimit < MINIMUM_FILE_SIZE_LIMIT) {
+        throw std::runtime_error(TStringFormat("Capture file size limit must be at least {0} bytes", MINIMUM_FILE_SIZE_LIMIT));
+    }
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    this->stop();
+}
+
+uint16_t CaptureWriter::addPort(const std::string &portName)
+{
+    if (this->m_running.load()) {
+        throw std::runtime_error(TStringFormat("Cannot add port {0} after capture has started", portName));
+    }
+    if (this->m_ports.size() > UINT16_MAX) {
+        throw std::runtime_error("Too many ports to capture");
+    }
+    this->m_ports.emplace_back(new CapturePort{portName, this->m_ringSize});
+    return static_cast<uint16_t>(this->m_ports.size() - 1);
+}
+
+void CaptureWriter::start()
+{
+    if (this->m_running.load()) {
+        return;
+    }
+    this->m_wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->m_wakeDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to create capture wake descriptor ({0})", strerror(errno)));
+    }
+    this->openNextFile();
+    this->m_running.store(true);
+    this->m_writerThread = std::thread{[this]() { this->runWriter(); }};
+    LOG_INFO(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Capturing {0} port(s) to {1}.*", this->m_ports.size(), this->m_basePath);
+}
+
+void CaptureWriter::stop()
+{
+    if (!this->m_running.exchange(false)) {
+        return;
+    }
+    this->wakeWriter();
+    if (this->m_writerThread.joinable()) {
+        this->m_writerThread.join();
+    }
+    this->closeCurrentFile();
+    ::close(this->m_wakeDescriptor);
+    this->m_wakeDescriptor = -1;
+    LOG_INFO(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Captured {0} bytes in {1} file(s), dropped {2} bytes",
+                                                     this->capturedBytes(), this->fileCount(), this->droppedBytes());
+}
+
+void CaptureWriter::record(uint16_t portId, CaptureDirection direction, const char *data, size_t length, uint64_t timestampNs)
+{
+    CapturePort &capturePort = *this->m_ports[portId];
+    CaptureRecordHeader recordHeader{(timestampNs != 0) ? timestampNs : monotonicNanoseconds(), static_cast<uint32_t>(length), portId, static_cast<uint8_t>(direction), 0};
+    if ( (captureRecordLength(length) > this->m_fileSizeLimit / 2) || (!capturePort.ring.tryWrite(&recordHeader, sizeof(recordHeader), data, length)) ) {
+        capturePort.droppedBytes.fetch_add(length, std::memory_order_relaxed);
+        return;
+    }
+    /* Pairs with the fence in runWriter(): either the writer sees the new
+     * record before it goes to sleep, or this sees that it is asleep */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (this->m_writerSleeping.load(std::memory_order_relaxed)) {
+        this->wakeWriter();
+    }
+}
+
+uint64_t CaptureWriter::capturedBytes() const
+{
+    return this->m_capturedBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t CaptureWriter::droppedBytes() const
+{
+    uint64_t totalDroppedBytes{0};
+    for (const auto &capturePort : this->m_ports) {
+        totalDroppedBytes += capturePort->droppedBytes.load(std::memory_order_relaxed);
+    }
+    return totalDroppedBytes;
+}
+
+uint32_t CaptureWriter::fileCount() const
+{
+    return this->m_fileCount.load(std::memory_order_relaxed);
+}
+
+void CaptureWriter::runWriter()
+{
+    while (true) {
+        if (this->drainPorts()) {
+            continue;
+        }
+        this->publishDataLength();
+        if (!this->m_running.load()) {
+            /* Producers are stopped before the writer, so one empty pass
+             * after stop() means everything has been written */
+            break;
+        }
+        this->m_writerSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!this->drainPorts()) {
+            pollfd pollDescriptor{this->m_wakeDescriptor, POLLIN, 0};
+            poll(&pollDescriptor, 1, IDLE_POLL_TIMEOUT_MILLISECONDS);
+            uint64_t counter{0};
+            ssize_t readResult{read(this->m_wakeDescriptor, &counter, sizeof(counter))};
+            (void)readResult;
+        }
+        this->m_writerSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool CaptureWriter::drainPorts()
+{
+    bool drainedAny{false};
+    for (size_t i = 0; i < this->m_ports.size(); i++) {
+        drainedAny |= this->drainPort(static_cast<uint16_t>(i), *this->m_ports[i]);
+    }
+    return drainedAny;
+}
+
+bool CaptureWriter::drainPort(uint16_t portId, CapturePort &capturePort)
+{
+    bool drainedAny{false};
+    size_t drainedBytes{0};
+    while (drainedBytes < MAXIMUM_DRAIN_BYTES_PER_PORT) {
+        size_t readableBytes{capturePort.ring.readableBytes()};
+        if (readableBytes < sizeof(CaptureRecordHeader)) {
+            break;
+        }
+        CaptureRecordHeader recordHeader;
+        capturePort.ring.peek(0, &recordHeader, sizeof(recordHeader));
+        /* A record is published in one piece, so the payload is there too */
+        this->appendRecord(recordHeader, &capturePort.ring, nullptr);
+        capturePort.ring.consume(sizeof(recordHeader) + recordHeader.length);
+        drainedBytes += sizeof(recordHeader) + recordHeader.length;
+        drainedAny = true;
+    }
+
+    /* Loss is reported after what was already queued, which is where the
+     * gap is: a chunk is only dropped once the ring is full */
+    uint64_t droppedBytes{capturePort.droppedBytes.load(std::memory_order_relaxed)};
+    if (droppedBytes != capturePort.reportedDroppedBytes) {
+        uint64_t droppedSinceLastReport{droppedBytes - capturePort.reportedDroppedBytes};
+        CaptureRecordHeader recordHeader{monotonicNanoseconds(), sizeof(droppedSinceLastReport), portId, static_cast<uint8_t>(CaptureDirection::Dropped), 0};
+        this->appendRecord(recordHeader, nullptr, &droppedSinceLastReport);
+        capturePort.reportedDroppedBytes = droppedBytes;
+        drainedAny = true;
+    }
+    return drainedAny;
+}
+
+bool CaptureWriter::appendRecord(const CaptureRecordHeader &recordHeader, const SpscByteRing *ring, const void *payload)
+{
+    size_t recordLength{captureRecordLength(recordHeader.length)};
+    if ( (this->m_mapping) && (this->m_writeOffset + recordLength > this->m_fileSizeLimit) ) {
+        this->closeCurrentFile();
+        this->m_fileIndex++;
+        try {
+            this->openNextFile();
+        } catch (std::exception &e) {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Capture stopped ({0})", e.what());
+        }
+    }
+    if (!this->m_mapping) {
+        return false;
+    }
+    /* The file was preallocated with zeros, so the padding is already there */
+    char *destination{this->m_mapping + this->m_writeOffset};
+    memcpy(destination, &recordHeader, sizeof(recordHeader));
+    if (ring) {
+        ring->peek(sizeof(recordHeader), destination + sizeof(recordHeader), recordHeader.length);
+    } else {
+        memcpy(destination + sizeof(recordHeader), payload, recordHeader.length);
+    }
+    this->m_writeOffset += recordLength;
+    this->m_capturedBytes.fetch_add(recordHeader.length, std::memory_order_relaxed);
+    return true;
+}
+
+void CaptureWriter::openNextFile()
+{
+    std::string filePath{TStringFormat("{0}.{1}", this->m_basePath, this->m_fileIndex)};
+    int fileDescriptor{open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+    if (fileDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open capture file {0} ({1})", filePath, strerror(errno)));
+    }
+    /* Reserve the blocks up front so the capture thread never has to wait
+     * on the filesystem to allocate them while it is copying records. Only
+     * a filesystem that cannot reserve space gets a sparse file instead:
+     * running out of space in a mapping is a SIGBUS, not an error */
+    int allocateResult{posix_fallocate(fileDescriptor, 0, static_cast<off_t>(this->m_fileSizeLimit))};
+    if ( (allocateResult != 0) && (allocateResult != EOPNOTSUPP) && (allocateResult != ENOSYS) && (allocateResult != EINVAL) ) {
+        ::close(fileDescriptor);
+        unlink(filePath.c_str());
+        throw std::runtime_error(TStringFormat("Unable to reserve space for capture file {0} ({1})", filePath, strerror(allocateResult)));
+    }
+    if ( (allocateResult != 0) && (ftruncate(fileDescriptor, static_cast<off_t>(this->m_fileSizeLimit)) == -1) ) {
+        int errorNumber{errno};
+        ::close(fileDescriptor);
+        unlink(filePath.c_str());
+        throw std::runtime_error(TStringFormat("Unable to size capture file {0} ({1})", filePath, strerror(errorNumber)));
+    }
+    void *mapping{mmap(nullptr, this->m_fileSizeLimit, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0)};
+    if (mapping == MAP_FAILED) {
+        int errorNumber{errno};
+        ::close(fileDescriptor);
+        throw std::runtime_error(TStringFormat("Unable to map capture file {0} ({1})", filePath, strerror(errorNumber)));
+    }
+    madvise(mapping, this->m_fileSizeLimit, MADV_SEQUENTIAL);
+    this->m_fileDescriptor = fileDescriptor;
+    this->m_mapping = static_cast<char *>(mapping);
+
+    CaptureFileHeader fileHeader{};
+    memcpy(fileHeader.magic, CAPTURE_FILE_MAGIC, sizeof(fileHeader.magic));
+    fileHeader.versionMajor = CAPTURE_VERSION_MAJOR;
+    fileHeader.versionMinor = CAPTURE_VERSION_MINOR;
+    fileHeader.headerSize = sizeof(CaptureFileHeader);
+    fileHeader.fileIndex = this->m_fileIndex;
+    fileHeader.portCount = static_cast<uint32_t>(this->m_ports.size());
+    fileHeader.dataOffset = sizeof(CaptureFileHeader) + this->m_ports.size() * sizeof(CapturePortEntry);
+    fileHeader.startRealtimeNs = realtimeNanoseconds();
+    fileHeader.startMonotonicNs = monotonicNanoseconds();
+    memcpy(this->m_mapping, &fileHeader, sizeof(fileHeader));
+    for (size_t i = 0; i < this->m_ports.size(); i++) {
+        CapturePortEntry portEntry{};
+        portEntry.portId = static_cast<uint16_t>(i);
+        strncpy(portEntry.portName, this->m_ports[i]->portName.c_str(), sizeof(portEntry.portName) - 1);
+        memcpy(this->m_mapping + sizeof(CaptureFileHeader) + i * sizeof(CapturePortEntry), &portEntry, sizeof(portEntry));
+    }
+    if (fileHeader.dataOffset + captureRecordLength(0) > this->m_fileSizeLimit) {
+        this->closeCurrentFile();
+        throw std::runtime_error("Capture file size limit is too small for the port table");
+    }
+    this->m_writeOffset = fileHeader.dataOffset;
+    this->m_fileCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CaptureWriter::closeCurrentFile()
+{
+    if (!this->m_mapping) {
+        return;
+    }
+    CaptureFileHeader *fileHeader{reinterpret_cast<CaptureFileHeader *>(this->m_mapping)};
+    fileHeader->dataLength = this->m_writeOffset - fileHeader->dataOffset;
+    fileHeader->flags |= CAPTURE_FILE_COMPLETE;
+    munmap(this->m_mapping, this->m_fileSizeLimit);
+    this->m_mapping = nullptr;
+    if (ftruncate(this->m_fileDescriptor, static_cast<off_t>(this->m_writeOffset)) == -1) {
+        LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Unable to trim capture file ({0})", strerror(errno));
+    }
+    ::close(this->m_fileDescriptor);
+    this->m_fileDescriptor = -1;
+}
+
+void CaptureWriter::publishDataLength()
+{
+    if (!this->m_mapping) {
+        return;
+    }
+    CaptureFileHeader *fileHeader{reinterpret_cast<CaptureFileHeader *>(this->m_mapping)};
+    fileHeader->dataLength = this->m_writeOffset - fileHeader->dataOffset;
+}
+
+void CaptureWriter::wakeWriter()
+{
+    uint64_t increment{1};
+    ssize_t writeResult{write(this->m_wakeDescriptor, &increment, sizeof(increment))};
+    (void)writeResult;
+}
+
+uint64_t CaptureWriter::monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+uint64_t CaptureWriter::realtimeNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
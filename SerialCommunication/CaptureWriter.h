@@ -0,0 +1,88 @@
+#ifndef SERIALCOMMUNICATION_CAPTUREWRITER_H
+#define SERIALCOMMUNICATION_CAPTUREWRITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CaptureFormat.h"
+#include "SpscByteRing.h"
+
+/* Records RX/TX traffic into memory-mapped capture files (see
+ * CaptureFormat.h). Every port gets its own SpscByteRing, filled by the one
+ * worker thread that services the port and drained by the capture thread,
+ * which copies records into the mapped file and rolls over to the next file
+ * at the size limit. record() never blocks: when a ring is full the chunk
+ * is dropped and the loss is written to the capture as a Dropped record */
+class CaptureWriter
+{
+public:
+    CaptureWriter(const std::string &basePath, uint64_t fileSizeLimit = DEFAULT_FILE_SIZE_LIMIT, size_t ringSize = DEFAULT_RING_SIZE);
+    ~CaptureWriter();
+    CaptureWriter(const CaptureWriter &) = delete;
+    CaptureWriter(CaptureWriter &&) = delete;
+    CaptureWriter &operator=(const CaptureWriter &) = delete;
+    CaptureWriter &operator=(CaptureWriter &&) = delete;
+
+    /* Ports are added before start(), the id is what record() expects */
+    uint16_t addPort(const std::string &portName);
+    void start();
+    void stop();
+
+    /* Only ever called from the thread that owns portId; timestampNs is
+     * CLOCK_MONOTONIC, 0 stamps the record with the current time */
+    void record(uint16_t portId, CaptureDirection direction, const char *data, size_t length, uint64_t timestampNs = 0);
+
+    uint64_t capturedBytes() const;
+    uint64_t droppedBytes() const;
+    uint32_t fileCount() const;
+
+    static const uint64_t DEFAULT_FILE_SIZE_LIMIT{64 * 1024 * 1024};
+    static const uint64_t MINIMUM_FILE_SIZE_LIMIT{1024 * 1024};
+    static const size_t DEFAULT_RING_SIZE{1024 * 1024};
+
+private:
+    struct CapturePort
+    {
+        explicit CapturePort(const std::string &name, size_t ringSize);
+
+        std::string portName;
+        SpscByteRing ring;
+        std::atomic<uint64_t> droppedBytes;
+        uint64_t reportedDroppedBytes;
+    };
+
+    std::string m_basePath;
+    uint64_t m_fileSizeLimit;
+    size_t m_ringSize;
+    std::vector<std::unique_ptr<CapturePort>> m_ports;
+    std::thread m_writerThread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_writerSleeping;
+    int m_wakeDescriptor;
+
+    /* Owned by the capture thread once started */
+    int m_fileDescriptor;
+    char *m_mapping;
+    uint64_t m_writeOffset;
+    uint32_t m_fileIndex;
+    std::atomic<uint64_t> m_capturedBytes;
+    std::atomic<uint32_t> m_fileCount;
+
+    void runWriter();
+    bool drainPorts();
+    bool drainPort(uint16_t portId, CapturePort &capturePort);
+    bool appendRecord(const CaptureRecordHeader &recordHeader, const SpscByteRing *ring, const void *payload);
+    void openNextFile();
+    void closeCurrentFile();
+    void publishDataLength();
+    void wakeWriter();
+
+    static uint64_t monotonicNanoseconds();
+    static uint64_t realtimeNanoseconds();
+};
+
+#endif //SERIALCOMMUNICATION_CAPTUREWRITER_H
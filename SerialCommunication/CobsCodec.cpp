@@ -0,0 +1,126 @@
+#include "CobsCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+/* Largest code byte: a block of 254 data bytes with no implied zero after it */
+static const unsigned int MAXIMUM_BLOCK_CODE{0xFF};
+
+CobsCodec::CobsCodec() :
+    FramingCodec{},
+    m_partialFrame{},
+    m_blockCode{0},
+    m_blockRemaining{0},
+    m_discarding{false}
+{
+
+}
+
+void CobsCodec::decode(char *data, size_t length)
+{
+    const char *input{data};
+    const char *end{data + length};
+    char *output{data};
+    char *frameStart{data};
+    while (input < end) {
+        if (this->m_discarding) {
+            const char *delimiter{static_cast<const char *>(memchr(input, 0, static_cast<size_t>(end - input)))};
+            if (!delimiter) {
+                return;
+            }
+            input = delimiter + 1;
+            output = frameStart = data + (input - data);
+            this->resetFrame();
+            continue;
+        }
+        if (this->m_blockRemaining > 0) {
+            /* Data bytes are never zero, so a block is copied down in one go
+             * unless a delimiter cuts it short */
+            size_t run{std::min<size_t>(this->m_blockRemaining, static_cast<size_t>(end - input))};
+            const char *delimiter{static_cast<const char *>(memchr(input, 0, run))};
+            if (delimiter) {
+                run = static_cast<size_t>(delimiter - input);
+            }
+            memmove(output, input, run);
+            output += run;
+            input += run;
+            this->m_blockRemaining -= static_cast<unsigned int>(run);
+            if (!delimiter) {
+                continue;
+            }
+        }
+        unsigned char byte{static_cast<unsigned char>(*input++)};
+        if (byte == 0) {
+            if (this->m_blockRemaining != 0) {
+                this->countError();
+            } else if (this->m_blockCode != 0) {
+                if (this->m_partialFrame.empty()) {
+                    this->emitFrame(frameStart, static_cast<size_t>(output - frameStart));
+                } else {
+                    this->m_partialFrame.append(frameStart, static_cast<size_t>(output - frameStart));
+                    this->emitFrame(this->m_partialFrame.data(), this->m_partialFrame.size());
+                }
+            }
+            this->resetFrame();
+            output = frameStart = data + (input - data);
+        } else {
+            /* A code byte; the block before it implied a zero unless it was
+             * a full one */
+            if ( (this->m_blockCode != 0) && (this->m_blockCode != MAXIMUM_BLOCK_CODE) ) {
+                *output++ = '\0';
+            }
+            this->m_blockCode = byte;
+            this->m_blockRemaining = byte - 1u;
+        }
+    }
+    if ( (!this->m_discarding) && (this->m_blockCode != 0) ) {
+        this->m_partialFrame.append(frameStart, static_cast<size_t>(output - frameStart));
+        if (this->m_partialFrame.size() > MAXIMUM_FRAME_LENGTH) {
+            this->countError();
+            this->resetFrame();
+            this->m_discarding = true;
+        }
+    }
+}
+
+size_t CobsCodec::maximumEncodedLength(size_t payloadLength) const
+{
+    return payloadLength + (payloadLength / (MAXIMUM_BLOCK_CODE - 1)) + 2;
+}
+
+size_t CobsCodec::encode(const char *payload, size_t length, char *destination) const
+{
+    char *codePosition{destination};
+    char *output{destination + 1};
+    unsigned int blockCode{1};
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] == '\0') {
+            *codePosition = static_cast<char>(blockCode);
+            codePosition = output++;
+            blockCode = 1;
+            continue;
+        }
+        *output++ = payload[i];
+        if (++blockCode == MAXIMUM_BLOCK_CODE) {
+            *codePosition = static_cast<char>(blockCode);
+            codePosition = output++;
+            blockCode = 1;
+        }
+    }
+    *codePosition = static_cast<char>(blockCode);
+    *output++ = '\0';
+    return static_cast<size_t>(output - destination);
+}
+
+std::string CobsCodec::name() const
+{
+    return "cobs";
+}
+
+void CobsCodec::resetFrame()
+{
+    this->m_partialFrame.clear();
+    this->m_blockCode = 0;
+    this->m_blockRemaining = 0;
+    this->m_discarding = false;
+}
@@ -0,0 +1,32 @@
+#ifndef SERIALCOMMUNICATION_COBSCODEC_H
+#define SERIALCOMMUNICATION_COBSCODEC_H
+
+#include <string>
+
+#include "FramingCodec.h"
+
+/* Consistent Overhead Byte Stuffing, with a zero byte after every frame.
+ * Decoding never produces more bytes than it consumes, so frames are
+ * unstuffed in place in the receive buffer */
+class CobsCodec : public FramingCodec
+{
+public:
+    CobsCodec();
+
+    void decode(char *data, size_t length) override;
+
+    size_t maximumEncodedLength(size_t payloadLength) const override;
+    size_t encode(const char *payload, size_t length, char *destination) const override;
+
+    std::string name() const override;
+
+private:
+    std::string m_partialFrame;
+    unsigned int m_blockCode;
+    unsigned int m_blockRemaining;
+    bool m_discarding;
+
+    void resetFrame();
+};
+
+#endif //SERIALCOMMUNICATION_COBSCODEC_H
@@ -0,0 +1,281 @@
+#include "CommandEngine.h"
+#include "EventLoop.h"
+#include "GlobalDefinitions.h"
+#include "SerialSession.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+using namespace TMessageLogger;
+
+const char *CommandEngine::DEFAULT_RESPONSE_PATTERN{R"(^(OK|ERROR|\+CM[ES] ERROR.*)$)"};
+const char *CommandEngine::DEFAULT_ERROR_PATTERN{R"(^(ERROR|\+CM[ES] ERROR.*)$)"};
+
+CommandEngine::CommandEngine(SerialSession &serialSession, const std::vector<std::string> &commands, const CommandOptions &commandOptions) :
+    m_serialSession(serialSession),
+    m_commands{commands},
+    m_commandOptions(commandOptions),
+    m_responsePattern{},
+    m_errorPattern{},
+    m_resultHandler{},
+    m_finishedHandler{},
+    m_inFlight{},
+    m_nextCommand{0},
+    m_timeoutTimer{-1},
+    m_started{false},
+    m_finished{false},
+    m_completedCount{0},
+    m_failedCount{0},
+    m_startTime{},
+    m_roundTripMetric{}
+{
+    if (this->m_commandOptions.window == 0) {
+        throw std::runtime_error("The command window must allow at least one request in flight");
+    }
+    try {
+        this->m_responsePattern = std::regex{this->m_commandOptions.responsePattern, std::regex::optimize};
+    } catch (std::regex_error &e) {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a valid response pattern ({1}))", this->m_commandOptions.responsePattern, e.what()));
+    }
+    if (!this->m_commandOptions.errorPattern.empty()) {
+        try {
+            this->m_errorPattern = std::regex{this->m_commandOptions.errorPattern, std::regex::optimize};
+        } catch (std::regex_error &e) {
+            throw std::runtime_error(TStringFormat(R"("{0}" is not a valid error pattern ({1}))", this->m_commandOptions.errorPattern, e.what()));
+        }
+    }
+    this->m_roundTripMetric = MetricsRegistry::instance().histogram("port." + this->m_serialSession.portSettings().portName + ".command_rtt_ns");
+}
+
+CommandEngine::~CommandEngine()
+{
+    if (this->m_timeoutTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_timeoutTimer);
+    }
+}
+
+void CommandEngine::setResultHandler(const ResultHandler &resultHandler)
+{
+    this->m_resultHandler = resultHandler;
+}
+
+void CommandEngine::setFinishedHandler(const FinishedHandler &finishedHandler)
+{
+    this->m_finishedHandler = finishedHandler;
+}
+
+void CommandEngine::start()
+{
+    if (this->m_started) {
+        return;
+    }
+    this->m_started = true;
+    this->m_startTime = std::chrono::steady_clock::now();
+    /* Commands for a port that is expected back are held for it, and time
+     * out as usual if it does not come back in time */
+    if ( (!this->m_serialSession.isOpen()) && (!this->m_serialSession.isAwaitingReconnect()) ) {
+        for (; this->m_nextCommand < this->m_commands.size(); this->m_nextCommand++) {
+            this->m_inFlight.push_back(Request{this->m_nextCommand, this->m_commands[this->m_nextCommand], "", 0, this->m_startTime, this->m_startTime, ""});
+            this->complete(this->m_inFlight.begin(), CommandStatus::NotSent);
+        }
+        this->finishIfDone();
+        return;
+    }
+    this->fillWindow();
+    this->finishIfDone();
+}
+
+void CommandEngine::handleLine(const char *line, size_t length)
+{
+    /* A device answering with CR LF on a port set to LF line endings */
+    if ( (length > 0) && (line[length - 1] == '\r') ) {
+        length--;
+    }
+    if ( (this->m_inFlight.empty()) || (length == 0) ) {
+        return;
+    }
+    auto request = this->m_inFlight.begin();
+    if (this->m_commandOptions.tagged) {
+        const char *tagEnd{static_cast<const char *>(memchr(line, ' ', length))};
+        size_t tagLength{tagEnd ? static_cast<size_t>(tagEnd - line) : length};
+        for (; request != this->m_inFlight.end(); ++request) {
+            if ( (request->tag.size() == tagLength) && (memcmp(request->tag.data(), line, tagLength) == 0) ) {
+                break;
+            }
+        }
+        if (request == this->m_inFlight.end()) {
+            return;
+        }
+        if (tagEnd) {
+            tagLength++;
+        }
+        line += tagLength;
+        length -= tagLength;
+    }
+    if ( (length == request->command.size()) && (memcmp(line, request->command.data(), length) == 0) ) {
+        return;
+    }
+    if (!request->response.empty()) {
+        request->response.append(" | ");
+    }
+    request->response.append(line, length);
+    if (std::regex_search(line, line + length, this->m_responsePattern)) {
+        bool failed{ (!this->m_commandOptions.errorPattern.empty()) && (std::regex_search(line, line + length, this->m_errorPattern)) };
+        this->complete(request, failed ? CommandStatus::Error : CommandStatus::Ok);
+        this->fillWindow();
+        this->rearmTimeout();
+        this->finishIfDone();
+    }
+}
+
+bool CommandEngine::isFinished() const
+{
+    return this->m_finished;
+}
+
+size_t CommandEngine::failedCount() const
+{
+    return this->m_failedCount;
+}
+
+std::vector<std::string> CommandEngine::loadScript(const std::string &path)
+{
+    std::ifstream scriptFile{path};
+    if (!scriptFile.is_open()) {
+        throw std::runtime_error(TStringFormat(R"(Unable to open command script "{0}" ({1}))", path, strerror(errno)));
+    }
+    std::vector<std::string> commands{};
+    for (std::string line{""}; std::getline(scriptFile, line); ) {
+        if ( (!line.empty()) && (line.back() == '\r') ) {
+            line.pop_back();
+        }
+        if ( (!line.empty()) && (line[0] != '#') ) {
+            commands.push_back(line);
+        }
+    }
+    return commands;
+}
+
+const char *CommandEngine::statusName(CommandStatus status)
+{
+    switch (status) {
+        case CommandStatus::Ok:
+            return "ok";
+        case CommandStatus::Error:
+            return "error";
+        case CommandStatus::Timeout:
+            return "timeout";
+        case CommandStatus::NotSent:
+            return "not-sent";
+    }
+    return "unknown";
+}
+
+void CommandEngine::fillWindow()
+{
+    while ( (this->m_inFlight.size() < this->m_commandOptions.window) && (this->m_nextCommand < this->m_commands.size()) ) {
+        size_t index{this->m_nextCommand++};
+        Request request{index, this->m_commands[index], "", 0, {}, {}, ""};
+        if (this->m_commandOptions.tagged) {
+            request.tag = "T" + std::to_string(index + 1);
+            size_t placeholder{request.command.find("{tag}")};
+            if (placeholder != std::string::npos) {
+                request.command.replace(placeholder, 5, request.tag);
+            } else {
+                request.command.insert(0, request.tag + " ");
+            }
+        }
+        this->m_inFlight.push_back(request);
+        this->send(this->m_inFlight.back());
+    }
+    this->rearmTimeout();
+}
+
+void CommandEngine::send(Request &request)
+{
+    request.attempts++;
+    request.response.clear();
+    request.sentTime = std::chrono::steady_clock::now();
+    request.deadline = request.sentTime + this->m_commandOptions.timeout;
+    this->m_serialSession.sendLine(request.command);
+}
+
+void CommandEngine::complete(std::deque<Request>::iterator request, CommandStatus status)
+{
+    auto roundTrip = std::chrono::steady_clock::now() - request->sentTime;
+    if (status == CommandStatus::Ok) {
+        this->m_roundTripMetric.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(roundTrip).count()));
+    } else {
+        this->m_failedCount++;
+    }
+    this->m_completedCount++;
+    if (this->m_resultHandler) {
+        CommandResult result{request->index, request->command, status, request->attempts, std::chrono::duration_cast<std::chrono::nanoseconds>(roundTrip), request->response};
+        this->m_resultHandler(this->m_serialSession, result);
+    }
+    this->m_inFlight.erase(request);
+}
+
+void CommandEngine::onTimeout()
+{
+    auto now = std::chrono::steady_clock::now();
+    /* Every request has the same timeout and is appended when (re)sent, so
+     * the deadlines in the window are in order */
+    while ( (!this->m_inFlight.empty()) && (this->m_inFlight.front().deadline <= now) ) {
+        if (this->m_inFlight.front().attempts <= this->m_commandOptions.retries) {
+            Request request{this->m_inFlight.front()};
+            this->m_inFlight.pop_front();
+            this->m_inFlight.push_back(request);
+            this->send(this->m_inFlight.back());
+        } else {
+            this->complete(this->m_inFlight.begin(), CommandStatus::Timeout);
+        }
+    }
+    this->fillWindow();
+    this->finishIfDone();
+}
+
+void CommandEngine::rearmTimeout()
+{
+    if (this->m_inFlight.empty()) {
+        return;
+    }
+    auto deadline = this->m_inFlight.front().deadline;
+    if (this->m_timeoutTimer == -1) {
+        auto now = std::chrono::steady_clock::now();
+        this->m_timeoutTimer = this->m_serialSession.eventLoop().addTimer((deadline > now) ? (deadline - now) : std::chrono::nanoseconds{0}, [this]() {
+            this->onTimeout();
+        }, false);
+    } else {
+        this->m_serialSession.eventLoop().rearmTimer(this->m_timeoutTimer, deadline);
+    }
+}
+
+void CommandEngine::finishIfDone()
+{
+    if ( (this->m_finished) || (!this->m_inFlight.empty()) || (this->m_nextCommand < this->m_commands.size()) ) {
+        return;
+    }
+    this->m_finished = true;
+    if (this->m_timeoutTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_timeoutTimer);
+        this->m_timeoutTimer = -1;
+    }
+    double seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - this->m_startTime).count()};
+    HistogramSummary roundTrip{MetricsRegistry::instance().summary(this->m_roundTripMetric)};
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Ran {0} command(s) on {1} in {2} s ({3} commands/s, window {4}): {5} failed, round trip p50 {6} us, p99 {7} us, max {8} us",
+                                                     this->m_completedCount,
+                                                     this->m_serialSession.portSettings().portName,
+                                                     seconds,
+                                                     static_cast<uint64_t>( (seconds > 0.0) ? static_cast<double>(this->m_completedCount) / seconds : 0.0),
+                                                     this->m_commandOptions.window,
+                                                     this->m_failedCount,
+                                                     roundTrip.p50 / 1000,
+                                                     roundTrip.p99 / 1000,
+                                                     roundTrip.maximum / 1000);
+    if (this->m_finishedHandler) {
+        this->m_finishedHandler(*this);
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef SERIALCOMMUNICATION_COMMANDENGINE_H
+#define SERIALCOMMUNICATION_COMMANDENGINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "MetricsRegistry.h"
+
+class SerialSession;
+
+struct CommandOptions
+{
+    /* Requests sent before their responses arrive, 1 is lock-step */
+    size_t window;
+    std::chrono::milliseconds timeout;
+    size_t retries;
+    /* A response line matching this completes a request */
+    std::string responsePattern;
+    /* The request failed if that line also matches this; empty never fails */
+    std::string errorPattern;
+    /* Give every request a tag (replacing "{tag}" in the command, or put in
+     * front of it) and match response lines to requests by their first word,
+     * so the device may answer out of order */
+    bool tagged;
+};
+
+enum class CommandStatus {
+    Ok,
+    Error,
+    Timeout,
+    NotSent
+};
+
+struct CommandResult
+{
+    size_t index;
+    std::string command;
+    CommandStatus status;
+    size_t attempts;
+    /* From the last attempt being sent to its final response line */
+    std::chrono::nanoseconds roundTrip;
+    /* Every line of the response, joined with " | " */
+    std::string response;
+};
+
+/* Runs a list of request/response commands on one session, on the session's
+ * loop thread, keeping up to window requests in flight instead of waiting
+ * for each response before sending the next command. Lines come from the
+ * session's line framing; untagged responses belong to the oldest request
+ * in flight, which is what strictly ordered devices (AT, SCPI) produce.
+ * Echoed commands are skipped. One timer, re-armed to the oldest deadline,
+ * handles every request's timeout; a request that times out is sent again
+ * at the back of the window until its retries run out */
+class CommandEngine
+{
+public:
+    using ResultHandler = std::function<void(SerialSession &, const CommandResult &)>;
+    using FinishedHandler = std::function<void(CommandEngine &)>;
+
+    CommandEngine(SerialSession &serialSession, const std::vector<std::string> &commands, const CommandOptions &commandOptions);
+    ~CommandEngine();
+    CommandEngine(const CommandEngine &) = delete;
+    CommandEngine(CommandEngine &&) = delete;
+    CommandEngine &operator=(const CommandEngine &) = delete;
+    CommandEngine &operator=(CommandEngine &&) = delete;
+
+    void setResultHandler(const ResultHandler &resultHandler);
+    void setFinishedHandler(const FinishedHandler &finishedHandler);
+
+    void start();
+    void handleLine(const char *line, size_t length);
+
+    bool isFinished() const;
+    size_t failedCount() const;
+
+    /* One command per line, skipping blank lines and lines starting with # */
+    static std::vector<std::string> loadScript(const std::string &path);
+    static const char *statusName(CommandStatus status);
+
+    static const char *DEFAULT_RESPONSE_PATTERN;
+    static const char *DEFAULT_ERROR_PATTERN;
+
+private:
+    struct Request
+    {
+        size_t index;
+        std::string command;
+        std::string tag;
+        size_t attempts;
+        std::chrono::steady_clock::time_point sentTime;
+        std::chrono::steady_clock::time_point deadline;
+        std::string response;
+    };
+
+    SerialSession &m_serialSession;
+    std::vector<std::string> m_commands;
+    CommandOptions m_commandOptions;
+    std::regex m_responsePattern;
+    std::regex m_errorPattern;
+    ResultHandler m_resultHandler;
+    FinishedHandler m_finishedHandler;
+    std::deque<Request> m_inFlight;
+    size_t m_nextCommand;
+    int m_timeoutTimer;
+    bool m_started;
+    bool m_finished;
+    size_t m_completedCount;
+    size_t m_failedCount;
+    std::chrono::steady_clock::time_point m_startTime;
+    MetricHistogram m_roundTripMetric;
+
+    void fillWindow();
+    void send(Request &request);
+    void complete(std::deque<Request>::iterator request, CommandStatus status);
+    void onTimeout();
+    void rearmTimeout();
+    void finishIfDone();
+};
+
+#endif //SERIALCOMMUNICATION_COMMANDENGINE_H
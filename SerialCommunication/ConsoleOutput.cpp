@@ -0,0 +1,137 @@
+#include "ConsoleOutput.h"
+#include "ApplicationUtilities.h"
+#include "GlobalDefinitions.h"
+
+using namespace TMessageLogger;
+
+const size_t ConsoleOutput::DEFAULT_QUEUE_LIMIT;
+
+ConsoleOutput::ConsoleOutput(int fileDescriptor, size_t queueLimit) :
+    m_fileDescriptor{fileDescriptor},
+    m_queueLimit{queueLimit},
+    m_mutex{},
+    m_condition{},
+    m_queue{""},
+    m_writingBytes{0},
+    m_running{false},
+    m_dropping{false},
+    m_droppedBytes{0},
+    m_droppedBytesMetric{MetricsRegistry::instance().counter("console.dropped_bytes")},
+    m_writerThread{}
+{
+
+}
+
+ConsoleOutput::~ConsoleOutput()
+{
+    this->stop();
+}
+
+void ConsoleOutput::start()
+{
+    std::lock_guard<std::mutex> queueLock{this->m_mutex};
+    if (this->m_running) {
+        return;
+    }
+    this->m_running = true;
+    this->m_writerThread = std::thread{[this]() { this->runWriter(); }};
+}
+
+void ConsoleOutput::stop()
+{
+    {
+        std::lock_guard<std::mutex> queueLock{this->m_mutex};
+        this->m_running = false;
+    }
+    this->m_condition.notify_one();
+    if (this->m_writerThread.joinable()) {
+        this->m_writerThread.join();
+    }
+}
+
+void ConsoleOutput::write(const char *data, size_t length)
+{
+    std::unique_lock<std::mutex> queueLock{this->m_mutex};
+    if (!this->m_running) {
+        queueLock.unlock();
+        ApplicationUtilities::writeAll(this->m_fileDescriptor, data, length);
+        return;
+    }
+    if (this->m_queue.size() + this->m_writingBytes + length > this->m_queueLimit) {
+        bool firstDrop{!this->m_dropping};
+        this->m_dropping = true;
+        queueLock.unlock();
+        this->m_droppedBytes.fetch_add(length, std::memory_order_relaxed);
+        this->m_droppedBytesMetric.add(length);
+        if (firstDrop) {
+            LOG_WARN() << "The console is not keeping up, dropping output";
+        }
+        return;
+    }
+    bool wasEmpty{this->m_queue.empty()};
+    this->m_queue.append(data, length);
+    queueLock.unlock();
+    if (wasEmpty) {
+        this->m_condition.notify_one();
+    }
+}
+
+uint64_t ConsoleOutput::droppedBytes() const
+{
+    return this->m_droppedBytes.load(std::memory_order_relaxed);
+}
+
+void ConsoleOutput::runWriter()
+{
+    /* Swapping keeps both strings' storage, so steady output does not allocate */
+    std::string batch{""};
+    std::unique_lock<std::mutex> queueLock{this->m_mutex};
+    while (true) {
+        this->m_condition.wait(queueLock, [this]() {
+            return (!this->m_queue.empty()) || (!this->m_running);
+        });
+        if (this->m_queue.empty()) {
+            return;
+        }
+        batch.swap(this->m_queue);
+        this->m_writingBytes = batch.size();
+        queueLock.unlock();
+        ApplicationUtilities::writeAll(this->m_fileDescriptor, batch.data(), batch.size());
+        batch.clear();
+        queueLock.lock();
+        this->m_writingBytes = 0;
+        if ( (this->m_dropping) && (this->m_queue.empty()) ) {
+            this->m_dropping = false;
+            uint64_t droppedBytes{this->droppedBytes()};
+            queueLock.unlock();
+            LOG_INFO() << TStringFormat("The console caught up, {0} bytes of output dropped so far", droppedBytes);
+            queueLock.lock();
+        }
+    }
+}
+
+void ConsoleOutput::appendLine(std::string &output, const std::string &portName, uint64_t receiveTimestamp, bool withTimestamp, const char *line, size_t length)
+{
+    if (withTimestamp) {
+        appendTimestamp(output, receiveTimestamp);
+    }
+    output.append(portName);
+    output.append(": ");
+    output.append(line, length);
+    output.push_back('\n');
+}
+
+void ConsoleOutput::appendTimestamp(std::string &output, uint64_t nanoseconds)
+{
+    char fraction[9];
+    uint64_t remainder{nanoseconds % 1000000000ULL};
+    for (int i = 8; i >= 0; i--) {
+        fraction[i] = static_cast<char>('0' + (remainder % 10));
+        remainder /= 10;
+    }
+    output.push_back('[');
+    output.append(std::to_string(nanoseconds / 1000000000ULL));
+    output.push_back('.');
+    output.append(fraction, sizeof(fraction));
+    output.append("] ");
+}
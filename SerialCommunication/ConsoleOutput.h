@@ -0,0 +1,64 @@
+#ifndef SERIALCOMMUNICATION_CONSOLEOUTPUT_H
+#define SERIALCOMMUNICATION_CONSOLEOUTPUT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "MetricsRegistry.h"
+
+/* What the ports print, written to the console off their worker threads.
+ * write() copies a whole record (a line, a frame, a dump) into a bounded
+ * queue and returns at once; one writer thread empties the queue with
+ * ordinary blocking writes, so a slow reader of the console (a pager, a
+ * stalled pipe) only ever holds up that thread and never a port's loop.
+ * A record that does not fit is dropped whole and counted in
+ * console.dropped_bytes. Before start() and after stop() write() writes
+ * straight through. Safe to write from several threads */
+class ConsoleOutput
+{
+public:
+    explicit ConsoleOutput(int fileDescriptor, size_t queueLimit = DEFAULT_QUEUE_LIMIT);
+    ~ConsoleOutput();
+    ConsoleOutput(const ConsoleOutput &) = delete;
+    ConsoleOutput(ConsoleOutput &&) = delete;
+    ConsoleOutput &operator=(const ConsoleOutput &) = delete;
+    ConsoleOutput &operator=(ConsoleOutput &&) = delete;
+
+    void start();
+    /* Writes out what is still queued, then stops the writer thread */
+    void stop();
+    void write(const char *data, size_t length);
+
+    uint64_t droppedBytes() const;
+
+    /* Appends a received line the way the console shows it: the read's
+     * time if withTimestamp, the port name, the line and a newline */
+    static void appendLine(std::string &output, const std::string &portName, uint64_t receiveTimestamp, bool withTimestamp, const char *line, size_t length);
+    /* [seconds.nanoseconds] of CLOCK_MONOTONIC, as in capture files */
+    static void appendTimestamp(std::string &output, uint64_t nanoseconds);
+
+    static const size_t DEFAULT_QUEUE_LIMIT{16 * 1024 * 1024};
+
+private:
+    int m_fileDescriptor;
+    size_t m_queueLimit;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::string m_queue;
+    /* Taken off the queue and being written, still counted against the limit */
+    size_t m_writingBytes;
+    bool m_running;
+    bool m_dropping;
+    std::atomic<uint64_t> m_droppedBytes;
+    MetricCounter m_droppedBytesMetric;
+    std::thread m_writerThread;
+
+    void runWriter();
+};
+
+#endif //SERIALCOMMUNICATION_CONSOLEOUTPUT_H
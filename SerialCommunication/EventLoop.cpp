@@ -0,0 +1,204 @@
+#include "EventLoop.h"
+#include "MessageLogger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+EventLoop::EventLoop() :
+    m_epollDescriptor{epoll_create1(EPOLL_CLOEXEC)},
+    m_wakeDescriptor{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+    m_stopRequested{false},
+    m_registrations{},
+    m_retiredRegistrations{},
+    m_taskMutex{},
+    m_pendingTasks{},
+    m_runningTasks{}
+{
+    if ( (this->m_epollDescriptor == -1) || (this->m_wakeDescriptor == -1) ) {
+        throw std::runtime_error(TStringFormat("Unable to create event loop ({0})", strerror(errno)));
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = this->m_wakeDescriptor;
+    if (epoll_ctl(this->m_epollDescriptor, EPOLL_CTL_ADD, this->m_wakeDescriptor, &event) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to register event loop wake descriptor ({0})", strerror(errno)));
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    close(this->m_wakeDescriptor);
+    close(this->m_epollDescriptor);
+}
+
+void EventLoop::addDescriptor(int fileDescriptor, uint32_t events, const EventHandler &handler)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fileDescriptor;
+    if (epoll_ctl(this->m_epollDescriptor, EPOLL_CTL_ADD, fileDescriptor, &event) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to add descriptor {0} to event loop ({1})", fileDescriptor, strerror(errno)));
+    }
+    std::unique_ptr<Registration> registration{new Registration{handler}};
+    this->m_registrations[fileDescriptor] = std::move(registration);
+}
+
+void EventLoop::modifyDescriptor(int fileDescriptor, uint32_t events)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fileDescriptor;
+    if (epoll_ctl(this->m_epollDescriptor, EPOLL_CTL_MOD, fileDescriptor, &event) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to modify descriptor {0} in event loop ({1})", fileDescriptor, strerror(errno)));
+    }
+}
+
+void EventLoop::removeDescriptor(int fileDescriptor)
+{
+    auto found = this->m_registrations.find(fileDescriptor);
+    if (found == this->m_registrations.end()) {
+        return;
+    }
+    epoll_ctl(this->m_epollDescriptor, EPOLL_CTL_DEL, fileDescriptor, nullptr);
+    /* The handler may be the one currently executing, so it is only
+     * destroyed once the current batch of events has been dispatched */
+    this->m_retiredRegistrations.push_back(std::move(found->second));
+    this->m_registrations.erase(found);
+}
+
+int EventLoop::addTimer(std::chrono::nanoseconds interval, const TimerHandler &handler, bool repeating)
+{
+    int timerDescriptor{timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)};
+    if (timerDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to create timer ({0})", strerror(errno)));
+    }
+    itimerspec timerSpec{};
+    timerSpec.it_value.tv_sec = static_cast<time_t>(interval.count() / 1000000000);
+    timerSpec.it_value.tv_nsec = static_cast<long>(interval.count() % 1000000000);
+    if ( (timerSpec.it_value.tv_sec == 0) && (timerSpec.it_value.tv_nsec == 0) ) {
+        timerSpec.it_value.tv_nsec = 1;
+    }
+    if (repeating) {
+        timerSpec.it_interval = timerSpec.it_value;
+    }
+    if (timerfd_settime(timerDescriptor, 0, &timerSpec, nullptr) == -1) {
+        close(timerDescriptor);
+        throw std::runtime_error(TStringFormat("Unable to arm timer ({0})", strerror(errno)));
+    }
+    this->addDescriptor(timerDescriptor, EPOLLIN, [timerDescriptor, handler](uint32_t) {
+        uint64_t expirations{0};
+        if (read(timerDescriptor, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            handler();
+        }
+    });
+    return timerDescriptor;
+}
+
+void EventLoop::rearmTimer(int timerDescriptor, std::chrono::steady_clock::time_point deadline)
+{
+    /* steady_clock is CLOCK_MONOTONIC, the clock the timers are created on */
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    itimerspec timerSpec{};
+    timerSpec.it_value.tv_sec = static_cast<time_t>(sinceEpoch / 1000000000);
+    timerSpec.it_value.tv_nsec = static_cast<long>(sinceEpoch % 1000000000);
+    if ( (timerSpec.it_value.tv_sec == 0) && (timerSpec.it_value.tv_nsec == 0) ) {
+        timerSpec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &timerSpec, nullptr) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to arm timer ({0})", strerror(errno)));
+    }
+}
+
+void EventLoop::removeTimer(int timerDescriptor)
+{
+    this->removeDescriptor(timerDescriptor);
+    close(timerDescriptor);
+}
+
+void EventLoop::post(const Task &task)
+{
+    {
+        std::lock_guard<std::mutex> taskLock{this->m_taskMutex};
+        this->m_pendingTasks.push_back(task);
+    }
+    this->wakeUp();
+}
+
+void EventLoop::wakeUp()
+{
+    uint64_t increment{1};
+    ssize_t writeResult{write(this->m_wakeDescriptor, &increment, sizeof(increment))};
+    (void)writeResult;
+}
+
+void EventLoop::stop()
+{
+    this->m_stopRequested.store(true);
+    this->wakeUp();
+}
+
+bool EventLoop::isStopRequested() const
+{
+    return this->m_stopRequested.load();
+}
+
+void EventLoop::run()
+{
+    epoll_event events[MAXIMUM_EVENTS_PER_WAIT];
+    while (!this->m_stopRequested.load()) {
+        int eventCount{epoll_wait(this->m_epollDescriptor, events, MAXIMUM_EVENTS_PER_WAIT, -1)};
+        if (eventCount == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(TStringFormat("Event loop wait failed ({0})", strerror(errno)));
+        }
+        for (int i = 0; i < eventCount; i++) {
+            int fileDescriptor{events[i].data.fd};
+            if (fileDescriptor == this->m_wakeDescriptor) {
+                this->drainWakeDescriptor();
+                this->runPendingTasks();
+                continue;
+            }
+            /* Look the handler up again for each event, because an earlier
+             * handler in this batch may have removed the descriptor */
+            auto found = this->m_registrations.find(fileDescriptor);
+            if (found != this->m_registrations.end()) {
+                Registration *registration{found->second.get()};
+                registration->handler(events[i].events);
+            }
+        }
+        this->m_retiredRegistrations.clear();
+    }
+    this->runPendingTasks();
+    this->m_retiredRegistrations.clear();
+}
+
+void EventLoop::drainWakeDescriptor()
+{
+    uint64_t counter{0};
+    ssize_t readResult{read(this->m_wakeDescriptor, &counter, sizeof(counter))};
+    (void)readResult;
+}
+
+void EventLoop::runPendingTasks()
+{
+    {
+        std::lock_guard<std::mutex> taskLock{this->m_taskMutex};
+        if (this->m_pendingTasks.empty()) {
+            return;
+        }
+        this->m_runningTasks.swap(this->m_pendingTasks);
+    }
+    for (auto &task : this->m_runningTasks) {
+        task();
+    }
+    this->m_runningTasks.clear();
+}
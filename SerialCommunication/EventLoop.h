@@ -0,0 +1,69 @@
+#ifndef SERIALCOMMUNICATION_EVENTLOOP_H
+#define SERIALCOMMUNICATION_EVENTLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/* Single-threaded epoll reactor. Every descriptor registered on a loop is
+ * serviced by the thread that calls run(), so handlers never need locks.
+ * post(), stop() and wakeUp() are the only members that may be called from
+ * other threads (stop() and wakeUp() are also async-signal-safe) */
+class EventLoop
+{
+public:
+    using EventHandler = std::function<void(uint32_t)>;
+    using TimerHandler = std::function<void()>;
+    using Task = std::function<void()>;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop(EventLoop &&) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+    EventLoop &operator=(EventLoop &&) = delete;
+
+    void addDescriptor(int fileDescriptor, uint32_t events, const EventHandler &handler);
+    void modifyDescriptor(int fileDescriptor, uint32_t events);
+    void removeDescriptor(int fileDescriptor);
+
+    int addTimer(std::chrono::nanoseconds interval, const TimerHandler &handler, bool repeating = true);
+    /* Makes a timer from addTimer() fire once at deadline instead; a series
+     * of deadlines computed from one start time does not drift the way
+     * chained intervals do */
+    void rearmTimer(int timerDescriptor, std::chrono::steady_clock::time_point deadline);
+    void removeTimer(int timerDescriptor);
+
+    void post(const Task &task);
+    void wakeUp();
+    void run();
+    void stop();
+    bool isStopRequested() const;
+
+private:
+    struct Registration
+    {
+        EventHandler handler;
+    };
+
+    int m_epollDescriptor;
+    int m_wakeDescriptor;
+    std::atomic<bool> m_stopRequested;
+    std::unordered_map<int, std::unique_ptr<Registration>> m_registrations;
+    std::vector<std::unique_ptr<Registration>> m_retiredRegistrations;
+    std::mutex m_taskMutex;
+    std::vector<Task> m_pendingTasks;
+    std::vector<Task> m_runningTasks;
+
+    void drainWakeDescriptor();
+    void runPendingTasks();
+
+    static const int MAXIMUM_EVENTS_PER_WAIT{64};
+};
+
+#endif //SERIALCOMMUNICATION_EVENTLOOP_H
@@ -0,0 +1,135 @@
+#include "FramingCodec.h"
+#include "CobsCodec.h"
+#include "LengthPrefixCodec.h"
+#include "LineFramer.h"
+#include "MessageLogger.h"
+#include "SlipCodec.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace TMessageLogger;
+
+const size_t FramingCodec::MAXIMUM_FRAME_LENGTH;
+
+namespace {
+
+/* Text lines on the port's line ending, the framing the tool always had */
+class LineCodec : public FramingCodec
+{
+public:
+    explicit LineCodec(const std::string &lineEnding) :
+        FramingCodec{},
+        m_lineFramer{lineEnding}
+    {
+        this->m_lineFramer.setLineHandler([this](const char *line, size_t length) {
+            this->emitFrame(line, length);
+        });
+    }
+
+    void decode(char *data, size_t length) override
+    {
+        this->m_lineFramer.feed(data, length);
+    }
+
+    void flush() override
+    {
+        this->m_lineFramer.flush();
+    }
+
+    size_t maximumEncodedLength(size_t payloadLength) const override
+    {
+        return payloadLength + this->m_lineFramer.delimiter().size();
+    }
+
+    size_t encode(const char *payload, size_t length, char *destination) const override
+    {
+        const std::string &delimiter = this->m_lineFramer.delimiter();
+        memcpy(destination, payload, length);
+        memcpy(destination + length, delimiter.data(), delimiter.size());
+        return length + delimiter.size();
+    }
+
+    std::string name() const override
+    {
+        return "line";
+    }
+
+    bool isBinary() const override
+    {
+        return false;
+    }
+
+private:
+    LineFramer m_lineFramer;
+};
+
+} //Global namespace
+
+FramingCodec::FramingCodec() :
+    m_frameHandler{},
+    m_frameCount{0},
+    m_errorCount{0}
+{
+
+}
+
+void FramingCodec::setFrameHandler(const FrameHandler &frameHandler)
+{
+    this->m_frameHandler = frameHandler;
+}
+
+void FramingCodec::flush()
+{
+
+}
+
+bool FramingCodec::isBinary() const
+{
+    return true;
+}
+
+uint64_t FramingCodec::frameCount() const
+{
+    return this->m_frameCount;
+}
+
+uint64_t FramingCodec::errorCount() const
+{
+    return this->m_errorCount;
+}
+
+void FramingCodec::emitFrame(const char *data, size_t length)
+{
+    this->m_frameCount++;
+    if (this->m_frameHandler) {
+        this->m_frameHandler(data, length);
+    }
+}
+
+void FramingCodec::countError()
+{
+    this->m_errorCount++;
+}
+
+std::unique_ptr<FramingCodec> FramingCodec::create(const std::string &specification, const std::string &lineEnding)
+{
+    if (specification == "line") {
+        return std::unique_ptr<FramingCodec>{new LineCodec{lineEnding}};
+    } else if (specification == "cobs") {
+        return std::unique_ptr<FramingCodec>{new CobsCodec{}};
+    } else if (specification == "slip") {
+        return std::unique_ptr<FramingCodec>{new SlipCodec{}};
+    } else if (specification == "length:u8") {
+        return std::unique_ptr<FramingCodec>{new LengthPrefixCodec{1, false}};
+    } else if (specification == "length:u16le") {
+        return std::unique_ptr<FramingCodec>{new LengthPrefixCodec{2, false}};
+    } else if (specification == "length:u16be") {
+        return std::unique_ptr<FramingCodec>{new LengthPrefixCodec{2, true}};
+    } else if (specification == "length:u32le") {
+        return std::unique_ptr<FramingCodec>{new LengthPrefixCodec{4, false}};
+    } else if (specification == "length:u32be") {
+        return std::unique_ptr<FramingCodec>{new LengthPrefixCodec{4, true}};
+    }
+    throw std::runtime_error(TStringFormat("Unknown framing {0} (expected line, cobs, slip or length:<u8|u16le|u16be|u32le|u32be>)", specification));
+}
@@ -0,0 +1,58 @@
+#ifndef SERIALCOMMUNICATION_FRAMINGCODEC_H
+#define SERIALCOMMUNICATION_FRAMINGCODEC_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/* Turns a byte stream into frames and frames into bytes. decode() takes
+ * reads of any size, keeps whatever state a frame split across reads needs,
+ * and hands every complete frame to the FrameHandler. A frame that lies
+ * entirely inside one read is handed over as a view into that read's buffer
+ * (codecs that unescape do so in place, which is why decode() takes a
+ * mutable buffer); only frames spanning reads are assembled in a buffer of
+ * the codec's own. encode() writes a complete frame, delimiters included,
+ * into a caller supplied buffer of at least maximumEncodedLength() bytes, so
+ * it can go straight into a channel's write queue */
+class FramingCodec
+{
+public:
+    using FrameHandler = std::function<void(const char *, size_t)>;
+
+    virtual ~FramingCodec() = default;
+
+    void setFrameHandler(const FrameHandler &frameHandler);
+
+    virtual void decode(char *data, size_t length) = 0;
+    /* Hands over a frame still in progress, where that makes sense */
+    virtual void flush();
+
+    virtual size_t maximumEncodedLength(size_t payloadLength) const = 0;
+    virtual size_t encode(const char *payload, size_t length, char *destination) const = 0;
+
+    virtual std::string name() const = 0;
+    virtual bool isBinary() const;
+
+    uint64_t frameCount() const;
+    uint64_t errorCount() const;
+
+    /* line, cobs, slip or length:<u8|u16le|u16be|u32le|u32be> */
+    static std::unique_ptr<FramingCodec> create(const std::string &specification, const std::string &lineEnding);
+
+protected:
+    FramingCodec();
+
+    void emitFrame(const char *data, size_t length);
+    void countError();
+
+    /* Largest frame assembled across reads before it is discarded as an error */
+    static const size_t MAXIMUM_FRAME_LENGTH{1024 * 1024};
+
+private:
+    FrameHandler m_frameHandler;
+    uint64_t m_frameCount;
+    uint64_t m_errorCount;
+};
+
+#endif //SERIALCOMMUNICATION_FRAMINGCODEC_H
@@ -30,19 +30,44 @@ const char *COMPILER_NAME{"msvc"};
     #endif
 
 
+/* Log statements below MINIMUM_LOG_LEVEL (0 = Debug, 1 = Info, 2 = Warn)
+ * are compiled out; the constant condition lets the compiler drop them.
+ * Above it, the runtime threshold of the statement's subsystem is checked
+ * before the message is created, so the arguments of a disabled statement
+ * are never evaluated. The optional macro argument selects the subsystem,
+ * for example LOG_DEBUG(SERIAL_LOG_SUBSYSTEM) << ... */
+#ifndef MINIMUM_LOG_LEVEL
+#    define MINIMUM_LOG_LEVEL 0
+#endif //MINIMUM_LOG_LEVEL
+
+#ifndef LOG_AT_LEVEL
+#    define LOG_AT_LEVEL(level, subsystem) \
+        if ( (static_cast<int>(level) < MINIMUM_LOG_LEVEL) || (!TMessageLogger::MessageLogger::isEnabled(level, TMessageLogger::logSubsystem(subsystem))) ) { } \
+        else LogMessage::createInstance(level, __FILE__, __LINE__, __func__)
+#endif //LOG_AT_LEVEL
+
 #ifndef LOG_DEBUG
-#    define LOG_DEBUG(x) logMessage::createInstance(LogLevel::Debug, __FILE__, __LINE__, __func__)
-#endif //LOG_FATAL
+#    define LOG_DEBUG(x) LOG_AT_LEVEL(LogLevel::Debug, x)
+#endif //LOG_DEBUG
 #ifndef LOG_WARN
-#    define LOG_WARN(x) LogMessage::createInstance(LogLevel::Debug, __FILE__, __LINE__, __func__)
+#    define LOG_WARN(x) LOG_AT_LEVEL(LogLevel::Warn, x)
 #endif //LOG_WARN
 #ifndef LOG_INFO
-#    define LOG_INFO(x) LogMessage::createInstance(LogLevel::Info, __FILE__, __LINE__, __func__)
+#    define LOG_INFO(x) LOG_AT_LEVEL(LogLevel::Info, x)
 #endif //LOG_INFO
 #ifndef LOG_FATAL
 #    define LOG_FATAL(x) LogMessage::createInstance(LogLevel::Fatal, __FILE__, __LINE__, __func__)
 #endif //LOG_FATAL
 
+/* Subsystems for LOG_* statements, named in registerLogSubsystems() */
+const TMessageLogger::LogSubsystem GENERAL_LOG_SUBSYSTEM{TMessageLogger::DEFAULT_LOG_SUBSYSTEM};
+const TMessageLogger::LogSubsystem SESSION_LOG_SUBSYSTEM{1};
+const TMessageLogger::LogSubsystem SERIAL_LOG_SUBSYSTEM{2};
+const TMessageLogger::LogSubsystem LOGGING_LOG_SUBSYSTEM{3};
+const TMessageLogger::LogSubsystem CAPTURE_LOG_SUBSYSTEM{4};
+const TMessageLogger::LogSubsystem METRICS_LOG_SUBSYSTEM{5};
+const TMessageLogger::LogSubsystem TRIGGER_LOG_SUBSYSTEM{6};
+
 #ifndef STRING_TO_INT
 #    if defined(__ANDROID__)
 #        define STRING_TO_INT(x) std::atoi(x.c_str())
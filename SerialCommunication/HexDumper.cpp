@@ -0,0 +1,224 @@
+#include "HexDumper.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define HEXDUMPER_X86 1
+#    include <immintrin.h>
+#endif
+
+using namespace TMessageLogger;
+
+const size_t HexDumper::BYTES_PER_ROW;
+
+/* A row is the offset, two spaces, 16 "xx " groups with an extra space
+ * after the eighth, then " |", the ASCII column and "|\n" */
+static const size_t HEX_COLUMN_LENGTH{HexDumper::BYTES_PER_ROW * 3 + 1};
+static const size_t ROW_LENGTH_WITHOUT_OFFSET{2 + HEX_COLUMN_LENGTH + 2 + HexDumper::BYTES_PER_ROW + 2};
+static const char HEX_DIGITS[]{"0123456789abcdef"};
+
+namespace {
+
+inline size_t offsetDigits(bool wideOffset)
+{
+    return wideOffset ? 16 : 8;
+}
+
+char *renderOffset(char *output, uint64_t offset, size_t digits)
+{
+    for (size_t i = digits; i > 0; i--) {
+        output[i - 1] = HEX_DIGITS[offset & 0x0F];
+        offset >>= 4;
+    }
+    return output + digits;
+}
+
+/* Also renders the short last row of a dump, padding the hex column so the
+ * ASCII column stays aligned */
+char *renderPartialRow(char *output, const unsigned char *bytes, size_t count, uint64_t offset, bool wideOffset)
+{
+    output = renderOffset(output, offset, offsetDigits(wideOffset));
+    *output++ = ' ';
+    *output++ = ' ';
+    for (size_t i = 0; i < HexDumper::BYTES_PER_ROW; i++) {
+        if (i == HexDumper::BYTES_PER_ROW / 2) {
+            *output++ = ' ';
+        }
+        if (i < count) {
+            *output++ = HEX_DIGITS[bytes[i] >> 4];
+            *output++ = HEX_DIGITS[bytes[i] & 0x0F];
+        } else {
+            *output++ = ' ';
+            *output++ = ' ';
+        }
+        *output++ = ' ';
+    }
+    *output++ = ' ';
+    *output++ = '|';
+    for (size_t i = 0; i < count; i++) {
+        *output++ = ( (bytes[i] >= 0x20) && (bytes[i] < 0x7F) ) ? static_cast<char>(bytes[i]) : '.';
+    }
+    *output++ = '|';
+    *output++ = '\n';
+    return output;
+}
+
+char *renderRowScalar(char *output, const unsigned char *bytes, uint64_t offset, bool wideOffset)
+{
+    return renderPartialRow(output, bytes, HexDumper::BYTES_PER_ROW, offset, wideOffset);
+}
+
+#if defined(HEXDUMPER_X86)
+
+/* Spreads the 16 bytes of value over 32 hex digits, first holding the
+ * digits of bytes 0-7 and second those of bytes 8-15 */
+__attribute__((target("ssse3")))
+inline void expandNibbles(__m128i value, __m128i &first, __m128i &second)
+{
+    const __m128i digits{_mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f')};
+    const __m128i nibbleMask{_mm_set1_epi8(0x0F)};
+    __m128i highDigits{_mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(value, 4), nibbleMask))};
+    __m128i lowDigits{_mm_shuffle_epi8(digits, _mm_and_si128(value, nibbleMask))};
+    first = _mm_unpacklo_epi8(highDigits, lowDigits);
+    second = _mm_unpackhi_epi8(highDigits, lowDigits);
+}
+
+/* The hex column is stored as three 16 byte blocks. Shuffle indices with
+ * the top bit set produce zero, which the OR with the separator block turns
+ * into a space; the second block straddles both halves of the row */
+__attribute__((target("ssse3")))
+char *renderRowSsse3(char *output, const unsigned char *bytes, uint64_t offset, bool wideOffset)
+{
+    const char Z{static_cast<char>(0x80)};
+    const __m128i firstBlockIndices{_mm_setr_epi8(0, 1, Z, 2, 3, Z, 4, 5, Z, 6, 7, Z, 8, 9, Z, 10)};
+    const __m128i firstBlockSpaces{_mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0)};
+    const __m128i secondBlockLowIndices{_mm_setr_epi8(11, Z, 12, 13, Z, 14, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z)};
+    const __m128i secondBlockHighIndices{_mm_setr_epi8(Z, Z, Z, Z, Z, Z, Z, Z, Z, 0, 1, Z, 2, 3, Z, 4)};
+    const __m128i secondBlockSpaces{_mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', ' ', 0, 0, ' ', 0, 0, ' ', 0)};
+    const __m128i thirdBlockIndices{_mm_setr_epi8(5, Z, 6, 7, Z, 8, 9, Z, 10, 11, Z, 12, 13, Z, 14, 15)};
+    const __m128i thirdBlockSpaces{_mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0)};
+
+    /* Byte swapped, the offset's hex digits come out most significant first */
+    uint64_t swappedOffset{__builtin_bswap64(offset)};
+    __m128i offsetLow{};
+    __m128i offsetHigh{};
+    expandNibbles(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&swappedOffset)), offsetLow, offsetHigh);
+    if (wideOffset) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output), offsetLow);
+        output += 16;
+    } else {
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(output), _mm_srli_si128(offsetLow, 8));
+        output += 8;
+    }
+    memcpy(output, "  ", 2);
+    output += 2;
+
+    __m128i value{_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes))};
+    __m128i first{};
+    __m128i second{};
+    expandNibbles(value, first, second);
+    __m128i firstBlock{_mm_or_si128(_mm_shuffle_epi8(first, firstBlockIndices), firstBlockSpaces)};
+    __m128i secondBlock{_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(first, secondBlockLowIndices), _mm_shuffle_epi8(second, secondBlockHighIndices)), secondBlockSpaces)};
+    __m128i thirdBlock{_mm_or_si128(_mm_shuffle_epi8(second, thirdBlockIndices), thirdBlockSpaces)};
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), firstBlock);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 16), secondBlock);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 32), thirdBlock);
+    memcpy(output + 48, "  |", 3);
+    output += 51;
+
+    /* Signed compares, so bytes from 0x80 up count as unprintable too */
+    __m128i printable{_mm_and_si128(_mm_cmpgt_epi8(value, _mm_set1_epi8(0x1F)), _mm_cmplt_epi8(value, _mm_set1_epi8(0x7F)))};
+    __m128i ascii{_mm_or_si128(_mm_and_si128(printable, value), _mm_andnot_si128(printable, _mm_set1_epi8('.')))};
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), ascii);
+    memcpy(output + 16, "|\n", 2);
+    return output + 18;
+}
+
+#endif
+
+} //Global namespace
+
+HexDumper::HexDumper(InstructionSet instructionSet) :
+    m_instructionSet{instructionSet},
+    m_rowRenderer{renderRowScalar},
+    m_text{}
+{
+    if (this->m_instructionSet == InstructionSet::Best) {
+        this->m_instructionSet = isSupported(InstructionSet::Ssse3) ? InstructionSet::Ssse3 : InstructionSet::Scalar;
+    }
+    if (!isSupported(this->m_instructionSet)) {
+        throw std::runtime_error(TStringFormat("{0} is not supported on this CPU", instructionSetName(this->m_instructionSet)));
+    }
+#if defined(HEXDUMPER_X86)
+    if (this->m_instructionSet == InstructionSet::Ssse3) {
+        this->m_rowRenderer = renderRowSsse3;
+    }
+#endif
+}
+
+size_t HexDumper::dump(const std::string &prefix, uint64_t offset, const char *data, size_t length)
+{
+    if (length == 0) {
+        return 0;
+    }
+    bool wideOffset{offset + (length - 1) > std::numeric_limits<uint32_t>::max()};
+    size_t rowCount{(length + BYTES_PER_ROW - 1) / BYTES_PER_ROW};
+    size_t maximumLength{rowCount * (prefix.size() + offsetDigits(wideOffset) + ROW_LENGTH_WITHOUT_OFFSET)};
+    if (this->m_text.size() < maximumLength) {
+        this->m_text.resize(std::max(maximumLength, this->m_text.size() * 2));
+    }
+    const unsigned char *bytes{reinterpret_cast<const unsigned char *>(data)};
+    char *output{this->m_text.data()};
+    size_t position{0};
+    for (; position + BYTES_PER_ROW <= length; position += BYTES_PER_ROW) {
+        memcpy(output, prefix.data(), prefix.size());
+        output = this->m_rowRenderer(output + prefix.size(), bytes + position, offset + position, wideOffset);
+    }
+    if (position < length) {
+        memcpy(output, prefix.data(), prefix.size());
+        output = renderPartialRow(output + prefix.size(), bytes + position, length - position, offset + position, wideOffset);
+    }
+    return static_cast<size_t>(output - this->m_text.data());
+}
+
+const char *HexDumper::text() const
+{
+    return this->m_text.data();
+}
+
+HexDumper::InstructionSet HexDumper::instructionSet() const
+{
+    return this->m_instructionSet;
+}
+
+bool HexDumper::isSupported(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+        case InstructionSet::Scalar:
+            return true;
+#if defined(HEXDUMPER_X86)
+        case InstructionSet::Ssse3:
+            return __builtin_cpu_supports("ssse3");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *HexDumper::instructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+            return "best";
+        case InstructionSet::Ssse3:
+            return "ssse3";
+        case InstructionSet::Scalar:
+            return "scalar";
+    }
+    return "unknown";
+}
@@ -0,0 +1,56 @@
+#ifndef SERIALCOMMUNICATION_HEXDUMPER_H
+#define SERIALCOMMUNICATION_HEXDUMPER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Renders bytes the way hexdump -C does: one row per BYTES_PER_ROW bytes
+ * with the offset, the bytes in hex in two groups of eight and the
+ * printable ones as ASCII, each row preceded by a caller supplied prefix
+ * (the port name). Full rows are converted with SSSE3 where the CPU has it,
+ * a row at a time: nibbles are turned into digits with one byte shuffle and
+ * moved into place around the separators with another, so nothing goes
+ * through a stream. The text is written into a buffer owned by the dumper
+ * that only ever grows, so a dumper that is reused allocates nothing once
+ * it has seen its largest input */
+class HexDumper
+{
+public:
+    enum class InstructionSet {
+        Best,
+        Ssse3,
+        Scalar
+    };
+
+    explicit HexDumper(InstructionSet instructionSet = InstructionSet::Best);
+    HexDumper(const HexDumper &) = delete;
+    HexDumper(HexDumper &&) = delete;
+    HexDumper &operator=(const HexDumper &) = delete;
+    HexDumper &operator=(HexDumper &&) = delete;
+
+    /* Renders data, whose first byte sits at offset in its stream, replacing
+     * the previous dump; returns the length of text(). Offsets are printed
+     * with 8 digits, or 16 once they no longer fit */
+    size_t dump(const std::string &prefix, uint64_t offset, const char *data, size_t length);
+    /* Valid until the next dump() */
+    const char *text() const;
+
+    InstructionSet instructionSet() const;
+
+    static bool isSupported(InstructionSet instructionSet);
+    static const char *instructionSetName(InstructionSet instructionSet);
+
+    static const size_t BYTES_PER_ROW{16};
+
+private:
+    /* Renders one full row at output and returns the end of it */
+    using RowRenderer = char *(*)(char *output, const unsigned char *bytes, uint64_t offset, bool wideOffset);
+
+    InstructionSet m_instructionSet;
+    RowRenderer m_rowRenderer;
+    std::vector<char> m_text;
+};
+
+#endif //SERIALCOMMUNICATION_HEXDUMPER_H
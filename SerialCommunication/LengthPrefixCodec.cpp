@@ -0,0 +1,115 @@
+#include "LengthPrefixCodec.h"
+#include "MessageLogger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace TMessageLogger;
+
+LengthPrefixCodec::LengthPrefixCodec(size_t prefixLength, bool bigEndian) :
+    FramingCodec{},
+    m_prefixLength{prefixLength},
+    m_bigEndian{bigEndian},
+    m_partialFrame{},
+    m_prefix{},
+    m_prefixBytesRead{0},
+    m_payloadLength{0},
+    m_payloadRemaining{0},
+    m_inPayload{false}
+{
+    if ( (this->m_prefixLength != 1) && (this->m_prefixLength != 2) && (this->m_prefixLength != 4) ) {
+        throw std::runtime_error(TStringFormat("{0} is not a valid length prefix size", this->m_prefixLength));
+    }
+}
+
+void LengthPrefixCodec::decode(char *data, size_t length)
+{
+    const char *input{data};
+    const char *end{data + length};
+    while (input < end) {
+        if (!this->m_inPayload) {
+            this->m_prefix[this->m_prefixBytesRead] = static_cast<unsigned char>(*input++);
+            if (++this->m_prefixBytesRead < this->m_prefixLength) {
+                continue;
+            }
+            this->m_payloadLength = this->prefixValue();
+            if (this->m_payloadLength > MAXIMUM_FRAME_LENGTH) {
+                /* Resynchronise one byte further on */
+                this->countError();
+                memmove(this->m_prefix, this->m_prefix + 1, this->m_prefixLength - 1);
+                this->m_prefixBytesRead--;
+                continue;
+            }
+            if (this->m_payloadLength == 0) {
+                this->emitFrame(input, 0);
+                this->resetFrame();
+                continue;
+            }
+            this->m_payloadRemaining = this->m_payloadLength;
+            this->m_inPayload = true;
+            continue;
+        }
+        size_t available{static_cast<size_t>(end - input)};
+        if ( (this->m_partialFrame.empty()) && (available >= this->m_payloadRemaining) ) {
+            this->emitFrame(input, this->m_payloadRemaining);
+            input += this->m_payloadRemaining;
+            this->resetFrame();
+            continue;
+        }
+        size_t taken{std::min<size_t>(available, this->m_payloadRemaining)};
+        this->m_partialFrame.append(input, taken);
+        input += taken;
+        this->m_payloadRemaining -= static_cast<uint32_t>(taken);
+        if (this->m_payloadRemaining == 0) {
+            this->emitFrame(this->m_partialFrame.data(), this->m_partialFrame.size());
+            this->resetFrame();
+        }
+    }
+}
+
+size_t LengthPrefixCodec::maximumEncodedLength(size_t payloadLength) const
+{
+    return this->m_prefixLength + payloadLength;
+}
+
+size_t LengthPrefixCodec::encode(const char *payload, size_t length, char *destination) const
+{
+    uint64_t maximumPayloadLength{(this->m_prefixLength == 4) ? 0xFFFFFFFFULL : ((1ULL << (8 * this->m_prefixLength)) - 1)};
+    if (length > maximumPayloadLength) {
+        throw std::runtime_error(TStringFormat("A {0} byte frame does not fit a {1} byte length prefix", length, this->m_prefixLength));
+    }
+    for (size_t i = 0; i < this->m_prefixLength; i++) {
+        size_t shift{this->m_bigEndian ? (this->m_prefixLength - 1 - i) * 8 : i * 8};
+        destination[i] = static_cast<char>((length >> shift) & 0xFF);
+    }
+    memcpy(destination + this->m_prefixLength, payload, length);
+    return this->m_prefixLength + length;
+}
+
+std::string LengthPrefixCodec::name() const
+{
+    if (this->m_prefixLength == 1) {
+        return "length:u8";
+    }
+    return TStringFormat("length:u{0}{1}", this->m_prefixLength * 8, this->m_bigEndian ? "be" : "le");
+}
+
+uint32_t LengthPrefixCodec::prefixValue() const
+{
+    uint32_t value{0};
+    for (size_t i = 0; i < this->m_prefixLength; i++) {
+        size_t index{this->m_bigEndian ? i : this->m_prefixLength - 1 - i};
+        value = (value << 8) | this->m_prefix[index];
+    }
+    return value;
+}
+
+void LengthPrefixCodec::resetFrame()
+{
+    this->m_partialFrame.clear();
+    this->m_prefixBytesRead = 0;
+    this->m_payloadLength = 0;
+    this->m_payloadRemaining = 0;
+    this->m_inPayload = false;
+}
@@ -0,0 +1,41 @@
+#ifndef SERIALCOMMUNICATION_LENGTHPREFIXCODEC_H
+#define SERIALCOMMUNICATION_LENGTHPREFIXCODEC_H
+
+#include <cstdint>
+#include <string>
+
+#include "FramingCodec.h"
+
+/* Frames preceded by their payload length as an unsigned 1, 2 or 4 byte
+ * integer of either byte order. Payloads are never transformed, so a frame
+ * inside one read is handed over exactly where it was received. A length
+ * above the maximum frame length cannot be a real prefix, so its first byte
+ * is dropped and the prefix is read again from the next one, which slides
+ * over garbage until a plausible length comes up */
+class LengthPrefixCodec : public FramingCodec
+{
+public:
+    LengthPrefixCodec(size_t prefixLength, bool bigEndian);
+
+    void decode(char *data, size_t length) override;
+
+    size_t maximumEncodedLength(size_t payloadLength) const override;
+    size_t encode(const char *payload, size_t length, char *destination) const override;
+
+    std::string name() const override;
+
+private:
+    size_t m_prefixLength;
+    bool m_bigEndian;
+    std::string m_partialFrame;
+    unsigned char m_prefix[4];
+    size_t m_prefixBytesRead;
+    uint32_t m_payloadLength;
+    uint32_t m_payloadRemaining;
+    bool m_inPayload;
+
+    uint32_t prefixValue() const;
+    void resetFrame();
+};
+
+#endif //SERIALCOMMUNICATION_LENGTHPREFIXCODEC_H
@@ -0,0 +1,275 @@
+#include "LineFramer.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define LINEFRAMER_X86 1
+#    include <immintrin.h>
+#endif
+
+using namespace TMessageLogger;
+
+const size_t LineFramer::DEFAULT_MAXIMUM_LINE_LENGTH;
+
+/* Match offsets gathered per scanner call; the SIMD scanners stop a block
+ * early rather than overrun it, so it has to be well above the 64 bytes they
+ * consume per iteration */
+static const size_t MATCH_POSITION_CAPACITY{1024};
+static const size_t SIMD_BLOCK_SIZE{64};
+
+/* Offsets are stored as uint32_t, so one call never scans further than this */
+static const size_t MAXIMUM_SCAN_LENGTH{std::numeric_limits<uint32_t>::max()};
+
+namespace {
+
+size_t scanScalar(const char *data, size_t length, char byte, uint32_t *positions, size_t maximumPositions, size_t &scannedLength)
+{
+    size_t limit{std::min(length, MAXIMUM_SCAN_LENGTH)};
+    size_t matchCount{0};
+    size_t i{0};
+    for (; (i < limit) && (matchCount < maximumPositions); i++) {
+        if (data[i] == byte) {
+            positions[matchCount++] = static_cast<uint32_t>(i);
+        }
+    }
+    scannedLength = i;
+    return matchCount;
+}
+
+/* Shared by the SIMD scanners: turn a 64 bit match mask for the block at
+ * offset into positions, then finish a short tail one byte at a time */
+inline size_t storeMatches(uint64_t matchMask, size_t offset, uint32_t *positions, size_t matchCount)
+{
+    while (matchMask) {
+        positions[matchCount++] = static_cast<uint32_t>(offset + static_cast<size_t>(__builtin_ctzll(matchMask)));
+        matchMask &= matchMask - 1;
+    }
+    return matchCount;
+}
+
+inline size_t finishScan(const char *data, size_t i, size_t limit, char byte, uint32_t *positions, size_t maximumPositions, size_t matchCount, size_t &scannedLength)
+{
+    if (limit - i < SIMD_BLOCK_SIZE) {
+        for (; (i < limit) && (matchCount < maximumPositions); i++) {
+            if (data[i] == byte) {
+                positions[matchCount++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+    scannedLength = i;
+    return matchCount;
+}
+
+#if defined(LINEFRAMER_X86)
+
+size_t scanSse2(const char *data, size_t length, char byte, uint32_t *positions, size_t maximumPositions, size_t &scannedLength)
+{
+    size_t limit{std::min(length, MAXIMUM_SCAN_LENGTH)};
+    size_t matchCount{0};
+    size_t i{0};
+    const __m128i needle{_mm_set1_epi8(byte)};
+    for (; (i + SIMD_BLOCK_SIZE <= limit) && (matchCount + SIMD_BLOCK_SIZE <= maximumPositions); i += SIMD_BLOCK_SIZE) {
+        const __m128i *block{reinterpret_cast<const __m128i *>(data + i)};
+        uint64_t mask0{static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block), needle)))};
+        uint64_t mask1{static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 1), needle)))};
+        uint64_t mask2{static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 2), needle)))};
+        uint64_t mask3{static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 3), needle)))};
+        matchCount = storeMatches(mask0 | (mask1 << 16) | (mask2 << 32) | (mask3 << 48), i, positions, matchCount);
+    }
+    return finishScan(data, i, limit, byte, positions, maximumPositions, matchCount, scannedLength);
+}
+
+__attribute__((target("avx2")))
+size_t scanAvx2(const char *data, size_t length, char byte, uint32_t *positions, size_t maximumPositions, size_t &scannedLength)
+{
+    size_t limit{std::min(length, MAXIMUM_SCAN_LENGTH)};
+    size_t matchCount{0};
+    size_t i{0};
+    const __m256i needle{_mm256_set1_epi8(byte)};
+    for (; (i + SIMD_BLOCK_SIZE <= limit) && (matchCount + SIMD_BLOCK_SIZE <= maximumPositions); i += SIMD_BLOCK_SIZE) {
+        const __m256i *block{reinterpret_cast<const __m256i *>(data + i)};
+        uint64_t mask0{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block), needle)))};
+        uint64_t mask1{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), needle)))};
+        matchCount = storeMatches(mask0 | (mask1 << 32), i, positions, matchCount);
+    }
+    return finishScan(data, i, limit, byte, positions, maximumPositions, matchCount, scannedLength);
+}
+
+#endif
+
+} //Global namespace
+
+LineFramer::LineFramer(const std::string &delimiter, size_t maximumLineLength, InstructionSet instructionSet) :
+    m_delimiter{delimiter},
+    m_maximumLineLength{maximumLineLength},
+    m_instructionSet{instructionSet},
+    m_matchScanner{scanScalar},
+    m_lineHandler{},
+    m_partialLine{},
+    m_positions(MATCH_POSITION_CAPACITY),
+    m_splitLineCount{0}
+{
+    if (this->m_delimiter.empty()) {
+        throw std::runtime_error("Line framing needs a non-empty delimiter");
+    }
+    if (this->m_maximumLineLength == 0) {
+        throw std::runtime_error("Line framing needs a non-zero maximum line length");
+    }
+    if (this->m_instructionSet == InstructionSet::Best) {
+        this->m_instructionSet = isSupported(InstructionSet::Avx2) ? InstructionSet::Avx2 :
+                                 isSupported(InstructionSet::Sse2) ? InstructionSet::Sse2 : InstructionSet::Scalar;
+    }
+    if (!isSupported(this->m_instructionSet)) {
+        throw std::runtime_error(TStringFormat("{0} is not supported on this CPU", instructionSetName(this->m_instructionSet)));
+    }
+#if defined(LINEFRAMER_X86)
+    if (this->m_instructionSet == InstructionSet::Avx2) {
+        this->m_matchScanner = scanAvx2;
+    } else if (this->m_instructionSet == InstructionSet::Sse2) {
+        this->m_matchScanner = scanSse2;
+    }
+#endif
+    this->m_partialLine.reserve(std::min<size_t>(this->m_maximumLineLength, 4096));
+}
+
+void LineFramer::setLineHandler(const LineHandler &lineHandler)
+{
+    this->m_lineHandler = lineHandler;
+}
+
+void LineFramer::feed(const char *data, size_t length)
+{
+    const char lastDelimiterByte{this->m_delimiter.back()};
+    const size_t delimiterLength{this->m_delimiter.size()};
+    size_t lineStart{0};
+    size_t offset{0};
+    while (offset < length) {
+        size_t scannedLength{0};
+        size_t matchCount{this->m_matchScanner(data + offset, length - offset, lastDelimiterByte, this->m_positions.data(), this->m_positions.size(), scannedLength)};
+        for (size_t i = 0; i < matchCount; i++) {
+            size_t position{offset + this->m_positions[i]};
+            if ( (delimiterLength > 1) && (!this->delimiterEndsAt(data, lineStart, position)) ) {
+                continue;
+            }
+            size_t lineEnd{position + 1};
+            if (this->m_partialLine.empty()) {
+                this->emitLine(data + lineStart, lineEnd - lineStart - delimiterLength);
+            } else {
+                /* Only the first line of a buffer can continue the tail of the
+                 * previous one, and the delimiter may straddle the two */
+                this->m_partialLine.append(data + lineStart, lineEnd - lineStart);
+                this->m_partialLine.resize(this->m_partialLine.size() - delimiterLength);
+                this->emitLine(this->m_partialLine.data(), this->m_partialLine.size());
+                this->m_partialLine.clear();
+            }
+            lineStart = lineEnd;
+        }
+        offset += scannedLength;
+    }
+    if (lineStart < length) {
+        this->appendPartial(data + lineStart, length - lineStart);
+    }
+}
+
+void LineFramer::flush()
+{
+    if (!this->m_partialLine.empty()) {
+        this->emitLine(this->m_partialLine.data(), this->m_partialLine.size());
+        this->m_partialLine.clear();
+    }
+}
+
+size_t LineFramer::pendingBytes() const
+{
+    return this->m_partialLine.size();
+}
+
+uint64_t LineFramer::splitLineCount() const
+{
+    return this->m_splitLineCount;
+}
+
+const std::string &LineFramer::delimiter() const
+{
+    return this->m_delimiter;
+}
+
+LineFramer::InstructionSet LineFramer::instructionSet() const
+{
+    return this->m_instructionSet;
+}
+
+bool LineFramer::isSupported(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+        case InstructionSet::Scalar:
+            return true;
+#if defined(LINEFRAMER_X86)
+        case InstructionSet::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case InstructionSet::Sse2:
+            return __builtin_cpu_supports("sse2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *LineFramer::instructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+            return "best";
+        case InstructionSet::Avx2:
+            return "avx2";
+        case InstructionSet::Sse2:
+            return "sse2";
+        case InstructionSet::Scalar:
+            return "scalar";
+    }
+    return "unknown";
+}
+
+bool LineFramer::delimiterEndsAt(const char *data, size_t lineStart, size_t position) const
+{
+    /* The bytes before position may run back into the buffered tail, which
+     * is only non-empty while lineStart is still 0 */
+    const size_t delimiterLength{this->m_delimiter.size()};
+    size_t lineBytesBefore{position - lineStart + this->m_partialLine.size()};
+    if (lineBytesBefore < delimiterLength - 1) {
+        return false;
+    }
+    for (size_t k = 1; k < delimiterLength; k++) {
+        char byte{(position - lineStart >= k) ? data[position - k] :
+                                                 this->m_partialLine[this->m_partialLine.size() - (k - (position - lineStart))]};
+        if (byte != this->m_delimiter[delimiterLength - 1 - k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LineFramer::appendPartial(const char *data, size_t length)
+{
+    while (this->m_partialLine.size() + length >= this->m_maximumLineLength) {
+        size_t fitting{this->m_maximumLineLength - this->m_partialLine.size()};
+        this->m_partialLine.append(data, fitting);
+        this->emitLine(this->m_partialLine.data(), this->m_partialLine.size());
+        this->m_partialLine.clear();
+        this->m_splitLineCount++;
+        data += fitting;
+        length -= fitting;
+    }
+    this->m_partialLine.append(data, length);
+}
+
+void LineFramer::emitLine(const char *data, size_t length)
+{
+    if (this->m_lineHandler) {
+        this->m_lineHandler(data, length);
+    }
+}
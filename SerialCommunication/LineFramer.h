@@ -0,0 +1,67 @@
+#ifndef SERIALCOMMUNICATION_LINEFRAMER_H
+#define SERIALCOMMUNICATION_LINEFRAMER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Splits a byte stream into lines on a delimiter of any length (the port's
+ * line ending: "\n", "\r\n", "\r" or a custom string). Buffers are scanned
+ * with AVX2 or SSE2 where the CPU has them, a block of bytes at a time, for
+ * the last byte of the delimiter; the rest of the delimiter is only compared
+ * at those candidates. Lines that lie entirely inside one buffer are handed
+ * to the LineHandler in place, without the delimiter; only the unterminated
+ * tail of a buffer is copied, and the next buffer is scanned from where that
+ * tail ends, never from its start again. An unterminated tail is buffered
+ * up to maximumLineLength and handed over in pieces of that size beyond it */
+class LineFramer
+{
+public:
+    using LineHandler = std::function<void(const char *, size_t)>;
+
+    enum class InstructionSet {
+        Best,
+        Avx2,
+        Sse2,
+        Scalar
+    };
+
+    explicit LineFramer(const std::string &delimiter, size_t maximumLineLength = DEFAULT_MAXIMUM_LINE_LENGTH, InstructionSet instructionSet = InstructionSet::Best);
+
+    void setLineHandler(const LineHandler &lineHandler);
+
+    void feed(const char *data, size_t length);
+    void flush();
+
+    size_t pendingBytes() const;
+    uint64_t splitLineCount() const;
+    const std::string &delimiter() const;
+    InstructionSet instructionSet() const;
+
+    static bool isSupported(InstructionSet instructionSet);
+    static const char *instructionSetName(InstructionSet instructionSet);
+
+    static const size_t DEFAULT_MAXIMUM_LINE_LENGTH{64 * 1024};
+
+private:
+    /* Scans data for byte, storing match offsets in positions until it is
+     * nearly full; returns the number stored and sets scannedLength to how
+     * far it got */
+    using MatchScanner = size_t (*)(const char *data, size_t length, char byte, uint32_t *positions, size_t maximumPositions, size_t &scannedLength);
+
+    std::string m_delimiter;
+    size_t m_maximumLineLength;
+    InstructionSet m_instructionSet;
+    MatchScanner m_matchScanner;
+    LineHandler m_lineHandler;
+    std::string m_partialLine;
+    std::vector<uint32_t> m_positions;
+    uint64_t m_splitLineCount;
+
+    bool delimiterEndsAt(const char *data, size_t lineStart, size_t position) const;
+    void appendPartial(const char *data, size_t length);
+    void emitLine(const char *data, size_t length);
+};
+
+#endif //SERIALCOMMUNICATION_LINEFRAMER_H
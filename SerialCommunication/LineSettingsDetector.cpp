@@ -0,0 +1,319 @@
+#include "LineSettingsDetector.h"
+#include "PortSettingsLookup.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+const std::chrono::milliseconds LineSettingsDetector::DEFAULT_TIMEOUT{5000};
+const std::chrono::milliseconds LineSettingsDetector::MINIMUM_SAMPLE_TIME{40};
+const std::chrono::milliseconds LineSettingsDetector::MAXIMUM_SAMPLE_TIME{250};
+const size_t LineSettingsDetector::SAMPLE_CHARACTERS;
+const size_t LineSettingsDetector::MINIMUM_CHARACTERS;
+const size_t LineSettingsDetector::SCORE_WINDOW_CHARACTERS;
+const double LineSettingsDetector::ACCEPT_SCORE{0.9};
+const double LineSettingsDetector::MINIMUM_SCORE{0.6};
+
+namespace {
+
+struct BaudRateCandidate
+{
+    BaudRate baudRate;
+    speed_t speed;
+    uint32_t bitsPerSecond;
+};
+
+/* Most common first, since the first clear winner ends the search */
+const BaudRateCandidate BAUD_RATE_CANDIDATES[] {
+        {BaudRate::BAUD115200, B115200, 115200},
+        {BaudRate::BAUD9600, B9600, 9600},
+        {BaudRate::BAUD57600, B57600, 57600},
+        {BaudRate::BAUD38400, B38400, 38400},
+        {BaudRate::BAUD19200, B19200, 19200},
+        {BaudRate::BAUD230400, B230400, 230400},
+        {BaudRate::BAUD460800, B460800, 460800},
+        {BaudRate::BAUD921600, B921600, 921600},
+        {BaudRate::BAUD4800, B4800, 4800},
+        {BaudRate::BAUD2400, B2400, 2400},
+        {BaudRate::BAUD1200, B1200, 1200},
+        {BaudRate::BAUD1000000, B1000000, 1000000},
+        {BaudRate::BAUD500000, B500000, 500000},
+        {BaudRate::BAUD2000000, B2000000, 2000000},
+        {BaudRate::BAUD1500000, B1500000, 1500000},
+        {BaudRate::BAUD3000000, B3000000, 3000000},
+        {BaudRate::BAUD576000, B576000, 576000},
+        {BaudRate::BAUD1152000, B1152000, 1152000},
+        {BaudRate::BAUD2500000, B2500000, 2500000},
+        {BaudRate::BAUD3500000, B3500000, 3500000},
+        {BaudRate::BAUD4000000, B4000000, 4000000},
+        {BaudRate::BAUD600, B600, 600},
+        {BaudRate::BAUD300, B300, 300},
+        {BaudRate::BAUD1800, B1800, 1800},
+        {BaudRate::BAUD200, B200, 200},
+        {BaudRate::BAUD150, B150, 150},
+        {BaudRate::BAUD134, B134, 134},
+        {BaudRate::BAUD110, B110, 110},
+        {BaudRate::BAUD75, B75, 75},
+        {BaudRate::BAUD50, B50, 50}
+};
+
+/* Start bit, eight data bits, a parity bit and a stop bit */
+const uint32_t MAXIMUM_BITS_PER_CHARACTER{11};
+
+bool isText(unsigned char character)
+{
+    return ( (character >= 0x20) && (character < 0x7F) ) || (character == '\n') || (character == '\r') || (character == '\t');
+}
+
+std::chrono::milliseconds sampleTime(const BaudRateCandidate &candidate)
+{
+    std::chrono::milliseconds characterTime{(LineSettingsDetector::SAMPLE_CHARACTERS * MAXIMUM_BITS_PER_CHARACTER * 1000) / candidate.bitsPerSecond};
+    return std::min(std::max(characterTime, LineSettingsDetector::MINIMUM_SAMPLE_TIME), LineSettingsDetector::MAXIMUM_SAMPLE_TIME);
+}
+
+double fitScore(size_t checked, size_t failed, size_t usable, size_t text)
+{
+    if ( (checked == 0) || (usable == 0) ) {
+        return 0.0;
+    }
+    double wholeRatio{1.0 - (static_cast<double>(failed) / static_cast<double>(checked))};
+    return wholeRatio * (0.5 + (0.5 * static_cast<double>(text) / static_cast<double>(usable)));
+}
+
+} //Global namespace
+
+LineSettingsDetector::LineSettingsDetector(const std::string &devicePath) :
+    m_devicePath{devicePath},
+    m_fileDescriptor{open(devicePath.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)},
+    m_originalSettings{},
+    m_lineCountersSupported{true}
+{
+    if (this->m_fileDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open {0} ({1})", devicePath, strerror(errno)));
+    }
+    if (tcgetattr(this->m_fileDescriptor, &this->m_originalSettings) == -1) {
+        int errorNumber{errno};
+        close(this->m_fileDescriptor);
+        throw std::runtime_error(TStringFormat("Unable to read the terminal settings of {0} ({1})", devicePath, strerror(errorNumber)));
+    }
+}
+
+LineSettingsDetector::~LineSettingsDetector()
+{
+    tcsetattr(this->m_fileDescriptor, TCSANOW, &this->m_originalSettings);
+    close(this->m_fileDescriptor);
+}
+
+LineSettingsScore LineSettingsDetector::detect(std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    LineSettingsScore best{BaudRate::BAUD9600, DataBits::EIGHT, Parity::NONE, StopBits::ONE, 0.0, 0};
+    bool heard{false};
+    do {
+        for (const auto &candidate : BAUD_RATE_CANDIDATES) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0) {
+                return best;
+            }
+            LineSettingsScore fit{};
+            if (!this->listenAt(candidate.baudRate, candidate.speed, std::min(sampleTime(candidate), remaining), fit)) {
+                continue;
+            }
+            heard = true;
+            LOG_DEBUG(SERIAL_LOG_SUBSYSTEM) << TStringFormat("{0} at {1}: best read with DataBits {2}, Parity {3} (score {4} over {5} characters)",
+                                                             this->m_devicePath, baudRateToString(candidate.baudRate), dataBitsToString(fit.dataBits),
+                                                             parityToString(fit.parity), fit.score, fit.characters);
+            if (isBetter(fit, best)) {
+                best = fit;
+            }
+            if ( (best.score >= ACCEPT_SCORE) && (best.characters >= MINIMUM_CHARACTERS) ) {
+                return best;
+            }
+        }
+        /* A device that said nothing at any rate may only talk now and then */
+    } while ( (!heard) && (std::chrono::steady_clock::now() < deadline) );
+    return best;
+}
+
+std::vector<LineSettingsScore> LineSettingsDetector::scoreSample(BaudRate baudRate, const char *sample, size_t length, int64_t frameErrors)
+{
+    /* One pass counts what every setting needs: characters that arrived
+     * whole, split by the parity of their eight bits and by their top bit,
+     * and how many of each read as text with seven or eight data bits */
+    size_t nulCharacters{static_cast<size_t>(std::count(sample, sample + length, '\0'))};
+    /* Without the UART counters every NUL stands for a framing error; with
+     * them, NULs beyond the counted errors were sent as such. Every error
+     * comes in as a NUL, so any more than those were outside the sample */
+    size_t errors{(frameErrors < 0) ? nulCharacters : std::min(static_cast<size_t>(frameErrors), nulCharacters)};
+    size_t sentNulCharacters{(nulCharacters > errors) ? nulCharacters - errors : 0};
+    size_t checkedCharacters{length - nulCharacters + sentNulCharacters + errors};
+    size_t evenCharacters{sentNulCharacters};
+    size_t oddCharacters{0};
+    size_t topBitCharacters{0};
+    size_t text{0};
+    size_t oddText{0};
+    size_t evenText{0};
+    size_t oddSevenBitText{0};
+    size_t evenSevenBitText{0};
+    size_t topBitSevenBitText{0};
+    for (size_t i = 0; i < length; i++) {
+        unsigned char character{static_cast<unsigned char>(sample[i])};
+        if (character == 0) {
+            continue;
+        }
+        bool eightBitText{isText(character)};
+        bool sevenBitText{isText(character & 0x7F)};
+        text += eightBitText;
+        if (__builtin_parity(character)) {
+            oddCharacters++;
+            oddText += eightBitText;
+            oddSevenBitText += sevenBitText;
+        } else {
+            evenCharacters++;
+            evenText += eightBitText;
+            evenSevenBitText += sevenBitText;
+        }
+        if (character & 0x80) {
+            topBitCharacters++;
+            topBitSevenBitText += sevenBitText;
+        }
+    }
+    size_t wholeCharacters{checkedCharacters - errors};
+    /* 8E1 and 8O1 lose the characters whose parity bit is 0 to framing
+     * errors, so only the ones that got through are checked */
+    std::vector<LineSettingsScore> scores{
+            {baudRate, DataBits::EIGHT, Parity::NONE, StopBits::ONE, fitScore(checkedCharacters, errors, wholeCharacters, text), wholeCharacters},
+            {baudRate, DataBits::SEVEN, Parity::EVEN, StopBits::ONE, fitScore(checkedCharacters, errors + oddCharacters, evenCharacters, evenSevenBitText), evenCharacters},
+            {baudRate, DataBits::SEVEN, Parity::ODD, StopBits::ONE, fitScore(checkedCharacters, errors + evenCharacters, oddCharacters, oddSevenBitText), oddCharacters},
+            {baudRate, DataBits::SEVEN, Parity::NONE, StopBits::TWO, fitScore(checkedCharacters, errors + wholeCharacters - topBitCharacters, topBitCharacters, topBitSevenBitText), topBitCharacters},
+            {baudRate, DataBits::EIGHT, Parity::EVEN, StopBits::ONE, fitScore(wholeCharacters, evenCharacters, oddCharacters, oddText), oddCharacters},
+            {baudRate, DataBits::EIGHT, Parity::ODD, StopBits::ONE, fitScore(wholeCharacters, oddCharacters, evenCharacters, evenText), evenCharacters}
+    };
+    /* Ties go to the simpler setting, listed first */
+    std::stable_sort(scores.begin(), scores.end(), [](const LineSettingsScore &first, const LineSettingsScore &second) {
+        return first.score > second.score;
+    });
+    return scores;
+}
+
+bool LineSettingsDetector::isConfident(const LineSettingsScore &lineSettingsScore)
+{
+    return (lineSettingsScore.score >= MINIMUM_SCORE) && (lineSettingsScore.characters >= MINIMUM_CHARACTERS);
+}
+
+bool LineSettingsDetector::isBetter(const LineSettingsScore &first, const LineSettingsScore &second)
+{
+    /* Otherwise a few characters that happen to fit would hold on to the
+     * lead against any real sample */
+    bool firstConfident{isConfident(first)};
+    bool secondConfident{isConfident(second)};
+    if (firstConfident != secondConfident) {
+        return firstConfident;
+    }
+    return first.score > second.score;
+}
+
+void LineSettingsDetector::setSpeed(speed_t speed)
+{
+    /* 8N1 with input checking but neither IGNPAR nor PARMRK, so a character
+     * that does not fit comes in as a NUL instead of being dropped or
+     * marked; without INPCK the serial core leaves framing errors out and
+     * hands over the raw byte */
+    termios settings{this->m_originalSettings};
+    cfmakeraw(&settings);
+    settings.c_iflag &= ~static_cast<tcflag_t>(IGNPAR | PARMRK | IGNBRK | BRKINT | ISTRIP | IXON | IXOFF | IXANY);
+    settings.c_iflag |= INPCK;
+    settings.c_cflag &= ~static_cast<tcflag_t>(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    settings.c_cflag |= CS8 | CREAD | CLOCAL;
+    settings.c_cc[VMIN] = 1;
+    settings.c_cc[VTIME] = 0;
+    if ( (cfsetispeed(&settings, speed) == -1) || (cfsetospeed(&settings, speed) == -1) ||
+         (tcsetattr(this->m_fileDescriptor, TCSANOW, &settings) == -1) ) {
+        throw std::runtime_error(TStringFormat("Unable to change the settings of {0} ({1})", this->m_devicePath, strerror(errno)));
+    }
+    /* Whatever came in at the previous rate */
+    tcflush(this->m_fileDescriptor, TCIFLUSH);
+}
+
+int64_t LineSettingsDetector::frameErrorCount()
+{
+    /* Only real UARTs keep these; without them a NUL always counts as a
+     * framing error */
+    if (!this->m_lineCountersSupported) {
+        return -1;
+    }
+    serial_icounter_struct lineCounters{};
+    if (ioctl(this->m_fileDescriptor, TIOCGICOUNT, &lineCounters) == -1) {
+        this->m_lineCountersSupported = false;
+        return -1;
+    }
+    return static_cast<int64_t>(lineCounters.frame) + static_cast<int64_t>(lineCounters.brk);
+}
+
+bool LineSettingsDetector::listenAt(BaudRate baudRate, speed_t speed, std::chrono::milliseconds sampleTime, LineSettingsScore &fit)
+{
+    this->setSpeed(speed);
+    /* Where each read started and the UART's error count then */
+    std::vector<std::pair<size_t, int64_t>> readStarts{};
+    std::string sampled{""};
+    char buffer[SAMPLE_CHARACTERS];
+    auto end = std::chrono::steady_clock::now() + sampleTime;
+    while (sampled.size() < SAMPLE_CHARACTERS) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            break;
+        }
+        pollfd pollDescriptor{this->m_fileDescriptor, POLLIN, 0};
+        int readyCount{poll(&pollDescriptor, 1, static_cast<int>(remaining.count()))};
+        if ( (readyCount == -1) && (errno == EINTR) ) {
+            continue;
+        }
+        if (readyCount <= 0) {
+            break;
+        }
+        int64_t frameErrorsBefore{this->frameErrorCount()};
+        ssize_t bytesRead{read(this->m_fileDescriptor, buffer, SAMPLE_CHARACTERS - sampled.size())};
+        if (bytesRead == 0) {
+            throw std::runtime_error(TStringFormat("{0} closed while listening to it", this->m_devicePath));
+        } else if (bytesRead < 0) {
+            if ( (errno != EAGAIN) && (errno != EINTR) ) {
+                throw std::runtime_error(TStringFormat("Unable to read {0} ({1})", this->m_devicePath, strerror(errno)));
+            }
+            continue;
+        }
+        readStarts.emplace_back(sampled.size(), frameErrorsBefore);
+        sampled.append(buffer, static_cast<size_t>(bytesRead));
+        /* The UART's errors are counted from the read the window starts in,
+         * scoreSample() keeps them to the NULs that are in it */
+        size_t windowStart{(sampled.size() > SCORE_WINDOW_CHARACTERS) ? sampled.size() - SCORE_WINDOW_CHARACTERS : 0};
+        int64_t windowErrorsBefore{readStarts.front().second};
+        for (const auto &it : readStarts) {
+            if (it.first > windowStart) {
+                break;
+            }
+            windowErrorsBefore = it.second;
+        }
+        int64_t frameErrorsNow{this->frameErrorCount()};
+        int64_t frameErrors{( (windowErrorsBefore == -1) || (frameErrorsNow == -1) ) ? -1 : frameErrorsNow - windowErrorsBefore};
+        fit = scoreSample(baudRate, sampled.data() + windowStart, sampled.size() - windowStart, frameErrors).front();
+        /* Scored after every read, so that a clear sample either way ends
+         * the listening early */
+        if ( (fit.score >= ACCEPT_SCORE) && (fit.characters >= MINIMUM_CHARACTERS) ) {
+            break;
+        }
+        if ( (sampled.size() >= 2 * SCORE_WINDOW_CHARACTERS) && (!isConfident(fit)) ) {
+            break;
+        }
+    }
+    return !sampled.empty();
+}
@@ -0,0 +1,90 @@
+#ifndef SERIALCOMMUNICATION_LINESETTINGSDETECTOR_H
+#define SERIALCOMMUNICATION_LINESETTINGSDETECTOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <termios.h>
+
+#include <CppSerialPort/SerialPort.h>
+
+/* One way of reading the line, and how well a sample fits it: the share of
+ * characters that arrived whole and passed the parity check, weighted by
+ * how many of them are printable text */
+struct LineSettingsScore
+{
+    CppSerialPort::BaudRate baudRate;
+    CppSerialPort::DataBits dataBits;
+    CppSerialPort::Parity parity;
+    CppSerialPort::StopBits stopBits;
+    double score;
+    /* Characters the score stands on */
+    size_t characters;
+};
+
+/* Finds a talking device's baud rate, data bits and parity by listening to
+ * it. The port is read at one candidate rate at a time, most common rates
+ * first, always as 8N1 with INPCK: a character with a framing error (or a
+ * break) then arrives as a NUL, and where the driver keeps the UART
+ * counters their framing error count is used instead, so NULs that were
+ * sent still count as data. Every data bits and parity setting is scored
+ * from that one sample, since each leaves its own trace in it: 7E1 and 7O1
+ * put their parity bit in the eighth data bit, 7N2 a stop bit, and 8E1 and
+ * 8O1 their parity bit where 8N1 wants the stop bit, so only characters
+ * whose parity bit is 1 get through. A rate is listened to only until its
+ * sample decides it, either way, and the first rate with a clear winner
+ * ends the search. Blocks the calling thread */
+class LineSettingsDetector
+{
+public:
+    explicit LineSettingsDetector(const std::string &devicePath);
+    ~LineSettingsDetector();
+    LineSettingsDetector(const LineSettingsDetector &) = delete;
+    LineSettingsDetector(LineSettingsDetector &&) = delete;
+    LineSettingsDetector &operator=(const LineSettingsDetector &) = delete;
+    LineSettingsDetector &operator=(LineSettingsDetector &&) = delete;
+
+    /* The best fit found; a quiet line is listened to again at every rate
+     * until timeout has passed. Check it with isConfident() */
+    LineSettingsScore detect(std::chrono::milliseconds timeout = DEFAULT_TIMEOUT);
+
+    /* sample was read as 8N1 at baudRate; frameErrors is what the UART
+     * counted meanwhile (at most the NULs in sample are taken as errors),
+     * or -1 when it does not count them. Returns every data bits and parity
+     * setting, best first */
+    static std::vector<LineSettingsScore> scoreSample(CppSerialPort::BaudRate baudRate, const char *sample, size_t length, int64_t frameErrors);
+    static bool isConfident(const LineSettingsScore &lineSettingsScore);
+    /* Confident fits beat any that are not, whatever their score */
+    static bool isBetter(const LineSettingsScore &first, const LineSettingsScore &second);
+
+    static const std::chrono::milliseconds DEFAULT_TIMEOUT;
+    static const std::chrono::milliseconds MINIMUM_SAMPLE_TIME;
+    static const std::chrono::milliseconds MAXIMUM_SAMPLE_TIME;
+    static const size_t SAMPLE_CHARACTERS{256};
+    static const size_t MINIMUM_CHARACTERS{24};
+    /* Only the latest characters of a sample are scored, since a receiver
+     * that switched rates mid-character can stay out of step until the
+     * line next goes idle; a rate with twice as many and still no
+     * confident fit is given up on */
+    static const size_t SCORE_WINDOW_CHARACTERS{64};
+    static const double ACCEPT_SCORE;
+    static const double MINIMUM_SCORE;
+
+private:
+    std::string m_devicePath;
+    int m_fileDescriptor;
+    termios m_originalSettings;
+    bool m_lineCountersSupported;
+
+    void setSpeed(speed_t speed);
+    int64_t frameErrorCount();
+    /* Sets fit to the best fit at baudRate, scored after every read until
+     * it is clear, rejected or sampleTime has passed; false when the line
+     * was quiet */
+    bool listenAt(CppSerialPort::BaudRate baudRate, speed_t speed, std::chrono::milliseconds sampleTime, LineSettingsScore &fit);
+};
+
+#endif //SERIALCOMMUNICATION_LINESETTINGSDETECTOR_H
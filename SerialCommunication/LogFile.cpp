@@ -0,0 +1,199 @@
+#include "LogFile.h"
+#include "ApplicationUtilities.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+const uint64_t LogFile::DEFAULT_SIZE_LIMIT{64ULL * 1024ULL * 1024ULL};
+const size_t LogFile::DEFAULT_RETAINED_FILES{5};
+const std::chrono::milliseconds LogFile::DEFAULT_SYNC_INTERVAL{1000};
+const uint64_t LogFile::PREALLOCATION_SIZE{4ULL * 1024ULL * 1024ULL};
+
+LogFile::LogFile(const std::string &path) :
+    m_mutex{},
+    m_path{path},
+    m_settings{DEFAULT_SIZE_LIMIT, std::chrono::seconds{0}, DEFAULT_RETAINED_FILES, LogSyncPolicy::Interval, DEFAULT_SYNC_INTERVAL},
+    m_fileDescriptor{-1},
+    m_fileSize{0},
+    m_preallocatedSize{0},
+    m_preallocationSupported{true},
+    m_unsynced{false},
+    m_rotationCount{0},
+    m_fileGeneration{0},
+    m_encodeBuffer{""},
+    m_openTime{},
+    m_lastSyncTime{}
+{
+    if (!this->openFile()) {
+        throw std::runtime_error(TStringFormat(R"(Failed to open log file "{0}" ({1}))", this->m_path, strerror(errno)));
+    }
+}
+
+LogFile::~LogFile()
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    this->closeFile();
+}
+
+void LogFile::setSettings(const LogFileSettings &settings)
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    this->m_settings = settings;
+    this->m_settings.retainedFiles = std::max<size_t>(1, this->m_settings.retainedFiles);
+}
+
+bool LogFile::write(const char *data, size_t length)
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    if (!this->prepareWrite(length)) {
+        return false;
+    }
+    return this->appendData(data, length);
+}
+
+bool LogFile::write(size_t sizeHint, const Encoder &encoder)
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    if (!this->prepareWrite(sizeHint)) {
+        return false;
+    }
+    this->m_encodeBuffer.clear();
+    encoder(this->m_fileGeneration, this->m_encodeBuffer);
+    return this->appendData(this->m_encodeBuffer.data(), this->m_encodeBuffer.size());
+}
+
+void LogFile::sync()
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    if ( (this->m_fileDescriptor != -1) && (this->m_unsynced) ) {
+        fdatasync(this->m_fileDescriptor);
+        this->m_unsynced = false;
+        this->m_lastSyncTime = std::chrono::steady_clock::now();
+    }
+}
+
+bool LogFile::prepareWrite(size_t length)
+{
+    if (this->m_fileSize > 0) {
+        bool sizeReached{ (this->m_settings.sizeLimit > 0) && (this->m_fileSize + length > this->m_settings.sizeLimit) };
+        bool intervalReached{ (this->m_settings.rotateInterval.count() > 0) && (std::chrono::steady_clock::now() - this->m_openTime >= this->m_settings.rotateInterval) };
+        if ( (sizeReached) || (intervalReached) ) {
+            this->rotate();
+        }
+    }
+    /* A failed rotation retries at the next write */
+    return (this->m_fileDescriptor != -1) || (this->openFile());
+}
+
+bool LogFile::appendData(const char *data, size_t length)
+{
+    this->preallocate(this->m_fileSize + length);
+    if (!ApplicationUtilities::writeAll(this->m_fileDescriptor, data, length)) {
+        return false;
+    }
+    this->m_fileSize += length;
+    this->m_unsynced = true;
+    auto now = std::chrono::steady_clock::now();
+    if ( (this->m_settings.syncPolicy == LogSyncPolicy::Always) ||
+         ( (this->m_settings.syncPolicy == LogSyncPolicy::Interval) && (now - this->m_lastSyncTime >= this->m_settings.syncInterval) ) ) {
+        fdatasync(this->m_fileDescriptor);
+        this->m_unsynced = false;
+        this->m_lastSyncTime = now;
+    }
+    return true;
+}
+
+const std::string &LogFile::path() const
+{
+    return this->m_path;
+}
+
+uint64_t LogFile::rotationCount() const
+{
+    std::lock_guard<std::mutex> fileLock{this->m_mutex};
+    return this->m_rotationCount;
+}
+
+bool LogFile::openFile()
+{
+    this->m_fileDescriptor = open(this->m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->m_fileDescriptor == -1) {
+        return false;
+    }
+    /* Appending to a file left by an earlier run that started in the same
+     * second; its allocated blocks may already reach past its end */
+    struct stat fileStatus{};
+    fstat(this->m_fileDescriptor, &fileStatus);
+    this->m_fileSize = static_cast<uint64_t>(fileStatus.st_size);
+    this->m_preallocatedSize = std::max<uint64_t>(this->m_fileSize, static_cast<uint64_t>(fileStatus.st_blocks) * 512);
+    this->m_unsynced = false;
+    this->m_fileGeneration++;
+    this->m_openTime = std::chrono::steady_clock::now();
+    this->m_lastSyncTime = this->m_openTime;
+    return true;
+}
+
+void LogFile::closeFile()
+{
+    if (this->m_fileDescriptor == -1) {
+        return;
+    }
+    /* Gives back the reserved space past the end of the data */
+    if (this->m_preallocatedSize > this->m_fileSize) {
+        int truncateResult{ftruncate(this->m_fileDescriptor, static_cast<off_t>(this->m_fileSize))};
+        (void)truncateResult;
+    }
+    if ( (this->m_unsynced) && (this->m_settings.syncPolicy != LogSyncPolicy::Never) ) {
+        fdatasync(this->m_fileDescriptor);
+    }
+    close(this->m_fileDescriptor);
+    this->m_fileDescriptor = -1;
+    this->m_preallocatedSize = 0;
+}
+
+void LogFile::rotate()
+{
+    this->closeFile();
+    if (this->m_settings.retainedFiles <= 1) {
+        unlink(this->m_path.c_str());
+    } else {
+        unlink(this->rotatedPath(this->m_settings.retainedFiles - 1).c_str());
+        for (size_t index = this->m_settings.retainedFiles - 1; index > 1; index--) {
+            rename(this->rotatedPath(index - 1).c_str(), this->rotatedPath(index).c_str());
+        }
+        rename(this->m_path.c_str(), this->rotatedPath(1).c_str());
+    }
+    this->m_rotationCount++;
+    this->openFile();
+}
+
+void LogFile::preallocate(uint64_t requiredSize)
+{
+    if ( (!this->m_preallocationSupported) || (requiredSize <= this->m_preallocatedSize) ) {
+        return;
+    }
+    uint64_t reservedSize{requiredSize + PREALLOCATION_SIZE};
+    if (this->m_settings.sizeLimit > 0) {
+        reservedSize = std::max(requiredSize, std::min(reservedSize, this->m_settings.sizeLimit));
+    }
+    /* FALLOC_FL_KEEP_SIZE leaves the file size alone, so readers never see
+     * the reserved space as zeros after the last line */
+    if (fallocate(this->m_fileDescriptor, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(this->m_preallocatedSize),
+                  static_cast<off_t>(reservedSize - this->m_preallocatedSize)) == 0) {
+        this->m_preallocatedSize = reservedSize;
+    } else if ( (errno == EOPNOTSUPP) || (errno == ENOSYS) ) {
+        this->m_preallocationSupported = false;
+    }
+}
+
+std::string LogFile::rotatedPath(size_t index) const
+{
+    return this->m_path + "." + std::to_string(index);
+}
@@ -0,0 +1,91 @@
+#ifndef SERIALCOMMUNICATION_LOGFILE_H
+#define SERIALCOMMUNICATION_LOGFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+enum class LogSyncPolicy {
+    Never,
+    Interval,
+    Always
+};
+
+struct LogFileSettings
+{
+    /* Rotate once the file would grow past this many bytes, 0 never */
+    uint64_t sizeLimit;
+    /* Rotate once the file has been open this long, 0 never */
+    std::chrono::seconds rotateInterval;
+    /* The file being written plus the rotated ones kept next to it */
+    size_t retainedFiles;
+    LogSyncPolicy syncPolicy;
+    /* For LogSyncPolicy::Interval, the longest a write stays unsynced while
+     * more writes follow it; the owner calls sync() that often to cover the
+     * last write before a pause */
+    std::chrono::milliseconds syncInterval;
+};
+
+/* The log file, opened once at a fixed path and kept open. Space is
+ * reserved ahead of the data with fallocate() so appends do not allocate
+ * blocks one write at a time, and released again when the file is rotated
+ * or closed. Rotation renames the file to <path>.1 (shifting older ones up
+ * and deleting the oldest) and reopens <path>, so directory operations only
+ * happen then and never per write. Safe to write from several threads */
+class LogFile
+{
+public:
+    /* Produces the bytes to append while the file is locked; the generation
+     * changes whenever a different file (or a rotated one) is opened, so
+     * formats that need a header per file know when to write it again */
+    using Encoder = std::function<void(uint64_t fileGeneration, std::string &output)>;
+
+    explicit LogFile(const std::string &path);
+    ~LogFile();
+    LogFile(const LogFile &) = delete;
+    LogFile(LogFile &&) = delete;
+    LogFile &operator=(const LogFile &) = delete;
+    LogFile &operator=(LogFile &&) = delete;
+
+    void setSettings(const LogFileSettings &settings);
+    /* False, with errno set, if the data could not be written */
+    bool write(const char *data, size_t length);
+    /* Rotation is decided on sizeHint before encoder runs */
+    bool write(size_t sizeHint, const Encoder &encoder);
+    void sync();
+
+    const std::string &path() const;
+    uint64_t rotationCount() const;
+
+    static const uint64_t DEFAULT_SIZE_LIMIT;
+    static const size_t DEFAULT_RETAINED_FILES;
+    static const std::chrono::milliseconds DEFAULT_SYNC_INTERVAL;
+    static const uint64_t PREALLOCATION_SIZE;
+
+private:
+    mutable std::mutex m_mutex;
+    std::string m_path;
+    LogFileSettings m_settings;
+    int m_fileDescriptor;
+    uint64_t m_fileSize;
+    uint64_t m_preallocatedSize;
+    bool m_preallocationSupported;
+    bool m_unsynced;
+    uint64_t m_rotationCount;
+    uint64_t m_fileGeneration;
+    std::string m_encodeBuffer;
+    std::chrono::steady_clock::time_point m_openTime;
+    std::chrono::steady_clock::time_point m_lastSyncTime;
+
+    bool prepareWrite(size_t length);
+    bool appendData(const char *data, size_t length);
+    bool openFile();
+    void closeFile();
+    void rotate();
+    void preallocate(uint64_t requiredSize);
+    std::string rotatedPath(size_t index) const;
+};
+
+#endif //SERIALCOMMUNICATION_LOGFILE_H
@@ -1,15 +1,88 @@
+#include <atomic>
 #include <iostream>
+#include <cstring>
+#include <csignal>
+#include <cctype>
 
 #include <CppSerialPort/SerialPort.h>
 #include "MessageLogger.h"
+#include "AsyncLogHandler.h"
 #include "ApplicationUtilities.h"
+#include "BinaryLogReader.h"
+#include "BinaryLogWriter.h"
+#include "CaptureWriter.h"
+#include "CommandEngine.h"
+#include "ConsoleOutput.h"
 #include "GlobalDefinitions.h"
+#include "EventLoop.h"
+#include "FramingCodec.h"
+#include "HexDumper.h"
+#include "LogFile.h"
+#include "MetricsRegistry.h"
+#include "PortChannel.h"
+#include "PortServer.h"
+#include "PortSettingsLookup.h"
+#include "ReplayEngine.h"
+#include "SerialSession.h"
+#include "SessionManager.h"
+#include "StreamFanout.h"
+#include "TerminalUi.h"
+#include "TriggerEngine.h"
+#include "UploadSource.h"
+#include <fcntl.h>
 #include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 using namespace CppSerialPort;
 using namespace TMessageLogger;
 using namespace ApplicationUtilities;
 
+/* Options without a short form use values outside the range of char */
+enum LongOnlyOption {
+    LOG_OVERFLOW_OPTION = 256,
+    LOG_QUEUE_SIZE_OPTION,
+    LOG_LEVEL_OPTION,
+    LOG_LEVEL_FILE_OPTION,
+    CAPTURE_OPTION,
+    CAPTURE_SIZE_OPTION,
+    REPLAY_OPTION,
+    REPLAY_SPEED_OPTION,
+    REPLAY_PTY_OPTION,
+    LINES_OPTION,
+    FRAMING_OPTION,
+    METRICS_INTERVAL_OPTION,
+    TUI_OPTION,
+    HEX_OPTION,
+    FLOW_CONTROL_OPTION,
+    SEND_OPTION,
+    SEND_BYTE_DELAY_OPTION,
+    SEND_LINE_DELAY_OPTION,
+    SCRIPT_OPTION,
+    WINDOW_OPTION,
+    COMMAND_TIMEOUT_OPTION,
+    COMMAND_RETRIES_OPTION,
+    RESPONSE_PATTERN_OPTION,
+    ERROR_PATTERN_OPTION,
+    COMMAND_TAGS_OPTION,
+    LOG_FILE_SIZE_OPTION,
+    LOG_FILE_COUNT_OPTION,
+    LOG_ROTATE_INTERVAL_OPTION,
+    LOG_SYNC_OPTION,
+    LOG_FORMAT_OPTION,
+    DECODE_LOG_OPTION,
+    SINK_OPTION,
+    DAEMON_OPTION,
+    CLIENT_QUEUE_SIZE_OPTION,
+    LOW_LATENCY_OPTION,
+    TIMESTAMPS_OPTION,
+    JITTER_INTERVAL_OPTION,
+    RECONNECT_OPTION,
+    AUTO_OPTION,
+    TRIGGERS_OPTION
+};
+
 static const struct option longOptions[] {
         {"help",        no_argument,       nullptr, 'h'},
         {"verbose",     no_argument,       nullptr, 'e'},
@@ -20,105 +93,280 @@ static const struct option longOptions[] {
         {"data-bits",   required_argument, nullptr, 'd'},
         {"parity",      required_argument, nullptr, 'a'},
         {"line-ending", required_argument, nullptr, 'n'},
+        {"threads",     required_argument, nullptr, 't'},
+        {"log-overflow",   required_argument, nullptr, LOG_OVERFLOW_OPTION},
+        {"log-queue-size", required_argument, nullptr, LOG_QUEUE_SIZE_OPTION},
+        {"log-level",      required_argument, nullptr, LOG_LEVEL_OPTION},
+        {"log-level-file", required_argument, nullptr, LOG_LEVEL_FILE_OPTION},
+        {"capture",        required_argument, nullptr, CAPTURE_OPTION},
+        {"capture-size",   required_argument, nullptr, CAPTURE_SIZE_OPTION},
+        {"replay",         required_argument, nullptr, REPLAY_OPTION},
+        {"replay-speed",   required_argument, nullptr, REPLAY_SPEED_OPTION},
+        {"replay-pty",     no_argument,       nullptr, REPLAY_PTY_OPTION},
+        {"lines",          no_argument,       nullptr, LINES_OPTION},
+        {"framing",        required_argument, nullptr, FRAMING_OPTION},
+        {"metrics-interval", required_argument, nullptr, METRICS_INTERVAL_OPTION},
+        {"tui",            no_argument,       nullptr, TUI_OPTION},
+        {"hex",            no_argument,       nullptr, HEX_OPTION},
+        {"flow-control",   required_argument, nullptr, FLOW_CONTROL_OPTION},
+        {"send",           required_argument, nullptr, SEND_OPTION},
+        {"send-byte-delay", required_argument, nullptr, SEND_BYTE_DELAY_OPTION},
+        {"send-line-delay", required_argument, nullptr, SEND_LINE_DELAY_OPTION},
+        {"script",          required_argument, nullptr, SCRIPT_OPTION},
+        {"window",          required_argument, nullptr, WINDOW_OPTION},
+        {"command-timeout", required_argument, nullptr, COMMAND_TIMEOUT_OPTION},
+        {"command-retries", required_argument, nullptr, COMMAND_RETRIES_OPTION},
+        {"response-pattern", required_argument, nullptr, RESPONSE_PATTERN_OPTION},
+        {"error-pattern",   required_argument, nullptr, ERROR_PATTERN_OPTION},
+        {"command-tags",    no_argument,       nullptr, COMMAND_TAGS_OPTION},
+        {"log-file-size",   required_argument, nullptr, LOG_FILE_SIZE_OPTION},
+        {"log-file-count",  required_argument, nullptr, LOG_FILE_COUNT_OPTION},
+        {"log-rotate-interval", required_argument, nullptr, LOG_ROTATE_INTERVAL_OPTION},
+        {"log-sync",        required_argument, nullptr, LOG_SYNC_OPTION},
+        {"log-format",      required_argument, nullptr, LOG_FORMAT_OPTION},
+        {"decode-log",      required_argument, nullptr, DECODE_LOG_OPTION},
+        {"sink",            required_argument, nullptr, SINK_OPTION},
+        {"daemon",          required_argument, nullptr, DAEMON_OPTION},
+        {"client-queue-size", required_argument, nullptr, CLIENT_QUEUE_SIZE_OPTION},
+        {"low-latency",     no_argument,       nullptr, LOW_LATENCY_OPTION},
+        {"timestamps",      no_argument,       nullptr, TIMESTAMPS_OPTION},
+        {"jitter-interval", required_argument, nullptr, JITTER_INTERVAL_OPTION},
+        {"reconnect",       no_argument,       nullptr, RECONNECT_OPTION},
+        {"auto",            no_argument,       nullptr, AUTO_OPTION},
+        {"triggers",        required_argument, nullptr, TRIGGERS_OPTION},
         {0, 0, 0, 0}
 };
 
-static std::map<std::string, BaudRate> baudRateLookup {
-        {"50", BaudRate::BAUD50},
-        {"75", BaudRate::BAUD75},
-        {"110", BaudRate::BAUD110},
-        {"134", BaudRate::BAUD134},
-        {"150", BaudRate::BAUD150},
-        {"200", BaudRate::BAUD200},
-        {"300", BaudRate::BAUD300},
-        {"600", BaudRate::BAUD600},
-        {"1200", BaudRate::BAUD1200},
-        {"1800", BaudRate::BAUD1800},
-        {"2400", BaudRate::BAUD2400},
-        {"4800", BaudRate::BAUD4800},
-        {"9600", BaudRate::BAUD9600},
-        {"19200", BaudRate::BAUD19200},
-        {"38400", BaudRate::BAUD38400},
-        {"57600", BaudRate::BAUD57600},
-        {"115200", BaudRate::BAUD115200},
-        {"230400", BaudRate::BAUD230400},
-        {"460800", BaudRate::BAUD460800},
-        {"500000", BaudRate::BAUD500000},
-        {"576000", BaudRate::BAUD57600},
-        {"921600", BaudRate::BAUD921600},
-        {"1000000", BaudRate::BAUD1000000},
-        {"1152000", BaudRate::BAUD1152000},
-        {"1500000", BaudRate::BAUD1500000},
-        {"2000000", BaudRate::BAUD2000000},
-        {"2500000", BaudRate::BAUD2500000},
-        {"3000000", BaudRate::BAUD3000000},
-        {"3500000", BaudRate::BAUD3500000},
-        {"4000000", BaudRate::BAUD4000000}
-};
-
-static std::map<std::string, StopBits> stopBitsLookup{
-        {"one", StopBits::ONE},
-        {"two", StopBits::TWO}
-};
-
-static std::map<std::string, DataBits> dataBitsLookup {
-        {"five", DataBits::FIVE},
-        {"six", DataBits::SIX},
-        {"seven", DataBits::SEVEN},
-        {"eight", DataBits::EIGHT}
-};
-
-static std::map<std::string, Parity> parityLookup {
-        {"none", Parity::NONE},
-        {"even", Parity::EVEN},
-        {"odd", Parity::ODD}
-};
-
-std::string baudRateToString(BaudRate baudRate);
-std::string dataBitsToString(DataBits dataBits);
-std::string stopBitsToString(StopBits stopBits);
-std::string parityToString(Parity parity);
-
-
 BaudRate tryParseBaudRate(char *name);
 StopBits tryParseStopBits(char *name);
 DataBits tryParseDataBits(char *name);
 Parity tryParseParity(char *name);
+FlowControl tryParseFlowControl(char *name);
 std::string tryParseLineEnding(char *name);
 
+size_t tryParseCount(char *name, const char *parameterName, bool allowZero = false);
+uint64_t tryParseByteSize(char *name, const char *parameterName, bool allowZero = false);
+double tryParseReplaySpeed(char *name);
+OverflowPolicy tryParseOverflowPolicy(char *name);
+void tryParseLogSync(char *name, LogFileSettings &logFileSettings);
+bool tryParseBinaryLogFormat(char *name);
+PortSettings parsePortSpecification(const std::string &specification, const PortSettings &defaultSettings);
+StreamSinkSettings parseSinkSpecification(const std::string &specification);
+
+void signalHandler(int signalNumber);
+int addSignalNotifier(EventLoop &eventLoop, const std::string &logLevelFilePath, const EventLoop::TimerHandler &dumpMetrics);
+void logMetricsSnapshot();
+void receiveToStandardOutput(SerialSession &serialSession, char *data, size_t length);
+void lineToStandardOutput(SerialSession &serialSession, const char *line, size_t length);
+void frameToStandardOutput(SerialSession &serialSession, const char *frame, size_t length);
+void writeLine(const std::string &portName, uint64_t receiveTimestamp, const char *line, size_t length);
+void writeFrame(const std::string &portName, uint64_t receiveTimestamp, const char *frame, size_t length);
+void hexToStandardOutput(SerialSession &serialSession, char *data, size_t length);
+void hexFrameToStandardOutput(SerialSession &serialSession, const char *frame, size_t length);
+void writeHexDump(const std::string &portName, uint64_t offset, const char *data, size_t length, bool toStandardOutput);
+void commandResultToStandardOutput(SerialSession &serialSession, const CommandResult &commandResult);
+void forwardStandardInput(EventLoop &eventLoop, SessionManager &sessionManager);
+void runReplay(EventLoop &eventLoop, ReplayEngine &replayEngine, bool replayToPseudoTerminals, bool hexDumpEnabled,
+               const std::string &framingSpecification, const std::string &lineEnding);
+int decodeBinaryLog(const std::string &logPath);
+
+static EventLoop *mainEventLoop{nullptr};
+static int signalNotifierDescriptor{-1};
+static volatile sig_atomic_t logLevelReloadRequested{0};
+static volatile sig_atomic_t metricsDumpRequested{0};
+static std::shared_ptr<LogFile> hexLogFile{nullptr};
+static bool timestampsEnabled{false};
+/* Everything the ports print goes through here, never straight to stdout */
+static ConsoleOutput consoleOutput{STDOUT_FILENO};
+static const char *BINARY_LOG_SUFFIX{".blog"};
 
 int main(int argc, char *argv[]) {
 
     MessageLogger::initializeInstance(globalLogHandler);
+    registerLogSubsystems();
+    MessageLogger::setLogLevel(LogLevel::Info);
     opterr = 0;
     int optionIndex{0};
     int currentOption{0};
 
-    std::string portName{""};
-    BaudRate baudRate{BaudRate::BAUD9600};
-    StopBits stopBits{StopBits::ONE};
-    DataBits dataBits{DataBits::EIGHT};
-    Parity parity{Parity::NONE};
-    std::string lineEnding{"\n"};
-    while ( -1 != (currentOption = getopt_long(argc, argv, "vep:b:s:d:a:n:", longOptions, &optionIndex)) ) {
+    std::vector<std::string> portSpecifications{};
+    size_t workerCount{0};
+    OverflowPolicy logOverflowPolicy{OverflowPolicy::Block};
+    size_t logQueueSize{AsyncLogHandler::DEFAULT_CAPACITY};
+    std::string logLevelFilePath{""};
+    std::string capturePath{""};
+    uint64_t captureFileSize{CaptureWriter::DEFAULT_FILE_SIZE_LIMIT};
+    std::string replayPath{""};
+    double replaySpeed{1.0};
+    bool replayToPseudoTerminals{false};
+    std::string framingSpecification{""};
+    size_t metricsInterval{0};
+    bool terminalUiEnabled{false};
+    bool hexDumpEnabled{false};
+    std::string sendPath{""};
+    UploadPacing uploadPacing{std::chrono::microseconds{0}, std::chrono::milliseconds{0}};
+    std::string scriptPath{""};
+    std::string triggersPath{""};
+    bool binaryLogFormat{false};
+    std::string decodeLogPath{""};
+    std::vector<StreamSinkSettings> sinkSettings{};
+    PortServerOptions portServerOptions{"", PortServer::DEFAULT_CLIENT_QUEUE_LIMIT};
+    bool workerCountGiven{false};
+    bool lowLatencyEnabled{false};
+    bool reconnectEnabled{false};
+    bool autoDetectEnabled{false};
+    size_t jitterInterval{0};
+    LogFileSettings logFileSettings{LogFile::DEFAULT_SIZE_LIMIT, std::chrono::seconds{0}, LogFile::DEFAULT_RETAINED_FILES, LogSyncPolicy::Interval, LogFile::DEFAULT_SYNC_INTERVAL};
+    CommandOptions commandOptions{1, std::chrono::milliseconds{1000}, 0, CommandEngine::DEFAULT_RESPONSE_PATTERN, CommandEngine::DEFAULT_ERROR_PATTERN, false};
+    PortSettings defaultSettings{"", BaudRate::BAUD9600, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None};
+    while ( -1 != (currentOption = getopt_long(argc, argv, "vep:b:s:d:a:n:t:", longOptions, &optionIndex)) ) {
         switch (currentOption) {
             case 'p':
-                portName = optarg;
+                portSpecifications.emplace_back(optarg);
                 break;
             case 'b':
-                baudRate = tryParseBaudRate(optarg);
+                defaultSettings.baudRate = tryParseBaudRate(optarg);
                 break;
             case 's':
-                stopBits = tryParseStopBits(optarg);
+                defaultSettings.stopBits = tryParseStopBits(optarg);
                 break;
             case 'd':
-                dataBits = tryParseDataBits(optarg);
+                defaultSettings.dataBits = tryParseDataBits(optarg);
                 break;
             case 'a':
-                parity = tryParseParity(optarg);
+                defaultSettings.parity = tryParseParity(optarg);
                 break;
             case 'n':
-                lineEnding = tryParseLineEnding(optarg);
+                defaultSettings.lineEnding = tryParseLineEnding(optarg);
+                break;
+            case 't':
+                workerCount = tryParseCount(optarg, "threads");
+                workerCountGiven = true;
+                break;
+            case LOG_OVERFLOW_OPTION:
+                logOverflowPolicy = tryParseOverflowPolicy(optarg);
+                break;
+            case LOG_QUEUE_SIZE_OPTION:
+                logQueueSize = tryParseCount(optarg, "log queue size");
+                break;
+            case LOG_LEVEL_OPTION:
+                applyLogLevels(optarg);
+                break;
+            case LOG_LEVEL_FILE_OPTION:
+                logLevelFilePath = optarg;
+                reloadLogLevels(logLevelFilePath);
+                break;
+            case CAPTURE_OPTION:
+                capturePath = optarg;
+                break;
+            case CAPTURE_SIZE_OPTION:
+                captureFileSize = tryParseByteSize(optarg, "capture size");
+                break;
+            case REPLAY_OPTION:
+                replayPath = optarg;
+                break;
+            case REPLAY_SPEED_OPTION:
+                replaySpeed = tryParseReplaySpeed(optarg);
+                break;
+            case REPLAY_PTY_OPTION:
+                replayToPseudoTerminals = true;
+                break;
+            case LINES_OPTION:
+                framingSpecification = "line";
+                break;
+            case FRAMING_OPTION:
+                framingSpecification = optarg;
+                FramingCodec::create(framingSpecification, defaultSettings.lineEnding);
+                break;
+            case METRICS_INTERVAL_OPTION:
+                metricsInterval = tryParseCount(optarg, "metrics interval");
+                break;
+            case TUI_OPTION:
+                terminalUiEnabled = true;
+                break;
+            case HEX_OPTION:
+                hexDumpEnabled = true;
+                break;
+            case FLOW_CONTROL_OPTION:
+                defaultSettings.flowControl = tryParseFlowControl(optarg);
+                break;
+            case SEND_OPTION:
+                sendPath = optarg;
+                break;
+            case SEND_BYTE_DELAY_OPTION:
+                uploadPacing.byteDelay = std::chrono::microseconds{tryParseCount(optarg, "send byte delay", true)};
+                break;
+            case SEND_LINE_DELAY_OPTION:
+                uploadPacing.lineDelay = std::chrono::milliseconds{tryParseCount(optarg, "send line delay", true)};
+                break;
+            case SCRIPT_OPTION:
+                scriptPath = optarg;
+                break;
+            case WINDOW_OPTION:
+                commandOptions.window = tryParseCount(optarg, "window");
+                break;
+            case COMMAND_TIMEOUT_OPTION:
+                commandOptions.timeout = std::chrono::milliseconds{tryParseCount(optarg, "command timeout")};
+                break;
+            case COMMAND_RETRIES_OPTION:
+                commandOptions.retries = tryParseCount(optarg, "command retries", true);
+                break;
+            case RESPONSE_PATTERN_OPTION:
+                commandOptions.responsePattern = optarg;
+                break;
+            case ERROR_PATTERN_OPTION:
+                commandOptions.errorPattern = optarg;
+                break;
+            case COMMAND_TAGS_OPTION:
+                commandOptions.tagged = true;
+                break;
+            case LOG_FILE_SIZE_OPTION:
+                logFileSettings.sizeLimit = tryParseByteSize(optarg, "log file size", true);
+                break;
+            case LOG_FILE_COUNT_OPTION:
+                logFileSettings.retainedFiles = tryParseCount(optarg, "log file count");
+                break;
+            case LOG_ROTATE_INTERVAL_OPTION:
+                logFileSettings.rotateInterval = std::chrono::seconds{tryParseCount(optarg, "log rotate interval")};
+                break;
+            case LOG_SYNC_OPTION:
+                tryParseLogSync(optarg, logFileSettings);
+                break;
+            case LOG_FORMAT_OPTION:
+                binaryLogFormat = tryParseBinaryLogFormat(optarg);
+                break;
+            case DECODE_LOG_OPTION:
+                decodeLogPath = optarg;
+                break;
+            case SINK_OPTION:
+                sinkSettings.push_back(parseSinkSpecification(optarg));
+                break;
+            case DAEMON_OPTION:
+                portServerOptions.socketDirectory = optarg;
+                if (portServerOptions.socketDirectory.empty()) {
+                    throw std::runtime_error("Empty string not valid for parameter daemon");
+                }
+                break;
+            case CLIENT_QUEUE_SIZE_OPTION:
+                portServerOptions.clientQueueLimit = static_cast<size_t>(tryParseByteSize(optarg, "client queue size"));
+                break;
+            case LOW_LATENCY_OPTION:
+                lowLatencyEnabled = true;
+                break;
+            case TIMESTAMPS_OPTION:
+                timestampsEnabled = true;
+                break;
+            case JITTER_INTERVAL_OPTION:
+                jitterInterval = tryParseCount(optarg, "jitter interval");
+                break;
+            case RECONNECT_OPTION:
+                reconnectEnabled = true;
+                break;
+            case AUTO_OPTION:
+                autoDetectEnabled = true;
+                break;
+            case TRIGGERS_OPTION:
+                triggersPath = optarg;
                 break;
             case 'h':
                 displayHelp();
@@ -128,39 +376,735 @@ int main(int argc, char *argv[]) {
                 exit(EXIT_SUCCESS);
             case 'e':
                 ApplicationUtilities::verboseLogging = true;
+                MessageLogger::setLogLevel(LogLevel::Debug);
                 break;
             default:
                 LOG_WARN() << TStringFormat(R"(Unknown option "{0}", skipping)", longOptions[optionIndex].name);
                 break;
         }
     }
-    for (int i = 1; i < argc; i++) {
-        if ( (strlen(argv[i]) > 0) && (argv[i][0] != '-') ) {
-            portName = argv[i];
+    for (int i = optind; i < argc; i++) {
+        if (strlen(argv[i]) > 0) {
+            portSpecifications.emplace_back(argv[i]);
+        }
+    }
+    if (!decodeLogPath.empty()) {
+        return decodeBinaryLog(decodeLogPath);
+    }
+    /* Set up before anything is logged, so the version lines already go to
+     * the chosen log file */
+    std::shared_ptr<LogFile> logFile{nullptr};
+    try {
+        if (binaryLogFormat) {
+            logFile = std::make_shared<LogFile>(ApplicationUtilities::getLogFilePath() + BINARY_LOG_SUFFIX);
+            globalLogSink()->setBinaryLogWriter(std::make_shared<BinaryLogWriter>(logFile));
+        } else {
+            logFile = globalLogFile();
         }
+        logFile->setSettings(logFileSettings);
+    } catch (std::exception &e) {
+        LOG_WARN() << TStringFormat("{0}, log file settings ignored", e.what());
     }
     displayVersion();
 
-    if (portName.empty()) {
+    if ( (portSpecifications.empty()) && (replayPath.empty()) ) {
         displayHelp();
         LOG_FATAL() << "Please specify serial port with (or without) the -p option";
     }
-    LOG_INFO() << TStringFormat("Using LogFile {0}", ApplicationUtilities::getLogFilePath());
-    LOG_INFO() << TStringFormat("Using PortName {0}", portName);
-    LOG_INFO() << TStringFormat("Using BaudRate {0}", baudRateToString(baudRate));
-    LOG_INFO() << TStringFormat("Using DataBits {0}", dataBitsToString(dataBits));
-    LOG_INFO() << TStringFormat("Using StopBits {0}", stopBitsToString(stopBits));
-    LOG_INFO() << TStringFormat("Using Parity {0}", parityToString(parity));
+    LOG_INFO() << TStringFormat("Using LogFile {0}", logFile ? logFile->path() : ApplicationUtilities::getLogFilePath());
+    if (hexDumpEnabled) {
+        /* Dumps bypass the log queue and go straight to the log file, whose
+         * lock keeps each dump whole next to the log records; a binary log
+         * leaves them the text log file */
+        hexLogFile = logFile;
+        if (binaryLogFormat) {
+            try {
+                hexLogFile = globalLogFile();
+                hexLogFile->setSettings(logFileSettings);
+                LOG_INFO() << TStringFormat("Writing hex dumps to {0}", hexLogFile->path());
+            } catch (std::exception &e) {
+                hexLogFile.reset();
+            }
+        }
+        if (!hexLogFile) {
+            LOG_WARN() << "No log file for hex dumps, dumping to the console only";
+        }
+    }
+
+    bool daemonEnabled{ (!portServerOptions.socketDirectory.empty()) && (replayPath.empty()) };
+    if (daemonEnabled) {
+        /* The clients own the ports' input and output, so nothing else may
+         * write to them, and one loop serves every port unless asked */
+        if ( (!scriptPath.empty()) || (!sendPath.empty()) || (terminalUiEnabled) ) {
+            LOG_WARN() << "--script, --send and --tui are not used in daemon mode";
+            scriptPath.clear();
+            sendPath.clear();
+            terminalUiEnabled = false;
+        }
+        if (!workerCountGiven) {
+            workerCount = 1;
+        }
+    }
+    SessionManager sessionManager{workerCount};
+    std::vector<PortSettings> sessionSettings{};
+    for (const auto &it : portSpecifications) {
+        PortSettings portSettings{parsePortSpecification(it, defaultSettings)};
+        LOG_INFO() << TStringFormat("Using PortName {0} (BaudRate {1}, DataBits {2}, StopBits {3}, Parity {4}, FlowControl {5})",
+                                    portSettings.portName,
+                                    baudRateToString(portSettings.baudRate),
+                                    dataBitsToString(portSettings.dataBits),
+                                    stopBitsToString(portSettings.stopBits),
+                                    parityToString(portSettings.parity),
+                                    flowControlToString(portSettings.flowControl));
+        sessionManager.addSession(portSettings);
+        sessionSettings.push_back(portSettings);
+    }
+    if ( (autoDetectEnabled) && (replayPath.empty()) ) {
+        sessionManager.detectLineSettings();
+        sessionSettings = sessionManager.portSettings();
+    } else if (autoDetectEnabled) {
+        LOG_WARN() << "--auto is not used when replaying";
+    }
+    for (const auto &it : sinkSettings) {
+        if (!replayPath.empty()) {
+            LOG_WARN() << TStringFormat("Sink {0} is not used when replaying", it.path);
+            continue;
+        }
+        sessionManager.addStreamSink(it);
+        LOG_INFO() << TStringFormat("Copying received data to {0} ({1})", it.path,
+                                    (it.backpressure == SinkBackpressure::Drop) ? "dropping data it cannot take" : TStringFormat("buffering up to {0} bytes", it.queueLimit));
+    }
+
+    sessionManager.setLowLatency(lowLatencyEnabled);
+    sessionManager.setReconnect(reconnectEnabled);
+    sessionManager.setTimingReportInterval(std::chrono::seconds{jitterInterval});
+    if (daemonEnabled) {
+        sessionManager.setPortServers(portServerOptions);
+        LOG_INFO() << TStringFormat("Sharing ports in {0}, disconnecting clients more than {1} bytes behind", portServerOptions.socketDirectory, portServerOptions.clientQueueLimit);
+    } else if (!portServerOptions.socketDirectory.empty()) {
+        LOG_WARN() << "--daemon is not used when replaying";
+    }
+    if ( (!triggersPath.empty()) && (replayPath.empty()) ) {
+        std::shared_ptr<const TriggerSet> triggerSet{std::make_shared<TriggerSet>(TriggerSet::load(triggersPath))};
+        const TriggerAutomaton &automaton = triggerSet->automaton();
+        sessionManager.setTriggers(triggerSet);
+        LOG_INFO() << TStringFormat("Watching for {0} trigger(s) from {1} ({2} states, {3} start bytes, {4} prefilter)", triggerSet->triggers().size(), triggersPath,
+                                    automaton.stateCount(), automaton.startByteCount(), TriggerAutomaton::instructionSetName(automaton.instructionSet()));
+        if ( (triggerSet->usesAction(TriggerAction::Mark)) && (capturePath.empty()) ) {
+            LOG_WARN() << "Triggers that mark the capture do nothing without --capture";
+        }
+    } else if (!triggersPath.empty()) {
+        LOG_WARN() << "--triggers is not used when replaying";
+    }
+
+    EventLoop eventLoop{};
+    mainEventLoop = &eventLoop;
+    installSignalHandlers(signalHandler);
+
+    int exitCode{EXIT_SUCCESS};
+    /* The terminal UI and timestamps show whole lines (or frames), so they
+     * need a codec */
+    std::unique_ptr<TerminalUi> terminalUi{nullptr};
+    std::atomic<size_t> failedCommandCount{0};
+    bool scriptEnabled{ (!scriptPath.empty()) && (replayPath.empty()) };
+    if ( ( ( (terminalUiEnabled) && (replayPath.empty()) ) || ( (timestampsEnabled) && (!daemonEnabled) ) ) && (framingSpecification.empty()) ) {
+        framingSpecification = "line";
+    }
+    if (scriptEnabled) {
+        /* Script mode owns the ports' input, framing them into lines for the
+         * command engines, and stops once every port ran its script */
+        std::vector<std::string> commands{CommandEngine::loadScript(scriptPath)};
+        LOG_INFO() << TStringFormat("Running {0} command(s) from {1} with a window of {2}", commands.size(), scriptPath, commandOptions.window);
+        sessionManager.setCommandScript(commands, commandOptions, [&failedCommandCount](SerialSession &serialSession, const CommandResult &commandResult) {
+            if (commandResult.status != CommandStatus::Ok) {
+                failedCommandCount.fetch_add(1);
+            }
+            commandResultToStandardOutput(serialSession, commandResult);
+        }, [&eventLoop]() {
+            eventLoop.stop();
+        });
+    } else if (!framingSpecification.empty()) {
+        bool binaryFraming{FramingCodec::create(framingSpecification, defaultSettings.lineEnding)->isBinary()};
+        if ( (terminalUiEnabled) && (replayPath.empty()) ) {
+            terminalUi.reset(new TerminalUi{eventLoop, sessionManager, sessionSettings, binaryFraming || hexDumpEnabled});
+            SerialSession::FrameHandler terminalUiHandler{terminalUi->frameHandler()};
+            if (hexDumpEnabled) {
+                sessionManager.setFraming(framingSpecification, [terminalUiHandler](SerialSession &serialSession, const char *frame, size_t length) {
+                    terminalUiHandler(serialSession, frame, length);
+                    writeHexDump(serialSession.portSettings().portName, 0, frame, length, false);
+                });
+            } else {
+                sessionManager.setFraming(framingSpecification, terminalUiHandler);
+            }
+        } else if (hexDumpEnabled) {
+            sessionManager.setFraming(framingSpecification, hexFrameToStandardOutput);
+        } else {
+            sessionManager.setFraming(framingSpecification, binaryFraming ? frameToStandardOutput : lineToStandardOutput);
+        }
+    } else if (!daemonEnabled) {
+        sessionManager.setReceiveHandler(hexDumpEnabled ? hexToStandardOutput : receiveToStandardOutput);
+    }
+    sessionManager.setCloseHandler([&sessionManager, &eventLoop, &exitCode](SerialSession &, int) {
+        /* Runs on a worker thread, EventLoop::stop() is safe to call from there */
+        if (sessionManager.activeSessionCount() == 0) {
+            exitCode = EXIT_FAILURE;
+            eventLoop.stop();
+        }
+    });
+    AsyncLogHandler asyncLogHandler{globalLogSink(), logQueueSize, logOverflowPolicy};
+    MessageLogger::installLogHandler(asyncLogHandler);
+
+    /* Drop counts kept elsewhere are copied into gauges just before each
+     * snapshot, the per-port metrics are updated as traffic flows */
+    std::unique_ptr<CaptureWriter> captureWriter{nullptr};
+    MetricGauge droppedLogMessagesMetric{MetricsRegistry::instance().gauge("log.dropped_messages")};
+    MetricGauge droppedCaptureBytesMetric{MetricsRegistry::instance().gauge("capture.dropped_bytes")};
+    auto dumpMetrics = [&asyncLogHandler, &captureWriter, droppedLogMessagesMetric, droppedCaptureBytesMetric]() {
+        droppedLogMessagesMetric.set(static_cast<int64_t>(asyncLogHandler.droppedCount()));
+        if (captureWriter) {
+            droppedCaptureBytesMetric.set(static_cast<int64_t>(captureWriter->droppedBytes()));
+        }
+        logMetricsSnapshot();
+    };
+    signalNotifierDescriptor = addSignalNotifier(eventLoop, logLevelFilePath, dumpMetrics);
+    if (metricsInterval > 0) {
+        eventLoop.addTimer(std::chrono::seconds{metricsInterval}, dumpMetrics);
+    }
+    if ( (logFileSettings.syncPolicy == LogSyncPolicy::Interval) && ( (logFile) || (hexLogFile) ) ) {
+        /* A write only syncs once the interval has passed since the last
+         * sync, so the tail of a burst followed by silence is synced here */
+        std::shared_ptr<LogFile> dumpLogFile{hexLogFile};
+        eventLoop.addTimer(logFileSettings.syncInterval, [logFile, dumpLogFile]() {
+            if (logFile) {
+                logFile->sync();
+            }
+            if ( (dumpLogFile) && (dumpLogFile != logFile) ) {
+                dumpLogFile->sync();
+            }
+        });
+    }
+    if (!replayPath.empty()) {
+        /* No port to hold up, so a replay goes at the pace stdout is read */
+        ReplayEngine replayEngine{replayPath, replaySpeed};
+        runReplay(eventLoop, replayEngine, replayToPseudoTerminals, hexDumpEnabled, framingSpecification, defaultSettings.lineEnding);
+    } else {
+        consoleOutput.start();
+        if (!capturePath.empty()) {
+            captureWriter.reset(new CaptureWriter{capturePath, captureFileSize});
+            sessionManager.setCaptureWriter(captureWriter.get());
+            captureWriter->start();
+        }
+
+        std::shared_ptr<UploadSource> uploadSource{nullptr};
+        if (!sendPath.empty()) {
+            uploadSource = std::make_shared<UploadSource>(sendPath);
+            sessionManager.setUpload(uploadSource, uploadPacing);
+        }
+        sessionManager.start();
+        if (uploadSource) {
+            uploadSource->start();
+        }
+        if (terminalUi) {
+            /* Log records would scribble over the screen, they still go to
+             * the log file */
+            globalLogSink()->setConsoleEnabled(false);
+            terminalUi->start();
+        } else if ( (!scriptEnabled) && (!daemonEnabled) && (sendPath != "-") ) {
+            forwardStandardInput(eventLoop, sessionManager);
+        }
+
+        eventLoop.run();
+
+        if (terminalUi) {
+            terminalUi->stop();
+            globalLogSink()->setConsoleEnabled(true);
+        }
+        sessionManager.stop();
+        if (failedCommandCount.load() > 0) {
+            exitCode = EXIT_FAILURE;
+        }
+        if (uploadSource) {
+            uploadSource->stop();
+        }
+        if (captureWriter) {
+            captureWriter->stop();
+        }
+    }
+    consoleOutput.stop();
+    MessageLogger::installLogHandler(globalLogHandler);
+    asyncLogHandler.shutdown();
+    mainEventLoop = nullptr;
+    hexLogFile.reset();
+    if (logFile) {
+        logFile->sync();
+    }
+    return exitCode;
+}
+
+bool tryParseBinaryLogFormat(char *name)
+{
+    std::string nameCopy{name ? name : ""};
+    toLower(nameCopy);
+    if (nameCopy == "binary") {
+        return true;
+    } else if (nameCopy == "text") {
+        return false;
+    }
+    throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"log format\" (expected text or binary)", nameCopy));
+}
+
+void tryParseLogSync(char *name, LogFileSettings &logFileSettings)
+{
+    /* never, always, or the longest in milliseconds a record stays unsynced,
+     * where 0 is the same as always */
+    if ( (!name) || (strlen(name) == 0) ) {
+        throw std::runtime_error("Empty string not valid for parameter log sync");
+    }
+    std::string nameCopy{name};
+    toLower(nameCopy);
+    if (nameCopy == "never") {
+        logFileSettings.syncPolicy = LogSyncPolicy::Never;
+    } else if (nameCopy == "always") {
+        logFileSettings.syncPolicy = LogSyncPolicy::Always;
+    } else {
+        std::chrono::milliseconds syncInterval{tryParseCount(name, "log sync", true)};
+        if (syncInterval.count() == 0) {
+            logFileSettings.syncPolicy = LogSyncPolicy::Always;
+        } else {
+            logFileSettings.syncPolicy = LogSyncPolicy::Interval;
+            logFileSettings.syncInterval = syncInterval;
+        }
+    }
+}
+
+PortSettings parsePortSpecification(const std::string &specification, const PortSettings &defaultSettings)
+{
+    /* name[,baud-rate[,data-bits[,parity[,stop-bits[,flow-control]]]]], where empty fields
+     * (for example /dev/ttyUSB0,,seven) keep the command line defaults */
+    PortSettings portSettings{defaultSettings};
+    std::vector<std::string> fields{};
+    std::stringstream specificationStream{specification};
+    for (std::string field{""}; std::getline(specificationStream, field, ','); ) {
+        fields.push_back(field);
+    }
+    if ( (fields.empty()) || (fields[0].empty()) ) {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a valid port specification)", specification));
+    }
+    portSettings.portName = fields[0];
+    if ( (fields.size() > 1) && (!fields[1].empty()) ) {
+        portSettings.baudRate = tryParseBaudRate(&fields[1][0]);
+    }
+    if ( (fields.size() > 2) && (!fields[2].empty()) ) {
+        portSettings.dataBits = tryParseDataBits(&fields[2][0]);
+    }
+    if ( (fields.size() > 3) && (!fields[3].empty()) ) {
+        portSettings.parity = tryParseParity(&fields[3][0]);
+    }
+    if ( (fields.size() > 4) && (!fields[4].empty()) ) {
+        portSettings.stopBits = tryParseStopBits(&fields[4][0]);
+    }
+    if ( (fields.size() > 5) && (!fields[5].empty()) ) {
+        portSettings.flowControl = tryParseFlowControl(&fields[5][0]);
+    }
+    if (fields.size() > 6) {
+        throw std::runtime_error(TStringFormat(R"("{0}" has too many fields for a port specification)", specification));
+    }
+    return portSettings;
+}
+
+StreamSinkSettings parseSinkSpecification(const std::string &specification)
+{
+    /* path[,drop|buffer[,queue-size]], buffering up to 16M by default */
+    StreamSinkSettings sinkSettings{"", SinkBackpressure::Buffer, StreamFanout::DEFAULT_QUEUE_LIMIT};
+    std::vector<std::string> fields{};
+    std::stringstream specificationStream{specification};
+    for (std::string field{""}; std::getline(specificationStream, field, ','); ) {
+        fields.push_back(field);
+    }
+    if ( (fields.empty()) || (fields[0].empty()) ) {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a valid sink specification)", specification));
+    }
+    sinkSettings.path = fields[0];
+    if ( (fields.size() > 1) && (fields[1] == "drop") ) {
+        sinkSettings.backpressure = SinkBackpressure::Drop;
+    } else if ( (fields.size() > 1) && (fields[1] != "buffer") && (!fields[1].empty()) ) {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a valid sink backpressure policy (drop or buffer))", fields[1]));
+    }
+    if ( (fields.size() > 2) && (!fields[2].empty()) ) {
+        sinkSettings.queueLimit = static_cast<size_t>(tryParseByteSize(&fields[2][0], "sink queue size"));
+    }
+    if (fields.size() > 3) {
+        throw std::runtime_error(TStringFormat(R"("{0}" has too many fields for a sink specification)", specification));
+    }
+    return sinkSettings;
+}
+
+size_t tryParseCount(char *name, const char *parameterName, bool allowZero)
+{
+    /* 0 only where the option gives it a meaning */
+    if ( (!name) || (strlen(name) == 0) ) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("Empty string not valid for parameter {0}", parameterName));
+    }
+    char *endPointer{nullptr};
+    unsigned long count{std::strtoul(name, &endPointer, 10)};
+    bool haveDigits{endPointer != name};
+    if ( (!haveDigits) || (*endPointer != '\0') || ( (count == 0) && (!allowZero) ) ) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"{1}\"", name, parameterName));
+    }
+    return static_cast<size_t>(count);
+}
+
+uint64_t tryParseByteSize(char *name, const char *parameterName, bool allowZero)
+{
+    /* A plain number of bytes, or one with a K, M or G (binary) suffix; 0
+     * only where the option gives it a meaning */
+    if ( (!name) || (strlen(name) == 0) ) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("Empty string not valid for parameter {0}", parameterName));
+    }
+    char *endPointer{nullptr};
+    unsigned long long size{std::strtoull(name, &endPointer, 10)};
+    bool haveDigits{endPointer != name};
+    switch (std::toupper(static_cast<unsigned char>(*endPointer))) {
+        case 'K':
+            size <<= 10;
+            endPointer++;
+            break;
+        case 'M':
+            size <<= 20;
+            endPointer++;
+            break;
+        case 'G':
+            size <<= 30;
+            endPointer++;
+            break;
+        default:
+            break;
+    }
+    if ( (!haveDigits) || (*endPointer != '\0') || ( (size == 0) && (!allowZero) ) ) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"{1}\"", name, parameterName));
+    }
+    return static_cast<uint64_t>(size);
+}
+
+double tryParseReplaySpeed(char *name)
+{
+    /* A multiple of the recorded speed, or "max" to ignore the timestamps */
+    if ( (!name) || (strlen(name) == 0) ) {
+        throw std::runtime_error("Empty string not valid for parameter replay speed");
+    }
+    std::string nameCopy{name};
+    toLower(nameCopy);
+    if (nameCopy == "max") {
+        return ReplayEngine::MAXIMUM_SPEED;
+    }
+    char *endPointer{nullptr};
+    double speed{std::strtod(name, &endPointer)};
+    if ( (*endPointer != '\0') || (!(speed > 0.0)) ) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"replay speed\"", name));
+    }
+    return speed;
+}
+
+OverflowPolicy tryParseOverflowPolicy(char *name)
+{
+    if (!name) {
+        throw std::runtime_error("Empty string not valid for parameter log overflow");
+    }
+    std::string nameCopy{name};
+    toLower(nameCopy);
+    if (nameCopy.empty()) {
+        throw std::runtime_error("Empty string not valid for parameter log overflow");
+    }
+    if (startsWith(nameCopy, "block")) {
+        return OverflowPolicy::Block;
+    } else if ( (startsWith(nameCopy, "drop-oldest")) || (startsWith(nameCopy, "oldest")) ) {
+        return OverflowPolicy::DropOldest;
+    } else if ( (startsWith(nameCopy, "drop-newest")) || (startsWith(nameCopy, "newest")) || (startsWith(nameCopy, "count")) ) {
+        return OverflowPolicy::DropNewest;
+    } else {
+        throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"log overflow\"", name));
+    }
+}
+
+void signalHandler(int signalNumber)
+{
+    switch (signalNumber) {
+        case SIGHUP:
+        case SIGINT:
+        case SIGQUIT:
+        case SIGTERM:
+            if (mainEventLoop) {
+                mainEventLoop->stop();
+            }
+            break;
+        case SIGUSR1:
+        case SIGUSR2:
+            if (signalNumber == SIGUSR1) {
+                metricsDumpRequested = 1;
+            } else {
+                logLevelReloadRequested = 1;
+            }
+            if (signalNotifierDescriptor != -1) {
+                uint64_t increment{1};
+                ssize_t writeResult{write(signalNotifierDescriptor, &increment, sizeof(increment))};
+                (void)writeResult;
+            }
+            break;
+        case SIGILL:
+        case SIGFPE:
+        case SIGABRT:
+            signal(signalNumber, SIG_DFL);
+            raise(signalNumber);
+            break;
+        default:
+            break;
+    }
+}
+
+int addSignalNotifier(EventLoop &eventLoop, const std::string &logLevelFilePath, const EventLoop::TimerHandler &dumpMetrics)
+{
+    /* The signal handler only sets a flag and bumps this eventfd, the
+     * actual work happens here on the main loop */
+    int notifierDescriptor{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+    if (notifierDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to create signal notifier ({0})", strerror(errno)));
+    }
+    eventLoop.addDescriptor(notifierDescriptor, EPOLLIN, [notifierDescriptor, logLevelFilePath, dumpMetrics](uint32_t) {
+        uint64_t counter{0};
+        ssize_t readResult{read(notifierDescriptor, &counter, sizeof(counter))};
+        (void)readResult;
+        if (logLevelReloadRequested) {
+            logLevelReloadRequested = 0;
+            reloadLogLevels(logLevelFilePath);
+        }
+        if (metricsDumpRequested) {
+            metricsDumpRequested = 0;
+            dumpMetrics();
+        }
+    });
+    return notifierDescriptor;
+}
+
+void logMetricsSnapshot()
+{
+    std::vector<std::string> snapshot{MetricsRegistry::instance().snapshot()};
+    LOG_INFO(METRICS_LOG_SUBSYSTEM) << TStringFormat("Metrics snapshot, {0} metric(s)", snapshot.size());
+    for (const auto &line : snapshot) {
+        LOG_INFO(METRICS_LOG_SUBSYSTEM) << line;
+    }
+}
+
+void receiveToStandardOutput(SerialSession &serialSession, char *data, size_t length)
+{
+    (void)serialSession;
+    consoleOutput.write(data, length);
+}
+
+void runReplay(EventLoop &eventLoop, ReplayEngine &replayEngine, bool replayToPseudoTerminals, bool hexDumpEnabled,
+               const std::string &framingSpecification, const std::string &lineEnding)
+{
+    /* One codec per captured port, with the timestamp of the port's latest
+     * chunk, all used on the replay thread */
+    std::vector<std::unique_ptr<FramingCodec>> framingCodecs{};
+    std::vector<uint64_t> receiveTimestamps(replayEngine.portNames().size(), 0);
+    if (replayToPseudoTerminals) {
+        if (!framingSpecification.empty()) {
+            LOG_WARN() << "--framing, --lines and --timestamps are not used when replaying to pseudo-terminals";
+        }
+        replayEngine.openPseudoTerminals();
+        for (size_t i = 0; i < replayEngine.portNames().size(); i++) {
+            LOG_INFO() << TStringFormat("Replaying {0} on {1}", replayEngine.portNames()[i], replayEngine.pseudoTerminalName(static_cast<uint16_t>(i)));
+        }
+        /* Closing the master side now could throw away what the reader has
+         * not picked up yet, so the terminals stay up until interrupted */
+        replayEngine.setFinishedHandler([]() {
+            LOG_INFO() << "Replay finished, interrupt to close the pseudo-terminals";
+        });
+    } else if (!framingSpecification.empty()) {
+        /* Frames and lines are printed as they would have been live, with
+         * the recorded receive timestamps */
+        for (size_t i = 0; i < replayEngine.portNames().size(); i++) {
+            const std::string &portName = replayEngine.portNames()[i];
+            framingCodecs.push_back(FramingCodec::create(framingSpecification, lineEnding));
+            if (hexDumpEnabled) {
+                framingCodecs.back()->setFrameHandler([&portName](const char *frame, size_t length) {
+                    writeHexDump(portName, 0, frame, length, true);
+                });
+            } else if (framingCodecs.back()->isBinary()) {
+                framingCodecs.back()->setFrameHandler([&portName, &receiveTimestamps, i](const char *frame, size_t length) {
+                    writeFrame(portName, receiveTimestamps[i], frame, length);
+                });
+            } else {
+                framingCodecs.back()->setFrameHandler([&portName, &receiveTimestamps, i](const char *line, size_t length) {
+                    writeLine(portName, receiveTimestamps[i], line, length);
+                });
+            }
+        }
+        replayEngine.setReceiveHandler([&framingCodecs, &receiveTimestamps](uint16_t portId, uint64_t timestampNs, char *data, size_t length) {
+            receiveTimestamps[portId] = timestampNs;
+            framingCodecs[portId]->decode(data, length);
+        });
+        replayEngine.setFinishedHandler([&eventLoop, &framingCodecs]() {
+            for (auto &it : framingCodecs) {
+                it->flush();
+            }
+            eventLoop.stop();
+        });
+    } else {
+        if (hexDumpEnabled) {
+            /* Offsets count from the start of each port's recorded stream */
+            std::shared_ptr<std::vector<uint64_t>> portOffsets{std::make_shared<std::vector<uint64_t>>(replayEngine.portNames().size(), 0)};
+            replayEngine.setReceiveHandler([&replayEngine, portOffsets](uint16_t portId, uint64_t, char *data, size_t length) {
+                writeHexDump(replayEngine.portNames()[portId], (*portOffsets)[portId], data, length, true);
+                (*portOffsets)[portId] += length;
+            });
+        } else {
+            replayEngine.setReceiveHandler([](uint16_t, uint64_t, char *data, size_t length) {
+                consoleOutput.write(data, length);
+            });
+        }
+        replayEngine.setFinishedHandler([&eventLoop]() {
+            eventLoop.stop();
+        });
+    }
+    replayEngine.start();
+    eventLoop.run();
+    replayEngine.stop();
+}
+
+void lineToStandardOutput(SerialSession &serialSession, const char *line, size_t length)
+{
+    writeLine(serialSession.portSettings().portName, serialSession.receiveTimestamp(), line, length);
+}
+
+void writeLine(const std::string &portName, uint64_t receiveTimestamp, const char *line, size_t length)
+{
+    /* One write per line keeps lines from different ports whole */
+    thread_local std::string outputLine{};
+    outputLine.clear();
+    ConsoleOutput::appendLine(outputLine, portName, receiveTimestamp, timestampsEnabled, line, length);
+    consoleOutput.write(outputLine.data(), outputLine.size());
+}
 
+void commandResultToStandardOutput(SerialSession &serialSession, const CommandResult &commandResult)
+{
+    std::string outputLine{TMessageLogger::TStringFormat("{0}: #{1} {2} after {3} attempt(s) in {4} us: {5} -> {6}\n",
+                                                          serialSession.portSettings().portName,
+                                                          commandResult.index + 1,
+                                                          CommandEngine::statusName(commandResult.status),
+                                                          commandResult.attempts,
+                                                          std::chrono::duration_cast<std::chrono::microseconds>(commandResult.roundTrip).count(),
+                                                          commandResult.command,
+                                                          commandResult.response)};
+    consoleOutput.write(outputLine.data(), outputLine.size());
+}
 
-    std::shared_ptr<SerialPort> serialPort{std::make_shared<SerialPort>(portName, baudRate, dataBits, stopBits, parity)};
-    serialPort->setLineEnding(lineEnding);
-    serialPort->openPort();
+void frameToStandardOutput(SerialSession &serialSession, const char *frame, size_t length)
+{
+    writeFrame(serialSession.portSettings().portName, serialSession.receiveTimestamp(), frame, length);
+}
 
+void writeFrame(const std::string &portName, uint64_t receiveTimestamp, const char *frame, size_t length)
+{
+    static const char HEX_DIGITS[]{"0123456789abcdef"};
+    thread_local std::string outputLine{};
+    outputLine.clear();
+    if (timestampsEnabled) {
+        ConsoleOutput::appendTimestamp(outputLine, receiveTimestamp);
+    }
+    outputLine.append(portName);
+    outputLine.append(TStringFormat(": [{0}]", length));
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte{static_cast<unsigned char>(frame[i])};
+        outputLine.push_back(' ');
+        outputLine.push_back(HEX_DIGITS[byte >> 4]);
+        outputLine.push_back(HEX_DIGITS[byte & 0x0F]);
+    }
+    outputLine.push_back('\n');
+    consoleOutput.write(outputLine.data(), outputLine.size());
+}
 
+void hexToStandardOutput(SerialSession &serialSession, char *data, size_t length)
+{
+    /* The channel has already counted this read, so the offset of its first
+     * byte in the port's stream is what came before it */
+    uint64_t offset{serialSession.channel()->bytesRead() - length};
+    writeHexDump(serialSession.portSettings().portName, offset, data, length, true);
+}
 
+void hexFrameToStandardOutput(SerialSession &serialSession, const char *frame, size_t length)
+{
+    writeHexDump(serialSession.portSettings().portName, 0, frame, length, true);
+}
 
-    return 0;
+void writeHexDump(const std::string &portName, uint64_t offset, const char *data, size_t length, bool toStandardOutput)
+{
+    /* One dumper per thread, its buffer is reused for every dump; each dump
+     * is one write() per destination so ports do not interleave mid-row */
+    thread_local HexDumper hexDumper{};
+    thread_local std::string prefix{};
+    prefix.assign(portName);
+    prefix.append(": ");
+    size_t textLength{hexDumper.dump(prefix, offset, data, length)};
+    if (toStandardOutput) {
+        consoleOutput.write(hexDumper.text(), textLength);
+    }
+    if (hexLogFile) {
+        hexLogFile->write(hexDumper.text(), textLength);
+    }
+}
+
+int decodeBinaryLog(const std::string &logPath)
+{
+    try {
+        BinaryLogReader binaryLogReader{logPath};
+        binaryLogReader.renderText([](const char *text, size_t length) {
+            writeAll(STDOUT_FILENO, text, length);
+        });
+        if (binaryLogReader.truncatedFileCount() > 0) {
+            std::cerr << TMessageLogger::TStringFormat("{0} file(s) ended with an incomplete record", binaryLogReader.truncatedFileCount()) << std::endl;
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void forwardStandardInput(EventLoop &eventLoop, SessionManager &sessionManager)
+{
+    /* Complete lines typed on stdin are sent to every port with its configured
+     * line ending, anything after the last newline waits for the next read */
+    std::shared_ptr<std::string> partialLine{std::make_shared<std::string>()};
+    auto stdinHandler = [&eventLoop, &sessionManager, partialLine](uint32_t) {
+        char inputBuffer[4096];
+        ssize_t bytesRead{read(STDIN_FILENO, inputBuffer, sizeof(inputBuffer))};
+        if ( (bytesRead == -1) && ( (errno == EINTR) || (errno == EAGAIN) ) ) {
+            return;
+        }
+        if (bytesRead <= 0) {
+            if (!partialLine->empty()) {
+                sessionManager.broadcastLine(*partialLine);
+                partialLine->clear();
+            }
+            eventLoop.removeDescriptor(STDIN_FILENO);
+            return;
+        }
+        partialLine->append(inputBuffer, static_cast<size_t>(bytesRead));
+        size_t lineStart{0};
+        size_t lineEnd{partialLine->find('\n')};
+        while (lineEnd != std::string::npos) {
+            sessionManager.broadcastLine(partialLine->substr(lineStart, lineEnd - lineStart));
+            lineStart = lineEnd + 1;
+            lineEnd = partialLine->find('\n', lineStart);
+        }
+        partialLine->erase(0, lineStart);
+    };
+    try {
+        eventLoop.addDescriptor(STDIN_FILENO, EPOLLIN, stdinHandler);
+    } catch (std::exception &e) {
+        LOG_DEBUG() << TStringFormat("Not forwarding standard input ({0})", e.what());
+    }
 }
 
 BaudRate tryParseBaudRate(char *name)
@@ -200,6 +1144,20 @@ StopBits tryParseStopBits(char *name)
     }
 }
 
+FlowControl tryParseFlowControl(char *name)
+{
+    if (!name) {
+        throw std::runtime_error("Empty string not valid for parameter flow control");
+    }
+    std::string nameCopy{name};
+    toLower(nameCopy);
+    auto found = flowControlLookup.find(nameCopy);
+    if (found == flowControlLookup.end()) {
+        throw std::runtime_error(TMessageLogger::TStringFormat("{0} is not a valid value for parameter \"flow control\"", name));
+    }
+    return found->second;
+}
+
 DataBits tryParseDataBits(char *name)
 {
     if (!name) {
@@ -255,51 +1213,33 @@ std::string tryParseLineEnding(char *name)
         return "\n";
     } else if ( (nameCopy[0] == 'c') || (startsWith(nameCopy, "cr")) ) {
         if (nameCopy.find("lf") == std::string::npos) {
-            return "\r\n";
-        } else {
             return "\r";
-        }
-    } else {
-        return std::string{name};
-    }
-}
-
-std::string baudRateToString(BaudRate baudRate)
-{
-    for (const auto &it : baudRateLookup) {
-        if (it.second == baudRate) {
-            return it.first;
-        }
-    }
-    return "";
-}
-
-std::string dataBitsToString(DataBits dataBits)
-{
-    for (const auto &it : dataBitsLookup) {
-        if (it.second == dataBits) {
-            return it.first;
+        } else {
+            return "\r\n";
         }
     }
-    return "";
-}
-
-std::string stopBitsToString(StopBits stopBits)
-{
-    for (const auto &it : stopBitsLookup) {
-        if (it.second == stopBits) {
-            return it.first;
+    /* Anything else is taken literally, apart from the escapes \n, \r, \t
+     * and \\, so that -n '\r\n' means what it looks like */
+    std::string lineEnding{""};
+    for (const char *it = name; *it != '\0'; it++) {
+        if ( (*it != '\\') || (*(it + 1) == '\0') ) {
+            lineEnding.push_back(*it);
+            continue;
         }
-    }
-    return "";
-}
-
-std::string parityToString(Parity parity)
-{
-    for (const auto &it : parityLookup) {
-        if (it.second == parity) {
-            return it.first;
+        switch (*++it) {
+            case 'n':
+                lineEnding.push_back('\n');
+                break;
+            case 'r':
+                lineEnding.push_back('\r');
+                break;
+            case 't':
+                lineEnding.push_back('\t');
+                break;
+            default:
+                lineEnding.push_back(*it);
+                break;
         }
     }
-    return "";
+    return lineEnding;
 }
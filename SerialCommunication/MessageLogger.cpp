@@ -2,11 +2,18 @@
 
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 namespace TMessageLogger {
 
 MessageLogger *messageLogger{nullptr};
 
+std::atomic<int> logLevelThresholds[MAXIMUM_LOG_SUBSYSTEMS]{};
+
 namespace {
     void defaultLogFunction(LogLevel logLevel, LogContext logContext, const std::string &str) {
         std::ostream *outputStream{nullptr};
@@ -32,8 +39,13 @@ namespace {
 } //Global namespace
 
 MessageLogger::MessageLogger() :
-        m_logHandler{defaultLogFunction}
-{ }
+        m_logHandler{nullptr},
+        m_installMutex{},
+        m_installedHandlers{}
+{
+    this->m_installedHandlers.emplace_back(new LogFunction{defaultLogFunction});
+    this->m_logHandler.store(this->m_installedHandlers.back().get());
+}
 
 
 
@@ -50,19 +62,227 @@ LogFunction MessageLogger::initializeInstance(const LogFunction &logHandler)
     if (messageLogger == nullptr) {
         messageLogger = new MessageLogger{};
     }
-    LogFunction function{messageLogger->m_logHandler};
-    messageLogger->installLogHandler(logHandler);
-    return function;
+    return messageLogger->installLogHandler(logHandler);
 }
 
 LogFunction MessageLogger::installLogHandler(const LogFunction &logHandler) {
-    auto tempLogger = messageLogger->m_logHandler;
-    messageLogger->m_logHandler = logHandler;
-    return tempLogger;
+    std::lock_guard<std::mutex> installLock{messageLogger->m_installMutex};
+    messageLogger->m_installedHandlers.emplace_back(new LogFunction{logHandler});
+    LogFunction *previous{messageLogger->m_logHandler.exchange(messageLogger->m_installedHandlers.back().get(), std::memory_order_acq_rel)};
+    return *previous;
+}
+
+namespace {
+    const size_t LOG_BUFFERS_PER_THREAD{4};
+    const size_t INITIAL_LOG_BUFFER_CAPACITY{256};
+
+    struct LogBufferPool
+    {
+        std::string buffers[LOG_BUFFERS_PER_THREAD];
+        bool inUse[LOG_BUFFERS_PER_THREAD];
+
+        LogBufferPool() :
+            inUse{}
+        {
+            for (auto &it : this->buffers) {
+                it.reserve(INITIAL_LOG_BUFFER_CAPACITY);
+            }
+        }
+    };
+
+    LogBufferPool &logBufferPool()
+    {
+        static thread_local LogBufferPool pool{};
+        return pool;
+    }
+} //Global namespace
+
+std::string *acquireLogBuffer()
+{
+    LogBufferPool &pool = logBufferPool();
+    for (size_t i = 0; i < LOG_BUFFERS_PER_THREAD; i++) {
+        if (!pool.inUse[i]) {
+            pool.inUse[i] = true;
+            pool.buffers[i].clear();
+            return &pool.buffers[i];
+        }
+    }
+    /* Deeper nesting than the pool covers, fall back to a private buffer */
+    return new std::string{};
+}
+
+void releaseLogBuffer(std::string *logBuffer)
+{
+    LogBufferPool &pool = logBufferPool();
+    for (size_t i = 0; i < LOG_BUFFERS_PER_THREAD; i++) {
+        if (logBuffer == &pool.buffers[i]) {
+            pool.inUse[i] = false;
+            return;
+        }
+    }
+    delete logBuffer;
+}
+
+void appendFormattedUnsigned(std::string &output, unsigned long long value)
+{
+    char digits[24];
+    char *digitsEnd{digits + sizeof(digits)};
+    char *digitsBegin{digitsEnd};
+    do {
+        *--digitsBegin = static_cast<char>('0' + (value % 10));
+        value /= 10;
+    } while (value != 0);
+    output.append(digitsBegin, static_cast<size_t>(digitsEnd - digitsBegin));
+}
+
+void appendFormattedSigned(std::string &output, long long value)
+{
+    if (value < 0) {
+        output.push_back('-');
+        appendFormattedUnsigned(output, 0ULL - static_cast<unsigned long long>(value));
+    } else {
+        appendFormattedUnsigned(output, static_cast<unsigned long long>(value));
+    }
+}
+
+/* %g with the default precision of 6 is what std::ostream produces for
+ * floating point values without any manipulators */
+void appendFormattedFloatingPoint(std::string &output, double value)
+{
+    char buffer[64];
+    int length{snprintf(buffer, sizeof(buffer), "%g", value)};
+    if (length > 0) {
+        output.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+void appendFormattedFloatingPoint(std::string &output, long double value)
+{
+    char buffer[64];
+    int length{snprintf(buffer, sizeof(buffer), "%Lg", value)};
+    if (length > 0) {
+        output.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+namespace {
+    const size_t MAXIMUM_CACHED_FORMATS{512};
+
+    void parseFormatInto(const char *formatting, ParsedFormat &parsedFormat)
+    {
+        struct Token
+        {
+            size_t offset;
+            size_t length;
+            unsigned long long value;
+        };
+        parsedFormat.formatting.assign(formatting);
+        parsedFormat.segments.clear();
+
+        /* Match exactly one opening brace, one or more numeric digit,
+         * then exactly one closing brace, identifying a token */
+        std::vector<Token> tokens{};
+        const std::string &source = parsedFormat.formatting;
+        for (size_t position = 0; position < source.size(); position++) {
+            if (source[position] != '{') {
+                continue;
+            }
+            size_t digitPosition{position + 1};
+            unsigned long long value{0};
+            while ( (digitPosition < source.size()) && (source[digitPosition] >= '0') && (source[digitPosition] <= '9') ) {
+                value = std::min(value * 10 + static_cast<unsigned long long>(source[digitPosition] - '0'), 1ULL << 48);
+                digitPosition++;
+            }
+            if ( (digitPosition > position + 1) && (digitPosition < source.size()) && (source[digitPosition] == '}') ) {
+                tokens.push_back(Token{position, digitPosition + 1 - position, value});
+                position = digitPosition;
+            }
+        }
+
+        std::vector<unsigned long long> distinctValues{};
+        for (const auto &it : tokens) {
+            distinctValues.push_back(it.value);
+        }
+        std::sort(distinctValues.begin(), distinctValues.end());
+        distinctValues.erase(std::unique(distinctValues.begin(), distinctValues.end()), distinctValues.end());
+        parsedFormat.distinctTokenCount = distinctValues.size();
+
+        size_t literalOffset{0};
+        parsedFormat.literalLength = 0;
+        for (const auto &it : tokens) {
+            size_t argumentRank{static_cast<size_t>(std::lower_bound(distinctValues.begin(), distinctValues.end(), it.value) - distinctValues.begin())};
+            parsedFormat.segments.push_back(FormatSegment{literalOffset, it.offset - literalOffset, it.offset, it.length, argumentRank});
+            parsedFormat.literalLength += it.offset - literalOffset;
+            literalOffset = it.offset + it.length;
+        }
+        parsedFormat.trailingOffset = literalOffset;
+        parsedFormat.literalLength += source.size() - literalOffset;
+    }
+} //Global namespace
+
+const ParsedFormat &parseFormat(const char *formatting, ParsedFormat &scratch)
+{
+    static thread_local std::unordered_map<const char *, ParsedFormat> parsedFormats{};
+    auto found = parsedFormats.find(formatting);
+    if (found != parsedFormats.end()) {
+        if (strcmp(found->second.formatting.c_str(), formatting) != 0) {
+            parseFormatInto(formatting, found->second);
+        }
+        return found->second;
+    }
+    if (parsedFormats.size() >= MAXIMUM_CACHED_FORMATS) {
+        parseFormatInto(formatting, scratch);
+        return scratch;
+    }
+    ParsedFormat &parsedFormat = parsedFormats[formatting];
+    parseFormatInto(formatting, parsedFormat);
+    return parsedFormat;
+}
+
+namespace {
+    std::string subsystemNames[MAXIMUM_LOG_SUBSYSTEMS]{};
+    std::mutex subsystemNameMutex{};
+} //Global namespace
+
+void MessageLogger::setLogLevel(LogLevel logLevel)
+{
+    for (auto &it : logLevelThresholds) {
+        it.store(static_cast<int>(logLevel), std::memory_order_relaxed);
+    }
+}
+
+void MessageLogger::setLogLevel(LogSubsystem subsystem, LogLevel logLevel)
+{
+    logLevelThresholds[logSubsystem(subsystem)].store(static_cast<int>(logLevel), std::memory_order_relaxed);
+}
+
+LogLevel MessageLogger::logLevel(LogSubsystem subsystem)
+{
+    return static_cast<LogLevel>(logLevelThresholds[logSubsystem(subsystem)].load(std::memory_order_relaxed));
+}
+
+void MessageLogger::setSubsystemName(LogSubsystem subsystem, const std::string &name)
+{
+    std::lock_guard<std::mutex> subsystemNameLock{subsystemNameMutex};
+    subsystemNames[logSubsystem(subsystem)] = name;
+}
+
+bool MessageLogger::findSubsystem(const std::string &name, LogSubsystem *subsystem)
+{
+    std::lock_guard<std::mutex> subsystemNameLock{subsystemNameMutex};
+    for (LogSubsystem i = 0; i < MAXIMUM_LOG_SUBSYSTEMS; i++) {
+        if ( (!subsystemNames[i].empty()) && (subsystemNames[i] == name) ) {
+            if (subsystem) {
+                *subsystem = i;
+            }
+            return true;
+        }
+    }
+    return false;
 }
 
 void MessageLogger::log(const LogMessage &logger) {
-    messageLogger->m_logHandler.operator()(logger.logLevel(), logger.logContext(), logger.logMessage());
+    (*messageLogger->m_logHandler.load(std::memory_order_acquire))(logger.logLevel(), logger.logContext(), logger.logMessage());
 }
 
 
@@ -3,11 +3,15 @@
 
 #include <sstream>
 
+#include <atomic>
 #include <string>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <ctime>
 #include <iomanip>
-#include <regex>
+#include <stdexcept>
+#include <vector>
 
 namespace TMessageLogger {
 
@@ -28,6 +32,17 @@ struct LogContext
 class LogMessage;
 using LogFunction = std::function<void(LogLevel, LogContext, const std::string &)>;
 
+/* Log statements can be tagged with a subsystem, each of which has its own
+ * runtime threshold. Subsystem 0 is the default for untagged statements */
+using LogSubsystem = unsigned int;
+const LogSubsystem DEFAULT_LOG_SUBSYSTEM{0};
+const LogSubsystem MAXIMUM_LOG_SUBSYSTEMS{32};
+
+extern std::atomic<int> logLevelThresholds[MAXIMUM_LOG_SUBSYSTEMS];
+
+inline LogSubsystem logSubsystem() { return DEFAULT_LOG_SUBSYSTEM; }
+inline LogSubsystem logSubsystem(LogSubsystem subsystem) { return (subsystem < MAXIMUM_LOG_SUBSYSTEMS) ? subsystem : DEFAULT_LOG_SUBSYSTEM; }
+
 class MessageLogger
 {
     friend class LogMessage;
@@ -41,8 +56,25 @@ public:
     static LogFunction initializeInstance(const LogFunction &logHandler);
     static LogFunction installLogHandler(const LogFunction &logHandler);
 
+    static void setLogLevel(LogLevel logLevel);
+    static void setLogLevel(LogSubsystem subsystem, LogLevel logLevel);
+    static LogLevel logLevel(LogSubsystem subsystem = DEFAULT_LOG_SUBSYSTEM);
+    static void setSubsystemName(LogSubsystem subsystem, const std::string &name);
+    static bool findSubsystem(const std::string &name, LogSubsystem *subsystem);
+
+    /* Called by the LOG_* macros before anything is formatted, so this is
+     * a single relaxed load. Fatal messages are never filtered */
+    static inline bool isEnabled(LogLevel logLevel, LogSubsystem subsystem = DEFAULT_LOG_SUBSYSTEM) {
+        return (logLevel == LogLevel::Fatal) || (static_cast<int>(logLevel) >= logLevelThresholds[subsystem].load(std::memory_order_relaxed));
+    }
+
 private:
-    std::function<void(LogLevel, LogContext, const std::string &)> m_logHandler;
+    /* Published atomically, since handlers are installed while other threads
+     * log. A replaced handler is kept alive in m_installedHandlers, as a
+     * thread may still be inside it; there are only ever a few */
+    std::atomic<LogFunction *> m_logHandler;
+    std::mutex m_installMutex;
+    std::vector<std::unique_ptr<LogFunction>> m_installedHandlers;
 
     MessageLogger();
     static void log(const LogMessage &logger);
@@ -52,13 +84,73 @@ private:
 extern MessageLogger *messageLogger;
 
 
+/* Appends the text representation of a value to a string. Integers,
+ * floating point values, characters and strings are written directly,
+ * producing the same text std::ostream would, and anything else falls
+ * back to its operator<< */
+inline void appendFormatted(std::string &output, const std::string &value) { output.append(value); }
+inline void appendFormatted(std::string &output, const char *value) { if (value) { output.append(value); } }
+inline void appendFormatted(std::string &output, char *value) { appendFormatted(output, static_cast<const char *>(value)); }
+inline void appendFormatted(std::string &output, char value) { output.push_back(value); }
+inline void appendFormatted(std::string &output, signed char value) { output.push_back(static_cast<char>(value)); }
+inline void appendFormatted(std::string &output, unsigned char value) { output.push_back(static_cast<char>(value)); }
+inline void appendFormatted(std::string &output, bool value) { output.push_back(value ? '1' : '0'); }
+
+void appendFormattedUnsigned(std::string &output, unsigned long long value);
+void appendFormattedSigned(std::string &output, long long value);
+void appendFormattedFloatingPoint(std::string &output, double value);
+void appendFormattedFloatingPoint(std::string &output, long double value);
+
+inline void appendFormatted(std::string &output, short value) { appendFormattedSigned(output, value); }
+inline void appendFormatted(std::string &output, int value) { appendFormattedSigned(output, value); }
+inline void appendFormatted(std::string &output, long value) { appendFormattedSigned(output, value); }
+inline void appendFormatted(std::string &output, long long value) { appendFormattedSigned(output, value); }
+inline void appendFormatted(std::string &output, unsigned short value) { appendFormattedUnsigned(output, value); }
+inline void appendFormatted(std::string &output, unsigned int value) { appendFormattedUnsigned(output, value); }
+inline void appendFormatted(std::string &output, unsigned long value) { appendFormattedUnsigned(output, value); }
+inline void appendFormatted(std::string &output, unsigned long long value) { appendFormattedUnsigned(output, value); }
+inline void appendFormatted(std::string &output, float value) { appendFormattedFloatingPoint(output, static_cast<double>(value)); }
+inline void appendFormatted(std::string &output, double value) { appendFormattedFloatingPoint(output, value); }
+inline void appendFormatted(std::string &output, long double value) { appendFormattedFloatingPoint(output, value); }
+
+template <typename T>
+inline void appendFormatted(std::string &output, const T &value)
+{
+    std::ostringstream outputStream{};
+    outputStream << value;
+    output.append(outputStream.str());
+}
+
+/* Log messages are built in a per-thread buffer that keeps its capacity
+ * from one message to the next, and the log handler is given a reference
+ * to that buffer, so steady-state logging of integers, floating point
+ * values and strings does not allocate. A few buffers are kept per thread
+ * so that a message built while another is in progress (a log statement
+ * inside an argument expression) gets its own */
+std::string *acquireLogBuffer();
+void releaseLogBuffer(std::string *logBuffer);
+
 class LogMessage
 {
 public:
     inline ~LogMessage() {
-        MessageLogger::log(*this);
+        if (this->m_logBuffer) {
+            MessageLogger::log(*this);
+            releaseLogBuffer(this->m_logBuffer);
+        }
     }
 
+    inline LogMessage(LogMessage &&other) :
+        m_logLevel{other.m_logLevel},
+        m_logBuffer{other.m_logBuffer},
+        m_logContext(other.m_logContext) {
+        other.m_logBuffer = nullptr;
+    }
+
+    LogMessage(const LogMessage &) = delete;
+    LogMessage &operator=(const LogMessage &) = delete;
+    LogMessage &operator=(LogMessage &&) = delete;
+
     static inline LogMessage createInstance(LogLevel logLevel, const char *fileName, int sourceFileLine, const char *functionName) {
         return LogMessage{logLevel, fileName, sourceFileLine, functionName};
     }
@@ -66,34 +158,22 @@ public:
 
     template <typename T>
     inline LogMessage &operator<<(const T &t) {
-        this->m_logMessage += toStdString(t);
+        appendFormatted(*this->m_logBuffer, t);
         return *this;
     }
 
     inline const LogLevel &logLevel() const { return this->m_logLevel; }
-    inline const std::string &logMessage() const { return this->m_logMessage; }
+    inline const std::string &logMessage() const { return *this->m_logBuffer; }
     inline const LogContext &logContext() const {return this->m_logContext; }
 
 private:
     LogLevel m_logLevel;
-    std::string m_logMessage;
+    std::string *m_logBuffer;
     LogContext m_logContext;
 
-    template <typename T> static inline std::string toStdString(T t) { return dynamic_cast<std::ostringstream &>(std::ostringstream{} << t).str(); }
-
-    template <typename T>
-    inline LogMessage(LogLevel logLevel, const char *fileName, int sourceFileLine, const char *functionName, const T &t) :
-        m_logLevel{logLevel},
-        m_logMessage{toStdString(t)},
-        m_logContext{} {
-        this->m_logContext.fileName = fileName;
-        this->m_logContext.sourceFileLine = sourceFileLine;
-        this->m_logContext.functionName = functionName;
-    }
-
     inline LogMessage(LogLevel logLevel, const char *fileName, int sourceFileLine, const char *functionName) :
             m_logLevel{logLevel},
-            m_logMessage{""},
+            m_logBuffer{acquireLogBuffer()},
             m_logContext{} {
         this->m_logContext.fileName = fileName;
         this->m_logContext.sourceFileLine = sourceFileLine;
@@ -103,96 +183,81 @@ private:
 
 };
 
-template <typename T> std::string toTStringFormatString(T t) { return dynamic_cast<std::ostringstream &>(std::ostringstream{} << t).str(); }
+template <typename T> std::string toTStringFormatString(const T &t)
+{
+    std::string returnString{""};
+    appendFormatted(returnString, t);
+    return returnString;
+}
+
+/* A format string broken into literal text and brace tokens. Each token
+ * refers to an argument by rank: the smallest distinct number inside braces
+ * is replaced by the first argument, the next smallest by the second, and
+ * so on, with repeated numbers receiving the same argument */
+struct FormatSegment
+{
+    size_t literalOffset;
+    size_t literalLength;
+    size_t tokenOffset;
+    size_t tokenLength;
+    size_t argumentRank;
+};
+
+struct ParsedFormat
+{
+    std::string formatting;
+    std::vector<FormatSegment> segments;
+    size_t trailingOffset;
+    size_t literalLength;
+    size_t distinctTokenCount;
+};
+
+/* Returns the parsed form of a format string, from a per-thread cache keyed
+ * on the format string's address (and checked against its contents, so a
+ * reused buffer is simply parsed again). Once the cache is full, further
+ * strings are parsed into the caller supplied scratch instead */
+const ParsedFormat &parseFormat(const char *formatting, ParsedFormat &scratch);
+
+inline void appendArgument(std::string &, size_t) { }
 
-/*Base case to break recursion*/
+template <typename First, typename ... Args>
+inline void appendArgument(std::string &output, size_t argumentRank, const First &first, const Args& ... args)
+{
+    if (argumentRank == 0) {
+        appendFormatted(output, first);
+    } else {
+        appendArgument(output, argumentRank - 1, args...);
+    }
+}
+
+/*Base case, a format string without arguments is returned untouched*/
 inline std::string TStringFormat(const char *formatting) { return formatting; }
 
 /*C# style String.Format()*/
 template <typename First, typename ... Args>
 std::string TStringFormat(const char *formatting, First &&first, Args&& ... args)
 {
-    /* Match exactly one opening brace, one or more numeric digit,
-    * then exactly one closing brace, identifying a token */
-    static const std::regex targetRegex{R"(\{[0-9]+\})"};
-    std::smatch match;
-
-    /* Copy the formatting string to a std::string, to
-    * make for easier processing, which will eventually
-    * be used (the .c_str() method) to pass the remainder
-    * of the formatting recursively */
-    std::string returnString{formatting};
-
-    /* Copy the formatting string to another std::string, which
-    * will get modified in the regex matching loop, to remove the
-    * current match from the string and find the next match */
-    std::string copyString{formatting};
-
-    /* std::tuple to hold the current smallest valued brace token,
-    * wrapped in a std::vector because there can be multiple brace
-    * tokens with the same value. For example, in the following format string:
-    * "There were {0} books found matching the title {1}, {0}/{2}",
-    * this pass will save the locations of the first and second {0} */
-    using TokenInformation = std::tuple<int, size_t, size_t>;
-    std::vector<TokenInformation> smallestValueInformation{std::make_tuple(-1, 0, 0)};
-
-    /*Iterate through string, finding position and lengths of all matches {x}*/
-    while(std::regex_search(copyString, match, targetRegex)) {
-        /*Get the absolute position of the match in the original return string*/
-        size_t foundPosition{match.position() + (returnString.length() - copyString.length())};
-        int regexMatchNumericValue{0};
-        /*Convert the integer value between the opening and closing braces to an int to compare */
-        regexMatchNumericValue = std::stoi(returnString.substr(foundPosition + 1, (foundPosition + match.str().length())));
-
-        /*Do not allow negative numbers, although this should never get picked up the regex anyway*/
-        if (regexMatchNumericValue < 0) {
-            throw std::runtime_error(TStringFormat("ERROR: In TStringFormat() - Formatted string is invalid (formatting = {0})", formatting));
-        }
-        /* If the numeric value in the curly brace token is smaller than
-        * the current smallest (or if the smallest value has not yet been set,
-        * ie it is the first match), set the corresponding smallestX variables
-        * and wrap them up into a TokenInformation and add it to the std::vector */
-        int smallestValue{std::get<0>(smallestValueInformation.at(0))};
-        if ((smallestValue == -1) || (regexMatchNumericValue < smallestValue)) {
-            smallestValueInformation.clear();
-            smallestValueInformation.push_back(std::make_tuple(regexMatchNumericValue,
-                                                               foundPosition,
-                                                               match.str().length()));
-        } else if (regexMatchNumericValue == smallestValue) {
-            smallestValueInformation.push_back(std::make_tuple(regexMatchNumericValue,
-                                                               foundPosition,
-                                                               match.str().length()));
-        }
-        copyString = match.suffix();
-    }
-    int smallestValue{std::get<0>(smallestValueInformation.at(0))};
-    if (smallestValue == -1) {
+    static const size_t ARGUMENT_COUNT{1 + sizeof...(Args)};
+    ParsedFormat scratch{};
+    const ParsedFormat &parsedFormat = parseFormat(formatting, scratch);
+    if (ARGUMENT_COUNT > parsedFormat.distinctTokenCount) {
         throw std::runtime_error(TStringFormat("ERROR: In TStringFormat() - Formatted string is invalid (formatting = {0})", formatting));
     }
-    /* Set the returnString to be up to the brace token, then the string
-    * representation of current argument in line (first), then the remainder
-    * of the format string, effectively removing the token and replacing it
-    * with the requested item in the final string, then pass it off recursively */
-
-    std::string firstString{toTStringFormatString(first)};
-    int index{0};
-    for (const auto &it : smallestValueInformation) {
-        size_t smallestValueLength{std::get<2>(it)};
-
-        /* Since the original string will be modified, the adjusted position must be
-        calculated for any repeated brace tokens, kept track of by index.
-        The length of string representation of first mutiplied by which the iterationn count
-        is added, and the length of the brace token multiplied by the iteration count is
-        subtracted, resulting in the correct starting position of the current brace token */
-        size_t lengthOfTokenBracesRemoved{index * smallestValueLength};
-        size_t lengthOfStringAdded{index * firstString.length()};
-        size_t smallestValueAdjustedPosition{std::get<1>(it) + lengthOfStringAdded - lengthOfTokenBracesRemoved};
-        returnString = returnString.substr(0, smallestValueAdjustedPosition)
-                       + firstString
-                       + returnString.substr(smallestValueAdjustedPosition + smallestValueLength);
-        index++;
+
+    std::string returnString{};
+    returnString.reserve(parsedFormat.literalLength + (ARGUMENT_COUNT * 16));
+    const char *source{parsedFormat.formatting.data()};
+    for (const auto &it : parsedFormat.segments) {
+        returnString.append(source + it.literalOffset, it.literalLength);
+        if (it.argumentRank < ARGUMENT_COUNT) {
+            appendArgument(returnString, it.argumentRank, first, args...);
+        } else {
+            /* More tokens than arguments, leave the token in place */
+            returnString.append(source + it.tokenOffset, it.tokenLength);
+        }
     }
-    return TStringFormat(returnString.c_str(), std::forward<Args>(args)...);
+    returnString.append(source + parsedFormat.trailingOffset, parsedFormat.formatting.size() - parsedFormat.trailingOffset);
+    return returnString;
 }
 
 } //namespace TMessageLogger
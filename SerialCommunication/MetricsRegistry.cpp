@@ -0,0 +1,270 @@
+#include "MetricsRegistry.h"
+#include "GlobalDefinitions.h"
+#include "MessageLogger.h"
+
+#include <algorithm>
+
+using namespace TMessageLogger;
+
+const size_t MetricsRegistry::MAXIMUM_COUNTERS;
+const size_t MetricsRegistry::MAXIMUM_GAUGES;
+const size_t MetricsRegistry::MAXIMUM_HISTOGRAMS;
+const unsigned MetricsRegistry::HISTOGRAM_SUB_BUCKET_BITS;
+const unsigned MetricsRegistry::HISTOGRAM_MAXIMUM_EXPONENT;
+const size_t MetricsRegistry::HISTOGRAM_SUB_BUCKETS;
+const size_t MetricsRegistry::HISTOGRAM_BUCKET_COUNT;
+
+/* Index 0 of every kind is the unreported slot default handles point at */
+MetricCounter::MetricCounter() :
+    m_index{0}
+{
+
+}
+
+MetricCounter::MetricCounter(size_t index) :
+    m_index{index}
+{
+
+}
+
+MetricGauge::MetricGauge() :
+    m_index{0}
+{
+
+}
+
+MetricGauge::MetricGauge(size_t index) :
+    m_index{index}
+{
+
+}
+
+void MetricGauge::set(int64_t value) const
+{
+    MetricsRegistry::instance().m_gauges[this->m_index].store(value, std::memory_order_relaxed);
+}
+
+MetricHistogram::MetricHistogram() :
+    m_index{0}
+{
+
+}
+
+MetricHistogram::MetricHistogram(size_t index) :
+    m_index{index}
+{
+
+}
+
+MetricsRegistry::MetricsRegistry() :
+    m_mutex{},
+    m_counterIndices{},
+    m_gaugeIndices{},
+    m_histogramIndices{},
+    m_shards{},
+    m_gauges{new std::atomic<int64_t>[MAXIMUM_GAUGES]}
+{
+    for (size_t i = 0; i < MAXIMUM_GAUGES; i++) {
+        this->m_gauges[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+    static MetricsRegistry metricsRegistry{};
+    return metricsRegistry;
+}
+
+MetricCounter MetricsRegistry::counter(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    return MetricCounter{registerName(this->m_counterIndices, name, MAXIMUM_COUNTERS, "counter")};
+}
+
+MetricGauge MetricsRegistry::gauge(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    return MetricGauge{registerName(this->m_gaugeIndices, name, MAXIMUM_GAUGES, "gauge")};
+}
+
+MetricHistogram MetricsRegistry::histogram(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    return MetricHistogram{registerName(this->m_histogramIndices, name, MAXIMUM_HISTOGRAMS, "histogram")};
+}
+
+size_t MetricsRegistry::registerName(std::map<std::string, size_t> &indices, const std::string &name, size_t maximumCount, const char *kind)
+{
+    auto found = indices.find(name);
+    if (found != indices.end()) {
+        return found->second;
+    }
+    size_t index{indices.size() + 1};
+    if (index >= maximumCount) {
+        /* Names that did not fit are kept on the unreported slot, so that
+         * only the first of them is warned about */
+        if (index == maximumCount) {
+            LOG_WARN(METRICS_LOG_SUBSYSTEM) << TStringFormat("All {0} {1} slots are in use, {2} and any further {1}s are not reported", maximumCount - 1, kind, name);
+        }
+        indices.emplace(name, 0);
+        return 0;
+    }
+    indices.emplace(name, index);
+    return index;
+}
+
+MetricsRegistry::Shard::~Shard()
+{
+    for (auto &it : this->histograms) {
+        delete it.load(std::memory_order_relaxed);
+    }
+}
+
+MetricsRegistry::HistogramShard *MetricsRegistry::createHistogramShard(std::atomic<HistogramShard *> &slot)
+{
+    /* Published with release, so a snapshot that sees the pointer also
+     * sees the zeroed buckets */
+    HistogramShard *histogram{new HistogramShard()};
+    slot.store(histogram, std::memory_order_release);
+    return histogram;
+}
+
+MetricsRegistry::Shard *MetricsRegistry::createShard()
+{
+    /* Value initialisation zeroes every slot; the shard is never freed, a
+     * thread that exits keeps contributing what it counted */
+    std::unique_ptr<Shard> shard{new Shard()};
+    Shard *shardPointer{shard.get()};
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    this->m_shards.push_back(std::move(shard));
+    return shardPointer;
+}
+
+uint64_t MetricsRegistry::value(const MetricCounter &metricCounter) const
+{
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    uint64_t total{0};
+    for (const auto &shard : this->m_shards) {
+        total += shard->counters[metricCounter.m_index].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+int64_t MetricsRegistry::value(const MetricGauge &metricGauge) const
+{
+    return this->m_gauges[metricGauge.m_index].load(std::memory_order_relaxed);
+}
+
+HistogramSummary MetricsRegistry::summary(const MetricHistogram &metricHistogram) const
+{
+    std::vector<uint64_t> buckets(HISTOGRAM_BUCKET_COUNT, 0);
+    HistogramSummary histogramSummary{0, 0, 0, 0, 0, 0};
+    this->addShards(metricHistogram, buckets, &histogramSummary.sum, &histogramSummary.maximum);
+    for (const auto &bucket : buckets) {
+        histogramSummary.count += bucket;
+    }
+
+    /* A percentile is reported as the top of the bucket it falls in, which
+     * never understates it by more than the bucket width */
+    uint64_t *percentiles[]{&histogramSummary.p50, &histogramSummary.p99, &histogramSummary.p999};
+    const double fractions[]{0.50, 0.99, 0.999};
+    for (size_t i = 0; i < 3; i++) {
+        uint64_t rank{static_cast<uint64_t>(fractions[i] * static_cast<double>(histogramSummary.count))};
+        uint64_t seen{0};
+        for (size_t bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; bucket++) {
+            seen += buckets[bucket];
+            if ( (buckets[bucket] != 0) && (seen > rank) ) {
+                *percentiles[i] = std::min(bucketUpperBound(bucket), histogramSummary.maximum);
+                break;
+            }
+        }
+    }
+    return histogramSummary;
+}
+
+std::vector<uint64_t> MetricsRegistry::bucketCounts(const MetricHistogram &metricHistogram) const
+{
+    std::vector<uint64_t> buckets(HISTOGRAM_BUCKET_COUNT, 0);
+    uint64_t sum{0};
+    uint64_t maximum{0};
+    this->addShards(metricHistogram, buckets, &sum, &maximum);
+    return buckets;
+}
+
+void MetricsRegistry::addShards(const MetricHistogram &metricHistogram, std::vector<uint64_t> &buckets, uint64_t *sum, uint64_t *maximum) const
+{
+    std::lock_guard<std::mutex> lock{this->m_mutex};
+    for (const auto &shard : this->m_shards) {
+        const HistogramShard *histogramPointer{shard->histograms[metricHistogram.m_index].load(std::memory_order_acquire)};
+        if (histogramPointer == nullptr) {
+            continue;
+        }
+        const HistogramShard &histogram = *histogramPointer;
+        for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+            buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+        }
+        *sum += histogram.sum.load(std::memory_order_relaxed);
+        *maximum = std::max(*maximum, histogram.maximum.load(std::memory_order_relaxed));
+    }
+}
+
+std::vector<std::string> MetricsRegistry::snapshot() const
+{
+    std::map<std::string, size_t> counterIndices{};
+    std::map<std::string, size_t> gaugeIndices{};
+    std::map<std::string, size_t> histogramIndices{};
+    {
+        std::lock_guard<std::mutex> lock{this->m_mutex};
+        counterIndices = this->m_counterIndices;
+        gaugeIndices = this->m_gaugeIndices;
+        histogramIndices = this->m_histogramIndices;
+    }
+    std::map<std::string, std::string> lines{};
+    for (const auto &it : counterIndices) {
+        if (it.second == 0) {
+            continue;
+        }
+        lines[it.first] = TStringFormat("{0} {1}", it.first, this->value(MetricCounter{it.second}));
+    }
+    for (const auto &it : gaugeIndices) {
+        if (it.second == 0) {
+            continue;
+        }
+        lines[it.first] = TStringFormat("{0} {1}", it.first, this->value(MetricGauge{it.second}));
+    }
+    for (const auto &it : histogramIndices) {
+        if (it.second == 0) {
+            continue;
+        }
+        HistogramSummary histogramSummary{this->summary(MetricHistogram{it.second})};
+        lines[it.first] = TStringFormat("{0} count={1} mean={2} p50={3} p99={4} p999={5} max={6}",
+                                        it.first,
+                                        histogramSummary.count,
+                                        (histogramSummary.count == 0) ? 0 : (histogramSummary.sum / histogramSummary.count),
+                                        histogramSummary.p50,
+                                        histogramSummary.p99,
+                                        histogramSummary.p999,
+                                        histogramSummary.maximum);
+    }
+    std::vector<std::string> snapshotLines{};
+    for (const auto &it : lines) {
+        snapshotLines.push_back(it.second);
+    }
+    return snapshotLines;
+}
+
+uint64_t MetricsRegistry::bucketLowerBound(size_t bucketIndex)
+{
+    return (bucketIndex == 0) ? 0 : bucketUpperBound(bucketIndex - 1) + 1;
+}
+
+uint64_t MetricsRegistry::bucketUpperBound(size_t bucketIndex)
+{
+    if (bucketIndex < HISTOGRAM_SUB_BUCKETS) {
+        return bucketIndex;
+    }
+    unsigned exponent{static_cast<unsigned>(bucketIndex / HISTOGRAM_SUB_BUCKETS) + HISTOGRAM_SUB_BUCKET_BITS - 1};
+    uint64_t subBucket{bucketIndex % HISTOGRAM_SUB_BUCKETS};
+    unsigned shift{exponent - HISTOGRAM_SUB_BUCKET_BITS};
+    return ((HISTOGRAM_SUB_BUCKETS + subBucket + 1) << shift) - 1;
+}
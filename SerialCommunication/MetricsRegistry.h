@@ -0,0 +1,188 @@
+#ifndef SERIALCOMMUNICATION_METRICSREGISTRY_H
+#define SERIALCOMMUNICATION_METRICSREGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Handles to metrics held by the MetricsRegistry. They are plain indices,
+ * cheap to copy, and a default constructed handle updates a slot that is
+ * never reported, so owners can declare them before registering */
+class MetricCounter
+{
+public:
+    MetricCounter();
+    void add(uint64_t value = 1) const;
+
+private:
+    friend class MetricsRegistry;
+    explicit MetricCounter(size_t index);
+    size_t m_index;
+};
+
+class MetricGauge
+{
+public:
+    MetricGauge();
+    void set(int64_t value) const;
+
+private:
+    friend class MetricsRegistry;
+    explicit MetricGauge(size_t index);
+    size_t m_index;
+};
+
+class MetricHistogram
+{
+public:
+    MetricHistogram();
+    void record(uint64_t value) const;
+
+private:
+    friend class MetricsRegistry;
+    explicit MetricHistogram(size_t index);
+    size_t m_index;
+};
+
+struct HistogramSummary
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t maximum;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+/* Process-wide counters, gauges and histograms that are safe to update from
+ * any hot path. Every thread that updates a counter or histogram gets its
+ * own shard on first use and only ever writes to that, with a relaxed load
+ * and store rather than a locked read-modify-write, so updates never contend
+ * or bounce cache lines between threads; snapshots add the shards up.
+ * Histograms keep 8 log-linear buckets per power of two (HDR style, within
+ * 12.5% of the recorded value) up to 2^40; a shard only allocates the
+ * buckets of a histogram once its thread first records to it, so every
+ * port can have its own. Gauges are set by their single owner and are not
+ * sharded. Registering takes a lock, so do it up front; past the maximum it
+ * warns and hands out a default handle rather than failing */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry &instance();
+    MetricsRegistry(const MetricsRegistry &) = delete;
+    MetricsRegistry(MetricsRegistry &&) = delete;
+    MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+    MetricsRegistry &operator=(MetricsRegistry &&) = delete;
+
+    /* Registering an existing name returns the same metric */
+    MetricCounter counter(const std::string &name);
+    MetricGauge gauge(const std::string &name);
+    MetricHistogram histogram(const std::string &name);
+
+    uint64_t value(const MetricCounter &metricCounter) const;
+    int64_t value(const MetricGauge &metricGauge) const;
+    HistogramSummary summary(const MetricHistogram &metricHistogram) const;
+    /* All HISTOGRAM_BUCKET_COUNT bucket counts, added up over the shards;
+     * bucket i holds the values from bucketLowerBound(i) to
+     * bucketUpperBound(i), the last one everything larger as well */
+    std::vector<uint64_t> bucketCounts(const MetricHistogram &metricHistogram) const;
+    static uint64_t bucketLowerBound(size_t bucketIndex);
+    static uint64_t bucketUpperBound(size_t bucketIndex);
+
+    /* One line per metric, sorted by name */
+    std::vector<std::string> snapshot() const;
+
+    static const size_t MAXIMUM_COUNTERS{1024};
+    static const size_t MAXIMUM_GAUGES{1024};
+    static const size_t MAXIMUM_HISTOGRAMS{4096};
+    static const unsigned HISTOGRAM_SUB_BUCKET_BITS{3};
+    static const unsigned HISTOGRAM_MAXIMUM_EXPONENT{40};
+    static const size_t HISTOGRAM_SUB_BUCKETS{1 << HISTOGRAM_SUB_BUCKET_BITS};
+    static const size_t HISTOGRAM_BUCKET_COUNT{HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAXIMUM_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 2)};
+
+private:
+    friend class MetricCounter;
+    friend class MetricGauge;
+    friend class MetricHistogram;
+
+    struct HistogramShard
+    {
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKET_COUNT];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> maximum;
+    };
+
+    struct Shard
+    {
+        ~Shard();
+        std::atomic<uint64_t> counters[MAXIMUM_COUNTERS];
+        /* Written only by the owning thread, null until it records */
+        std::atomic<HistogramShard *> histograms[MAXIMUM_HISTOGRAMS];
+    };
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, size_t> m_counterIndices;
+    std::map<std::string, size_t> m_gaugeIndices;
+    std::map<std::string, size_t> m_histogramIndices;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::unique_ptr<std::atomic<int64_t>[]> m_gauges;
+
+    MetricsRegistry();
+    Shard *createShard();
+    static size_t registerName(std::map<std::string, size_t> &indices, const std::string &name, size_t maximumCount, const char *kind);
+    static Shard &localShard();
+    static HistogramShard *createHistogramShard(std::atomic<HistogramShard *> &slot);
+    static size_t bucketIndex(uint64_t value);
+    void addShards(const MetricHistogram &metricHistogram, std::vector<uint64_t> &buckets, uint64_t *sum, uint64_t *maximum) const;
+};
+
+inline MetricsRegistry::Shard &MetricsRegistry::localShard()
+{
+    static thread_local Shard *shard{nullptr};
+    if (__builtin_expect(shard == nullptr, 0)) {
+        shard = instance().createShard();
+    }
+    return *shard;
+}
+
+inline size_t MetricsRegistry::bucketIndex(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    unsigned exponent{63u - static_cast<unsigned>(__builtin_clzll(value))};
+    if (exponent > HISTOGRAM_MAXIMUM_EXPONENT) {
+        return HISTOGRAM_BUCKET_COUNT - 1;
+    }
+    size_t subBucket{static_cast<size_t>(value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1)};
+    return (HISTOGRAM_SUB_BUCKETS * (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1)) + subBucket;
+}
+
+inline void MetricCounter::add(uint64_t value) const
+{
+    std::atomic<uint64_t> &slot = MetricsRegistry::localShard().counters[this->m_index];
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void MetricHistogram::record(uint64_t value) const
+{
+    std::atomic<MetricsRegistry::HistogramShard *> &slot = MetricsRegistry::localShard().histograms[this->m_index];
+    MetricsRegistry::HistogramShard *histogramPointer{slot.load(std::memory_order_relaxed)};
+    if (__builtin_expect(histogramPointer == nullptr, 0)) {
+        histogramPointer = MetricsRegistry::createHistogramShard(slot);
+    }
+    MetricsRegistry::HistogramShard &histogram = *histogramPointer;
+    std::atomic<uint64_t> &bucket = histogram.buckets[MetricsRegistry::bucketIndex(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.sum.store(histogram.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    if (value > histogram.maximum.load(std::memory_order_relaxed)) {
+        histogram.maximum.store(value, std::memory_order_relaxed);
+    }
+}
+
+#endif //SERIALCOMMUNICATION_METRICSREGISTRY_H
@@ -0,0 +1,307 @@
+#include "PortChannel.h"
+#include "EventLoop.h"
+#include "MessageLogger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+PortChannel::PortChannel(EventLoop &eventLoop, int fileDescriptor, size_t readBufferSize) :
+    m_eventLoop{eventLoop},
+    m_fileDescriptor{fileDescriptor},
+    m_readBuffer(readBufferSize),
+    m_writeQueue{""},
+    m_writeOffset{0},
+    m_reservedOffset{0},
+    m_started{false},
+    m_writeInterest{false},
+    m_writableWanted{false},
+    m_bytesRead{0},
+    m_readTimestamp{0},
+    m_bytesWritten{0},
+    m_readHandler{},
+    m_errorHandler{},
+    m_writableHandler{}
+{
+    int flags{fcntl(this->m_fileDescriptor, F_GETFL)};
+    if ( (flags == -1) || (fcntl(this->m_fileDescriptor, F_SETFL, flags | O_NONBLOCK) == -1) ) {
+        throw std::runtime_error(TStringFormat("Unable to make descriptor {0} non-blocking ({1})", this->m_fileDescriptor, strerror(errno)));
+    }
+}
+
+PortChannel::~PortChannel()
+{
+    this->stop();
+}
+
+void PortChannel::setReadHandler(const ReadHandler &readHandler)
+{
+    this->m_readHandler = readHandler;
+}
+
+void PortChannel::setErrorHandler(const ErrorHandler &errorHandler)
+{
+    this->m_errorHandler = errorHandler;
+}
+
+void PortChannel::setWritableHandler(const WritableHandler &writableHandler)
+{
+    this->m_writableHandler = writableHandler;
+}
+
+void PortChannel::start()
+{
+    if (this->m_started) {
+        return;
+    }
+    uint32_t events{EPOLLIN};
+    if ( (this->pendingWriteBytes() > 0) || (this->m_writableWanted) ) {
+        events |= EPOLLOUT;
+        this->m_writeInterest = true;
+    }
+    this->m_eventLoop.addDescriptor(this->m_fileDescriptor, events, [this](uint32_t firedEvents) {
+        this->onEvents(firedEvents);
+    });
+    this->m_started = true;
+}
+
+void PortChannel::stop()
+{
+    if (!this->m_started) {
+        return;
+    }
+    this->m_eventLoop.removeDescriptor(this->m_fileDescriptor);
+    this->m_started = false;
+    this->m_writeInterest = false;
+    this->m_writableWanted = false;
+}
+
+bool PortChannel::isStarted() const
+{
+    return this->m_started;
+}
+
+int PortChannel::fileDescriptor() const
+{
+    return this->m_fileDescriptor;
+}
+
+uint64_t PortChannel::bytesRead() const
+{
+    return this->m_bytesRead;
+}
+
+uint64_t PortChannel::readTimestamp() const
+{
+    return this->m_readTimestamp;
+}
+
+uint64_t PortChannel::bytesWritten() const
+{
+    return this->m_bytesWritten;
+}
+
+size_t PortChannel::pendingWriteBytes() const
+{
+    return this->m_writeQueue.size() - this->m_writeOffset;
+}
+
+std::string PortChannel::takePendingWrites()
+{
+    std::string pendingWrites{this->m_writeQueue.substr(this->m_writeOffset)};
+    this->m_writeQueue.clear();
+    this->m_writeOffset = 0;
+    this->updateInterest();
+    return pendingWrites;
+}
+
+void PortChannel::write(const std::string &data)
+{
+    this->write(data.data(), data.size());
+}
+
+void PortChannel::write(const char *data, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    /* Nothing queued, so try to hand the data straight to the kernel and
+     * only queue whatever it would not accept */
+    if ( (this->pendingWriteBytes() == 0) && (this->m_started) ) {
+        while (length > 0) {
+            ssize_t written{::write(this->m_fileDescriptor, data, length)};
+            if (written > 0) {
+                this->m_bytesWritten += static_cast<uint64_t>(written);
+                data += written;
+                length -= static_cast<size_t>(written);
+            } else if ( (written == -1) && (errno == EINTR) ) {
+                continue;
+            } else if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+                break;
+            } else {
+                this->fail(errno);
+                return;
+            }
+        }
+        if (length == 0) {
+            return;
+        }
+    }
+    if (this->m_writeOffset == this->m_writeQueue.size()) {
+        this->m_writeQueue.clear();
+        this->m_writeOffset = 0;
+    }
+    this->m_writeQueue.append(data, length);
+    this->updateInterest();
+}
+
+char *PortChannel::reserveWrite(size_t maximumLength)
+{
+    if (this->m_writeOffset == this->m_writeQueue.size()) {
+        this->m_writeQueue.clear();
+        this->m_writeOffset = 0;
+    }
+    this->m_reservedOffset = this->m_writeQueue.size();
+    this->m_writeQueue.resize(this->m_reservedOffset + maximumLength);
+    return &this->m_writeQueue[this->m_reservedOffset];
+}
+
+void PortChannel::commitWrite(size_t length)
+{
+    bool wasIdle{this->m_reservedOffset == this->m_writeOffset};
+    this->m_writeQueue.resize(this->m_reservedOffset + length);
+    if ( (wasIdle) && (this->m_started) ) {
+        /* Same as write(): go straight to the kernel when nothing was queued */
+        this->handleWritable();
+    } else {
+        this->updateInterest();
+    }
+}
+
+size_t PortChannel::writeSome(const char *data, size_t length)
+{
+    if ( (!this->m_started) || (this->pendingWriteBytes() > 0) ) {
+        this->m_writableWanted = this->m_started;
+        this->updateInterest();
+        return 0;
+    }
+    size_t totalWritten{0};
+    while (totalWritten < length) {
+        ssize_t written{::write(this->m_fileDescriptor, data + totalWritten, length - totalWritten)};
+        if (written > 0) {
+            totalWritten += static_cast<size_t>(written);
+        } else if ( (written == -1) && (errno == EINTR) ) {
+            continue;
+        } else if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+            break;
+        } else {
+            this->m_bytesWritten += totalWritten;
+            this->fail(errno);
+            return totalWritten;
+        }
+    }
+    this->m_bytesWritten += totalWritten;
+    if (totalWritten < length) {
+        this->m_writableWanted = true;
+        this->updateInterest();
+    }
+    return totalWritten;
+}
+
+void PortChannel::onEvents(uint32_t events)
+{
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        this->handleReadable();
+    }
+    if ( (this->m_started) && (events & EPOLLOUT) ) {
+        this->handleWritable();
+    }
+}
+
+void PortChannel::handleReadable()
+{
+    for (int i = 0; i < MAXIMUM_READS_PER_EVENT; i++) {
+        ssize_t bytesRead{::read(this->m_fileDescriptor, this->m_readBuffer.data(), this->m_readBuffer.size())};
+        if (bytesRead > 0) {
+            timespec now{};
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            this->m_readTimestamp = (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+            this->m_bytesRead += static_cast<uint64_t>(bytesRead);
+            if (this->m_readHandler) {
+                this->m_readHandler(this->m_readBuffer.data(), static_cast<size_t>(bytesRead));
+            }
+            if ( (!this->m_started) || (static_cast<size_t>(bytesRead) < this->m_readBuffer.size()) ) {
+                return;
+            }
+        } else if (bytesRead == 0) {
+            this->fail(EPIPE);
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) {
+            return;
+        } else {
+            this->fail(errno);
+            return;
+        }
+    }
+}
+
+void PortChannel::handleWritable()
+{
+    while (this->pendingWriteBytes() > 0) {
+        ssize_t written{::write(this->m_fileDescriptor, this->m_writeQueue.data() + this->m_writeOffset, this->pendingWriteBytes())};
+        if (written > 0) {
+            this->m_bytesWritten += static_cast<uint64_t>(written);
+            this->m_writeOffset += static_cast<size_t>(written);
+        } else if ( (written == -1) && (errno == EINTR) ) {
+            continue;
+        } else if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+            break;
+        } else {
+            this->fail(errno);
+            return;
+        }
+    }
+    if (this->pendingWriteBytes() == 0) {
+        this->m_writeQueue.clear();
+        this->m_writeOffset = 0;
+        /* Queued data always goes first, direct writers resume after it */
+        if (this->m_writableWanted) {
+            this->m_writableWanted = false;
+            if (this->m_writableHandler) {
+                this->m_writableHandler();
+            }
+            if (!this->m_started) {
+                return;
+            }
+        }
+    }
+    this->updateInterest();
+}
+
+void PortChannel::updateInterest()
+{
+    if (!this->m_started) {
+        return;
+    }
+    bool wantWrite{(this->pendingWriteBytes() > 0) || (this->m_writableWanted)};
+    if (wantWrite != this->m_writeInterest) {
+        this->m_eventLoop.modifyDescriptor(this->m_fileDescriptor, wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+        this->m_writeInterest = wantWrite;
+    }
+}
+
+void PortChannel::fail(int errorNumber)
+{
+    this->stop();
+    if (this->m_errorHandler) {
+        this->m_errorHandler(errorNumber);
+    }
+}
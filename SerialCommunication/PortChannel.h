@@ -0,0 +1,91 @@
+#ifndef SERIALCOMMUNICATION_PORTCHANNEL_H
+#define SERIALCOMMUNICATION_PORTCHANNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+/* Non-blocking reader/writer for one already-open descriptor (a serial port,
+ * a pty, a pipe). It is owned by exactly one EventLoop, and every member
+ * must be called from that loop's thread */
+class PortChannel
+{
+public:
+    using ReadHandler = std::function<void(char *, size_t)>;
+    using ErrorHandler = std::function<void(int)>;
+    using WritableHandler = std::function<void()>;
+
+    PortChannel(EventLoop &eventLoop, int fileDescriptor, size_t readBufferSize = DEFAULT_READ_BUFFER_SIZE);
+    ~PortChannel();
+    PortChannel(const PortChannel &) = delete;
+    PortChannel(PortChannel &&) = delete;
+    PortChannel &operator=(const PortChannel &) = delete;
+    PortChannel &operator=(PortChannel &&) = delete;
+
+    void setReadHandler(const ReadHandler &readHandler);
+    void setErrorHandler(const ErrorHandler &errorHandler);
+    void setWritableHandler(const WritableHandler &writableHandler);
+
+    void start();
+    void stop();
+    bool isStarted() const;
+
+    void write(const char *data, size_t length);
+    void write(const std::string &data);
+    /* Lets a caller build data straight in the write queue: reserve room for
+     * up to maximumLength bytes, fill in what is needed, then commit that
+     * much. Nothing else may be written in between */
+    char *reserveWrite(size_t maximumLength);
+    void commitWrite(size_t length);
+    size_t pendingWriteBytes() const;
+    /* Hands over whatever is still queued, unwritten, and empties the queue */
+    std::string takePendingWrites();
+    /* Writes as much of data as the descriptor takes right now, straight
+     * from the caller's memory, and never queues the rest; returns how much
+     * was written (nothing while queued data is pending). When that is less
+     * than length, the writable handler runs once more can be written */
+    size_t writeSome(const char *data, size_t length);
+
+    int fileDescriptor() const;
+    uint64_t bytesRead() const;
+    /* CLOCK_MONOTONIC nanoseconds taken as soon as the read being handled
+     * returned, so it is when the data arrived, not when it was handled */
+    uint64_t readTimestamp() const;
+    uint64_t bytesWritten() const;
+
+    static const size_t DEFAULT_READ_BUFFER_SIZE{65536};
+
+private:
+    EventLoop &m_eventLoop;
+    int m_fileDescriptor;
+    std::vector<char> m_readBuffer;
+    std::string m_writeQueue;
+    size_t m_writeOffset;
+    size_t m_reservedOffset;
+    bool m_started;
+    bool m_writeInterest;
+    bool m_writableWanted;
+    uint64_t m_bytesRead;
+    uint64_t m_readTimestamp;
+    uint64_t m_bytesWritten;
+    ReadHandler m_readHandler;
+    ErrorHandler m_errorHandler;
+    WritableHandler m_writableHandler;
+
+    void onEvents(uint32_t events);
+    void handleReadable();
+    void handleWritable();
+    void updateInterest();
+    void fail(int errorNumber);
+
+    /* Upper bound on reads per wakeup, so that one busy descriptor cannot
+     * starve the others sharing the same loop (epoll is level triggered,
+     * so any remaining data is picked up on the next iteration) */
+    static const int MAXIMUM_READS_PER_EVENT{8};
+};
+
+#endif //SERIALCOMMUNICATION_PORTCHANNEL_H
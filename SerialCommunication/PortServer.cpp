@@ -0,0 +1,282 @@
+#include "PortServer.h"
+#include "EventLoop.h"
+#include "GlobalDefinitions.h"
+#include "SerialSession.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+const std::chrono::milliseconds PortServer::COALESCE_INTERVAL{5};
+
+/* Read from one client per wakeup, so a chatty client cannot starve the
+ * others (epoll is level triggered, the rest is read next time round) */
+static const size_t CLIENT_READ_SIZE{4096};
+
+PortServer::PortServer(SerialSession &serialSession, const PortServerOptions &options) :
+    m_serialSession(serialSession),
+    m_options(options),
+    m_socketPath{socketPathFor(options.socketDirectory, serialSession.portSettings().portName)},
+    m_listenDescriptor{-1},
+    m_streamFanout{serialSession.eventLoop(), serialSession.portSettings().portName},
+    m_clients{},
+    m_nextClientNumber{1},
+    m_broadcastBuffer{""},
+    m_coalesceTimer{-1},
+    m_coalesceTimerArmed{false},
+    m_transmitQueue{""},
+    m_transmitOffset{0},
+    m_readingPaused{false},
+    m_clientsMetric{},
+    m_disconnectsMetric{}
+{
+    const std::string prefix{"port." + serialSession.portSettings().portName + "."};
+    this->m_clientsMetric = MetricsRegistry::instance().gauge(prefix + "clients");
+    this->m_disconnectsMetric = MetricsRegistry::instance().counter(prefix + "client_disconnects");
+    this->m_broadcastBuffer.reserve(COALESCE_SIZE);
+    this->m_streamFanout.setClosedHandler([this](uint64_t sinkId) {
+        for (auto &client : this->m_clients) {
+            if (client->sinkId == sinkId) {
+                this->removeClient(*client, "not keeping up, or gone");
+                return;
+            }
+        }
+    });
+}
+
+PortServer::~PortServer()
+{
+    this->stop();
+}
+
+void PortServer::start()
+{
+    if (this->m_listenDescriptor != -1) {
+        return;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (this->m_socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error(TStringFormat(R"(Socket path "{0}" is too long)", this->m_socketPath));
+    }
+    memcpy(address.sun_path, this->m_socketPath.c_str(), this->m_socketPath.size() + 1);
+    struct stat fileStatus{};
+    if ( (lstat(this->m_socketPath.c_str(), &fileStatus) == 0) && (S_ISSOCK(fileStatus.st_mode)) ) {
+        unlink(this->m_socketPath.c_str());
+    }
+    int listenDescriptor{socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if ( (listenDescriptor == -1) ||
+         (bind(listenDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) ||
+         (listen(listenDescriptor, SOMAXCONN) == -1) ) {
+        int errorNumber{errno};
+        if (listenDescriptor != -1) {
+            close(listenDescriptor);
+        }
+        throw std::runtime_error(TStringFormat(R"(Unable to listen on "{0}" ({1}))", this->m_socketPath, strerror(errorNumber)));
+    }
+    this->m_listenDescriptor = listenDescriptor;
+    this->m_serialSession.eventLoop().addDescriptor(this->m_listenDescriptor, EPOLLIN, [this](uint32_t) {
+        this->acceptClients();
+    });
+    this->m_serialSession.setWritableHandler([this]() {
+        this->pumpTransmit();
+    });
+    this->m_clientsMetric.set(0);
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Sharing {0} on {1}", this->m_serialSession.portSettings().portName, this->m_socketPath);
+}
+
+void PortServer::stop()
+{
+    if (this->m_listenDescriptor == -1) {
+        return;
+    }
+    while (!this->m_clients.empty()) {
+        this->removeClient(*this->m_clients.back(), "server stopping");
+    }
+    this->m_serialSession.setWritableHandler(nullptr);
+    if (this->m_coalesceTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_coalesceTimer);
+        this->m_coalesceTimer = -1;
+        this->m_coalesceTimerArmed = false;
+    }
+    this->m_serialSession.eventLoop().removeDescriptor(this->m_listenDescriptor);
+    close(this->m_listenDescriptor);
+    this->m_listenDescriptor = -1;
+    unlink(this->m_socketPath.c_str());
+}
+
+void PortServer::handleReceive(const char *data, size_t length)
+{
+    if (this->m_clients.empty()) {
+        return;
+    }
+    this->m_broadcastBuffer.append(data, length);
+    if (this->m_broadcastBuffer.size() >= COALESCE_SIZE) {
+        this->flushBroadcast();
+        return;
+    }
+    if (!this->m_coalesceTimerArmed) {
+        if (this->m_coalesceTimer == -1) {
+            this->m_coalesceTimer = this->m_serialSession.eventLoop().addTimer(COALESCE_INTERVAL, [this]() {
+                this->m_coalesceTimerArmed = false;
+                this->flushBroadcast();
+            }, false);
+        } else {
+            this->m_serialSession.eventLoop().rearmTimer(this->m_coalesceTimer, std::chrono::steady_clock::now() + COALESCE_INTERVAL);
+        }
+        this->m_coalesceTimerArmed = true;
+    }
+}
+
+const std::string &PortServer::socketPath() const
+{
+    return this->m_socketPath;
+}
+
+size_t PortServer::clientCount() const
+{
+    return this->m_clients.size();
+}
+
+std::string PortServer::socketPathFor(const std::string &socketDirectory, const std::string &portName)
+{
+    size_t nameStart{portName.find_last_of('/')};
+    std::string baseName{(nameStart == std::string::npos) ? portName : portName.substr(nameStart + 1)};
+    return socketDirectory + "/" + baseName + ".sock";
+}
+
+void PortServer::acceptClients()
+{
+    for (;;) {
+        int fileDescriptor{accept4(this->m_listenDescriptor, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)};
+        if (fileDescriptor == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ( (errno != EAGAIN) && (errno != EWOULDBLOCK) ) {
+                LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to accept a client on {0} ({1})", this->m_socketPath, strerror(errno));
+            }
+            return;
+        }
+        std::unique_ptr<Client> client{new Client{this->m_nextClientNumber++, fileDescriptor, 0, ""}};
+        try {
+            client->sinkId = this->m_streamFanout.addSink(fileDescriptor, StreamSinkSettings{TStringFormat("client {0} on {1}", client->number, this->m_socketPath),
+                                                                                              SinkBackpressure::Disconnect, this->m_options.clientQueueLimit});
+        } catch (std::exception &e) {
+            LOG_WARN(SESSION_LOG_SUBSYSTEM) << e.what();
+            close(fileDescriptor);
+            continue;
+        }
+        Client *clientPointer{client.get()};
+        this->m_serialSession.eventLoop().addDescriptor(fileDescriptor, this->m_readingPaused ? 0 : static_cast<uint32_t>(EPOLLIN), [this, clientPointer](uint32_t) {
+            this->handleClientReadable(*clientPointer);
+        });
+        this->m_clients.push_back(std::move(client));
+        this->m_clientsMetric.set(static_cast<int64_t>(this->m_clients.size()));
+        LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Client {0} joined {1} ({2} client(s))", clientPointer->number, this->m_socketPath, this->m_clients.size());
+    }
+}
+
+void PortServer::handleClientReadable(Client &client)
+{
+    char buffer[CLIENT_READ_SIZE];
+    ssize_t bytesRead{read(client.fileDescriptor, buffer, sizeof(buffer))};
+    if ( (bytesRead == -1) && ( (errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+        return;
+    }
+    if (bytesRead <= 0) {
+        this->removeClient(client, (bytesRead == 0) ? "disconnected" : strerror(errno));
+        return;
+    }
+    const char *position{buffer};
+    const char *end{buffer + bytesRead};
+    while (position < end) {
+        const char *lineEnd{static_cast<const char *>(memchr(position, '\n', static_cast<size_t>(end - position)))};
+        if (!lineEnd) {
+            client.partialLine.append(position, static_cast<size_t>(end - position));
+            break;
+        }
+        lineEnd++;
+        if (client.partialLine.empty()) {
+            this->m_transmitQueue.append(position, static_cast<size_t>(lineEnd - position));
+        } else {
+            client.partialLine.append(position, static_cast<size_t>(lineEnd - position));
+            this->m_transmitQueue.append(client.partialLine);
+            client.partialLine.clear();
+        }
+        position = lineEnd;
+    }
+    if (client.partialLine.size() > MAXIMUM_LINE_LENGTH) {
+        this->removeClient(client, "line too long");
+    }
+    this->pumpTransmit();
+}
+
+void PortServer::removeClient(Client &client, const char *reason)
+{
+    uint64_t clientNumber{client.number};
+    this->m_serialSession.eventLoop().removeDescriptor(client.fileDescriptor);
+    this->m_streamFanout.removeSink(client.sinkId);
+    close(client.fileDescriptor);
+    this->m_clients.erase(std::find_if(this->m_clients.begin(), this->m_clients.end(), [&client](const std::unique_ptr<Client> &it) {
+        return it.get() == &client;
+    }));
+    this->m_clientsMetric.set(static_cast<int64_t>(this->m_clients.size()));
+    this->m_disconnectsMetric.add();
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Client {0} left {1}: {2} ({3} client(s))", clientNumber, this->m_socketPath, reason, this->m_clients.size());
+    if (this->m_clients.empty()) {
+        this->m_broadcastBuffer.clear();
+    }
+}
+
+void PortServer::flushBroadcast()
+{
+    if (this->m_broadcastBuffer.empty()) {
+        return;
+    }
+    this->m_streamFanout.publish(this->m_broadcastBuffer.data(), this->m_broadcastBuffer.size());
+    this->m_broadcastBuffer.clear();
+}
+
+void PortServer::pumpTransmit()
+{
+    while (this->m_transmitOffset < this->m_transmitQueue.size()) {
+        size_t written{this->m_serialSession.sendSome(this->m_transmitQueue.data() + this->m_transmitOffset,
+                                                      this->m_transmitQueue.size() - this->m_transmitOffset)};
+        if (written == 0) {
+            break;
+        }
+        this->m_transmitOffset += written;
+    }
+    /* Clients sending faster than the port keep the queue from running dry, so
+     * what was sent is dropped once it is most of the queue; that moves
+     * each byte at most once more on average */
+    if (this->m_transmitOffset == this->m_transmitQueue.size()) {
+        this->m_transmitQueue.clear();
+        this->m_transmitOffset = 0;
+    } else if (this->m_transmitOffset > this->m_transmitQueue.size() / 2) {
+        this->m_transmitQueue.erase(0, this->m_transmitOffset);
+        this->m_transmitOffset = 0;
+    }
+    size_t pendingBytes{this->m_transmitQueue.size() - this->m_transmitOffset};
+    if ( (!this->m_readingPaused) && (pendingBytes > TRANSMIT_QUEUE_LIMIT) ) {
+        this->setReadingPaused(true);
+    } else if ( (this->m_readingPaused) && (pendingBytes <= TRANSMIT_QUEUE_LIMIT / 2) ) {
+        this->setReadingPaused(false);
+    }
+}
+
+void PortServer::setReadingPaused(bool readingPaused)
+{
+    this->m_readingPaused = readingPaused;
+    for (const auto &client : this->m_clients) {
+        this->m_serialSession.eventLoop().modifyDescriptor(client->fileDescriptor, readingPaused ? 0 : static_cast<uint32_t>(EPOLLIN));
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef SERIALCOMMUNICATION_PORTSERVER_H
+#define SERIALCOMMUNICATION_PORTSERVER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MetricsRegistry.h"
+#include "StreamFanout.h"
+
+class SerialSession;
+
+struct PortServerOptions
+{
+    std::string socketDirectory;
+    size_t clientQueueLimit;
+};
+
+/* Shares one SerialSession with local processes over a Unix-domain stream
+ * socket, <directory>/<port base name>.sock, entirely on the session's
+ * loop. Received data goes to every client through a StreamFanout, gathered
+ * for up to COALESCE_INTERVAL (or COALESCE_SIZE bytes) first, so a busy
+ * port costs each client one send() per interval instead of one per read.
+ * What clients send reaches the port a whole line at a time, in the order
+ * the lines were completed, so lines from different clients never mix;
+ * while the port is behind, clients are not read. A client whose queue
+ * passes the limit, or whose unfinished line passes MAXIMUM_LINE_LENGTH,
+ * is disconnected rather than hold up the port or the other clients */
+class PortServer
+{
+public:
+    PortServer(SerialSession &serialSession, const PortServerOptions &options);
+    ~PortServer();
+    PortServer(const PortServer &) = delete;
+    PortServer(PortServer &&) = delete;
+    PortServer &operator=(const PortServer &) = delete;
+    PortServer &operator=(PortServer &&) = delete;
+
+    /* Binds and listens, replacing a socket left behind by an earlier run;
+     * throws if that fails */
+    void start();
+    void stop();
+    void handleReceive(const char *data, size_t length);
+
+    const std::string &socketPath() const;
+    size_t clientCount() const;
+
+    static std::string socketPathFor(const std::string &socketDirectory, const std::string &portName);
+
+    static const size_t DEFAULT_CLIENT_QUEUE_LIMIT{1024 * 1024};
+    static const size_t MAXIMUM_LINE_LENGTH{64 * 1024};
+    static const size_t TRANSMIT_QUEUE_LIMIT{64 * 1024};
+    static const size_t COALESCE_SIZE{16 * 1024};
+    static const std::chrono::milliseconds COALESCE_INTERVAL;
+
+private:
+    struct Client
+    {
+        uint64_t number;
+        int fileDescriptor;
+        uint64_t sinkId;
+        std::string partialLine;
+    };
+
+    SerialSession &m_serialSession;
+    PortServerOptions m_options;
+    std::string m_socketPath;
+    int m_listenDescriptor;
+    StreamFanout m_streamFanout;
+    std::vector<std::unique_ptr<Client>> m_clients;
+    uint64_t m_nextClientNumber;
+    std::string m_broadcastBuffer;
+    int m_coalesceTimer;
+    bool m_coalesceTimerArmed;
+    std::string m_transmitQueue;
+    size_t m_transmitOffset;
+    bool m_readingPaused;
+    MetricGauge m_clientsMetric;
+    MetricCounter m_disconnectsMetric;
+
+    void acceptClients();
+    void handleClientReadable(Client &client);
+    void removeClient(Client &client, const char *reason);
+    void flushBroadcast();
+    void pumpTransmit();
+    void setReadingPaused(bool readingPaused);
+};
+
+#endif //SERIALCOMMUNICATION_PORTSERVER_H
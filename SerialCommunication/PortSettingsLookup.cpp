@@ -0,0 +1,123 @@
+#include "PortSettingsLookup.h"
+
+using namespace CppSerialPort;
+
+const std::map<std::string, BaudRate> baudRateLookup {
+        {"50", BaudRate::BAUD50},
+        {"75", BaudRate::BAUD75},
+        {"110", BaudRate::BAUD110},
+        {"134", BaudRate::BAUD134},
+        {"150", BaudRate::BAUD150},
+        {"200", BaudRate::BAUD200},
+        {"300", BaudRate::BAUD300},
+        {"600", BaudRate::BAUD600},
+        {"1200", BaudRate::BAUD1200},
+        {"1800", BaudRate::BAUD1800},
+        {"2400", BaudRate::BAUD2400},
+        {"4800", BaudRate::BAUD4800},
+        {"9600", BaudRate::BAUD9600},
+        {"19200", BaudRate::BAUD19200},
+        {"38400", BaudRate::BAUD38400},
+        {"57600", BaudRate::BAUD57600},
+        {"115200", BaudRate::BAUD115200},
+        {"230400", BaudRate::BAUD230400},
+        {"460800", BaudRate::BAUD460800},
+        {"500000", BaudRate::BAUD500000},
+        {"576000", BaudRate::BAUD576000},
+        {"921600", BaudRate::BAUD921600},
+        {"1000000", BaudRate::BAUD1000000},
+        {"1152000", BaudRate::BAUD1152000},
+        {"1500000", BaudRate::BAUD1500000},
+        {"2000000", BaudRate::BAUD2000000},
+        {"2500000", BaudRate::BAUD2500000},
+        {"3000000", BaudRate::BAUD3000000},
+        {"3500000", BaudRate::BAUD3500000},
+        {"4000000", BaudRate::BAUD4000000}
+};
+
+const std::map<std::string, StopBits> stopBitsLookup{
+        {"one", StopBits::ONE},
+        {"two", StopBits::TWO}
+};
+
+const std::map<std::string, DataBits> dataBitsLookup {
+        {"five", DataBits::FIVE},
+        {"six", DataBits::SIX},
+        {"seven", DataBits::SEVEN},
+        {"eight", DataBits::EIGHT}
+};
+
+const std::map<std::string, Parity> parityLookup {
+        {"none", Parity::NONE},
+        {"even", Parity::EVEN},
+        {"odd", Parity::ODD}
+};
+
+const std::map<std::string, FlowControl> flowControlLookup {
+        {"none", FlowControl::None},
+        {"hardware", FlowControl::Hardware},
+        {"rtscts", FlowControl::Hardware},
+        {"software", FlowControl::Software},
+        {"xonxoff", FlowControl::Software}
+};
+
+std::string baudRateToString(BaudRate baudRate)
+{
+    for (const auto &it : baudRateLookup) {
+        if (it.second == baudRate) {
+            return it.first;
+        }
+    }
+    return "";
+}
+
+std::string dataBitsToString(DataBits dataBits)
+{
+    for (const auto &it : dataBitsLookup) {
+        if (it.second == dataBits) {
+            return it.first;
+        }
+    }
+    return "";
+}
+
+std::string stopBitsToString(StopBits stopBits)
+{
+    for (const auto &it : stopBitsLookup) {
+        if (it.second == stopBits) {
+            return it.first;
+        }
+    }
+    return "";
+}
+
+std::string parityToString(Parity parity)
+{
+    for (const auto &it : parityLookup) {
+        if (it.second == parity) {
+            return it.first;
+        }
+    }
+    return "";
+}
+
+double characterRate(const PortSettings &portSettings)
+{
+    double baudRate{std::stod(baudRateToString(portSettings.baudRate))};
+    double dataBits{(portSettings.dataBits == DataBits::FIVE) ? 5.0 :
+                    (portSettings.dataBits == DataBits::SIX) ? 6.0 :
+                    (portSettings.dataBits == DataBits::SEVEN) ? 7.0 : 8.0};
+    double parityBits{(portSettings.parity == Parity::NONE) ? 0.0 : 1.0};
+    double stopBits{(portSettings.stopBits == StopBits::TWO) ? 2.0 : 1.0};
+    return baudRate / (1.0 + dataBits + parityBits + stopBits);
+}
+
+std::string flowControlToString(FlowControl flowControl)
+{
+    for (const auto &it : flowControlLookup) {
+        if (it.second == flowControl) {
+            return it.first;
+        }
+    }
+    return "";
+}
@@ -0,0 +1,28 @@
+#ifndef SERIALCOMMUNICATION_PORTSETTINGSLOOKUP_H
+#define SERIALCOMMUNICATION_PORTSETTINGSLOOKUP_H
+
+#include <map>
+#include <string>
+
+#include <CppSerialPort/SerialPort.h>
+#include "SerialSession.h"
+
+/* The names accepted on the command line for each port setting, shared by
+ * the option parser and the benchmarks that sweep every setting */
+extern const std::map<std::string, CppSerialPort::BaudRate> baudRateLookup;
+extern const std::map<std::string, CppSerialPort::StopBits> stopBitsLookup;
+extern const std::map<std::string, CppSerialPort::DataBits> dataBitsLookup;
+extern const std::map<std::string, CppSerialPort::Parity> parityLookup;
+extern const std::map<std::string, FlowControl> flowControlLookup;
+
+std::string baudRateToString(CppSerialPort::BaudRate baudRate);
+std::string dataBitsToString(CppSerialPort::DataBits dataBits);
+std::string stopBitsToString(CppSerialPort::StopBits stopBits);
+std::string parityToString(CppSerialPort::Parity parity);
+std::string flowControlToString(FlowControl flowControl);
+
+/* Characters per second the line can carry at the port's settings, each
+ * character framed by a start bit, the parity bit if any and stop bits */
+double characterRate(const PortSettings &portSettings);
+
+#endif //SERIALCOMMUNICATION_PORTSETTINGSLOOKUP_H
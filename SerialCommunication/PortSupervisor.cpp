@@ -0,0 +1,348 @@
+#include "PortSupervisor.h"
+#include "EventLoop.h"
+#include "SerialSession.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <linux/netlink.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+const char *const PortSupervisor::SERIAL_BY_ID_DIRECTORY{"/dev/serial/by-id"};
+const std::chrono::milliseconds PortSupervisor::MINIMUM_RETRY_DELAY{5};
+const std::chrono::milliseconds PortSupervisor::MAXIMUM_RETRY_DELAY{1000};
+const size_t PortSupervisor::DEFAULT_HELD_TRANSMIT_LIMIT;
+
+namespace {
+
+/* udev announces a device here once its node has its permissions and its
+ * links; the kernel's own group (1) is too early for that */
+const uint32_t UDEV_MONITOR_GROUP{2};
+const size_t NETLINK_BUFFER_SIZE{8192};
+const size_t INOTIFY_BUFFER_SIZE{4096};
+const char TTY_SUBSYSTEM_PROPERTY[]{"SUBSYSTEM=tty"};
+const uint32_t WATCH_EVENTS{IN_CREATE | IN_MOVED_TO | IN_ATTRIB};
+
+bool isDirectory(const std::string &path)
+{
+    struct stat fileStatus{};
+    return (stat(path.c_str(), &fileStatus) == 0) && (S_ISDIR(fileStatus.st_mode));
+}
+
+} //Global namespace
+
+PortSupervisor::PortSupervisor(EventLoop &eventLoop) :
+    m_eventLoop(eventLoop),
+    m_ports{},
+    m_inotifyDescriptor{-1},
+    m_netlinkDescriptor{-1},
+    m_retryTimer{-1},
+    m_watches{}
+{
+
+}
+
+PortSupervisor::~PortSupervisor()
+{
+    this->stopWatching();
+    if (this->m_retryTimer != -1) {
+        this->m_eventLoop.removeTimer(this->m_retryTimer);
+    }
+}
+
+void PortSupervisor::track(SerialSession &serialSession)
+{
+    std::string stablePath{stableDevicePath(serialSession.devicePath())};
+    if (stablePath != serialSession.devicePath()) {
+        LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Following {0} as {1}", serialSession.portSettings().portName, stablePath);
+        serialSession.setDevicePath(stablePath);
+    }
+}
+
+void PortSupervisor::watch(SerialSession &serialSession)
+{
+    SupervisedPort &port = this->supervisedPort(serialSession);
+    if (port.absent) {
+        return;
+    }
+    /* A port that fails again right after it was reopened backs off, rather
+     * than being reopened as fast as it fails */
+    auto now = std::chrono::steady_clock::now();
+    port.retryDelay = (now - port.reopenTime < MAXIMUM_RETRY_DELAY) ? std::min(port.retryDelay * 2, MAXIMUM_RETRY_DELAY) : MINIMUM_RETRY_DELAY;
+    port.absent = true;
+    port.retryScheduled = true;
+    port.retryTime = now + port.retryDelay;
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Waiting for {0} to come back at {1}", serialSession.portSettings().portName, serialSession.devicePath());
+    this->startWatching();
+    this->updateWatches();
+    this->armRetryTimer();
+}
+
+size_t PortSupervisor::absentPortCount() const
+{
+    return static_cast<size_t>(std::count_if(this->m_ports.begin(), this->m_ports.end(), [](const SupervisedPort &port) { return port.absent; }));
+}
+
+std::string PortSupervisor::stableDevicePath(const std::string &devicePath)
+{
+    const std::string byIdDirectory{SERIAL_BY_ID_DIRECTORY};
+    if (devicePath.compare(0, byIdDirectory.size() + 1, byIdDirectory + "/") == 0) {
+        return devicePath;
+    }
+    char devicePathTarget[PATH_MAX];
+    if (!realpath(devicePath.c_str(), devicePathTarget)) {
+        return devicePath;
+    }
+    DIR *directory{opendir(SERIAL_BY_ID_DIRECTORY)};
+    if (!directory) {
+        return devicePath;
+    }
+    std::string stablePath{devicePath};
+    while (dirent *entry = readdir(directory)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        std::string linkPath{byIdDirectory + "/" + entry->d_name};
+        char linkTarget[PATH_MAX];
+        if ( (realpath(linkPath.c_str(), linkTarget)) && (strcmp(linkTarget, devicePathTarget) == 0) ) {
+            stablePath = linkPath;
+            break;
+        }
+    }
+    closedir(directory);
+    return stablePath;
+}
+
+PortSupervisor::SupervisedPort &PortSupervisor::supervisedPort(SerialSession &serialSession)
+{
+    auto found = std::find_if(this->m_ports.begin(), this->m_ports.end(), [&serialSession](const SupervisedPort &port) {
+        return port.serialSession == &serialSession;
+    });
+    if (found != this->m_ports.end()) {
+        return *found;
+    }
+    this->m_ports.push_back(SupervisedPort{&serialSession, false, false, MINIMUM_RETRY_DELAY,
+                                           std::chrono::steady_clock::time_point{}, std::chrono::steady_clock::time_point{}});
+    return this->m_ports.back();
+}
+
+void PortSupervisor::startWatching()
+{
+    if (this->m_inotifyDescriptor == -1) {
+        this->m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->m_inotifyDescriptor == -1) {
+            LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to watch for ports coming back ({0}), looking every {1} ms instead",
+                                                             strerror(errno), MAXIMUM_RETRY_DELAY.count());
+        } else {
+            this->m_eventLoop.addDescriptor(this->m_inotifyDescriptor, EPOLLIN, [this](uint32_t) {
+                this->onInotifyEvents();
+            });
+        }
+    }
+    if (this->m_netlinkDescriptor == -1) {
+        this->m_netlinkDescriptor = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        sockaddr_nl address{};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = UDEV_MONITOR_GROUP;
+        if ( (this->m_netlinkDescriptor != -1) && (bind(this->m_netlinkDescriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) ) {
+            close(this->m_netlinkDescriptor);
+            this->m_netlinkDescriptor = -1;
+        }
+        if (this->m_netlinkDescriptor == -1) {
+            LOG_DEBUG(SESSION_LOG_SUBSYSTEM) << TStringFormat("No udev events ({0}), watching with inotify only", strerror(errno));
+        } else {
+            this->m_eventLoop.addDescriptor(this->m_netlinkDescriptor, EPOLLIN, [this](uint32_t) {
+                this->onNetlinkEvents();
+            });
+        }
+    }
+}
+
+void PortSupervisor::stopWatching()
+{
+    if (this->m_inotifyDescriptor != -1) {
+        this->m_eventLoop.removeDescriptor(this->m_inotifyDescriptor);
+        close(this->m_inotifyDescriptor);
+        this->m_inotifyDescriptor = -1;
+    }
+    this->m_watches.clear();
+    if (this->m_netlinkDescriptor != -1) {
+        this->m_eventLoop.removeDescriptor(this->m_netlinkDescriptor);
+        close(this->m_netlinkDescriptor);
+        this->m_netlinkDescriptor = -1;
+    }
+}
+
+void PortSupervisor::updateWatches()
+{
+    /* Only the directories absent ports are (or would be) in; one that is
+     * gone itself is waited for from the nearest directory above it */
+    if (this->m_inotifyDescriptor == -1) {
+        return;
+    }
+    std::map<std::string, int> watches{};
+    for (const auto &port : this->m_ports) {
+        if (!port.absent) {
+            continue;
+        }
+        std::string directory{nearestExistingDirectory(port.serialSession->devicePath())};
+        auto found = this->m_watches.find(directory);
+        if (found != this->m_watches.end()) {
+            watches.insert(*found);
+            continue;
+        }
+        if (watches.count(directory) > 0) {
+            continue;
+        }
+        int watchDescriptor{inotify_add_watch(this->m_inotifyDescriptor, directory.c_str(), WATCH_EVENTS)};
+        if (watchDescriptor == -1) {
+            LOG_DEBUG(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to watch {0} ({1})", directory, strerror(errno));
+            continue;
+        }
+        watches.emplace(directory, watchDescriptor);
+    }
+    for (const auto &it : this->m_watches) {
+        if (watches.count(it.first) == 0) {
+            inotify_rm_watch(this->m_inotifyDescriptor, it.second);
+        }
+    }
+    this->m_watches.swap(watches);
+}
+
+void PortSupervisor::reopenAbsentPorts(bool retriesOnly)
+{
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < this->m_ports.size(); i++) {
+        SupervisedPort &port = this->m_ports[i];
+        if ( (!port.absent) || ( (retriesOnly) && ( (!port.retryScheduled) || (port.retryTime > now) ) ) ) {
+            continue;
+        }
+        this->tryReopen(port);
+    }
+    if (this->absentPortCount() == 0) {
+        this->stopWatching();
+        return;
+    }
+    this->updateWatches();
+    this->armRetryTimer();
+}
+
+bool PortSupervisor::tryReopen(SupervisedPort &port)
+{
+    SerialSession &serialSession = *port.serialSession;
+    auto now = std::chrono::steady_clock::now();
+    if (access(serialSession.devicePath().c_str(), F_OK) == -1) {
+        /* Waits for inotify or udev, unless neither is there to wake it */
+        port.retryScheduled = (this->m_inotifyDescriptor == -1) && (this->m_netlinkDescriptor == -1);
+        port.retryTime = now + MAXIMUM_RETRY_DELAY;
+        return false;
+    }
+    try {
+        serialSession.open();
+    } catch (std::exception &e) {
+        LOG_DEBUG(SESSION_LOG_SUBSYSTEM) << TStringFormat("{0} is back but does not open yet ({1}), trying again in {2} ms",
+                                                          serialSession.portSettings().portName, e.what(), port.retryDelay.count());
+        port.retryScheduled = true;
+        port.retryTime = now + port.retryDelay;
+        port.retryDelay = std::min(port.retryDelay * 2, MAXIMUM_RETRY_DELAY);
+        return false;
+    }
+    port.absent = false;
+    port.retryScheduled = false;
+    port.reopenTime = now;
+    return true;
+}
+
+void PortSupervisor::armRetryTimer()
+{
+    bool scheduled{false};
+    std::chrono::steady_clock::time_point retryTime{};
+    for (const auto &port : this->m_ports) {
+        if ( (port.absent) && (port.retryScheduled) && ( (!scheduled) || (port.retryTime < retryTime) ) ) {
+            retryTime = port.retryTime;
+            scheduled = true;
+        }
+    }
+    if (!scheduled) {
+        return;
+    }
+    if (this->m_retryTimer == -1) {
+        this->m_retryTimer = this->m_eventLoop.addTimer(MAXIMUM_RETRY_DELAY, [this]() {
+            this->reopenAbsentPorts(true);
+        }, false);
+    }
+    this->m_eventLoop.rearmTimer(this->m_retryTimer, retryTime);
+}
+
+void PortSupervisor::onInotifyEvents()
+{
+    alignas(inotify_event) char buffer[INOTIFY_BUFFER_SIZE];
+    while (true) {
+        ssize_t bytesRead{read(this->m_inotifyDescriptor, buffer, sizeof(buffer))};
+        if ( (bytesRead == -1) && (errno == EINTR) ) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            break;
+        }
+        /* A watched directory that was removed takes its watch with it */
+        for (const char *position = buffer; position < buffer + bytesRead; ) {
+            const inotify_event *event{reinterpret_cast<const inotify_event *>(position)};
+            if (event->mask & IN_IGNORED) {
+                for (auto it = this->m_watches.begin(); it != this->m_watches.end(); ) {
+                    it = (it->second == event->wd) ? this->m_watches.erase(it) : std::next(it);
+                }
+            }
+            position += sizeof(inotify_event) + event->len;
+        }
+    }
+    this->updateWatches();
+    this->reopenAbsentPorts(false);
+}
+
+void PortSupervisor::onNetlinkEvents()
+{
+    char buffer[NETLINK_BUFFER_SIZE];
+    bool ttyEvent{false};
+    while (true) {
+        ssize_t bytesReceived{recv(this->m_netlinkDescriptor, buffer, sizeof(buffer), 0)};
+        if (bytesReceived > 0) {
+            ttyEvent = (ttyEvent) || (memmem(buffer, static_cast<size_t>(bytesReceived), TTY_SUBSYSTEM_PROPERTY, sizeof(TTY_SUBSYSTEM_PROPERTY) - 1) != nullptr);
+        } else if ( (bytesReceived == -1) && (errno == EINTR) ) {
+            continue;
+        } else if ( (bytesReceived == -1) && (errno == ENOBUFS) ) {
+            /* Events were lost, one of them may have been ours */
+            ttyEvent = true;
+        } else {
+            break;
+        }
+    }
+    if (ttyEvent) {
+        this->reopenAbsentPorts(false);
+    }
+}
+
+std::string PortSupervisor::nearestExistingDirectory(const std::string &devicePath)
+{
+    std::string directory{devicePath};
+    while (true) {
+        size_t separator{directory.find_last_of('/')};
+        if (separator == std::string::npos) {
+            return ".";
+        }
+        directory.erase((separator == 0) ? 1 : separator);
+        if ( (directory == "/") || (isDirectory(directory)) ) {
+            return directory;
+        }
+    }
+}
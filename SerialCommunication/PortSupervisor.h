@@ -0,0 +1,81 @@
+#ifndef SERIALCOMMUNICATION_PORTSUPERVISOR_H
+#define SERIALCOMMUNICATION_PORTSUPERVISOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class SerialSession;
+
+/* Reopens ports that went away (a USB adapter unplugged, or reset and
+ * enumerated again) as soon as their device node is back, with the settings
+ * they were opened with. Runs on the ports' EventLoop. While a port is away
+ * it watches the directory its device path is in (or the nearest one that
+ * still exists) with inotify, and listens to udev on its netlink socket when
+ * the process may; both only wake it up, a port is reopened once its path
+ * exists and opens. Nothing is polled while a port is absent: a node that
+ * is there but does not open yet (udev still setting its permissions,
+ * another program probing it) is retried after 5 ms, doubling up to 1 s.
+ * Ports are followed by their /dev/serial/by-id name when they have one,
+ * so an adapter that comes back as another ttyUSB is still found */
+class PortSupervisor
+{
+public:
+    explicit PortSupervisor(EventLoop &eventLoop);
+    ~PortSupervisor();
+    PortSupervisor(const PortSupervisor &) = delete;
+    PortSupervisor(PortSupervisor &&) = delete;
+    PortSupervisor &operator=(const PortSupervisor &) = delete;
+    PortSupervisor &operator=(PortSupervisor &&) = delete;
+
+    /* After a port is opened: switches it to its stable name, if it has one */
+    void track(SerialSession &serialSession);
+    /* A port that is closed, or did not open: reopens it once it is back */
+    void watch(SerialSession &serialSession);
+    size_t absentPortCount() const;
+
+    /* The path under SERIAL_BY_ID_DIRECTORY that leads to the same device
+     * as devicePath, or devicePath itself when there is none */
+    static std::string stableDevicePath(const std::string &devicePath);
+
+    static const char *const SERIAL_BY_ID_DIRECTORY;
+    static const std::chrono::milliseconds MINIMUM_RETRY_DELAY;
+    static const std::chrono::milliseconds MAXIMUM_RETRY_DELAY;
+    static const size_t DEFAULT_HELD_TRANSMIT_LIMIT{1024 * 1024};
+
+private:
+    struct SupervisedPort
+    {
+        SerialSession *serialSession;
+        bool absent;
+        bool retryScheduled;
+        std::chrono::milliseconds retryDelay;
+        std::chrono::steady_clock::time_point retryTime;
+        std::chrono::steady_clock::time_point reopenTime;
+    };
+
+    EventLoop &m_eventLoop;
+    std::vector<SupervisedPort> m_ports;
+    int m_inotifyDescriptor;
+    int m_netlinkDescriptor;
+    int m_retryTimer;
+    /* Watched directory to inotify watch descriptor */
+    std::map<std::string, int> m_watches;
+
+    SupervisedPort &supervisedPort(SerialSession &serialSession);
+    void startWatching();
+    void stopWatching();
+    void updateWatches();
+    void reopenAbsentPorts(bool retriesOnly);
+    bool tryReopen(SupervisedPort &port);
+    void armRetryTimer();
+    void onInotifyEvents();
+    void onNetlinkEvents();
+
+    static std::string nearestExistingDirectory(const std::string &devicePath);
+};
+
+#endif //SERIALCOMMUNICATION_PORTSUPERVISOR_H
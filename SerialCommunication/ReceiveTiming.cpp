@@ -0,0 +1,145 @@
+#include "ReceiveTiming.h"
+#include "MessageLogger.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace TMessageLogger;
+
+const size_t ReceiveTiming::REPORT_BAR_WIDTH;
+
+namespace {
+
+std::string padLeft(const std::string &text, size_t width)
+{
+    return (text.size() >= width) ? text : std::string(width - text.size(), ' ') + text;
+}
+
+} //Global namespace
+
+ReceiveTiming::ReceiveTiming() :
+    m_lastTimestamp{0},
+    m_chunkCount{0},
+    m_byteCount{0},
+    m_gapCount{0},
+    m_minimumGap{0},
+    m_maximumGap{0},
+    m_gapSum{0.0},
+    m_gapSquareSum{0.0},
+    m_gapHistogram{},
+    m_bucketsAtReset(MetricsRegistry::HISTOGRAM_BUCKET_COUNT, 0)
+{
+
+}
+
+void ReceiveTiming::setGapHistogram(const MetricHistogram &gapHistogram)
+{
+    this->m_gapHistogram = gapHistogram;
+    this->m_bucketsAtReset = MetricsRegistry::instance().bucketCounts(this->m_gapHistogram);
+}
+
+void ReceiveTiming::record(uint64_t timestampNanoseconds, size_t length)
+{
+    this->m_chunkCount++;
+    this->m_byteCount += length;
+    if (this->m_lastTimestamp == 0) {
+        this->m_lastTimestamp = timestampNanoseconds;
+        return;
+    }
+    uint64_t gap{(timestampNanoseconds > this->m_lastTimestamp) ? (timestampNanoseconds - this->m_lastTimestamp) : 0};
+    this->m_lastTimestamp = timestampNanoseconds;
+    if ( (this->m_gapCount == 0) || (gap < this->m_minimumGap) ) {
+        this->m_minimumGap = gap;
+    }
+    this->m_maximumGap = std::max(this->m_maximumGap, gap);
+    this->m_gapCount++;
+    double gapValue{static_cast<double>(gap)};
+    this->m_gapSum += gapValue;
+    this->m_gapSquareSum += gapValue * gapValue;
+    this->m_gapHistogram.record(gap);
+}
+
+void ReceiveTiming::reset()
+{
+    this->m_chunkCount = 0;
+    this->m_byteCount = 0;
+    this->m_gapCount = 0;
+    this->m_minimumGap = 0;
+    this->m_maximumGap = 0;
+    this->m_gapSum = 0.0;
+    this->m_gapSquareSum = 0.0;
+    this->m_bucketsAtReset = MetricsRegistry::instance().bucketCounts(this->m_gapHistogram);
+}
+
+uint64_t ReceiveTiming::chunkCount() const
+{
+    return this->m_chunkCount;
+}
+
+uint64_t ReceiveTiming::byteCount() const
+{
+    return this->m_byteCount;
+}
+
+uint64_t ReceiveTiming::gapCount() const
+{
+    return this->m_gapCount;
+}
+
+uint64_t ReceiveTiming::minimumGapNanoseconds() const
+{
+    return this->m_minimumGap;
+}
+
+uint64_t ReceiveTiming::maximumGapNanoseconds() const
+{
+    return this->m_maximumGap;
+}
+
+double ReceiveTiming::meanGapNanoseconds() const
+{
+    return (this->m_gapCount == 0) ? 0.0 : this->m_gapSum / static_cast<double>(this->m_gapCount);
+}
+
+double ReceiveTiming::jitterNanoseconds() const
+{
+    if (this->m_gapCount < 2) {
+        return 0.0;
+    }
+    double mean{this->meanGapNanoseconds()};
+    double variance{(this->m_gapSquareSum / static_cast<double>(this->m_gapCount)) - (mean * mean)};
+    return (variance > 0.0) ? std::sqrt(variance) : 0.0;
+}
+
+std::vector<std::string> ReceiveTiming::report(const std::string &portName) const
+{
+    std::vector<std::string> lines{};
+    lines.push_back(TStringFormat("{0}: {1} read(s), {2} bytes, gap min {3} us, mean {4} us, max {5} us, jitter {6} us",
+                                  portName, this->m_chunkCount, this->m_byteCount,
+                                  this->m_minimumGap / 1000,
+                                  static_cast<uint64_t>(this->meanGapNanoseconds() / 1000.0),
+                                  this->m_maximumGap / 1000,
+                                  static_cast<uint64_t>(this->jitterNanoseconds() / 1000.0)));
+    /* The histogram's 8 buckets per power of two are merged, which is
+     * plenty for a log line */
+    std::vector<uint64_t> buckets{MetricsRegistry::instance().bucketCounts(this->m_gapHistogram)};
+    std::vector<uint64_t> groups((buckets.size() / MetricsRegistry::HISTOGRAM_SUB_BUCKETS), 0);
+    for (size_t i = 0; i < buckets.size(); i++) {
+        groups[i / MetricsRegistry::HISTOGRAM_SUB_BUCKETS] += buckets[i] - std::min(buckets[i], this->m_bucketsAtReset[i]);
+    }
+    uint64_t fullestGroup{*std::max_element(groups.begin(), groups.end())};
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (groups[i] == 0) {
+            continue;
+        }
+        size_t firstBucket{i * MetricsRegistry::HISTOGRAM_SUB_BUCKETS};
+        uint64_t lowerBound{MetricsRegistry::bucketLowerBound(firstBucket)};
+        std::string range{TStringFormat("{0}-{1}", lowerBound, MetricsRegistry::bucketUpperBound(firstBucket + MetricsRegistry::HISTOGRAM_SUB_BUCKETS - 1))};
+        if (i == groups.size() - 1) {
+            range = TStringFormat(">={0}", lowerBound);
+        }
+        size_t barLength{static_cast<size_t>(std::max<uint64_t>(1, groups[i] * REPORT_BAR_WIDTH / fullestGroup))};
+        lines.push_back(TStringFormat("{0}:   {1} ns {2} {3}", portName, padLeft(range, 27), padLeft(std::to_string(groups[i]), 10), std::string(barLength, '#')));
+    }
+    return lines;
+}
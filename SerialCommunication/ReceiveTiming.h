@@ -0,0 +1,57 @@
+#ifndef SERIALCOMMUNICATION_RECEIVETIMING_H
+#define SERIALCOMMUNICATION_RECEIVETIMING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MetricsRegistry.h"
+
+/* When a port's reads returned data: the smallest, largest and mean gap
+ * between consecutive reads and its standard deviation (the jitter), with
+ * each gap also recorded to the port's gap histogram in the
+ * MetricsRegistry. Counts run from the last reset(), which remembers the
+ * histogram's bucket counts so report() can show what came in since; the
+ * previous read's time is kept across it so no gap is lost. Updating is a
+ * few arithmetic operations and never allocates; it belongs to the port's
+ * loop thread */
+class ReceiveTiming
+{
+public:
+    ReceiveTiming();
+
+    void setGapHistogram(const MetricHistogram &gapHistogram);
+    /* timestampNanoseconds is CLOCK_MONOTONIC when the read returned */
+    void record(uint64_t timestampNanoseconds, size_t length);
+    void reset();
+
+    uint64_t chunkCount() const;
+    uint64_t byteCount() const;
+    uint64_t gapCount() const;
+    uint64_t minimumGapNanoseconds() const;
+    uint64_t maximumGapNanoseconds() const;
+    double meanGapNanoseconds() const;
+    double jitterNanoseconds() const;
+
+    /* A summary line followed by one line per power of two of nanoseconds
+     * the histogram has gaps in since the last reset(), each with its
+     * range, count and a bar scaled to the fullest one */
+    std::vector<std::string> report(const std::string &portName) const;
+
+    static const size_t REPORT_BAR_WIDTH{40};
+
+private:
+    uint64_t m_lastTimestamp;
+    uint64_t m_chunkCount;
+    uint64_t m_byteCount;
+    uint64_t m_gapCount;
+    uint64_t m_minimumGap;
+    uint64_t m_maximumGap;
+    double m_gapSum;
+    double m_gapSquareSum;
+    MetricHistogram m_gapHistogram;
+    std::vector<uint64_t> m_bucketsAtReset;
+};
+
+#endif //SERIALCOMMUNICATION_RECEIVETIMING_H
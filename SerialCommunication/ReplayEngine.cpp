@@ -0,0 +1,300 @@
+#include "ReplayEngine.h"
+#include "CaptureReader.h"
+#include "CaptureWriter.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+const double ReplayEngine::MAXIMUM_SPEED{0.0};
+
+/* Upper bound on how much due data is merged into one delivery */
+static const size_t MAXIMUM_CHUNK_SIZE{64 * 1024};
+
+static uint64_t monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+ReplayEngine::ReplayEngine(const std::string &capturePath, double speed) :
+    m_captureReader{new CaptureReader{capturePath}},
+    m_pendingPorts{},
+    m_emptyPorts{0},
+    m_pendingBytes{0},
+    m_reorderWindow{0},
+    m_speed{speed},
+    m_receiveHandler{},
+    m_finishedHandler{},
+    m_pseudoTerminals{},
+    m_replayThread{},
+    m_stopRequested{false},
+    m_stopDescriptor{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)},
+    m_chunkBuffer{}
+{
+    if (this->m_stopDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to create replay stop descriptor ({0})", strerror(errno)));
+    }
+    if (this->m_speed < 0.0) {
+        throw std::runtime_error(TStringFormat("{0} is not a valid replay speed", this->m_speed));
+    }
+    this->m_chunkBuffer.reserve(MAXIMUM_CHUNK_SIZE);
+    /* The capture thread drains every port in turn, so it can hold a record
+     * back behind about one ring's worth of each other port's data */
+    size_t portCount{this->m_captureReader->portNames().size()};
+    this->m_pendingPorts.resize(portCount, PendingPort{{}, {}, 0});
+    this->m_emptyPorts = portCount;
+    this->m_reorderWindow = portCount * CaptureWriter::DEFAULT_RING_SIZE;
+}
+
+ReplayEngine::~ReplayEngine()
+{
+    this->stop();
+    this->closePseudoTerminals();
+    close(this->m_stopDescriptor);
+}
+
+void ReplayEngine::setReceiveHandler(const ReceiveHandler &receiveHandler)
+{
+    this->m_receiveHandler = receiveHandler;
+}
+
+void ReplayEngine::setFinishedHandler(const FinishedHandler &finishedHandler)
+{
+    this->m_finishedHandler = finishedHandler;
+}
+
+void ReplayEngine::openPseudoTerminals()
+{
+    for (size_t i = this->m_pseudoTerminals.size(); i < this->m_pendingPorts.size(); i++) {
+        PseudoTerminal pseudoTerminal{-1, -1, ""};
+        char slaveName[256]{};
+        if (openpty(&pseudoTerminal.masterDescriptor, &pseudoTerminal.slaveDescriptor, slaveName, nullptr, nullptr) == -1) {
+            throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+        }
+        pseudoTerminal.slaveName = slaveName;
+        /* Replayed bytes must reach the reader untouched */
+        termios terminalSettings{};
+        tcgetattr(pseudoTerminal.slaveDescriptor, &terminalSettings);
+        cfmakeraw(&terminalSettings);
+        tcsetattr(pseudoTerminal.slaveDescriptor, TCSANOW, &terminalSettings);
+        fcntl(pseudoTerminal.masterDescriptor, F_SETFL, fcntl(pseudoTerminal.masterDescriptor, F_GETFL) | O_NONBLOCK);
+        fcntl(pseudoTerminal.masterDescriptor, F_SETFD, FD_CLOEXEC);
+        fcntl(pseudoTerminal.slaveDescriptor, F_SETFD, FD_CLOEXEC);
+        this->m_pseudoTerminals.push_back(pseudoTerminal);
+    }
+}
+
+std::string ReplayEngine::pseudoTerminalName(uint16_t portId) const
+{
+    return (portId < this->m_pseudoTerminals.size()) ? this->m_pseudoTerminals[portId].slaveName : "";
+}
+
+const std::vector<std::string> &ReplayEngine::portNames() const
+{
+    return this->m_captureReader->portNames();
+}
+
+void ReplayEngine::start()
+{
+    if (this->m_replayThread.joinable()) {
+        return;
+    }
+    this->m_stopRequested.store(false);
+    this->m_replayThread = std::thread{[this]() { this->runReplay(); }};
+}
+
+void ReplayEngine::stop()
+{
+    this->m_stopRequested.store(true);
+    uint64_t increment{1};
+    ssize_t writeResult{write(this->m_stopDescriptor, &increment, sizeof(increment))};
+    (void)writeResult;
+    if (this->m_replayThread.joinable()) {
+        this->m_replayThread.join();
+    }
+}
+
+void ReplayEngine::runReplay()
+{
+    /* The default 50us slack would eat most of the timing budget */
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+    bool timed{this->m_speed != MAXIMUM_SPEED};
+    uint64_t replayStart{monotonicNanoseconds()};
+    uint64_t firstTimestamp{UINT64_MAX};
+    uint64_t replayedBytes{0};
+    uint64_t deliveries{0};
+    uint64_t totalLateness{0};
+    uint64_t maximumLateness{0};
+    auto dueTime = [&](uint64_t timestampNs) {
+        uint64_t offset{(timestampNs > firstTimestamp) ? timestampNs - firstTimestamp : 0};
+        return replayStart + static_cast<uint64_t>(static_cast<double>(offset) / this->m_speed);
+    };
+
+    this->readAhead();
+    size_t portCount{this->m_pendingPorts.size()};
+    size_t portId{this->earliestPort()};
+    if (portId != portCount) {
+        firstTimestamp = this->m_pendingPorts[portId].records.front().first;
+    }
+
+    for (; (portId != portCount) && (!this->m_stopRequested.load()); portId = this->earliestPort()) {
+        const auto &records = this->m_pendingPorts[portId].records;
+        uint64_t now{0};
+        if (timed) {
+            uint64_t due{dueTime(records.front().first)};
+            if (!this->waitUntil(due)) {
+                break;
+            }
+            now = monotonicNanoseconds();
+            totalLateness += now - due;
+            maximumLateness = std::max(maximumLateness, now - due);
+        }
+        /* Gather everything for this port that is already due and comes
+         * before any other port's next record */
+        this->m_chunkBuffer.clear();
+        uint64_t chunkTimestamp{this->takeRecord(portId)};
+        while ( (!records.empty()) &&
+                (this->m_chunkBuffer.size() + records.front().second <= MAXIMUM_CHUNK_SIZE) &&
+                ( (!timed) || (dueTime(records.front().first) <= now) ) &&
+                (this->earliestPort() == portId) ) {
+            chunkTimestamp = this->takeRecord(portId);
+        }
+        this->deliver(static_cast<uint16_t>(portId), chunkTimestamp, this->m_chunkBuffer.data(), this->m_chunkBuffer.size());
+        replayedBytes += this->m_chunkBuffer.size();
+        deliveries++;
+    }
+
+    double elapsedSeconds{static_cast<double>(monotonicNanoseconds() - replayStart) / 1e9};
+    LOG_INFO(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Replayed {0} bytes in {1} chunks from {2} file(s) in {3} s", replayedBytes, deliveries, this->m_captureReader->filesRead(), elapsedSeconds);
+    if ( (timed) && (deliveries > 0) ) {
+        LOG_INFO(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Replay timing error: mean {0} us, maximum {1} us", static_cast<double>(totalLateness) / static_cast<double>(deliveries) / 1e3, static_cast<double>(maximumLateness) / 1e3);
+    }
+    if ( (!this->m_stopRequested.load()) && (this->m_finishedHandler) ) {
+        this->m_finishedHandler();
+    }
+}
+
+void ReplayEngine::readAhead()
+{
+    /* Once every port has a record queued, the earliest of them is the next
+     * one overall; a port that has gone quiet stops the read ahead at the
+     * reorder window instead */
+    CaptureRecord record{nullptr, nullptr};
+    while ( (this->m_emptyPorts > 0) && (this->m_pendingBytes < this->m_reorderWindow) && (this->m_captureReader->next(record)) ) {
+        if (record.header->direction != static_cast<uint8_t>(CaptureDirection::Receive)) {
+            continue;
+        }
+        PendingPort &pendingPort = this->m_pendingPorts[record.header->portId];
+        if (pendingPort.records.empty()) {
+            this->m_emptyPorts--;
+        }
+        pendingPort.records.emplace_back(record.header->timestampNs, record.header->length);
+        pendingPort.payload.insert(pendingPort.payload.end(), record.payload, record.payload + record.header->length);
+        this->m_pendingBytes += record.header->length;
+    }
+}
+
+size_t ReplayEngine::earliestPort() const
+{
+    size_t earliest{this->m_pendingPorts.size()};
+    for (size_t i = 0; i < this->m_pendingPorts.size(); i++) {
+        const auto &records = this->m_pendingPorts[i].records;
+        if ( (!records.empty()) &&
+             ( (earliest == this->m_pendingPorts.size()) || (records.front().first < this->m_pendingPorts[earliest].records.front().first) ) ) {
+            earliest = i;
+        }
+    }
+    return earliest;
+}
+
+uint64_t ReplayEngine::takeRecord(size_t portId)
+{
+    PendingPort &pendingPort = this->m_pendingPorts[portId];
+    uint64_t timestampNs{pendingPort.records.front().first};
+    size_t length{pendingPort.records.front().second};
+    const char *payload{pendingPort.payload.data() + pendingPort.payloadOffset};
+    this->m_chunkBuffer.insert(this->m_chunkBuffer.end(), payload, payload + length);
+    pendingPort.records.pop_front();
+    pendingPort.payloadOffset += length;
+    this->m_pendingBytes -= length;
+    /* Compacted once the consumed part is the larger one, so every byte is
+     * moved at most about once */
+    if (pendingPort.records.empty()) {
+        pendingPort.payload.clear();
+        pendingPort.payloadOffset = 0;
+        this->m_emptyPorts++;
+    } else if (pendingPort.payloadOffset * 2 >= pendingPort.payload.size()) {
+        pendingPort.payload.erase(pendingPort.payload.begin(), pendingPort.payload.begin() + static_cast<std::ptrdiff_t>(pendingPort.payloadOffset));
+        pendingPort.payloadOffset = 0;
+    }
+    this->readAhead();
+    return timestampNs;
+}
+
+bool ReplayEngine::waitUntil(uint64_t dueNanoseconds)
+{
+    /* ppoll() sleeps on a high resolution timer and still wakes for stop() */
+    pollfd pollDescriptor{this->m_stopDescriptor, POLLIN, 0};
+    while (!this->m_stopRequested.load()) {
+        uint64_t now{monotonicNanoseconds()};
+        if (now >= dueNanoseconds) {
+            return true;
+        }
+        uint64_t remaining{dueNanoseconds - now};
+        timespec timeout{static_cast<time_t>(remaining / 1000000000ULL), static_cast<long>(remaining % 1000000000ULL)};
+        ppoll(&pollDescriptor, 1, &timeout, nullptr);
+    }
+    return false;
+}
+
+void ReplayEngine::deliver(uint16_t portId, uint64_t timestampNs, char *data, size_t length)
+{
+    if (this->m_pseudoTerminals.empty()) {
+        if (this->m_receiveHandler) {
+            this->m_receiveHandler(portId, timestampNs, data, length);
+        }
+        return;
+    }
+    if (portId >= this->m_pseudoTerminals.size()) {
+        return;
+    }
+    /* Whoever has the slave open sets the pace; stop() still gets through */
+    int masterDescriptor{this->m_pseudoTerminals[portId].masterDescriptor};
+    while ( (length > 0) && (!this->m_stopRequested.load()) ) {
+        ssize_t writeResult{write(masterDescriptor, data, length)};
+        if (writeResult > 0) {
+            data += writeResult;
+            length -= static_cast<size_t>(writeResult);
+        } else if ( (writeResult == -1) && ( (errno == EAGAIN) || (errno == EINTR) ) ) {
+            pollfd pollDescriptors[2]{{masterDescriptor, POLLOUT, 0}, {this->m_stopDescriptor, POLLIN, 0}};
+            poll(pollDescriptors, 2, -1);
+        } else {
+            LOG_WARN(CAPTURE_LOG_SUBSYSTEM) << TStringFormat("Unable to replay into {0} ({1})", this->m_pseudoTerminals[portId].slaveName, strerror(errno));
+            return;
+        }
+    }
+}
+
+void ReplayEngine::closePseudoTerminals()
+{
+    for (auto &pseudoTerminal : this->m_pseudoTerminals) {
+        close(pseudoTerminal.masterDescriptor);
+        close(pseudoTerminal.slaveDescriptor);
+    }
+    this->m_pseudoTerminals.clear();
+}
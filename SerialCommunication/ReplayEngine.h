@@ -0,0 +1,95 @@
+#ifndef SERIALCOMMUNICATION_REPLAYENGINE_H
+#define SERIALCOMMUNICATION_REPLAYENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CaptureReader;
+
+/* Plays the RX side of a capture (see CaptureWriter) back, either into a
+ * ReceiveHandler, in place of a live port, or out of one pseudo-terminal per
+ * captured port, for programs that expect a tty. The capture thread writes
+ * ports out one at a time, so records are only in order per port; the
+ * capture is read once, front to back, and a short queue per port puts the
+ * records back in timestamp order. Records are due at their original offset from the earliest record divided
+ * by the speed; a speed of MAXIMUM_SPEED ignores timestamps. Records for the
+ * same port that are due together are handed over as one chunk, much like a
+ * single read() on a real port would return them */
+class ReplayEngine
+{
+public:
+    /* Port id, the timestamp of the last record in the chunk, and the chunk,
+     * which the handler may modify in place as a codec does */
+    using ReceiveHandler = std::function<void(uint16_t, uint64_t, char *, size_t)>;
+    using FinishedHandler = std::function<void()>;
+
+    ReplayEngine(const std::string &capturePath, double speed = 1.0);
+    ~ReplayEngine();
+    ReplayEngine(const ReplayEngine &) = delete;
+    ReplayEngine(ReplayEngine &&) = delete;
+    ReplayEngine &operator=(const ReplayEngine &) = delete;
+    ReplayEngine &operator=(ReplayEngine &&) = delete;
+
+    void setReceiveHandler(const ReceiveHandler &receiveHandler);
+    void setFinishedHandler(const FinishedHandler &finishedHandler);
+
+    /* Creates the pseudo-terminals; call before start() */
+    void openPseudoTerminals();
+    std::string pseudoTerminalName(uint16_t portId) const;
+
+    const std::vector<std::string> &portNames() const;
+
+    void start();
+    void stop();
+
+    static const double MAXIMUM_SPEED;
+
+private:
+    struct PseudoTerminal
+    {
+        int masterDescriptor;
+        int slaveDescriptor;
+        std::string slaveName;
+    };
+
+    /* Received data read ahead for one port, oldest first; the payloads
+     * are copied out because the mapping goes away when the reader changes
+     * file */
+    struct PendingPort
+    {
+        std::deque<std::pair<uint64_t, size_t>> records;
+        std::vector<char> payload;
+        size_t payloadOffset;
+    };
+
+    std::unique_ptr<CaptureReader> m_captureReader;
+    std::vector<PendingPort> m_pendingPorts;
+    size_t m_emptyPorts;
+    size_t m_pendingBytes;
+    size_t m_reorderWindow;
+    double m_speed;
+    ReceiveHandler m_receiveHandler;
+    FinishedHandler m_finishedHandler;
+    std::vector<PseudoTerminal> m_pseudoTerminals;
+    std::thread m_replayThread;
+    std::atomic<bool> m_stopRequested;
+    int m_stopDescriptor;
+    std::vector<char> m_chunkBuffer;
+
+    void runReplay();
+    void readAhead();
+    size_t earliestPort() const;
+    uint64_t takeRecord(size_t portId);
+    bool waitUntil(uint64_t monotonicNanoseconds);
+    void deliver(uint16_t portId, uint64_t timestampNs, char *data, size_t length);
+    void closePseudoTerminals();
+};
+
+#endif //SERIALCOMMUNICATION_REPLAYENGINE_H
@@ -0,0 +1,74 @@
+#include "Scrollback.h"
+#include "MessageLogger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace TMessageLogger;
+
+const size_t Scrollback::DEFAULT_BYTE_CAPACITY;
+const size_t Scrollback::DEFAULT_LINE_CAPACITY;
+const size_t Scrollback::MAXIMUM_LINE_LENGTH;
+
+Scrollback::Scrollback(size_t byteCapacity, size_t lineCapacity) :
+    m_bytes(byteCapacity),
+    m_lines(lineCapacity),
+    m_firstLine{0},
+    m_lineCount{0},
+    m_writeOffset{0},
+    m_appendedLineCount{0}
+{
+    if ( (byteCapacity < MAXIMUM_LINE_LENGTH) || (lineCapacity == 0) ) {
+        throw std::runtime_error(TStringFormat("A scrollback of {0} bytes and {1} lines is too small", byteCapacity, lineCapacity));
+    }
+}
+
+void Scrollback::append(uint16_t source, const char *data, size_t length)
+{
+    length = std::min(length, MAXIMUM_LINE_LENGTH);
+    /* A line never wraps around the end of the byte ring, whatever is left
+     * there stays unused until the next pass */
+    if (this->m_writeOffset + length > this->m_bytes.size()) {
+        this->m_writeOffset = 0;
+    }
+    /* Lines are stored in order, so only the oldest ones can sit in the
+     * space about to be written, and only if they start inside it */
+    while (this->m_lineCount > 0) {
+        const LineRecord &oldestLine = this->m_lines[this->m_firstLine];
+        if ( (oldestLine.offset < this->m_writeOffset) || (oldestLine.offset >= this->m_writeOffset + length) ) {
+            break;
+        }
+        this->evictOldestLine();
+    }
+    if (this->m_lineCount == this->m_lines.size()) {
+        this->evictOldestLine();
+    }
+    memcpy(this->m_bytes.data() + this->m_writeOffset, data, length);
+    this->m_lines[(this->m_firstLine + this->m_lineCount) % this->m_lines.size()] = LineRecord{this->m_writeOffset, static_cast<uint32_t>(length), source};
+    this->m_lineCount++;
+    this->m_writeOffset += length;
+    this->m_appendedLineCount++;
+}
+
+size_t Scrollback::lineCount() const
+{
+    return this->m_lineCount;
+}
+
+Scrollback::Line Scrollback::line(size_t index) const
+{
+    const LineRecord &lineRecord = this->m_lines[(this->m_firstLine + index) % this->m_lines.size()];
+    return Line{this->m_bytes.data() + lineRecord.offset, lineRecord.length, lineRecord.source};
+}
+
+uint64_t Scrollback::appendedLineCount() const
+{
+    return this->m_appendedLineCount;
+}
+
+void Scrollback::evictOldestLine()
+{
+    this->m_firstLine = (this->m_firstLine + 1) % this->m_lines.size();
+    this->m_lineCount--;
+}
@@ -0,0 +1,59 @@
+#ifndef SERIALCOMMUNICATION_SCROLLBACK_H
+#define SERIALCOMMUNICATION_SCROLLBACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Fixed size line history. The text of every line is packed into one byte
+ * ring and described by a second ring of line records, both allocated up
+ * front; appending evicts the oldest lines when either ring is full, so the
+ * memory used never grows and no line is allocated on its own */
+class Scrollback
+{
+public:
+    struct Line
+    {
+        const char *data;
+        size_t length;
+        uint16_t source;
+    };
+
+    explicit Scrollback(size_t byteCapacity = DEFAULT_BYTE_CAPACITY, size_t lineCapacity = DEFAULT_LINE_CAPACITY);
+    Scrollback(const Scrollback &) = delete;
+    Scrollback(Scrollback &&) = delete;
+    Scrollback &operator=(const Scrollback &) = delete;
+    Scrollback &operator=(Scrollback &&) = delete;
+
+    /* Lines longer than MAXIMUM_LINE_LENGTH are cut short */
+    void append(uint16_t source, const char *data, size_t length);
+
+    size_t lineCount() const;
+    /* 0 is the oldest line still held */
+    Line line(size_t index) const;
+    /* Every line ever appended, including the ones evicted since */
+    uint64_t appendedLineCount() const;
+
+    static const size_t DEFAULT_BYTE_CAPACITY{4 * 1024 * 1024};
+    static const size_t DEFAULT_LINE_CAPACITY{100000};
+    static const size_t MAXIMUM_LINE_LENGTH{1024};
+
+private:
+    struct LineRecord
+    {
+        size_t offset;
+        uint32_t length;
+        uint16_t source;
+    };
+
+    std::vector<char> m_bytes;
+    std::vector<LineRecord> m_lines;
+    size_t m_firstLine;
+    size_t m_lineCount;
+    size_t m_writeOffset;
+    uint64_t m_appendedLineCount;
+
+    void evictOldestLine();
+};
+
+#endif //SERIALCOMMUNICATION_SCROLLBACK_H
@@ -0,0 +1,483 @@
+#include "SerialSession.h"
+#include "CaptureWriter.h"
+#include "EventLoop.h"
+#include "FramingCodec.h"
+#include "PortChannel.h"
+#include "StreamFanout.h"
+#include "GlobalDefinitions.h"
+
+#include <chrono>
+#include <cstring>
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+uint64_t monotonicNanoseconds()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} //Global namespace
+
+SerialSession::SerialSession(EventLoop &eventLoop, const PortSettings &portSettings) :
+    m_eventLoop{eventLoop},
+    m_portSettings{portSettings},
+    m_serialPort{nullptr},
+    m_channel{nullptr},
+    m_receiveHandler{},
+    m_closeHandler{},
+    m_writableHandler{},
+    m_framingCodec{nullptr},
+    m_captureWriter{nullptr},
+    m_capturePortId{0},
+    m_streamFanout{nullptr},
+    m_receiveTiming{},
+    m_receiveTimestamp{0},
+    m_lowLatency{false},
+    m_devicePath{portSettings.portName},
+    m_heldTransmit{""},
+    m_heldTransmitLimit{0},
+    m_droppedHeldBytes{0},
+    m_lostTimestamp{0},
+    m_receivedBytesMetric{},
+    m_transmittedBytesMetric{},
+    m_framesMetric{},
+    m_framingErrorsMetric{},
+    m_readHandlerTimeMetric{},
+    m_reconnectsMetric{},
+    m_writeQueueBytesMetric{},
+    m_overrunsMetric{},
+    m_bufferOverrunsMetric{},
+    m_lineFrameErrorsMetric{},
+    m_parityErrorsMetric{},
+    m_reportedFrameCount{0},
+    m_reportedFramingErrorCount{0},
+    m_lineCountersSupported{true}
+{
+    MetricsRegistry &metricsRegistry = MetricsRegistry::instance();
+    const std::string prefix{"port." + this->m_portSettings.portName + "."};
+    this->m_receivedBytesMetric = metricsRegistry.counter(prefix + "rx_bytes");
+    this->m_transmittedBytesMetric = metricsRegistry.counter(prefix + "tx_bytes");
+    this->m_framesMetric = metricsRegistry.counter(prefix + "rx_frames");
+    this->m_framingErrorsMetric = metricsRegistry.counter(prefix + "framing_errors");
+    this->m_readHandlerTimeMetric = metricsRegistry.histogram(prefix + "read_handler_ns");
+    this->m_receiveTiming.setGapHistogram(metricsRegistry.histogram(prefix + "rx_gap_ns"));
+    this->m_reconnectsMetric = metricsRegistry.counter(prefix + "reconnects");
+    this->m_writeQueueBytesMetric = metricsRegistry.gauge(prefix + "tx_queue_bytes");
+    this->m_overrunsMetric = metricsRegistry.gauge(prefix + "uart_overruns");
+    this->m_bufferOverrunsMetric = metricsRegistry.gauge(prefix + "uart_buffer_overruns");
+    this->m_lineFrameErrorsMetric = metricsRegistry.gauge(prefix + "uart_frame_errors");
+    this->m_parityErrorsMetric = metricsRegistry.gauge(prefix + "uart_parity_errors");
+}
+
+SerialSession::~SerialSession()
+{
+    this->close();
+}
+
+void SerialSession::setReceiveHandler(const ReceiveHandler &receiveHandler)
+{
+    this->m_receiveHandler = receiveHandler;
+}
+
+void SerialSession::setCloseHandler(const CloseHandler &closeHandler)
+{
+    this->m_closeHandler = closeHandler;
+}
+
+void SerialSession::setFramingCodec(std::unique_ptr<FramingCodec> framingCodec, const FrameHandler &frameHandler)
+{
+    this->m_framingCodec = std::move(framingCodec);
+    if (this->m_framingCodec) {
+        this->m_framingCodec->setFrameHandler([this, frameHandler](const char *frame, size_t length) {
+            if (frameHandler) {
+                frameHandler(*this, frame, length);
+            }
+        });
+    }
+}
+
+void SerialSession::setCaptureWriter(CaptureWriter *captureWriter, uint16_t capturePortId)
+{
+    this->m_captureWriter = captureWriter;
+    this->m_capturePortId = capturePortId;
+}
+
+void SerialSession::addStreamSink(int fileDescriptor, const StreamSinkSettings &settings)
+{
+    if (!this->m_streamFanout) {
+        this->m_streamFanout.reset(new StreamFanout{this->m_eventLoop, this->m_portSettings.portName});
+        /* A closed sink never reopens, so it is forgotten rather than kept
+         * and skipped on every read */
+        this->m_streamFanout->setClosedHandler([this](uint64_t sinkId) {
+            this->m_streamFanout->removeSink(sinkId);
+        });
+    }
+    this->m_streamFanout->addSink(fileDescriptor, settings);
+}
+
+void SerialSession::setWritableHandler(const WritableHandler &writableHandler)
+{
+    this->m_writableHandler = writableHandler;
+    if (this->m_channel) {
+        this->m_channel->setWritableHandler(writableHandler);
+    }
+}
+
+void SerialSession::setLowLatency(bool lowLatency)
+{
+    this->m_lowLatency = lowLatency;
+}
+
+void SerialSession::setDevicePath(const std::string &devicePath)
+{
+    this->m_devicePath = devicePath;
+}
+
+const std::string &SerialSession::devicePath() const
+{
+    return this->m_devicePath;
+}
+
+void SerialSession::setHeldTransmitLimit(size_t limit)
+{
+    this->m_heldTransmitLimit = limit;
+}
+
+void SerialSession::open()
+{
+    if (this->isOpen()) {
+        return;
+    }
+    this->m_serialPort = std::make_shared<SerialPort>(this->m_devicePath,
+                                                      this->m_portSettings.baudRate,
+                                                      this->m_portSettings.dataBits,
+                                                      this->m_portSettings.stopBits,
+                                                      this->m_portSettings.parity);
+    this->m_serialPort->setLineEnding(this->m_portSettings.lineEnding);
+    try {
+        this->m_serialPort->openPort();
+        this->applyFlowControl();
+        this->applyLowLatency();
+    } catch (...) {
+        /* A port that is not there yet counts as away from the first try */
+        if (this->m_lostTimestamp == 0) {
+            this->m_lostTimestamp = monotonicNanoseconds();
+        }
+        throw;
+    }
+
+    this->m_channel.reset(new PortChannel{this->m_eventLoop, this->m_serialPort->getFileDescriptor()});
+    this->m_channel->setWritableHandler(this->m_writableHandler);
+    this->m_channel->setReadHandler([this](char *data, size_t length) {
+        auto startTime = std::chrono::steady_clock::now();
+        this->m_receiveTimestamp = this->m_channel->readTimestamp();
+        this->m_receiveTiming.record(this->m_receiveTimestamp, length);
+        this->m_receivedBytesMetric.add(length);
+        if (this->m_captureWriter) {
+            this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Receive, data, length, this->m_receiveTimestamp);
+        }
+        if (this->m_receiveHandler) {
+            this->m_receiveHandler(*this, data, length);
+        }
+        /* Only --sink destinations take the raw bytes; the capture, the
+         * console and the log above need the read's port and timestamp */
+        if (this->m_streamFanout) {
+            this->m_streamFanout->publish(data, length);
+        }
+        /* Last, since decoding may unescape frames in place */
+        if (this->m_framingCodec) {
+            this->m_framingCodec->decode(data, length);
+            uint64_t frameCount{this->m_framingCodec->frameCount()};
+            uint64_t framingErrorCount{this->m_framingCodec->errorCount()};
+            this->m_framesMetric.add(frameCount - this->m_reportedFrameCount);
+            this->m_framingErrorsMetric.add(framingErrorCount - this->m_reportedFramingErrorCount);
+            this->m_reportedFrameCount = frameCount;
+            this->m_reportedFramingErrorCount = framingErrorCount;
+        }
+        this->m_readHandlerTimeMetric.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count()));
+    });
+    this->m_channel->setErrorHandler([this](int errorNumber) {
+        this->onChannelError(errorNumber);
+    });
+    /* Queued before start(), so held data goes out ahead of anything else */
+    size_t heldBytes{this->m_heldTransmit.size()};
+    if (heldBytes > 0) {
+        this->m_channel->write(this->m_heldTransmit);
+        this->m_heldTransmit.clear();
+    }
+    this->m_channel->start();
+    if (this->m_lostTimestamp == 0) {
+        return;
+    }
+    uint64_t downtime{monotonicNanoseconds() - this->m_lostTimestamp};
+    this->m_lostTimestamp = 0;
+    this->m_reconnectsMetric.add(1);
+    if (this->m_captureWriter) {
+        this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Reconnected, reinterpret_cast<const char *>(&downtime), sizeof(downtime));
+    }
+    LOG_INFO(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Port {0} is back after {1} ms, sending {2} held byte(s), {3} dropped",
+                                                    this->m_portSettings.portName, downtime / 1000000, heldBytes, this->m_droppedHeldBytes);
+    this->m_droppedHeldBytes = 0;
+    /* Writers waiting for the port to take data (see sendSome()) carry on */
+    if (this->m_writableHandler) {
+        WritableHandler writableHandler{this->m_writableHandler};
+        this->m_eventLoop.post([writableHandler]() { writableHandler(); });
+    }
+}
+
+void SerialSession::close()
+{
+    if (this->m_framingCodec) {
+        this->m_framingCodec->flush();
+    }
+    this->m_channel.reset();
+    if (this->m_serialPort) {
+        this->m_serialPort->closePort();
+        this->m_serialPort.reset();
+    }
+}
+
+bool SerialSession::isOpen() const
+{
+    return (this->m_channel != nullptr) && (this->m_channel->isStarted());
+}
+
+bool SerialSession::isAwaitingReconnect() const
+{
+    return (!this->isOpen()) && (this->m_heldTransmitLimit > 0);
+}
+
+void SerialSession::send(const char *data, size_t length)
+{
+    if (this->m_channel) {
+        if (this->m_captureWriter) {
+            this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Transmit, data, length);
+        }
+        this->m_transmittedBytesMetric.add(length);
+        this->m_channel->write(data, length);
+    } else if (this->m_heldTransmitLimit > 0) {
+        this->holdTransmit(data, length);
+    }
+}
+
+void SerialSession::sendLine(const std::string &line)
+{
+    if (this->m_framingCodec) {
+        this->sendFrame(line.data(), line.size());
+        return;
+    }
+    std::string terminatedLine{line};
+    terminatedLine.append(this->m_portSettings.lineEnding);
+    this->send(terminatedLine.data(), terminatedLine.size());
+}
+
+void SerialSession::sendFrame(const char *payload, size_t length)
+{
+    if (!this->m_framingCodec) {
+        this->send(payload, length);
+        return;
+    }
+    if (!this->m_channel) {
+        if (this->m_heldTransmitLimit == 0) {
+            return;
+        }
+        std::string frame(this->m_framingCodec->maximumEncodedLength(length), '\0');
+        try {
+            frame.resize(this->m_framingCodec->encode(payload, length, &frame[0]));
+        } catch (std::exception &e) {
+            LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Not sending frame to {0} ({1})", this->m_portSettings.portName, e.what());
+            return;
+        }
+        this->holdTransmit(frame.data(), frame.size());
+        return;
+    }
+    char *frame{this->m_channel->reserveWrite(this->m_framingCodec->maximumEncodedLength(length))};
+    size_t frameLength{0};
+    try {
+        frameLength = this->m_framingCodec->encode(payload, length, frame);
+    } catch (std::exception &e) {
+        this->m_channel->commitWrite(0);
+        LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Not sending frame to {0} ({1})", this->m_portSettings.portName, e.what());
+        return;
+    }
+    if (this->m_captureWriter) {
+        this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Transmit, frame, frameLength);
+    }
+    this->m_transmittedBytesMetric.add(frameLength);
+    this->m_channel->commitWrite(frameLength);
+}
+
+void SerialSession::markCapture(const std::string &label)
+{
+    if (this->m_captureWriter) {
+        this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Marker, label.data(), label.size(), this->m_receiveTimestamp);
+    }
+}
+
+size_t SerialSession::sendSome(const char *data, size_t length)
+{
+    if (!this->m_channel) {
+        return 0;
+    }
+    size_t written{this->m_channel->writeSome(data, length)};
+    if (written > 0) {
+        if (this->m_captureWriter) {
+            this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Transmit, data, written);
+        }
+        this->m_transmittedBytesMetric.add(written);
+    }
+    return written;
+}
+
+void SerialSession::applyFlowControl()
+{
+    /* With flow control on, the kernel holds output back while the other
+     * end asks it to, and writers just see the port stop taking data */
+    int fileDescriptor{this->m_serialPort->getFileDescriptor()};
+    termios settings{};
+    if (tcgetattr(fileDescriptor, &settings) == -1) {
+        if (this->m_portSettings.flowControl == FlowControl::None) {
+            return;
+        }
+        throw std::runtime_error(TStringFormat("Unable to read the terminal settings of {0} ({1})", this->m_portSettings.portName, strerror(errno)));
+    }
+    settings.c_cflag &= ~static_cast<tcflag_t>(CRTSCTS);
+    settings.c_iflag &= ~static_cast<tcflag_t>(IXON | IXOFF | IXANY);
+    if (this->m_portSettings.flowControl == FlowControl::Hardware) {
+        settings.c_cflag |= CRTSCTS;
+    } else if (this->m_portSettings.flowControl == FlowControl::Software) {
+        settings.c_iflag |= IXON | IXOFF;
+    }
+    if (tcsetattr(fileDescriptor, TCSANOW, &settings) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to set flow control on {0} ({1})", this->m_portSettings.portName, strerror(errno)));
+    }
+}
+
+void SerialSession::applyLowLatency()
+{
+    /* VMIN 1 and VTIME 0 hand every byte over as soon as it arrives, rather
+     * than holding it back for more, to readers that block as well */
+    int fileDescriptor{this->m_serialPort->getFileDescriptor()};
+    termios settings{};
+    if (tcgetattr(fileDescriptor, &settings) == 0) {
+        settings.c_cc[VMIN] = 1;
+        settings.c_cc[VTIME] = 0;
+        if (tcsetattr(fileDescriptor, TCSANOW, &settings) == -1) {
+            LOG_DEBUG(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Unable to set VMIN and VTIME on {0} ({1})", this->m_portSettings.portName, strerror(errno));
+        }
+    }
+    if (!this->m_lowLatency) {
+        return;
+    }
+    /* Only serial drivers know this; pseudo-terminals and some adapters
+     * fail with ENOTTY or EINVAL and are simply left as they are */
+    serial_struct serialSettings{};
+    bool enabled{ioctl(fileDescriptor, TIOCGSERIAL, &serialSettings) == 0};
+    if (enabled) {
+        serialSettings.flags |= ASYNC_LOW_LATENCY;
+        enabled = (ioctl(fileDescriptor, TIOCSSERIAL, &serialSettings) == 0);
+    }
+    if (!enabled) {
+        LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Low latency mode is not available on {0} ({1})", this->m_portSettings.portName, strerror(errno));
+        return;
+    }
+    LOG_INFO(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Low latency mode enabled on {0}", this->m_portSettings.portName);
+}
+
+void SerialSession::sampleMetrics()
+{
+    if (!this->m_channel) {
+        return;
+    }
+    this->m_writeQueueBytesMetric.set(static_cast<int64_t>(this->m_channel->pendingWriteBytes()));
+    if (!this->m_lineCountersSupported) {
+        return;
+    }
+    /* Only real UARTs keep these; pseudo-terminals and USB adapters without
+     * them fail with ENOTTY or EINVAL, after which they are not asked again */
+    serial_icounter_struct lineCounters{};
+    if (ioctl(this->m_channel->fileDescriptor(), TIOCGICOUNT, &lineCounters) == -1) {
+        this->m_lineCountersSupported = false;
+        return;
+    }
+    this->m_overrunsMetric.set(lineCounters.overrun);
+    this->m_bufferOverrunsMetric.set(lineCounters.buf_overrun);
+    this->m_lineFrameErrorsMetric.set(lineCounters.frame);
+    this->m_parityErrorsMetric.set(lineCounters.parity);
+}
+
+uint64_t SerialSession::receiveTimestamp() const
+{
+    return this->m_receiveTimestamp;
+}
+
+ReceiveTiming &SerialSession::receiveTiming()
+{
+    return this->m_receiveTiming;
+}
+
+const PortSettings &SerialSession::portSettings() const
+{
+    return this->m_portSettings;
+}
+
+EventLoop &SerialSession::eventLoop() const
+{
+    return this->m_eventLoop;
+}
+
+PortChannel *SerialSession::channel() const
+{
+    return this->m_channel.get();
+}
+
+StreamFanout *SerialSession::streamFanout() const
+{
+    return this->m_streamFanout.get();
+}
+
+void SerialSession::holdTransmit(const char *data, size_t length)
+{
+    /* Whole sends or nothing, so lines and frames are not cut short */
+    if (this->m_heldTransmit.size() + length > this->m_heldTransmitLimit) {
+        if (this->m_droppedHeldBytes == 0) {
+            LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Holding {0} bytes for {1} while it is away, dropping what is sent beyond that",
+                                                            this->m_heldTransmitLimit, this->m_portSettings.portName);
+        }
+        this->m_droppedHeldBytes += length;
+        return;
+    }
+    if (this->m_captureWriter) {
+        this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Transmit, data, length);
+    }
+    this->m_transmittedBytesMetric.add(length);
+    this->m_heldTransmit.append(data, length);
+}
+
+void SerialSession::onChannelError(int errorNumber)
+{
+    LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Port {0} closed ({1})", this->m_portSettings.portName, strerror(errorNumber));
+    this->m_lostTimestamp = monotonicNanoseconds();
+    if (this->m_captureWriter) {
+        uint32_t lostError{static_cast<uint32_t>(errorNumber)};
+        this->m_captureWriter->record(this->m_capturePortId, CaptureDirection::Disconnected, reinterpret_cast<const char *>(&lostError), sizeof(lostError));
+    }
+    if (this->m_heldTransmitLimit > 0) {
+        /* Already counted and captured when it was sent */
+        this->m_heldTransmit = this->m_channel->takePendingWrites();
+    }
+    /* This runs from inside the channel's own event handler, so the channel
+     * is handed to the loop to be destroyed once the handler has returned */
+    PortChannel *retiredChannel{this->m_channel.release()};
+    this->m_eventLoop.post([retiredChannel]() { delete retiredChannel; });
+    this->close();
+    if (this->m_closeHandler) {
+        this->m_closeHandler(*this, errorNumber);
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef SERIALCOMMUNICATION_SERIALSESSION_H
+#define SERIALCOMMUNICATION_SERIALSESSION_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <CppSerialPort/SerialPort.h>
+#include "MetricsRegistry.h"
+#include "ReceiveTiming.h"
+
+class CaptureWriter;
+class EventLoop;
+class FramingCodec;
+class PortChannel;
+class StreamFanout;
+struct StreamSinkSettings;
+
+/* Applied to the port's termios after it is opened, the serial port
+ * library itself leaves flow control alone */
+enum class FlowControl {
+    None,
+    Hardware,
+    Software
+};
+
+struct PortSettings
+{
+    std::string portName;
+    CppSerialPort::BaudRate baudRate;
+    CppSerialPort::DataBits dataBits;
+    CppSerialPort::StopBits stopBits;
+    CppSerialPort::Parity parity;
+    std::string lineEnding;
+    FlowControl flowControl;
+};
+
+/* One open serial port plus the channel that services it on an EventLoop.
+ * Everything except the constructor must run on the owning loop's thread */
+class SerialSession
+{
+public:
+    using ReceiveHandler = std::function<void(SerialSession &, char *, size_t)>;
+    using CloseHandler = std::function<void(SerialSession &, int)>;
+    using FrameHandler = std::function<void(SerialSession &, const char *, size_t)>;
+    using WritableHandler = std::function<void()>;
+
+    SerialSession(EventLoop &eventLoop, const PortSettings &portSettings);
+    ~SerialSession();
+    SerialSession(const SerialSession &) = delete;
+    SerialSession(SerialSession &&) = delete;
+    SerialSession &operator=(const SerialSession &) = delete;
+    SerialSession &operator=(SerialSession &&) = delete;
+
+    void setReceiveHandler(const ReceiveHandler &receiveHandler);
+    void setCloseHandler(const CloseHandler &closeHandler);
+    /* Splits RX data into frames for frameHandler, and makes sendLine()
+     * send its argument as one frame; set before open() */
+    void setFramingCodec(std::unique_ptr<FramingCodec> framingCodec, const FrameHandler &frameHandler);
+    void setCaptureWriter(CaptureWriter *captureWriter, uint16_t capturePortId);
+    /* Also copies RX data to fileDescriptor (see StreamFanout), which the
+     * caller keeps open; kept across reopening the port */
+    void addStreamSink(int fileDescriptor, const StreamSinkSettings &settings);
+    /* See PortChannel::writeSome(), kept across reopening the port */
+    void setWritableHandler(const WritableHandler &writableHandler);
+    /* Asks the driver for low latency (ASYNC_LOW_LATENCY, which for FTDI
+     * and similar USB adapters shortens the latency timer) when the port is
+     * opened; set before open() */
+    void setLowLatency(bool lowLatency);
+    /* The path open() opens, the port name unless set; PortSupervisor points
+     * it at the port's /dev/serial/by-id name */
+    void setDevicePath(const std::string &devicePath);
+    const std::string &devicePath() const;
+    /* For ports that are reopened when they come back (see PortSupervisor):
+     * while the port is away, what is sent to it (and what it had not
+     * written yet) is held, up to limit bytes, and written ahead of anything
+     * else once it is reopened. 0, the default, drops it */
+    void setHeldTransmitLimit(size_t limit);
+
+    void open();
+    void close();
+    bool isOpen() const;
+    /* Closed, but holding what is sent for when it is reopened */
+    bool isAwaitingReconnect() const;
+
+    void send(const char *data, size_t length);
+    void sendLine(const std::string &line);
+    void sendFrame(const char *payload, size_t length);
+    /* Writes a Marker record to the capture, stamped like receiveTimestamp();
+     * does nothing without a capture writer */
+    void markCapture(const std::string &label);
+    /* Sends what the port takes right now without copying, see
+     * PortChannel::writeSome() */
+    size_t sendSome(const char *data, size_t length);
+
+    /* Refreshes the metrics that are polled rather than counted as they
+     * happen: the write queue depth and the UART error counters */
+    void sampleMetrics();
+
+    /* When the data being handled by the receive or frame handler was read,
+     * see PortChannel::readTimestamp(); a frame has the time of the read
+     * that completed it */
+    uint64_t receiveTimestamp() const;
+    ReceiveTiming &receiveTiming();
+
+    const PortSettings &portSettings() const;
+    EventLoop &eventLoop() const;
+    PortChannel *channel() const;
+    StreamFanout *streamFanout() const;
+
+private:
+    EventLoop &m_eventLoop;
+    PortSettings m_portSettings;
+    std::shared_ptr<CppSerialPort::SerialPort> m_serialPort;
+    std::unique_ptr<PortChannel> m_channel;
+    ReceiveHandler m_receiveHandler;
+    CloseHandler m_closeHandler;
+    WritableHandler m_writableHandler;
+    std::unique_ptr<FramingCodec> m_framingCodec;
+    CaptureWriter *m_captureWriter;
+    uint16_t m_capturePortId;
+    std::unique_ptr<StreamFanout> m_streamFanout;
+    ReceiveTiming m_receiveTiming;
+    uint64_t m_receiveTimestamp;
+    bool m_lowLatency;
+    std::string m_devicePath;
+    std::string m_heldTransmit;
+    size_t m_heldTransmitLimit;
+    uint64_t m_droppedHeldBytes;
+    uint64_t m_lostTimestamp;
+    MetricCounter m_receivedBytesMetric;
+    MetricCounter m_transmittedBytesMetric;
+    MetricCounter m_framesMetric;
+    MetricCounter m_framingErrorsMetric;
+    MetricHistogram m_readHandlerTimeMetric;
+    MetricCounter m_reconnectsMetric;
+    MetricGauge m_writeQueueBytesMetric;
+    MetricGauge m_overrunsMetric;
+    MetricGauge m_bufferOverrunsMetric;
+    MetricGauge m_lineFrameErrorsMetric;
+    MetricGauge m_parityErrorsMetric;
+    uint64_t m_reportedFrameCount;
+    uint64_t m_reportedFramingErrorCount;
+    bool m_lineCountersSupported;
+
+    void applyFlowControl();
+    void applyLowLatency();
+    void holdTransmit(const char *data, size_t length);
+    void onChannelError(int errorNumber);
+};
+
+#endif //SERIALCOMMUNICATION_SERIALSESSION_H
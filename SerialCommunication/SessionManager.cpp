@@ -0,0 +1,492 @@
+#include "SessionManager.h"
+#include "CaptureWriter.h"
+#include "EventLoop.h"
+#include "FramingCodec.h"
+#include "LineSettingsDetector.h"
+#include "PortChannel.h"
+#include "PortSettingsLookup.h"
+#include "PortSupervisor.h"
+#include "TriggerEngine.h"
+#include "UploadSource.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+static const std::chrono::seconds STATUS_TIMER_INTERVAL{1};
+
+SessionManager::SessionManager(size_t workerCount) :
+    m_requestedWorkerCount{workerCount},
+    m_portSettings{},
+    m_captureWriter{nullptr},
+    m_capturePortIds{},
+    m_streamSinks{},
+    m_workers{},
+    m_receiveHandler{},
+    m_closeHandler{},
+    m_framingSpecification{""},
+    m_frameHandler{},
+    m_uploadSource{nullptr},
+    m_uploadPacing{std::chrono::microseconds{0}, std::chrono::milliseconds{0}},
+    m_commands{},
+    m_commandOptions{1, std::chrono::milliseconds{0}, 0, "", "", false},
+    m_commandResultHandler{},
+    m_commandsFinishedHandler{},
+    m_portServerOptions{"", PortServer::DEFAULT_CLIENT_QUEUE_LIMIT},
+    m_triggerSet{nullptr},
+    m_lowLatency{false},
+    m_reconnect{false},
+    m_timingReportInterval{0},
+    m_finishedScriptCount{0},
+    m_activeSessionCount{0},
+    m_started{false}
+{
+
+}
+
+SessionManager::~SessionManager()
+{
+    this->stop();
+    for (const auto &it : this->m_streamSinks) {
+        close(it.fileDescriptor);
+    }
+}
+
+void SessionManager::setReceiveHandler(const SerialSession::ReceiveHandler &receiveHandler)
+{
+    this->m_receiveHandler = receiveHandler;
+}
+
+void SessionManager::setCloseHandler(const SerialSession::CloseHandler &closeHandler)
+{
+    this->m_closeHandler = closeHandler;
+}
+
+void SessionManager::setFraming(const std::string &framingSpecification, const SerialSession::FrameHandler &frameHandler)
+{
+    this->m_framingSpecification = framingSpecification;
+    this->m_frameHandler = frameHandler;
+}
+
+void SessionManager::setUpload(const std::shared_ptr<UploadSource> &uploadSource, const UploadPacing &pacing)
+{
+    this->m_uploadSource = uploadSource;
+    this->m_uploadPacing = pacing;
+}
+
+void SessionManager::setCommandScript(const std::vector<std::string> &commands, const CommandOptions &commandOptions,
+                                      const CommandEngine::ResultHandler &resultHandler, const std::function<void()> &finishedHandler)
+{
+    this->m_commands = commands;
+    this->m_commandOptions = commandOptions;
+    this->m_commandResultHandler = resultHandler;
+    this->m_commandsFinishedHandler = finishedHandler;
+}
+
+void SessionManager::setPortServers(const PortServerOptions &options)
+{
+    this->m_portServerOptions = options;
+}
+
+void SessionManager::setTriggers(const std::shared_ptr<const TriggerSet> &triggerSet)
+{
+    this->m_triggerSet = triggerSet;
+}
+
+void SessionManager::addSession(const PortSettings &portSettings)
+{
+    if (this->m_started) {
+        throw std::runtime_error(TStringFormat("Cannot add port {0} after the session manager has started", portSettings.portName));
+    }
+    this->m_portSettings.push_back(portSettings);
+}
+
+void SessionManager::setLowLatency(bool lowLatency)
+{
+    this->m_lowLatency = lowLatency;
+}
+
+void SessionManager::setReconnect(bool reconnect)
+{
+    this->m_reconnect = reconnect;
+}
+
+void SessionManager::detectLineSettings()
+{
+    if (this->m_started) {
+        throw std::runtime_error("Cannot detect line settings after the session manager has started");
+    }
+    /* Each thread only touches its own port's settings */
+    std::vector<std::thread> detectionThreads{};
+    for (auto &portSettings : this->m_portSettings) {
+        PortSettings *settingsPointer{&portSettings};
+        detectionThreads.emplace_back([settingsPointer]() {
+            PortSettings &portSettings = *settingsPointer;
+            auto started = std::chrono::steady_clock::now();
+            LineSettingsScore detected{};
+            try {
+                LineSettingsDetector lineSettingsDetector{portSettings.portName};
+                detected = lineSettingsDetector.detect();
+            } catch (std::exception &e) {
+                LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to detect the settings of {0} ({1}), keeping those given", portSettings.portName, e.what());
+                return;
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+            if (!LineSettingsDetector::isConfident(detected)) {
+                LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat("Could not tell the settings of {0} in {1} ms (best score {2} over {3} characters), keeping those given",
+                                                                 portSettings.portName, elapsed.count(), detected.score, detected.characters);
+                return;
+            }
+            portSettings.baudRate = detected.baudRate;
+            portSettings.dataBits = detected.dataBits;
+            portSettings.parity = detected.parity;
+            portSettings.stopBits = detected.stopBits;
+            LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Detected {0} in {1} ms: BaudRate {2}, DataBits {3}, StopBits {4}, Parity {5} (score {6} over {7} characters)",
+                                                             portSettings.portName, elapsed.count(), baudRateToString(detected.baudRate), dataBitsToString(detected.dataBits),
+                                                             stopBitsToString(detected.stopBits), parityToString(detected.parity), detected.score, detected.characters);
+        });
+    }
+    for (auto &it : detectionThreads) {
+        it.join();
+    }
+}
+
+const std::vector<PortSettings> &SessionManager::portSettings() const
+{
+    return this->m_portSettings;
+}
+
+void SessionManager::setTimingReportInterval(std::chrono::seconds interval)
+{
+    this->m_timingReportInterval = interval;
+}
+
+void SessionManager::setCaptureWriter(CaptureWriter *captureWriter)
+{
+    /* Registers every port added so far, so this goes after the last
+     * addSession() and before the capture writer is started */
+    if (this->m_started) {
+        throw std::runtime_error("Cannot change the capture writer after the session manager has started");
+    }
+    this->m_captureWriter = captureWriter;
+    this->m_capturePortIds.clear();
+    if (captureWriter) {
+        for (const auto &portSettings : this->m_portSettings) {
+            this->m_capturePortIds.push_back(captureWriter->addPort(portSettings.portName));
+        }
+    }
+}
+
+void SessionManager::addStreamSink(const StreamSinkSettings &settings)
+{
+    if (this->m_started) {
+        throw std::runtime_error(TStringFormat("Cannot add sink {0} after the session manager has started", settings.path));
+    }
+    this->m_streamSinks.push_back(OpenStreamSink{StreamFanout::openSink(settings.path), settings});
+}
+
+void SessionManager::start()
+{
+    if (this->m_started) {
+        return;
+    }
+    std::vector<int> cpus{availableCpus()};
+    size_t workerCount{this->m_requestedWorkerCount};
+    if (workerCount == 0) {
+        workerCount = cpus.empty() ? 1 : cpus.size();
+    }
+    workerCount = std::max<size_t>(1, std::min(workerCount, this->m_portSettings.size()));
+
+    for (size_t i = 0; i < workerCount; i++) {
+        std::unique_ptr<Worker> worker{new Worker{}};
+        worker->eventLoop.reset(new EventLoop{});
+        worker->cpu = (cpus.size() >= workerCount) ? cpus[i] : -1;
+        if (this->m_reconnect) {
+            worker->portSupervisor.reset(new PortSupervisor{*worker->eventLoop});
+        }
+        this->m_workers.push_back(std::move(worker));
+    }
+    for (size_t i = 0; i < this->m_portSettings.size(); i++) {
+        Worker &worker = *this->m_workers[i % workerCount];
+        std::unique_ptr<SerialSession> serialSession{new SerialSession{*worker.eventLoop, this->m_portSettings[i]}};
+        serialSession->setReceiveHandler(this->m_receiveHandler);
+        serialSession->setLowLatency(this->m_lowLatency);
+        if (this->m_reconnect) {
+            serialSession->setHeldTransmitLimit(PortSupervisor::DEFAULT_HELD_TRANSMIT_LIMIT);
+        }
+        if (this->m_commandResultHandler) {
+            std::unique_ptr<CommandEngine> commandEngine{new CommandEngine{*serialSession, this->m_commands, this->m_commandOptions}};
+            CommandEngine *enginePointer{commandEngine.get()};
+            commandEngine->setResultHandler(this->m_commandResultHandler);
+            commandEngine->setFinishedHandler([this](CommandEngine &) {
+                if ( (this->m_finishedScriptCount.fetch_add(1) + 1 == this->m_portSettings.size()) && (this->m_commandsFinishedHandler) ) {
+                    this->m_commandsFinishedHandler();
+                }
+            });
+            serialSession->setFramingCodec(FramingCodec::create("line", this->m_portSettings[i].lineEnding), [enginePointer](SerialSession &, const char *line, size_t length) {
+                enginePointer->handleLine(line, length);
+            });
+            worker.commandEngines.push_back(std::move(commandEngine));
+        } else if (!this->m_framingSpecification.empty()) {
+            serialSession->setFramingCodec(FramingCodec::create(this->m_framingSpecification, this->m_portSettings[i].lineEnding), this->m_frameHandler);
+        }
+        if ( (this->m_captureWriter) && (i < this->m_capturePortIds.size()) ) {
+            serialSession->setCaptureWriter(this->m_captureWriter, this->m_capturePortIds[i]);
+        }
+        for (const auto &it : this->m_streamSinks) {
+            serialSession->addStreamSink(it.fileDescriptor, it.settings);
+        }
+        TriggerEngine *triggerPointer{nullptr};
+        if (this->m_triggerSet) {
+            worker.triggerEngines.emplace_back(new TriggerEngine{*serialSession, this->m_triggerSet});
+            triggerPointer = worker.triggerEngines.back().get();
+        }
+        Worker *workerPointer{&worker};
+        serialSession->setCloseHandler([this, workerPointer, triggerPointer](SerialSession &closedSession, int errorNumber) {
+            if (triggerPointer) {
+                triggerPointer->reset();
+            }
+            if (workerPointer->portSupervisor) {
+                workerPointer->portSupervisor->watch(closedSession);
+                return;
+            }
+            this->retireSession(closedSession, errorNumber);
+        });
+        PortServer *serverPointer{nullptr};
+        if (!this->m_portServerOptions.socketDirectory.empty()) {
+            std::unique_ptr<PortServer> portServer{new PortServer{*serialSession, this->m_portServerOptions}};
+            portServer->start();
+            serverPointer = portServer.get();
+            worker.portServers.push_back(std::move(portServer));
+        }
+        if ( (serverPointer) || (triggerPointer) ) {
+            /* Triggers go first, so that a response is sent as soon as it can be */
+            SerialSession::ReceiveHandler receiveHandler{this->m_receiveHandler};
+            serialSession->setReceiveHandler([triggerPointer, serverPointer, receiveHandler](SerialSession &receivingSession, char *data, size_t length) {
+                if (triggerPointer) {
+                    triggerPointer->handleReceive(data, length);
+                }
+                if (receiveHandler) {
+                    receiveHandler(receivingSession, data, length);
+                }
+                if (serverPointer) {
+                    serverPointer->handleReceive(data, length);
+                }
+            });
+        }
+        if (this->m_uploadSource) {
+            /* Registered here, before the source starts reading, so that no
+             * block is freed before the uploads on the workers are set up */
+            worker.uploadReaders.push_back(this->m_uploadSource->addReader());
+        }
+        worker.sessions.push_back(std::move(serialSession));
+        worker.sessionRates.push_back(SessionRates{0, 0});
+    }
+
+    this->m_activeSessionCount.store(this->m_portSettings.size());
+    this->m_finishedScriptCount.store(0);
+    this->m_started = true;
+    if (this->m_uploadSource) {
+        for (auto &worker : this->m_workers) {
+            Worker *workerPointer{worker.get()};
+            this->m_uploadSource->addDataHandler([workerPointer]() {
+                workerPointer->eventLoop->post([workerPointer]() {
+                    for (auto &uploader : workerPointer->uploaders) {
+                        uploader->resume();
+                    }
+                });
+            });
+        }
+    }
+    for (auto &worker : this->m_workers) {
+        Worker *workerPointer{worker.get()};
+        worker->thread = std::thread{[this, workerPointer]() { this->runWorker(*workerPointer); }};
+        if (worker->cpu >= 0) {
+            pinToCpu(worker->thread, worker->cpu);
+        }
+    }
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Serving {0} port(s) with {1} worker thread(s)", this->m_portSettings.size(), workerCount);
+}
+
+void SessionManager::stop()
+{
+    if (!this->m_started) {
+        return;
+    }
+    for (auto &worker : this->m_workers) {
+        worker->eventLoop->stop();
+    }
+    for (auto &worker : this->m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    this->m_workers.clear();
+    this->m_started = false;
+}
+
+void SessionManager::broadcastLine(const std::string &line)
+{
+    for (auto &worker : this->m_workers) {
+        Worker *workerPointer{worker.get()};
+        worker->eventLoop->post([workerPointer, line]() {
+            for (auto &serialSession : workerPointer->sessions) {
+                if ( (serialSession->isOpen()) || (serialSession->isAwaitingReconnect()) ) {
+                    serialSession->sendLine(line);
+                }
+            }
+        });
+    }
+}
+
+size_t SessionManager::sessionCount() const
+{
+    return this->m_portSettings.size();
+}
+
+size_t SessionManager::workerCount() const
+{
+    return this->m_workers.size();
+}
+
+size_t SessionManager::activeSessionCount() const
+{
+    return this->m_activeSessionCount.load();
+}
+
+void SessionManager::runWorker(Worker &worker)
+{
+    /* Ports are opened on the worker itself, so that a port which is slow to
+     * open (or fails) only delays the other ports sharing this worker */
+    for (auto &serialSession : worker.sessions) {
+        try {
+            serialSession->open();
+            LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Opened {0}", serialSession->portSettings().portName);
+            if (worker.portSupervisor) {
+                worker.portSupervisor->track(*serialSession);
+            }
+        } catch (std::exception &e) {
+            LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to open {0} ({1})", serialSession->portSettings().portName, e.what());
+            if (worker.portSupervisor) {
+                worker.portSupervisor->watch(*serialSession);
+            } else {
+                this->retireSession(*serialSession, ENODEV);
+            }
+        }
+    }
+    if (this->m_uploadSource) {
+        for (size_t i = 0; i < worker.sessions.size(); i++) {
+            SerialSession &serialSession = *worker.sessions[i];
+            if ( (serialSession.isOpen()) || (serialSession.isAwaitingReconnect()) ) {
+                worker.uploaders.emplace_back(new Uploader{serialSession, this->m_uploadSource, worker.uploadReaders[i], this->m_uploadPacing});
+                worker.uploaders.back()->start();
+            } else {
+                this->m_uploadSource->removeReader(worker.uploadReaders[i]);
+            }
+        }
+    }
+    for (auto &commandEngine : worker.commandEngines) {
+        commandEngine->start();
+    }
+    worker.eventLoop->addTimer(STATUS_TIMER_INTERVAL, [this, &worker]() {
+        this->reportTransferRates(worker);
+    });
+    if (this->m_timingReportInterval.count() > 0) {
+        for (auto &serialSession : worker.sessions) {
+            serialSession->receiveTiming().reset();
+        }
+        worker.eventLoop->addTimer(this->m_timingReportInterval, [this, &worker]() {
+            this->reportReceiveTiming(worker);
+        });
+    }
+    worker.eventLoop->run();
+    worker.portSupervisor.reset();
+    worker.portServers.clear();
+    worker.uploaders.clear();
+    worker.commandEngines.clear();
+    worker.triggerEngines.clear();
+    for (auto &serialSession : worker.sessions) {
+        serialSession->close();
+    }
+    worker.sessions.clear();
+}
+
+void SessionManager::retireSession(SerialSession &serialSession, int errorNumber)
+{
+    this->m_activeSessionCount.fetch_sub(1);
+    if (this->m_closeHandler) {
+        this->m_closeHandler(serialSession, errorNumber);
+    }
+}
+
+void SessionManager::reportTransferRates(Worker &worker)
+{
+    bool reportEnabled{MessageLogger::isEnabled(LogLevel::Debug, SESSION_LOG_SUBSYSTEM)};
+    for (size_t i = 0; i < worker.sessions.size(); i++) {
+        PortChannel *channel{worker.sessions[i]->channel()};
+        if (!channel) {
+            continue;
+        }
+        SessionRates &sessionRates = worker.sessionRates[i];
+        uint64_t bytesRead{channel->bytesRead()};
+        uint64_t bytesWritten{channel->bytesWritten()};
+        /* A reopened port comes with a new channel, counting from zero */
+        if ( (bytesRead < sessionRates.lastBytesRead) || (bytesWritten < sessionRates.lastBytesWritten) ) {
+            sessionRates = SessionRates{0, 0};
+        }
+        if ( reportEnabled && ( (bytesRead != sessionRates.lastBytesRead) || (bytesWritten != sessionRates.lastBytesWritten) ) ) {
+            LOG_DEBUG(SESSION_LOG_SUBSYSTEM) << TStringFormat("{0}: RX {1} B/s, TX {2} B/s", worker.sessions[i]->portSettings().portName,
+                                         bytesRead - sessionRates.lastBytesRead, bytesWritten - sessionRates.lastBytesWritten);
+        }
+        sessionRates.lastBytesRead = bytesRead;
+        sessionRates.lastBytesWritten = bytesWritten;
+        worker.sessions[i]->sampleMetrics();
+    }
+}
+
+void SessionManager::reportReceiveTiming(Worker &worker)
+{
+    for (auto &serialSession : worker.sessions) {
+        ReceiveTiming &receiveTiming = serialSession->receiveTiming();
+        if (receiveTiming.chunkCount() == 0) {
+            continue;
+        }
+        for (const auto &line : receiveTiming.report(serialSession->portSettings().portName)) {
+            LOG_INFO(METRICS_LOG_SUBSYSTEM) << line;
+        }
+        receiveTiming.reset();
+    }
+}
+
+std::vector<int> SessionManager::availableCpus()
+{
+    std::vector<int> cpus{};
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpuSet)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+void SessionManager::pinToCpu(std::thread &thread, int cpu)
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    int result{pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet)};
+    if (result != 0) {
+        LOG_DEBUG(SESSION_LOG_SUBSYSTEM) << TStringFormat("Unable to pin worker thread to CPU {0} ({1})", cpu, strerror(result));
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef SERIALCOMMUNICATION_SESSIONMANAGER_H
+#define SERIALCOMMUNICATION_SESSIONMANAGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CommandEngine.h"
+#include "PortServer.h"
+#include "SerialSession.h"
+#include "StreamFanout.h"
+#include "Uploader.h"
+
+class CaptureWriter;
+class EventLoop;
+class PortSupervisor;
+class TriggerEngine;
+class TriggerSet;
+class UploadSource;
+
+/* Serves many serial ports from a fixed pool of worker threads. Each port
+ * is assigned to exactly one worker when it is added, and its session only
+ * ever runs on that worker's EventLoop, so the per-port hot path never takes
+ * a lock. Workers are pinned to distinct CPUs from the process's affinity
+ * mask when there are enough of them */
+class SessionManager
+{
+public:
+    explicit SessionManager(size_t workerCount = 0);
+    ~SessionManager();
+    SessionManager(const SessionManager &) = delete;
+    SessionManager(SessionManager &&) = delete;
+    SessionManager &operator=(const SessionManager &) = delete;
+    SessionManager &operator=(SessionManager &&) = delete;
+
+    void setReceiveHandler(const SerialSession::ReceiveHandler &receiveHandler);
+    void setCloseHandler(const SerialSession::CloseHandler &closeHandler);
+    /* Each session gets its own codec, built from framingSpecification */
+    void setFraming(const std::string &framingSpecification, const SerialSession::FrameHandler &frameHandler);
+
+    void addSession(const PortSettings &portSettings);
+    /* See SerialSession::setLowLatency() */
+    void setLowLatency(bool lowLatency);
+    /* Ports that go away, or are not there at start(), are reopened once
+     * they are back (see PortSupervisor) instead of being closed for good,
+     * and hold what is sent to them meanwhile */
+    void setReconnect(bool reconnect);
+    /* Listens to every port at once (see LineSettingsDetector) and replaces
+     * the baud rate, data bits, parity and stop bits it was added with by
+     * what it turns out to use; a port that cannot be told keeps them.
+     * Blocks until every port is done, call it before start() */
+    void detectLineSettings();
+    const std::vector<PortSettings> &portSettings() const;
+    /* Logs each port's read gap histogram (see ReceiveTiming) every
+     * interval, from the port's worker, and starts the next one afresh */
+    void setTimingReportInterval(std::chrono::seconds interval);
+    void setCaptureWriter(CaptureWriter *captureWriter);
+    /* Opens the sink now (throwing if that fails), and copies every port's
+     * RX data to it once started; ports interleave read by read */
+    void addStreamSink(const StreamSinkSettings &settings);
+    /* Streams uploadSource to every port once it is open; set before start(),
+     * which registers with the source, and start the source after it */
+    void setUpload(const std::shared_ptr<UploadSource> &uploadSource, const UploadPacing &pacing);
+    /* Runs commands on every port through line framing, in place of any other
+     * framing; finishedHandler is called, from a worker thread, once every
+     * port has finished its script */
+    void setCommandScript(const std::vector<std::string> &commands, const CommandOptions &commandOptions,
+                          const CommandEngine::ResultHandler &resultHandler, const std::function<void()> &finishedHandler);
+    /* Shares every port on a socket in options.socketDirectory, listening
+     * from start() (which throws if a socket cannot be set up) */
+    void setPortServers(const PortServerOptions &options);
+    /* Watches every port's received data for triggerSet (see TriggerEngine),
+     * ahead of anything else that handles it */
+    void setTriggers(const std::shared_ptr<const TriggerSet> &triggerSet);
+    void start();
+    void stop();
+
+    void broadcastLine(const std::string &line);
+
+    size_t sessionCount() const;
+    size_t workerCount() const;
+    size_t activeSessionCount() const;
+
+private:
+    struct SessionRates
+    {
+        uint64_t lastBytesRead;
+        uint64_t lastBytesWritten;
+    };
+
+    struct OpenStreamSink
+    {
+        int fileDescriptor;
+        StreamSinkSettings settings;
+    };
+
+    struct Worker
+    {
+        std::unique_ptr<EventLoop> eventLoop;
+        std::thread thread;
+        std::vector<std::unique_ptr<SerialSession>> sessions;
+        std::vector<SessionRates> sessionRates;
+        std::vector<size_t> uploadReaders;
+        std::vector<std::unique_ptr<Uploader>> uploaders;
+        std::vector<std::unique_ptr<CommandEngine>> commandEngines;
+        std::vector<std::unique_ptr<PortServer>> portServers;
+        std::vector<std::unique_ptr<TriggerEngine>> triggerEngines;
+        std::unique_ptr<PortSupervisor> portSupervisor;
+        int cpu;
+    };
+
+    size_t m_requestedWorkerCount;
+    std::vector<PortSettings> m_portSettings;
+    CaptureWriter *m_captureWriter;
+    std::vector<uint16_t> m_capturePortIds;
+    std::vector<OpenStreamSink> m_streamSinks;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    SerialSession::ReceiveHandler m_receiveHandler;
+    SerialSession::CloseHandler m_closeHandler;
+    std::string m_framingSpecification;
+    SerialSession::FrameHandler m_frameHandler;
+    std::shared_ptr<UploadSource> m_uploadSource;
+    UploadPacing m_uploadPacing;
+    std::vector<std::string> m_commands;
+    CommandOptions m_commandOptions;
+    CommandEngine::ResultHandler m_commandResultHandler;
+    std::function<void()> m_commandsFinishedHandler;
+    PortServerOptions m_portServerOptions;
+    std::shared_ptr<const TriggerSet> m_triggerSet;
+    bool m_lowLatency;
+    bool m_reconnect;
+    std::chrono::seconds m_timingReportInterval;
+    std::atomic<size_t> m_finishedScriptCount;
+    std::atomic<size_t> m_activeSessionCount;
+    bool m_started;
+
+    void runWorker(Worker &worker);
+    void retireSession(SerialSession &serialSession, int errorNumber);
+    void reportTransferRates(Worker &worker);
+    void reportReceiveTiming(Worker &worker);
+    static std::vector<int> availableCpus();
+    static void pinToCpu(std::thread &thread, int cpu);
+};
+
+#endif //SERIALCOMMUNICATION_SESSIONMANAGER_H
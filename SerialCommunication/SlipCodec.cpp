@@ -0,0 +1,100 @@
+#include "SlipCodec.h"
+
+static const char SLIP_END{static_cast<char>(0xC0)};
+static const char SLIP_ESC{static_cast<char>(0xDB)};
+static const char SLIP_ESC_END{static_cast<char>(0xDC)};
+static const char SLIP_ESC_ESC{static_cast<char>(0xDD)};
+
+SlipCodec::SlipCodec() :
+    FramingCodec{},
+    m_partialFrame{},
+    m_escaped{false},
+    m_discarding{false}
+{
+
+}
+
+void SlipCodec::decode(char *data, size_t length)
+{
+    const char *input{data};
+    const char *end{data + length};
+    char *output{data};
+    char *frameStart{data};
+    while (input < end) {
+        char byte{*input++};
+        if (byte == SLIP_END) {
+            if (this->m_escaped) {
+                this->countError();
+            } else if ( (!this->m_discarding) && ( (output != frameStart) || (!this->m_partialFrame.empty()) ) ) {
+                if (this->m_partialFrame.empty()) {
+                    this->emitFrame(frameStart, static_cast<size_t>(output - frameStart));
+                } else {
+                    this->m_partialFrame.append(frameStart, static_cast<size_t>(output - frameStart));
+                    this->emitFrame(this->m_partialFrame.data(), this->m_partialFrame.size());
+                }
+            }
+            this->resetFrame();
+            output = frameStart = data + (input - data);
+        } else if (this->m_discarding) {
+            continue;
+        } else if (this->m_escaped) {
+            this->m_escaped = false;
+            if (byte == SLIP_ESC_END) {
+                *output++ = SLIP_END;
+            } else if (byte == SLIP_ESC_ESC) {
+                *output++ = SLIP_ESC;
+            } else {
+                this->countError();
+                this->m_discarding = true;
+            }
+        } else if (byte == SLIP_ESC) {
+            this->m_escaped = true;
+        } else {
+            *output++ = byte;
+        }
+    }
+    if (!this->m_discarding) {
+        this->m_partialFrame.append(frameStart, static_cast<size_t>(output - frameStart));
+        if (this->m_partialFrame.size() > MAXIMUM_FRAME_LENGTH) {
+            this->countError();
+            this->resetFrame();
+            this->m_discarding = true;
+        }
+    }
+}
+
+size_t SlipCodec::maximumEncodedLength(size_t payloadLength) const
+{
+    return (payloadLength * 2) + 2;
+}
+
+size_t SlipCodec::encode(const char *payload, size_t length, char *destination) const
+{
+    char *output{destination};
+    *output++ = SLIP_END;
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] == SLIP_END) {
+            *output++ = SLIP_ESC;
+            *output++ = SLIP_ESC_END;
+        } else if (payload[i] == SLIP_ESC) {
+            *output++ = SLIP_ESC;
+            *output++ = SLIP_ESC_ESC;
+        } else {
+            *output++ = payload[i];
+        }
+    }
+    *output++ = SLIP_END;
+    return static_cast<size_t>(output - destination);
+}
+
+std::string SlipCodec::name() const
+{
+    return "slip";
+}
+
+void SlipCodec::resetFrame()
+{
+    this->m_partialFrame.clear();
+    this->m_escaped = false;
+    this->m_discarding = false;
+}
@@ -0,0 +1,31 @@
+#ifndef SERIALCOMMUNICATION_SLIPCODEC_H
+#define SERIALCOMMUNICATION_SLIPCODEC_H
+
+#include <string>
+
+#include "FramingCodec.h"
+
+/* SLIP (RFC 1055). Encoded frames start and end with END, so a receiver
+ * that joined mid-frame resynchronises on the next one; empty frames between
+ * two ENDs are ignored. Unescaping is done in place in the receive buffer */
+class SlipCodec : public FramingCodec
+{
+public:
+    SlipCodec();
+
+    void decode(char *data, size_t length) override;
+
+    size_t maximumEncodedLength(size_t payloadLength) const override;
+    size_t encode(const char *payload, size_t length, char *destination) const override;
+
+    std::string name() const override;
+
+private:
+    std::string m_partialFrame;
+    bool m_escaped;
+    bool m_discarding;
+
+    void resetFrame();
+};
+
+#endif //SERIALCOMMUNICATION_SLIPCODEC_H
@@ -0,0 +1,119 @@
+#ifndef SERIALCOMMUNICATION_SPSCBYTERING_H
+#define SERIALCOMMUNICATION_SPSCBYTERING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+/* Fixed size byte ring for exactly one producer thread and one consumer
+ * thread. Neither side ever blocks or takes a lock: a write that does not
+ * fit is refused as a whole, so the producer can count it and move on. Each
+ * side keeps a private copy of the other side's index and only re-reads the
+ * shared one when that copy says the ring is full (or empty), which keeps
+ * the two cache lines from bouncing on every call */
+class SpscByteRing
+{
+public:
+    explicit SpscByteRing(size_t capacity) :
+        m_capacity{roundUpToPowerOfTwo(capacity)},
+        m_mask{m_capacity - 1},
+        m_buffer{new char[m_capacity]},
+        m_writeIndex{0},
+        m_cachedReadIndex{0},
+        m_readIndex{0},
+        m_cachedWriteIndex{0}
+    {
+
+    }
+
+    SpscByteRing(const SpscByteRing &) = delete;
+    SpscByteRing &operator=(const SpscByteRing &) = delete;
+
+    size_t capacity() const
+    {
+        return this->m_capacity;
+    }
+
+    /* Producer side. Copies both parts or nothing */
+    bool tryWrite(const void *first, size_t firstLength, const void *second = nullptr, size_t secondLength = 0)
+    {
+        size_t totalLength{firstLength + secondLength};
+        uint64_t writeIndex{this->m_writeIndex.load(std::memory_order_relaxed)};
+        if (writeIndex + totalLength - this->m_cachedReadIndex > this->m_capacity) {
+            this->m_cachedReadIndex = this->m_readIndex.load(std::memory_order_acquire);
+            if (writeIndex + totalLength - this->m_cachedReadIndex > this->m_capacity) {
+                return false;
+            }
+        }
+        this->copyIn(writeIndex, static_cast<const char *>(first), firstLength);
+        this->copyIn(writeIndex + firstLength, static_cast<const char *>(second), secondLength);
+        this->m_writeIndex.store(writeIndex + totalLength, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side */
+    size_t readableBytes()
+    {
+        uint64_t readIndex{this->m_readIndex.load(std::memory_order_relaxed)};
+        if (this->m_cachedWriteIndex == readIndex) {
+            this->m_cachedWriteIndex = this->m_writeIndex.load(std::memory_order_acquire);
+        }
+        return static_cast<size_t>(this->m_cachedWriteIndex - readIndex);
+    }
+
+    /* Copies length bytes starting offset bytes past the read position,
+     * without consuming them. The caller checks readableBytes() first */
+    void peek(size_t offset, void *destination, size_t length) const
+    {
+        uint64_t readIndex{this->m_readIndex.load(std::memory_order_relaxed) + offset};
+        size_t position{static_cast<size_t>(readIndex & this->m_mask)};
+        size_t firstLength{std::min(length, this->m_capacity - position)};
+        memcpy(destination, this->m_buffer.get() + position, firstLength);
+        memcpy(static_cast<char *>(destination) + firstLength, this->m_buffer.get(), length - firstLength);
+    }
+
+    void consume(size_t length)
+    {
+        this->m_readIndex.store(this->m_readIndex.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+private:
+    /* The producer's and the consumer's fields live on separate cache lines */
+    static const size_t CACHE_LINE_SIZE{64};
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<char[]> m_buffer;
+    char m_padding0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> m_writeIndex;
+    uint64_t m_cachedReadIndex;
+    char m_padding1[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+    std::atomic<uint64_t> m_readIndex;
+    uint64_t m_cachedWriteIndex;
+    char m_padding2[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+    void copyIn(uint64_t index, const char *source, size_t length)
+    {
+        if (length == 0) {
+            return;
+        }
+        size_t position{static_cast<size_t>(index & this->m_mask)};
+        size_t firstLength{std::min(length, this->m_capacity - position)};
+        memcpy(this->m_buffer.get() + position, source, firstLength);
+        memcpy(this->m_buffer.get(), source + firstLength, length - firstLength);
+    }
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t roundedValue{1};
+        while (roundedValue < value) {
+            roundedValue <<= 1;
+        }
+        return roundedValue;
+    }
+};
+
+#endif //SERIALCOMMUNICATION_SPSCBYTERING_H
@@ -0,0 +1,372 @@
+#include "StreamFanout.h"
+#include "EventLoop.h"
+#include "GlobalDefinitions.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+StreamFanout::StreamFanout(EventLoop &eventLoop, const std::string &streamName) :
+    m_eventLoop(eventLoop),
+    m_streamName{streamName},
+    m_sinks{},
+    m_stagingPipe{-1, -1},
+    m_nullDescriptor{-1},
+    m_pipeSinkCount{0},
+    m_nextSinkId{1},
+    m_closedHandler{},
+    m_droppedBytesMetric{MetricsRegistry::instance().counter("port." + streamName + ".sink_dropped_bytes")}
+{
+
+}
+
+StreamFanout::~StreamFanout()
+{
+    for (auto &sink : this->m_sinks) {
+        if (sink->waitingForWritable) {
+            this->m_eventLoop.removeDescriptor(sink->fileDescriptor);
+        }
+        if (sink->fileDescriptor != -1) {
+            ::close(sink->fileDescriptor);
+        }
+    }
+    this->closeStagingPipe();
+}
+
+void StreamFanout::setClosedHandler(const ClosedHandler &closedHandler)
+{
+    this->m_closedHandler = closedHandler;
+}
+
+uint64_t StreamFanout::addSink(int fileDescriptor, const StreamSinkSettings &settings)
+{
+    /* Non-blocking applies to the open file, so the caller's descriptor
+     * becomes non-blocking as well */
+    int duplicateDescriptor{fcntl(fileDescriptor, F_DUPFD_CLOEXEC, 0)};
+    int flags{(duplicateDescriptor == -1) ? -1 : fcntl(duplicateDescriptor, F_GETFL)};
+    struct stat fileStatus{};
+    if ( (flags == -1) || (fcntl(duplicateDescriptor, F_SETFL, flags | O_NONBLOCK) == -1) || (fstat(duplicateDescriptor, &fileStatus) == -1) ) {
+        int errorNumber{errno};
+        if (duplicateDescriptor != -1) {
+            ::close(duplicateDescriptor);
+        }
+        throw std::runtime_error(TStringFormat(R"(Unable to add sink "{0}" to {1} ({2}))", settings.path, this->m_streamName, strerror(errorNumber)));
+    }
+    /* Each loop registers its own duplicate, a descriptor can only be in
+     * one epoll set once */
+    std::unique_ptr<Sink> sink{new Sink{this->m_nextSinkId++, duplicateDescriptor, settings.path, SinkKind::Stream, settings.backpressure, settings.queueLimit,
+                                        std::deque<QueuedChunk>{}, 0, 0, false, false, false, false}};
+    uint64_t sinkId{sink->id};
+    if (S_ISREG(fileStatus.st_mode)) {
+        sink->kind = SinkKind::File;
+    } else if (S_ISFIFO(fileStatus.st_mode)) {
+        sink->kind = SinkKind::Pipe;
+        this->m_pipeSinkCount++;
+    }
+    this->m_sinks.push_back(std::move(sink));
+    if ( (this->m_pipeSinkCount == 2) && (this->m_stagingPipe[0] == -1) ) {
+        this->openStagingPipe();
+    }
+    return sinkId;
+}
+
+void StreamFanout::removeSink(uint64_t sinkId)
+{
+    for (auto it = this->m_sinks.begin(); it != this->m_sinks.end(); it++) {
+        Sink &sink = **it;
+        if (sink.id != sinkId) {
+            continue;
+        }
+        if (sink.waitingForWritable) {
+            this->m_eventLoop.removeDescriptor(sink.fileDescriptor);
+        }
+        if (sink.fileDescriptor != -1) {
+            ::close(sink.fileDescriptor);
+        }
+        if (sink.kind == SinkKind::Pipe) {
+            this->m_pipeSinkCount--;
+        }
+        this->m_sinks.erase(it);
+        return;
+    }
+}
+
+void StreamFanout::publish(const char *data, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    /* Only built if some sink has to queue part of this read */
+    Chunk chunk{nullptr};
+    size_t idlePipeCount{0};
+    for (const auto &sink : this->m_sinks) {
+        if ( (sink->kind == SinkKind::Pipe) && (!sink->failed) && (sink->queue.empty()) ) {
+            idlePipeCount++;
+        }
+    }
+    size_t stagedLength{0};
+    if ( (idlePipeCount >= 2) && (length >= MINIMUM_TEE_LENGTH) ) {
+        stagedLength = this->stage(data, length);
+    }
+    for (auto &it : this->m_sinks) {
+        Sink &sink = *it;
+        if (sink.failed) {
+            continue;
+        }
+        if (!sink.queue.empty()) {
+            /* Still behind, so this read goes after what is queued */
+            this->enqueue(sink, chunk, data, length, 0);
+            continue;
+        }
+        size_t written{0};
+        if ( (sink.kind == SinkKind::Pipe) && (stagedLength > 0) ) {
+            written = this->teeTo(sink, stagedLength);
+        }
+        if ( (!sink.failed) && (written < length) ) {
+            written += this->writeTo(sink, data + written, length - written);
+        }
+        if ( (!sink.failed) && (written < length) ) {
+            this->enqueue(sink, chunk, data, length, written);
+        }
+    }
+    if (stagedLength > 0) {
+        this->discardStaged(stagedLength);
+    }
+    this->reportClosedSinks();
+}
+
+size_t StreamFanout::sinkCount() const
+{
+    return this->m_sinks.size();
+}
+
+uint64_t StreamFanout::droppedBytes() const
+{
+    uint64_t droppedBytes{0};
+    for (const auto &sink : this->m_sinks) {
+        droppedBytes += sink->droppedBytes;
+    }
+    return droppedBytes;
+}
+
+uint64_t StreamFanout::queuedBytes() const
+{
+    uint64_t queuedBytes{0};
+    for (const auto &sink : this->m_sinks) {
+        queuedBytes += sink->queuedBytes;
+    }
+    return queuedBytes;
+}
+
+int StreamFanout::openSink(const std::string &path)
+{
+    int fileDescriptor{::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644)};
+    if (fileDescriptor == -1) {
+        throw std::runtime_error(TStringFormat(R"(Unable to open sink "{0}" ({1}))", path, (errno == ENXIO) ? "nothing is reading the FIFO" : strerror(errno)));
+    }
+    return fileDescriptor;
+}
+
+size_t StreamFanout::stage(const char *data, size_t length)
+{
+    if (this->m_stagingPipe[1] == -1) {
+        return 0;
+    }
+    ssize_t written{0};
+    do {
+        written = ::write(this->m_stagingPipe[1], data, length);
+    } while ( (written == -1) && (errno == EINTR) );
+    return (written > 0) ? static_cast<size_t>(written) : 0;
+}
+
+void StreamFanout::discardStaged(size_t length)
+{
+    /* Splicing into /dev/null just drops the staging pipe's page references */
+    while (length > 0) {
+        ssize_t discarded{splice(this->m_stagingPipe[0], nullptr, this->m_nullDescriptor, nullptr, length, SPLICE_F_NONBLOCK)};
+        if (discarded > 0) {
+            length -= static_cast<size_t>(discarded);
+        } else if ( (discarded == -1) && (errno == EINTR) ) {
+            continue;
+        } else {
+            /* Left over data would be teed again with the next read */
+            LOG_DEBUG(SERIAL_LOG_SUBSYSTEM) << TStringFormat("Unable to empty the staging pipe of {0} ({1}), no longer using tee()",
+                                                             this->m_streamName, strerror(errno));
+            this->closeStagingPipe();
+            return;
+        }
+    }
+}
+
+size_t StreamFanout::teeTo(Sink &sink, size_t length)
+{
+    /* tee() never consumes the staging pipe, so a second call would send
+     * the same bytes again; whatever the first one leaves is written */
+    ssize_t teed{0};
+    do {
+        teed = tee(this->m_stagingPipe[0], sink.fileDescriptor, length, SPLICE_F_NONBLOCK);
+    } while ( (teed == -1) && (errno == EINTR) );
+    if (teed > 0) {
+        return static_cast<size_t>(teed);
+    }
+    if ( (teed == -1) && (errno != EAGAIN) && (errno != EINVAL) ) {
+        this->fail(sink, errno);
+    }
+    return 0;
+}
+
+size_t StreamFanout::writeTo(Sink &sink, const char *data, size_t length)
+{
+    size_t totalWritten{0};
+    while (totalWritten < length) {
+        ssize_t written{::write(sink.fileDescriptor, data + totalWritten, length - totalWritten)};
+        if (written > 0) {
+            totalWritten += static_cast<size_t>(written);
+        } else if ( (written == -1) && (errno == EINTR) ) {
+            continue;
+        } else if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) && (sink.kind != SinkKind::File) ) {
+            break;
+        } else {
+            this->fail(sink, (written == -1) ? errno : EIO);
+            break;
+        }
+    }
+    return totalWritten;
+}
+
+void StreamFanout::enqueue(Sink &sink, Chunk &chunk, const char *data, size_t length, size_t offset)
+{
+    size_t remaining{length - offset};
+    /* The rest of a read the sink already started on is always kept, so a
+     * sink never sees half of one read followed by the next */
+    bool accepted{offset > 0};
+    if ( (!accepted) && (sink.backpressure != SinkBackpressure::Drop) ) {
+        accepted = (sink.queuedBytes + remaining <= sink.queueLimit);
+    }
+    if ( (!accepted) && (sink.backpressure == SinkBackpressure::Disconnect) ) {
+        this->fail(sink, ENOBUFS);
+        return;
+    }
+    if (!accepted) {
+        sink.droppedBytes += remaining;
+        this->m_droppedBytesMetric.add(remaining);
+        if (!sink.dropping) {
+            sink.dropping = true;
+            LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat(R"(Sink "{0}" is not keeping up with {1}, dropping data)", sink.path, this->m_streamName);
+        }
+        return;
+    }
+    if (!chunk) {
+        chunk = std::make_shared<const std::vector<char>>(data, data + length);
+    }
+    sink.queue.push_back(QueuedChunk{chunk, offset});
+    sink.queuedBytes += remaining;
+    if (!sink.waitingForWritable) {
+        Sink *sinkPointer{&sink};
+        this->m_eventLoop.addDescriptor(sink.fileDescriptor, EPOLLOUT, [this, sinkPointer](uint32_t) {
+            this->flush(*sinkPointer);
+        });
+        sink.waitingForWritable = true;
+    }
+}
+
+void StreamFanout::flush(Sink &sink)
+{
+    while (!sink.queue.empty()) {
+        iovec iovecs[MAXIMUM_IOVECS_PER_WRITE];
+        int iovecCount{0};
+        for (auto it = sink.queue.begin(); (it != sink.queue.end()) && (iovecCount < MAXIMUM_IOVECS_PER_WRITE); it++, iovecCount++) {
+            iovecs[iovecCount].iov_base = const_cast<char *>(it->chunk->data() + it->offset);
+            iovecs[iovecCount].iov_len = it->chunk->size() - it->offset;
+        }
+        ssize_t written{writev(sink.fileDescriptor, iovecs, iovecCount)};
+        if ( (written == -1) && (errno == EINTR) ) {
+            continue;
+        }
+        if ( (written == -1) && ( (errno == EAGAIN) || (errno == EWOULDBLOCK) ) ) {
+            return;
+        }
+        if (written <= 0) {
+            /* May remove the sink, so nothing touches it after this */
+            this->fail(sink, (written == -1) ? errno : EIO);
+            this->reportClosedSinks();
+            return;
+        }
+        size_t consumed{static_cast<size_t>(written)};
+        sink.queuedBytes -= consumed;
+        while (consumed > 0) {
+            QueuedChunk &front = sink.queue.front();
+            size_t frontLength{front.chunk->size() - front.offset};
+            if (consumed < frontLength) {
+                front.offset += consumed;
+                break;
+            }
+            consumed -= frontLength;
+            sink.queue.pop_front();
+        }
+    }
+    this->m_eventLoop.removeDescriptor(sink.fileDescriptor);
+    sink.waitingForWritable = false;
+    if (sink.dropping) {
+        sink.dropping = false;
+        LOG_INFO(SERIAL_LOG_SUBSYSTEM) << TStringFormat(R"(Sink "{0}" caught up with {1}, {2} bytes dropped so far)", sink.path, this->m_streamName, sink.droppedBytes);
+    }
+}
+
+void StreamFanout::fail(Sink &sink, int errorNumber)
+{
+    LOG_WARN(SERIAL_LOG_SUBSYSTEM) << TStringFormat(R"(Closing sink "{0}" for {1} ({2}))", sink.path, this->m_streamName, strerror(errorNumber));
+    if (sink.waitingForWritable) {
+        this->m_eventLoop.removeDescriptor(sink.fileDescriptor);
+        sink.waitingForWritable = false;
+    }
+    sink.queue.clear();
+    sink.queuedBytes = 0;
+    ::close(sink.fileDescriptor);
+    sink.fileDescriptor = -1;
+    sink.failed = true;
+}
+
+void StreamFanout::reportClosedSinks()
+{
+    std::vector<uint64_t> closedSinkIds{};
+    for (auto &sink : this->m_sinks) {
+        if ( (sink->failed) && (!sink->closedReported) ) {
+            sink->closedReported = true;
+            closedSinkIds.push_back(sink->id);
+        }
+    }
+    if (this->m_closedHandler) {
+        for (uint64_t sinkId : closedSinkIds) {
+            this->m_closedHandler(sinkId);
+        }
+    }
+}
+
+void StreamFanout::openStagingPipe()
+{
+    if (pipe2(this->m_stagingPipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        this->m_stagingPipe[0] = this->m_stagingPipe[1] = -1;
+        return;
+    }
+    this->m_nullDescriptor = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (this->m_nullDescriptor == -1) {
+        this->closeStagingPipe();
+    }
+}
+
+void StreamFanout::closeStagingPipe()
+{
+    for (int *fileDescriptor : {&this->m_stagingPipe[0], &this->m_stagingPipe[1], &this->m_nullDescriptor}) {
+        if (*fileDescriptor != -1) {
+            ::close(*fileDescriptor);
+            *fileDescriptor = -1;
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef SERIALCOMMUNICATION_STREAMFANOUT_H
+#define SERIALCOMMUNICATION_STREAMFANOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MetricsRegistry.h"
+
+class EventLoop;
+
+/* What a sink does with data it cannot take yet. Drop never holds more
+ * than the rest of a read it had started on, Buffer holds up to the sink's
+ * queue limit; past that, new data is dropped and counted. Disconnect also
+ * holds up to the limit, then closes the sink rather than lose data */
+enum class SinkBackpressure {
+    Drop,
+    Buffer,
+    Disconnect
+};
+
+struct StreamSinkSettings
+{
+    std::string path;
+    SinkBackpressure backpressure;
+    size_t queueLimit;
+};
+
+/* Copies one port's RX stream to any number of descriptor sinks (files,
+ * FIFOs, terminals) on the port's EventLoop. Every sink is written without
+ * blocking and keeps its own queue, so a slow or stuck sink only ever loses
+ * its own data and never stalls the port. Whatever a sink cannot take right
+ * away is queued as a reference to one shared copy of the read, so a byte is
+ * stored once however many sinks are behind. With two or more FIFOs and a
+ * large enough read, the read is written once into a staging pipe and
+ * tee()d to each FIFO, which shares the pipe's pages instead of copying the
+ * data once per FIFO. Must be used from the owning loop's thread only */
+class StreamFanout
+{
+public:
+    /* Called with the id from addSink() when a sink is closed on an error
+     * or an overflow, once no publish or flush is in progress */
+    using ClosedHandler = std::function<void(uint64_t)>;
+
+    StreamFanout(EventLoop &eventLoop, const std::string &streamName);
+    ~StreamFanout();
+    StreamFanout(const StreamFanout &) = delete;
+    StreamFanout(StreamFanout &&) = delete;
+    StreamFanout &operator=(const StreamFanout &) = delete;
+    StreamFanout &operator=(StreamFanout &&) = delete;
+
+    void setClosedHandler(const ClosedHandler &closedHandler);
+    /* Writes to a non-blocking duplicate of fileDescriptor, which the
+     * caller keeps; returns the sink's id */
+    uint64_t addSink(int fileDescriptor, const StreamSinkSettings &settings);
+    void removeSink(uint64_t sinkId);
+    void publish(const char *data, size_t length);
+
+    size_t sinkCount() const;
+    uint64_t droppedBytes() const;
+    uint64_t queuedBytes() const;
+
+    /* Opens path for appending without blocking, creating a regular file if
+     * there is nothing there; throws if that fails (a FIFO must already
+     * have a reader) */
+    static int openSink(const std::string &path);
+
+    static const size_t DEFAULT_QUEUE_LIMIT{16 * 1024 * 1024};
+    /* Below this, a write() per FIFO costs less than staging plus tee() */
+    static const size_t MINIMUM_TEE_LENGTH{16 * 1024};
+
+private:
+    using Chunk = std::shared_ptr<const std::vector<char>>;
+
+    enum class SinkKind {
+        File,
+        Pipe,
+        Stream
+    };
+
+    struct QueuedChunk
+    {
+        Chunk chunk;
+        size_t offset;
+    };
+
+    struct Sink
+    {
+        uint64_t id;
+        int fileDescriptor;
+        std::string path;
+        SinkKind kind;
+        SinkBackpressure backpressure;
+        size_t queueLimit;
+        std::deque<QueuedChunk> queue;
+        size_t queuedBytes;
+        uint64_t droppedBytes;
+        bool waitingForWritable;
+        bool dropping;
+        bool failed;
+        bool closedReported;
+    };
+
+    EventLoop &m_eventLoop;
+    std::string m_streamName;
+    std::vector<std::unique_ptr<Sink>> m_sinks;
+    int m_stagingPipe[2];
+    int m_nullDescriptor;
+    size_t m_pipeSinkCount;
+    uint64_t m_nextSinkId;
+    ClosedHandler m_closedHandler;
+    MetricCounter m_droppedBytesMetric;
+
+    size_t stage(const char *data, size_t length);
+    void discardStaged(size_t length);
+    size_t teeTo(Sink &sink, size_t length);
+    size_t writeTo(Sink &sink, const char *data, size_t length);
+    void enqueue(Sink &sink, Chunk &chunk, const char *data, size_t length, size_t offset);
+    void flush(Sink &sink);
+    void fail(Sink &sink, int errorNumber);
+    void reportClosedSinks();
+    void openStagingPipe();
+    void closeStagingPipe();
+
+    static const int MAXIMUM_IOVECS_PER_WRITE{16};
+};
+
+#endif //SERIALCOMMUNICATION_STREAMFANOUT_H
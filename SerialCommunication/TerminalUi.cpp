@@ -0,0 +1,440 @@
+#include "TerminalUi.h"
+#include "EventLoop.h"
+#include "MessageLogger.h"
+#include "PortSettingsLookup.h"
+#include "SessionManager.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ncurses.h>
+#include <stdexcept>
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+const int TerminalUi::REFRESH_RATE;
+const size_t TerminalUi::PORT_RING_SIZE;
+const uint16_t TerminalUi::TRANSMIT_SOURCE;
+
+namespace {
+
+std::string settingsSummary(const PortSettings &portSettings)
+{
+    /* The usual 115200 8N1 shorthand */
+    static const char DATA_BITS[]{'5', '6', '7', '8'};
+    static const char PARITY[]{'N', 'E', 'O'};
+    std::string summary{baudRateToString(portSettings.baudRate)};
+    summary.push_back(' ');
+    summary.push_back(DATA_BITS[static_cast<int>(portSettings.dataBits)]);
+    summary.push_back(PARITY[static_cast<int>(portSettings.parity)]);
+    summary.push_back((portSettings.stopBits == StopBits::ONE) ? '1' : '2');
+    return summary;
+}
+
+std::string formatRate(uint64_t bytesPerSecond)
+{
+    char formattedRate[32];
+    if (bytesPerSecond >= 1000000) {
+        snprintf(formattedRate, sizeof(formattedRate), "%.1f MB/s", static_cast<double>(bytesPerSecond) / 1e6);
+    } else if (bytesPerSecond >= 1000) {
+        snprintf(formattedRate, sizeof(formattedRate), "%.1f kB/s", static_cast<double>(bytesPerSecond) / 1e3);
+    } else {
+        snprintf(formattedRate, sizeof(formattedRate), "%llu B/s", static_cast<unsigned long long>(bytesPerSecond));
+    }
+    return formattedRate;
+}
+
+} //Global namespace
+
+TerminalUi::PortPane::PortPane(const PortSettings &settings) :
+    portSettings{settings},
+    settingsSummary{::settingsSummary(settings)},
+    ring{PORT_RING_SIZE},
+    droppedFrames{0},
+    receivedBytesMetric{MetricsRegistry::instance().counter("port." + settings.portName + ".rx_bytes")},
+    transmittedBytesMetric{MetricsRegistry::instance().counter("port." + settings.portName + ".tx_bytes")},
+    lastReceivedBytes{0},
+    lastTransmittedBytes{0},
+    receiveRate{0},
+    transmitRate{0}
+{
+
+}
+
+TerminalUi::TerminalUi(EventLoop &eventLoop, SessionManager &sessionManager, const std::vector<PortSettings> &portSettings, bool binaryFrames) :
+    m_eventLoop{eventLoop},
+    m_sessionManager{sessionManager},
+    m_binaryFrames{binaryFrames},
+    m_ports{},
+    m_portIndices{},
+    m_scrollback{},
+    m_screen{nullptr},
+    m_receivePane{nullptr},
+    m_statusBar{nullptr},
+    m_inputLine{nullptr},
+    m_refreshTimer{-1},
+    m_started{false},
+    m_input{""},
+    m_renderBuffer{""},
+    m_frameBuffer(Scrollback::MAXIMUM_LINE_LENGTH),
+    m_renderedLineCount{0},
+    m_scrollOffset{0},
+    m_receivePaneDirty{true},
+    m_statusBarDirty{true},
+    m_inputLineDirty{true},
+    m_lastRateUpdate{}
+{
+    for (const auto &it : portSettings) {
+        this->m_portIndices.emplace(it.portName, this->m_ports.size());
+        this->m_ports.emplace_back(new PortPane{it});
+    }
+}
+
+TerminalUi::~TerminalUi()
+{
+    this->stop();
+}
+
+SerialSession::FrameHandler TerminalUi::frameHandler()
+{
+    /* Runs on the port's worker thread, the one producer of its ring */
+    return [this](SerialSession &serialSession, const char *frame, size_t length) {
+        auto found = this->m_portIndices.find(serialSession.portSettings().portName);
+        if (found == this->m_portIndices.end()) {
+            return;
+        }
+        PortPane &portPane = *this->m_ports[found->second];
+        uint32_t storedLength{static_cast<uint32_t>(std::min(length, Scrollback::MAXIMUM_LINE_LENGTH))};
+        if (!portPane.ring.tryWrite(&storedLength, sizeof(storedLength), frame, storedLength)) {
+            portPane.droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+}
+
+void TerminalUi::start()
+{
+    if (this->m_started) {
+        return;
+    }
+    this->m_screen = newterm(nullptr, stdout, stdin);
+    if (!this->m_screen) {
+        throw std::runtime_error("Unable to start the terminal UI (is TERM set?)");
+    }
+    cbreak();
+    noecho();
+    nonl();
+    set_escdelay(25);
+    this->createWindows();
+    this->m_lastRateUpdate = std::chrono::steady_clock::now();
+    this->m_refreshTimer = this->m_eventLoop.addTimer(std::chrono::microseconds{1000000 / REFRESH_RATE}, [this]() {
+        this->onRefreshTimer();
+    });
+    this->m_started = true;
+    this->render();
+}
+
+void TerminalUi::stop()
+{
+    if (!this->m_started) {
+        return;
+    }
+    this->m_eventLoop.removeTimer(this->m_refreshTimer);
+    this->m_refreshTimer = -1;
+    this->destroyWindows();
+    endwin();
+    delscreen(this->m_screen);
+    this->m_screen = nullptr;
+    this->m_started = false;
+}
+
+void TerminalUi::onRefreshTimer()
+{
+    this->handleKeys();
+    this->drainPorts();
+    if (std::chrono::steady_clock::now() - this->m_lastRateUpdate >= std::chrono::seconds{1}) {
+        this->updateRates();
+    }
+    this->render();
+}
+
+void TerminalUi::handleKeys()
+{
+    for (int key = wgetch(this->m_inputLine); key != ERR; key = wgetch(this->m_inputLine)) {
+        this->handleKey(key);
+    }
+}
+
+void TerminalUi::handleKey(int key)
+{
+    int pageLength{std::max(1, this->receivePaneHeight() - 1)};
+    switch (key) {
+        case KEY_RESIZE:
+            this->destroyWindows();
+            this->createWindows();
+            break;
+        case KEY_F(10):
+            this->m_eventLoop.stop();
+            break;
+        case KEY_PPAGE:
+            this->scrollBy(pageLength);
+            break;
+        case KEY_NPAGE:
+            this->scrollBy(-pageLength);
+            break;
+        case KEY_UP:
+            this->scrollBy(1);
+            break;
+        case KEY_DOWN:
+            this->scrollBy(-1);
+            break;
+        case KEY_HOME:
+            this->scrollBy(static_cast<long>(this->m_scrollback.lineCount()));
+            break;
+        case KEY_END:
+            this->scrollBy(-static_cast<long>(this->m_scrollOffset));
+            break;
+        case KEY_ENTER:
+        case '\r':
+        case '\n':
+            this->m_sessionManager.broadcastLine(this->m_input);
+            this->m_scrollback.append(TRANSMIT_SOURCE, this->m_input.data(), this->m_input.size());
+            this->m_input.clear();
+            this->m_inputLineDirty = true;
+            this->scrollBy(-static_cast<long>(this->m_scrollOffset));
+            break;
+        case KEY_BACKSPACE:
+        case 127:
+        case '\b':
+            if (!this->m_input.empty()) {
+                this->m_input.pop_back();
+                this->m_inputLineDirty = true;
+            }
+            break;
+        case 21: /* Ctrl-U */
+            this->m_input.clear();
+            this->m_inputLineDirty = true;
+            break;
+        default:
+            if ( (key >= 32) && (key < 127) && (this->m_input.size() < Scrollback::MAXIMUM_LINE_LENGTH) ) {
+                this->m_input.push_back(static_cast<char>(key));
+                this->m_inputLineDirty = true;
+            }
+            break;
+    }
+}
+
+void TerminalUi::drainPorts()
+{
+    for (size_t i = 0; i < this->m_ports.size(); i++) {
+        SpscByteRing &ring = this->m_ports[i]->ring;
+        size_t readableBytes{ring.readableBytes()};
+        size_t offset{0};
+        /* Records are written whole, so a length is always followed by its frame */
+        while (readableBytes - offset >= sizeof(uint32_t)) {
+            uint32_t length{0};
+            ring.peek(offset, &length, sizeof(length));
+            ring.peek(offset + sizeof(length), this->m_frameBuffer.data(), length);
+            this->m_scrollback.append(static_cast<uint16_t>(i), this->m_frameBuffer.data(), length);
+            offset += sizeof(length) + length;
+        }
+        ring.consume(offset);
+    }
+}
+
+void TerminalUi::updateRates()
+{
+    auto now = std::chrono::steady_clock::now();
+    double elapsedSeconds{std::chrono::duration<double>(now - this->m_lastRateUpdate).count()};
+    this->m_lastRateUpdate = now;
+    MetricsRegistry &metricsRegistry = MetricsRegistry::instance();
+    for (auto &portPane : this->m_ports) {
+        uint64_t receivedBytes{metricsRegistry.value(portPane->receivedBytesMetric)};
+        uint64_t transmittedBytes{metricsRegistry.value(portPane->transmittedBytesMetric)};
+        portPane->receiveRate = static_cast<uint64_t>(static_cast<double>(receivedBytes - portPane->lastReceivedBytes) / elapsedSeconds);
+        portPane->transmitRate = static_cast<uint64_t>(static_cast<double>(transmittedBytes - portPane->lastTransmittedBytes) / elapsedSeconds);
+        portPane->lastReceivedBytes = receivedBytes;
+        portPane->lastTransmittedBytes = transmittedBytes;
+    }
+    this->m_statusBarDirty = true;
+}
+
+void TerminalUi::createWindows()
+{
+    int rows{std::max(LINES, 3)};
+    this->m_receivePane = newwin(rows - 2, COLS, 0, 0);
+    this->m_statusBar = newwin(1, COLS, rows - 2, 0);
+    this->m_inputLine = newwin(1, COLS, rows - 1, 0);
+    /* idlok lets curses scroll the pane with the terminal's own insert and
+     * delete line commands instead of repainting it */
+    scrollok(this->m_receivePane, TRUE);
+    idlok(this->m_receivePane, TRUE);
+    wbkgdset(this->m_statusBar, A_REVERSE);
+    keypad(this->m_inputLine, TRUE);
+    nodelay(this->m_inputLine, TRUE);
+    erase();
+    wnoutrefresh(stdscr);
+    this->m_receivePaneDirty = true;
+    this->m_statusBarDirty = true;
+    this->m_inputLineDirty = true;
+}
+
+void TerminalUi::destroyWindows()
+{
+    for (WINDOW **window : {&this->m_receivePane, &this->m_statusBar, &this->m_inputLine}) {
+        if (*window) {
+            delwin(*window);
+            *window = nullptr;
+        }
+    }
+}
+
+int TerminalUi::receivePaneHeight() const
+{
+    return getmaxy(this->m_receivePane);
+}
+
+void TerminalUi::scrollBy(long lines)
+{
+    size_t height{static_cast<size_t>(this->receivePaneHeight())};
+    size_t maximumOffset{(this->m_scrollback.lineCount() > height) ? (this->m_scrollback.lineCount() - height) : 0};
+    long requestedOffset{static_cast<long>(this->m_scrollOffset) + lines};
+    size_t scrollOffset{std::min(maximumOffset, static_cast<size_t>(std::max(0L, requestedOffset)))};
+    if (scrollOffset != this->m_scrollOffset) {
+        this->m_scrollOffset = scrollOffset;
+        this->m_receivePaneDirty = true;
+        this->m_statusBarDirty = true;
+    }
+}
+
+void TerminalUi::render()
+{
+    bool changed{this->m_receivePaneDirty || this->m_statusBarDirty || this->m_inputLineDirty ||
+                 (this->m_scrollback.appendedLineCount() != this->m_renderedLineCount)};
+    if (!changed) {
+        return;
+    }
+    this->renderReceivePane();
+    if (this->m_statusBarDirty) {
+        this->renderStatusBar();
+    }
+    /* Always last, so the cursor is left on the input line */
+    this->renderInputLine();
+    doupdate();
+}
+
+void TerminalUi::renderReceivePane()
+{
+    int height{this->receivePaneHeight()};
+    uint64_t newLines{this->m_scrollback.appendedLineCount() - this->m_renderedLineCount};
+    this->m_renderedLineCount = this->m_scrollback.appendedLineCount();
+    if ( (newLines == 0) && (!this->m_receivePaneDirty) ) {
+        return;
+    }
+    size_t lineCount{this->m_scrollback.lineCount()};
+    if ( (this->m_scrollOffset > 0) && (!this->m_receivePaneDirty) ) {
+        /* Scrolled back: the same lines stay in view, unless they were
+         * evicted from the scrollback in the meantime */
+        size_t maximumOffset{(lineCount > static_cast<size_t>(height)) ? (lineCount - static_cast<size_t>(height)) : 0};
+        size_t anchoredOffset{this->m_scrollOffset + static_cast<size_t>(newLines)};
+        this->m_scrollOffset = std::min(anchoredOffset, maximumOffset);
+        this->m_statusBarDirty = true;
+        if (anchoredOffset <= maximumOffset) {
+            return;
+        }
+        this->m_receivePaneDirty = true;
+    }
+    long firstLine{static_cast<long>(lineCount) - height - static_cast<long>(this->m_scrollOffset)};
+    if ( (!this->m_receivePaneDirty) && (newLines < static_cast<uint64_t>(height)) ) {
+        wscrl(this->m_receivePane, static_cast<int>(newLines));
+        for (int row = height - static_cast<int>(newLines); row < height; row++) {
+            this->renderLine(row, firstLine + row);
+        }
+    } else {
+        for (int row = 0; row < height; row++) {
+            this->renderLine(row, firstLine + row);
+        }
+    }
+    this->m_receivePaneDirty = false;
+    wnoutrefresh(this->m_receivePane);
+}
+
+void TerminalUi::renderLine(int row, long lineIndex)
+{
+    wmove(this->m_receivePane, row, 0);
+    if (lineIndex < 0) {
+        wclrtoeol(this->m_receivePane);
+        return;
+    }
+    static const char HEX_DIGITS[]{"0123456789abcdef"};
+    /* The last column stays empty, writing to the bottom right corner
+     * would scroll the pane */
+    size_t width{static_cast<size_t>(std::max(getmaxx(this->m_receivePane) - 1, 1))};
+    Scrollback::Line line{this->m_scrollback.line(static_cast<size_t>(lineIndex))};
+    bool transmitted{line.source == TRANSMIT_SOURCE};
+    this->m_renderBuffer.clear();
+    if (transmitted) {
+        this->m_renderBuffer.append("> ");
+    } else if (this->m_ports.size() > 1) {
+        this->m_renderBuffer.append(this->m_ports[line.source]->portSettings.portName);
+        this->m_renderBuffer.append(": ");
+    }
+    for (size_t i = 0; (i < line.length) && (this->m_renderBuffer.size() < width); i++) {
+        unsigned char byte{static_cast<unsigned char>(line.data[i])};
+        if ( (this->m_binaryFrames) && (!transmitted) ) {
+            this->m_renderBuffer.push_back(HEX_DIGITS[byte >> 4]);
+            this->m_renderBuffer.push_back(HEX_DIGITS[byte & 0x0F]);
+            this->m_renderBuffer.push_back(' ');
+        } else {
+            this->m_renderBuffer.push_back( ( (byte >= 32) && (byte < 127) ) ? static_cast<char>(byte) : '.');
+        }
+    }
+    if (transmitted) {
+        wattron(this->m_receivePane, A_BOLD);
+    }
+    waddnstr(this->m_receivePane, this->m_renderBuffer.data(), static_cast<int>(std::min(this->m_renderBuffer.size(), width)));
+    if (transmitted) {
+        wattroff(this->m_receivePane, A_BOLD);
+    }
+    wclrtoeol(this->m_receivePane);
+}
+
+void TerminalUi::renderStatusBar()
+{
+    this->m_renderBuffer.clear();
+    uint64_t droppedFrames{0};
+    for (const auto &portPane : this->m_ports) {
+        if (!this->m_renderBuffer.empty()) {
+            this->m_renderBuffer.append(" | ");
+        }
+        this->m_renderBuffer.append(TStringFormat("{0} {1} RX {2} TX {3}",
+                                                  portPane->portSettings.portName,
+                                                  portPane->settingsSummary,
+                                                  formatRate(portPane->receiveRate),
+                                                  formatRate(portPane->transmitRate)));
+        droppedFrames += portPane->droppedFrames.load(std::memory_order_relaxed);
+    }
+    if (droppedFrames > 0) {
+        this->m_renderBuffer.append(TStringFormat(" | {0} frame(s) not shown", droppedFrames));
+    }
+    if (this->m_scrollOffset > 0) {
+        this->m_renderBuffer.append(TStringFormat(" | scrolled back {0}", this->m_scrollOffset));
+    }
+    werase(this->m_statusBar);
+    mvwaddnstr(this->m_statusBar, 0, 0, this->m_renderBuffer.data(), getmaxx(this->m_statusBar));
+    wnoutrefresh(this->m_statusBar);
+    this->m_statusBarDirty = false;
+}
+
+void TerminalUi::renderInputLine()
+{
+    if (this->m_inputLineDirty) {
+        /* Keep the end of a long input in view */
+        size_t width{static_cast<size_t>(std::max(getmaxx(this->m_inputLine) - 3, 1))};
+        size_t visibleStart{(this->m_input.size() > width) ? (this->m_input.size() - width) : 0};
+        werase(this->m_inputLine);
+        mvwaddstr(this->m_inputLine, 0, 0, "> ");
+        waddnstr(this->m_inputLine, this->m_input.data() + visibleStart, static_cast<int>(this->m_input.size() - visibleStart));
+        this->m_inputLineDirty = false;
+    }
+    wnoutrefresh(this->m_inputLine);
+}
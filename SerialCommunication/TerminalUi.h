@@ -0,0 +1,107 @@
+#ifndef SERIALCOMMUNICATION_TERMINALUI_H
+#define SERIALCOMMUNICATION_TERMINALUI_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MetricsRegistry.h"
+#include "Scrollback.h"
+#include "SerialSession.h"
+#include "SpscByteRing.h"
+
+class EventLoop;
+class SessionManager;
+typedef struct _win_st WINDOW;
+struct screen;
+
+/* Interactive ncurses front end: a scrolling pane of received frames, a
+ * status bar with every port's settings and rates, and an input line that
+ * is sent to every port on Enter. Worker threads only copy frames into a
+ * per-port SpscByteRing, dropping (and counting) rather than waiting when
+ * it is full, so a slow terminal never holds up a serial reader. The loop
+ * thread drains the rings into a Scrollback and repaints at most
+ * REFRESH_RATE times a second, and then only the windows that changed:
+ * while following the newest lines the pane is scrolled and just the new
+ * rows are drawn */
+class TerminalUi
+{
+public:
+    TerminalUi(EventLoop &eventLoop, SessionManager &sessionManager, const std::vector<PortSettings> &portSettings, bool binaryFrames);
+    ~TerminalUi();
+    TerminalUi(const TerminalUi &) = delete;
+    TerminalUi(TerminalUi &&) = delete;
+    TerminalUi &operator=(const TerminalUi &) = delete;
+    TerminalUi &operator=(TerminalUi &&) = delete;
+
+    /* Safe to call from any worker thread */
+    SerialSession::FrameHandler frameHandler();
+
+    void start();
+    void stop();
+
+    static const int REFRESH_RATE{60};
+    static const size_t PORT_RING_SIZE{1024 * 1024};
+
+private:
+    struct PortPane
+    {
+        explicit PortPane(const PortSettings &settings);
+
+        PortSettings portSettings;
+        std::string settingsSummary;
+        SpscByteRing ring;
+        std::atomic<uint64_t> droppedFrames;
+        MetricCounter receivedBytesMetric;
+        MetricCounter transmittedBytesMetric;
+        uint64_t lastReceivedBytes;
+        uint64_t lastTransmittedBytes;
+        uint64_t receiveRate;
+        uint64_t transmitRate;
+    };
+
+    EventLoop &m_eventLoop;
+    SessionManager &m_sessionManager;
+    bool m_binaryFrames;
+    std::vector<std::unique_ptr<PortPane>> m_ports;
+    std::unordered_map<std::string, size_t> m_portIndices;
+    Scrollback m_scrollback;
+    struct screen *m_screen;
+    WINDOW *m_receivePane;
+    WINDOW *m_statusBar;
+    WINDOW *m_inputLine;
+    int m_refreshTimer;
+    bool m_started;
+    std::string m_input;
+    std::string m_renderBuffer;
+    std::vector<char> m_frameBuffer;
+    uint64_t m_renderedLineCount;
+    size_t m_scrollOffset;
+    bool m_receivePaneDirty;
+    bool m_statusBarDirty;
+    bool m_inputLineDirty;
+    std::chrono::steady_clock::time_point m_lastRateUpdate;
+
+    void onRefreshTimer();
+    void handleKeys();
+    void handleKey(int key);
+    void drainPorts();
+    void updateRates();
+    void createWindows();
+    void destroyWindows();
+    int receivePaneHeight() const;
+    void scrollBy(long lines);
+    void render();
+    void renderReceivePane();
+    void renderLine(int row, long lineIndex);
+    void renderStatusBar();
+    void renderInputLine();
+
+    static const uint16_t TRANSMIT_SOURCE{0xFFFF};
+};
+
+#endif //SERIALCOMMUNICATION_TERMINALUI_H
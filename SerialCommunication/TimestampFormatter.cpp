@@ -0,0 +1,60 @@
+#include "TimestampFormatter.h"
+
+#include <cstring>
+#include <time.h>
+
+const size_t TimestampFormatter::TIME_OF_DAY_LENGTH;
+const size_t TimestampFormatter::LENGTH;
+
+namespace {
+
+const char DIGIT_PAIRS[]{
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899"
+};
+
+/* Plain data, so every thread's copy is set up without running any code */
+struct CachedSecond
+{
+    int64_t second;
+    char text[TimestampFormatter::TIME_OF_DAY_LENGTH];
+};
+
+inline void writeDigitPair(char *buffer, unsigned value)
+{
+    memcpy(buffer, DIGIT_PAIRS + (value * 2), 2);
+}
+
+} //Global namespace
+
+void TimestampFormatter::format(uint64_t realtimeNanoseconds, char *buffer)
+{
+    thread_local CachedSecond cachedSecond{-1, {}};
+    int64_t second{static_cast<int64_t>(realtimeNanoseconds / 1000000000ULL)};
+    if (second != cachedSecond.second) {
+        time_t seconds{static_cast<time_t>(second)};
+        struct tm localTime{};
+        localtime_r(&seconds, &localTime);
+        writeDigitPair(cachedSecond.text, static_cast<unsigned>(localTime.tm_hour));
+        cachedSecond.text[2] = '-';
+        writeDigitPair(cachedSecond.text + 3, static_cast<unsigned>(localTime.tm_min));
+        cachedSecond.text[5] = '-';
+        /* A leap second shows as 60 */
+        writeDigitPair(cachedSecond.text + 6, static_cast<unsigned>(localTime.tm_sec));
+        cachedSecond.second = second;
+    }
+    memcpy(buffer, cachedSecond.text, TIME_OF_DAY_LENGTH);
+    buffer[TIME_OF_DAY_LENGTH] = '.';
+    unsigned microseconds{static_cast<unsigned>((realtimeNanoseconds % 1000000000ULL) / 1000)};
+    writeDigitPair(buffer + TIME_OF_DAY_LENGTH + 1, microseconds / 10000);
+    writeDigitPair(buffer + TIME_OF_DAY_LENGTH + 3, (microseconds / 100) % 100);
+    writeDigitPair(buffer + TIME_OF_DAY_LENGTH + 5, microseconds % 100);
+}
@@ -0,0 +1,23 @@
+#ifndef SERIALCOMMUNICATION_TIMESTAMPFORMATTER_H
+#define SERIALCOMMUNICATION_TIMESTAMPFORMATTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* Formats CLOCK_REALTIME nanoseconds as local HH-MM-SS.uuuuuu for log
+ * records. Each thread keeps the text of the last second it formatted, so
+ * localtime_r() only runs when the second changes, and the microseconds are
+ * written two digits at a time from a table. Safe from any thread, never
+ * allocates */
+class TimestampFormatter
+{
+public:
+    /* Writes exactly LENGTH characters, no terminator, to buffer */
+    static void format(uint64_t realtimeNanoseconds, char *buffer);
+
+    /* HH-MM-SS */
+    static const size_t TIME_OF_DAY_LENGTH{8};
+    static const size_t LENGTH{TIME_OF_DAY_LENGTH + 7};
+};
+
+#endif //SERIALCOMMUNICATION_TIMESTAMPFORMATTER_H
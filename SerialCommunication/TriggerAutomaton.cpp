@@ -0,0 +1,318 @@
+#include "TriggerAutomaton.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define TRIGGERAUTOMATON_X86 1
+#    include <immintrin.h>
+#endif
+
+using namespace TMessageLogger;
+
+const uint32_t TriggerAutomaton::START_STATE;
+const uint32_t TriggerAutomaton::MATCH_FLAG;
+const size_t TriggerAutomaton::PREFILTER_BLOCK_SIZE;
+
+/* Marks a missing trie edge while the automaton is built */
+static const uint32_t NO_STATE{std::numeric_limits<uint32_t>::max()};
+
+namespace {
+
+#if defined(TRIGGERAUTOMATON_X86)
+
+/* For each byte: look its low nibble up in the table for its half of the
+ * byte range (a shuffle index with the top bit set gives zero, so each
+ * table only answers for its own half), then keep the bit for its high
+ * nibble. Returns 0xFF where the byte begins a pattern */
+__attribute__((target("ssse3")))
+inline __m128i startByteMatchesSsse3(__m128i bytes, __m128i highClearTable, __m128i highSetTable, __m128i highNibbleBits)
+{
+    const __m128i topBit{_mm_set1_epi8(static_cast<char>(0x80))};
+    __m128i nibbleBits{_mm_or_si128(_mm_shuffle_epi8(highClearTable, bytes), _mm_shuffle_epi8(highSetTable, _mm_xor_si128(bytes, topBit)))};
+    __m128i highNibbles{_mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x07))};
+    __m128i found{_mm_and_si128(nibbleBits, _mm_shuffle_epi8(highNibbleBits, highNibbles))};
+    return _mm_xor_si128(_mm_cmpeq_epi8(found, _mm_setzero_si128()), _mm_set1_epi8(static_cast<char>(0xFF)));
+}
+
+__attribute__((target("ssse3")))
+uint64_t prefilterSsse3(const unsigned char *block, const uint8_t *lowNibbleHighClear, const uint8_t *lowNibbleHighSet)
+{
+    const __m128i highClearTable{_mm_loadu_si128(reinterpret_cast<const __m128i *>(lowNibbleHighClear))};
+    const __m128i highSetTable{_mm_loadu_si128(reinterpret_cast<const __m128i *>(lowNibbleHighSet))};
+    const __m128i highNibbleBits{_mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(128), 1, 2, 4, 8, 16, 32, 64, static_cast<char>(128))};
+    const __m128i *blocks{reinterpret_cast<const __m128i *>(block)};
+    uint64_t mask0{static_cast<uint32_t>(_mm_movemask_epi8(startByteMatchesSsse3(_mm_loadu_si128(blocks), highClearTable, highSetTable, highNibbleBits)))};
+    uint64_t mask1{static_cast<uint32_t>(_mm_movemask_epi8(startByteMatchesSsse3(_mm_loadu_si128(blocks + 1), highClearTable, highSetTable, highNibbleBits)))};
+    uint64_t mask2{static_cast<uint32_t>(_mm_movemask_epi8(startByteMatchesSsse3(_mm_loadu_si128(blocks + 2), highClearTable, highSetTable, highNibbleBits)))};
+    uint64_t mask3{static_cast<uint32_t>(_mm_movemask_epi8(startByteMatchesSsse3(_mm_loadu_si128(blocks + 3), highClearTable, highSetTable, highNibbleBits)))};
+    return mask0 | (mask1 << 16) | (mask2 << 32) | (mask3 << 48);
+}
+
+/* The same with both 16 byte lanes holding the same tables */
+__attribute__((target("avx2")))
+inline __m256i startByteMatchesAvx2(__m256i bytes, __m256i highClearTable, __m256i highSetTable, __m256i highNibbleBits)
+{
+    const __m256i topBit{_mm256_set1_epi8(static_cast<char>(0x80))};
+    __m256i nibbleBits{_mm256_or_si256(_mm256_shuffle_epi8(highClearTable, bytes), _mm256_shuffle_epi8(highSetTable, _mm256_xor_si256(bytes, topBit)))};
+    __m256i highNibbles{_mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x07))};
+    __m256i found{_mm256_and_si256(nibbleBits, _mm256_shuffle_epi8(highNibbleBits, highNibbles))};
+    return _mm256_xor_si256(_mm256_cmpeq_epi8(found, _mm256_setzero_si256()), _mm256_set1_epi8(static_cast<char>(0xFF)));
+}
+
+__attribute__((target("avx2")))
+uint64_t prefilterAvx2(const unsigned char *block, const uint8_t *lowNibbleHighClear, const uint8_t *lowNibbleHighSet)
+{
+    const __m256i highClearTable{_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lowNibbleHighClear)))};
+    const __m256i highSetTable{_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lowNibbleHighSet)))};
+    const __m256i highNibbleBits{_mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(128), 1, 2, 4, 8, 16, 32, 64, static_cast<char>(128),
+                                                  1, 2, 4, 8, 16, 32, 64, static_cast<char>(128), 1, 2, 4, 8, 16, 32, 64, static_cast<char>(128))};
+    const __m256i *blocks{reinterpret_cast<const __m256i *>(block)};
+    uint64_t mask0{static_cast<uint32_t>(_mm256_movemask_epi8(startByteMatchesAvx2(_mm256_loadu_si256(blocks), highClearTable, highSetTable, highNibbleBits)))};
+    uint64_t mask1{static_cast<uint32_t>(_mm256_movemask_epi8(startByteMatchesAvx2(_mm256_loadu_si256(blocks + 1), highClearTable, highSetTable, highNibbleBits)))};
+    return mask0 | (mask1 << 32);
+}
+
+#endif
+
+} //Global namespace
+
+TriggerAutomaton::TriggerAutomaton(const std::vector<std::string> &patterns, InstructionSet instructionSet) :
+    m_instructionSet{instructionSet},
+    m_prefilterScanner{nullptr},
+    m_patternCount{patterns.size()},
+    m_stateCount{1},
+    m_classCount{1},
+    m_byteClasses{},
+    m_startBytes{},
+    m_startByteTables{},
+    m_transitions{},
+    m_matchOffsets{},
+    m_matchPatterns{}
+{
+    if (patterns.empty()) {
+        throw std::runtime_error("A trigger automaton needs at least one pattern");
+    }
+    if (this->m_instructionSet == InstructionSet::Best) {
+        this->m_instructionSet = isSupported(InstructionSet::Avx2) ? InstructionSet::Avx2 :
+                                 isSupported(InstructionSet::Ssse3) ? InstructionSet::Ssse3 : InstructionSet::Scalar;
+    }
+    if (!isSupported(this->m_instructionSet)) {
+        throw std::runtime_error(TStringFormat("{0} is not supported on this CPU", instructionSetName(this->m_instructionSet)));
+    }
+
+    /* Every byte that appears in a pattern gets its own column, the rest
+     * share column 0 */
+    for (size_t i = 0; i < patterns.size(); i++) {
+        if (patterns[i].empty()) {
+            throw std::runtime_error(TStringFormat("Trigger pattern {0} is empty", i + 1));
+        }
+        for (char byte : patterns[i]) {
+            uint32_t &byteClass = this->m_byteClasses[static_cast<unsigned char>(byte)];
+            if (byteClass == 0) {
+                byteClass = this->m_classCount++;
+            }
+        }
+    }
+    const uint32_t classCount{this->m_classCount};
+
+    /* The trie, with the patterns each state ends */
+    std::vector<uint32_t> transitions(classCount, NO_STATE);
+    std::vector<std::vector<uint32_t>> statePatterns(1);
+    for (size_t i = 0; i < patterns.size(); i++) {
+        uint32_t state{0};
+        for (char byte : patterns[i]) {
+            size_t edge{(static_cast<size_t>(state) * classCount) + this->m_byteClasses[static_cast<unsigned char>(byte)]};
+            if (transitions[edge] == NO_STATE) {
+                transitions[edge] = static_cast<uint32_t>(statePatterns.size());
+                statePatterns.emplace_back();
+                transitions.resize(transitions.size() + classCount, NO_STATE);
+            }
+            state = transitions[edge];
+        }
+        statePatterns[state].push_back(static_cast<uint32_t>(i));
+    }
+    this->m_stateCount = statePatterns.size();
+    if (this->m_stateCount * classCount > MATCH_FLAG) {
+        throw std::runtime_error(TStringFormat("{0} trigger patterns make too large an automaton ({1} states)", patterns.size(), this->m_stateCount));
+    }
+
+    /* Breadth first, so a state's failure state (always shallower) is
+     * complete before the state is: missing edges are then copied from the
+     * failure state's row, and so are the patterns ending there */
+    std::vector<uint32_t> failureStates(this->m_stateCount, 0);
+    std::vector<uint32_t> queue{};
+    queue.reserve(this->m_stateCount);
+    for (uint32_t c = 0; c < classCount; c++) {
+        if (transitions[c] == NO_STATE) {
+            transitions[c] = 0;
+        } else {
+            queue.push_back(transitions[c]);
+        }
+    }
+    for (size_t i = 0; i < queue.size(); i++) {
+        uint32_t state{queue[i]};
+        const std::vector<uint32_t> &failurePatterns = statePatterns[failureStates[state]];
+        statePatterns[state].insert(statePatterns[state].end(), failurePatterns.begin(), failurePatterns.end());
+        for (uint32_t c = 0; c < classCount; c++) {
+            uint32_t &next = transitions[(static_cast<size_t>(state) * classCount) + c];
+            uint32_t failureNext{transitions[(static_cast<size_t>(failureStates[state]) * classCount) + c]};
+            if (next == NO_STATE) {
+                next = failureNext;
+            } else {
+                failureStates[next] = failureNext;
+                queue.push_back(next);
+            }
+        }
+    }
+
+    this->m_matchOffsets.reserve(this->m_stateCount + 1);
+    for (const auto &it : statePatterns) {
+        this->m_matchOffsets.push_back(static_cast<uint32_t>(this->m_matchPatterns.size()));
+        this->m_matchPatterns.insert(this->m_matchPatterns.end(), it.begin(), it.end());
+        std::sort(this->m_matchPatterns.begin() + this->m_matchOffsets.back(), this->m_matchPatterns.end());
+    }
+    this->m_matchOffsets.push_back(static_cast<uint32_t>(this->m_matchPatterns.size()));
+    this->m_transitions.resize(transitions.size());
+    for (size_t i = 0; i < transitions.size(); i++) {
+        uint32_t next{transitions[i]};
+        this->m_transitions[i] = (next * classCount) | (statePatterns[next].empty() ? 0 : MATCH_FLAG);
+    }
+
+    for (int byte = 0; byte < 256; byte++) {
+        if (transitions[this->m_byteClasses[byte]] == 0) {
+            continue;
+        }
+        this->m_startBytes[byte] = true;
+        uint8_t highNibbleBit{static_cast<uint8_t>(1 << ((byte >> 4) & 0x07))};
+        if (byte < 0x80) {
+            this->m_startByteTables.lowNibbleHighClear[byte & 0x0F] |= highNibbleBit;
+        } else {
+            this->m_startByteTables.lowNibbleHighSet[byte & 0x0F] |= highNibbleBit;
+        }
+    }
+#if defined(TRIGGERAUTOMATON_X86)
+    if (this->m_instructionSet == InstructionSet::Avx2) {
+        this->m_prefilterScanner = prefilterAvx2;
+    } else if (this->m_instructionSet == InstructionSet::Ssse3) {
+        this->m_prefilterScanner = prefilterSsse3;
+    }
+#endif
+}
+
+uint32_t TriggerAutomaton::scan(uint32_t state, const char *data, size_t length, const MatchHandler &matchHandler) const
+{
+    const unsigned char *bytes{reinterpret_cast<const unsigned char *>(data)};
+    const uint32_t *transitions{this->m_transitions.data()};
+    const uint32_t *byteClasses{this->m_byteClasses};
+    size_t i{0};
+    if (!this->m_prefilterScanner) {
+        for (; i < length; i++) {
+            uint32_t entry{transitions[state + byteClasses[bytes[i]]]};
+            state = entry & ~MATCH_FLAG;
+            if (entry & MATCH_FLAG) {
+                this->reportMatches(state, i + 1, matchHandler);
+            }
+        }
+        return state;
+    }
+    /* Start bytes of the block from blockStart to blockEnd; a block is only
+     * scanned in the start state, and is kept for when the automaton falls
+     * back to it further on in the same block */
+    size_t blockStart{0};
+    size_t blockEnd{0};
+    uint64_t candidates{0};
+    while (i < length) {
+        if (state == START_STATE) {
+            if (i >= blockEnd) {
+                blockStart = i;
+                if (length - i >= PREFILTER_BLOCK_SIZE) {
+                    blockEnd = i + PREFILTER_BLOCK_SIZE;
+                    candidates = this->m_prefilterScanner(bytes + i, this->m_startByteTables.lowNibbleHighClear, this->m_startByteTables.lowNibbleHighSet);
+                } else {
+                    blockEnd = length;
+                    candidates = 0;
+                    for (size_t k = i; k < length; k++) {
+                        candidates |= static_cast<uint64_t>(this->m_startBytes[bytes[k]]) << (k - i);
+                    }
+                }
+            }
+            uint64_t remaining{candidates & (~uint64_t{0} << (i - blockStart))};
+            if (remaining == 0) {
+                i = blockEnd;
+                continue;
+            }
+            i = blockStart + static_cast<size_t>(__builtin_ctzll(remaining));
+        }
+        uint32_t entry{transitions[state + byteClasses[bytes[i]]]};
+        state = entry & ~MATCH_FLAG;
+        i++;
+        if (entry & MATCH_FLAG) {
+            this->reportMatches(state, i, matchHandler);
+        }
+    }
+    return state;
+}
+
+size_t TriggerAutomaton::patternCount() const
+{
+    return this->m_patternCount;
+}
+
+size_t TriggerAutomaton::stateCount() const
+{
+    return this->m_stateCount;
+}
+
+size_t TriggerAutomaton::startByteCount() const
+{
+    return static_cast<size_t>(std::count(std::begin(this->m_startBytes), std::end(this->m_startBytes), true));
+}
+
+TriggerAutomaton::InstructionSet TriggerAutomaton::instructionSet() const
+{
+    return this->m_instructionSet;
+}
+
+bool TriggerAutomaton::isSupported(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+        case InstructionSet::Scalar:
+            return true;
+#if defined(TRIGGERAUTOMATON_X86)
+        case InstructionSet::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case InstructionSet::Ssse3:
+            return __builtin_cpu_supports("ssse3");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *TriggerAutomaton::instructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+        case InstructionSet::Best:
+            return "best";
+        case InstructionSet::Avx2:
+            return "avx2";
+        case InstructionSet::Ssse3:
+            return "ssse3";
+        case InstructionSet::Scalar:
+            return "scalar";
+    }
+    return "unknown";
+}
+
+void TriggerAutomaton::reportMatches(uint32_t row, size_t matchEnd, const MatchHandler &matchHandler) const
+{
+    uint32_t state{row / this->m_classCount};
+    for (uint32_t i = this->m_matchOffsets[state]; i < this->m_matchOffsets[state + 1]; i++) {
+        matchHandler(this->m_matchPatterns[i], matchEnd);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SERIALCOMMUNICATION_TRIGGERAUTOMATON_H
+#define SERIALCOMMUNICATION_TRIGGERAUTOMATON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Finds every occurrence of a set of byte strings in a stream at once: the
+ * patterns are compiled into an Aho-Corasick automaton whose failure links
+ * are resolved ahead of time, so each byte costs one table lookup whatever
+ * the number of patterns. Bytes that no pattern uses share one column of the
+ * table, which keeps it small enough to stay in cache. While the automaton
+ * sits in its start state, which is most of the time on a stream that rarely
+ * matches, the input is skipped a block at a time to the next byte that can
+ * begin a pattern, found with AVX2 or SSSE3 byte shuffles where the CPU has
+ * them. The state is handed back to the caller, so a match may straddle any
+ * number of reads. The automaton itself is never modified after it is built
+ * and may be shared between threads */
+class TriggerAutomaton
+{
+public:
+    /* The index of the pattern and the offset just past its last byte in the
+     * data being scanned; the pattern may have started in an earlier read */
+    using MatchHandler = std::function<void(size_t, size_t)>;
+
+    enum class InstructionSet {
+        Best,
+        Avx2,
+        Ssse3,
+        Scalar
+    };
+
+    explicit TriggerAutomaton(const std::vector<std::string> &patterns, InstructionSet instructionSet = InstructionSet::Best);
+    TriggerAutomaton(const TriggerAutomaton &) = delete;
+    TriggerAutomaton(TriggerAutomaton &&) = delete;
+    TriggerAutomaton &operator=(const TriggerAutomaton &) = delete;
+    TriggerAutomaton &operator=(TriggerAutomaton &&) = delete;
+
+    /* Continues from state (START_STATE for a new stream) and returns the
+     * state to continue the next read from. Patterns that end at the same
+     * byte are reported in the order they were given */
+    uint32_t scan(uint32_t state, const char *data, size_t length, const MatchHandler &matchHandler) const;
+
+    size_t patternCount() const;
+    size_t stateCount() const;
+    /* Distinct bytes that begin a pattern, what the prefilter looks for */
+    size_t startByteCount() const;
+    InstructionSet instructionSet() const;
+
+    static bool isSupported(InstructionSet instructionSet);
+    static const char *instructionSetName(InstructionSet instructionSet);
+
+    static const uint32_t START_STATE{0};
+
+private:
+    /* Bit sets of the bytes that begin a pattern, indexed by the low nibble
+     * of a byte: bit n stands for the high nibble n (bytes below 0x80) or
+     * n + 8 (from 0x80 up) */
+    struct StartByteTables
+    {
+        uint8_t lowNibbleHighClear[16];
+        uint8_t lowNibbleHighSet[16];
+    };
+
+    /* Returns bit i set for each of the PREFILTER_BLOCK_SIZE bytes from
+     * block that begins a pattern */
+    using PrefilterScanner = uint64_t (*)(const unsigned char *block, const uint8_t *lowNibbleHighClear, const uint8_t *lowNibbleHighSet);
+
+    InstructionSet m_instructionSet;
+    PrefilterScanner m_prefilterScanner;
+    size_t m_patternCount;
+    size_t m_stateCount;
+    uint32_t m_classCount;
+    uint32_t m_byteClasses[256];
+    bool m_startBytes[256];
+    StartByteTables m_startByteTables;
+    /* One row of m_classCount entries per state; an entry is the offset of
+     * the next state's row, with MATCH_FLAG set if that state ends a pattern */
+    std::vector<uint32_t> m_transitions;
+    /* The patterns a state ends, its own and those ending in a suffix of it,
+     * are m_matchPatterns[m_matchOffsets[state]] up to the next state's offset */
+    std::vector<uint32_t> m_matchOffsets;
+    std::vector<uint32_t> m_matchPatterns;
+
+    void reportMatches(uint32_t row, size_t matchEnd, const MatchHandler &matchHandler) const;
+
+    static const uint32_t MATCH_FLAG{0x80000000};
+    static const size_t PREFILTER_BLOCK_SIZE{64};
+};
+
+#endif //SERIALCOMMUNICATION_TRIGGERAUTOMATON_H
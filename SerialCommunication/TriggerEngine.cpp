@@ -0,0 +1,318 @@
+#include "TriggerEngine.h"
+#include "EventLoop.h"
+#include "GlobalDefinitions.h"
+#include "SerialSession.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using namespace TMessageLogger;
+
+const size_t TriggerEngine::MAXIMUM_RUNNING_HOOKS;
+const std::chrono::milliseconds TriggerEngine::HOOK_REAP_INTERVAL{100};
+
+static const char *TRIGGER_SEPARATOR{" => "};
+
+namespace {
+
+int hexDigitValue(char digit)
+{
+    if ( (digit >= '0') && (digit <= '9') ) {
+        return digit - '0';
+    }
+    digit = static_cast<char>(tolower(static_cast<unsigned char>(digit)));
+    if ( (digit >= 'a') && (digit <= 'f') ) {
+        return digit - 'a' + 10;
+    }
+    return -1;
+}
+
+/* \n, \r, \t, \\ and \xHH; anything else after a backslash is kept as it is */
+std::string unescape(const std::string &text)
+{
+    std::string unescaped{""};
+    for (size_t i = 0; i < text.size(); i++) {
+        if ( (text[i] != '\\') || (i + 1 == text.size()) ) {
+            unescaped.push_back(text[i]);
+            continue;
+        }
+        char escaped{text[++i]};
+        if (escaped == 'n') {
+            unescaped.push_back('\n');
+        } else if (escaped == 'r') {
+            unescaped.push_back('\r');
+        } else if (escaped == 't') {
+            unescaped.push_back('\t');
+        } else if (escaped == '\\') {
+            unescaped.push_back('\\');
+        } else if ( (escaped == 'x') && (i + 2 < text.size()) && (hexDigitValue(text[i + 1]) >= 0) && (hexDigitValue(text[i + 2]) >= 0) ) {
+            unescaped.push_back(static_cast<char>((hexDigitValue(text[i + 1]) << 4) | hexDigitValue(text[i + 2])));
+            i += 2;
+        } else {
+            unescaped.push_back('\\');
+            unescaped.push_back(escaped);
+        }
+    }
+    return unescaped;
+}
+
+} //Global namespace
+
+TriggerSet::TriggerSet(const std::vector<Trigger> &triggers, TriggerAutomaton::InstructionSet instructionSet) :
+    m_triggers{triggers},
+    m_automaton{patternsOf(triggers), instructionSet}
+{
+
+}
+
+const std::vector<Trigger> &TriggerSet::triggers() const
+{
+    return this->m_triggers;
+}
+
+const TriggerAutomaton &TriggerSet::automaton() const
+{
+    return this->m_automaton;
+}
+
+bool TriggerSet::usesAction(TriggerAction action) const
+{
+    return std::any_of(this->m_triggers.begin(), this->m_triggers.end(), [action](const Trigger &trigger) {
+        return trigger.action == action;
+    });
+}
+
+std::vector<Trigger> TriggerSet::load(const std::string &path)
+{
+    std::ifstream triggerFile{path};
+    if (!triggerFile.is_open()) {
+        throw std::runtime_error(TStringFormat(R"(Unable to open trigger file "{0}" ({1}))", path, strerror(errno)));
+    }
+    std::vector<Trigger> triggers{};
+    size_t lineNumber{0};
+    for (std::string line{""}; std::getline(triggerFile, line); ) {
+        lineNumber++;
+        if ( (!line.empty()) && (line.back() == '\r') ) {
+            line.pop_back();
+        }
+        if ( (line.empty()) || (line[0] == '#') ) {
+            continue;
+        }
+        try {
+            triggers.push_back(parse(line));
+        } catch (std::exception &e) {
+            throw std::runtime_error(TStringFormat("{0}:{1}: {2}", path, lineNumber, e.what()));
+        }
+    }
+    if (triggers.empty()) {
+        throw std::runtime_error(TStringFormat(R"(No triggers in "{0}")", path));
+    }
+    return triggers;
+}
+
+Trigger TriggerSet::parse(const std::string &definition)
+{
+    size_t separatorPosition{definition.find(TRIGGER_SEPARATOR)};
+    if (separatorPosition == std::string::npos) {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a trigger (expected "<pattern> => <action> [argument]"))", definition));
+    }
+    Trigger trigger{unescape(definition.substr(0, separatorPosition)), TriggerAction::Log, ""};
+    if (trigger.pattern.empty()) {
+        throw std::runtime_error(TStringFormat(R"(Trigger "{0}" has an empty pattern)", definition));
+    }
+    std::string actionText{definition.substr(separatorPosition + strlen(TRIGGER_SEPARATOR))};
+    size_t argumentPosition{actionText.find(' ')};
+    std::string actionName{actionText.substr(0, argumentPosition)};
+    std::transform(actionName.begin(), actionName.end(), actionName.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+    if (argumentPosition != std::string::npos) {
+        trigger.argument = unescape(actionText.substr(argumentPosition + 1));
+    }
+    if (actionName == "log") {
+        trigger.action = TriggerAction::Log;
+    } else if (actionName == "mark") {
+        trigger.action = TriggerAction::Mark;
+    } else if (actionName == "respond") {
+        trigger.action = TriggerAction::Respond;
+    } else if (actionName == "run") {
+        trigger.action = TriggerAction::Run;
+    } else {
+        throw std::runtime_error(TStringFormat(R"("{0}" is not a trigger action (expected log, mark, respond or run))", actionName));
+    }
+    if ( (trigger.argument.empty()) && ( (trigger.action == TriggerAction::Respond) || (trigger.action == TriggerAction::Run) ) ) {
+        throw std::runtime_error(TStringFormat(R"(Trigger "{0}" needs something to {1})", definition, actionName));
+    }
+    return trigger;
+}
+
+const char *TriggerSet::actionName(TriggerAction action)
+{
+    switch (action) {
+        case TriggerAction::Log:
+            return "log";
+        case TriggerAction::Mark:
+            return "mark";
+        case TriggerAction::Respond:
+            return "respond";
+        case TriggerAction::Run:
+            return "run";
+    }
+    return "unknown";
+}
+
+std::vector<std::string> TriggerSet::patternsOf(const std::vector<Trigger> &triggers)
+{
+    std::vector<std::string> patterns{};
+    patterns.reserve(triggers.size());
+    for (const auto &it : triggers) {
+        patterns.push_back(it.pattern);
+    }
+    return patterns;
+}
+
+TriggerEngine::TriggerEngine(SerialSession &serialSession, const std::shared_ptr<const TriggerSet> &triggerSet) :
+    m_serialSession(serialSession),
+    m_triggerSet{triggerSet},
+    m_matchHandler{},
+    m_state{TriggerAutomaton::START_STATE},
+    m_matchCount{0},
+    m_runningHooks{},
+    m_reapTimer{-1},
+    m_matchesMetric{},
+    m_skippedHooksMetric{}
+{
+    if (!this->m_triggerSet) {
+        throw std::runtime_error("A trigger engine needs a trigger set");
+    }
+    /* Built once, so a read costs no std::function construction */
+    this->m_matchHandler = [this](size_t triggerIndex, size_t) {
+        this->m_matchCount++;
+        this->m_matchesMetric.add();
+        this->fire(this->m_triggerSet->triggers()[triggerIndex]);
+    };
+    MetricsRegistry &metricsRegistry = MetricsRegistry::instance();
+    const std::string prefix{"port." + this->m_serialSession.portSettings().portName + "."};
+    this->m_matchesMetric = metricsRegistry.counter(prefix + "trigger_matches");
+    this->m_skippedHooksMetric = metricsRegistry.counter(prefix + "trigger_hooks_skipped");
+}
+
+TriggerEngine::~TriggerEngine()
+{
+    this->reapHooks();
+    if (this->m_reapTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_reapTimer);
+    }
+}
+
+void TriggerEngine::handleReceive(const char *data, size_t length)
+{
+    this->m_state = this->m_triggerSet->automaton().scan(this->m_state, data, length, this->m_matchHandler);
+}
+
+void TriggerEngine::reset()
+{
+    this->m_state = TriggerAutomaton::START_STATE;
+}
+
+uint64_t TriggerEngine::matchCount() const
+{
+    return this->m_matchCount;
+}
+
+size_t TriggerEngine::runningHookCount() const
+{
+    return this->m_runningHooks.size();
+}
+
+void TriggerEngine::fire(const Trigger &trigger)
+{
+    const std::string &label = trigger.argument.empty() ? trigger.pattern : trigger.argument;
+    switch (trigger.action) {
+        case TriggerAction::Log:
+            LOG_INFO(TRIGGER_LOG_SUBSYSTEM) << TStringFormat("{0}: {1}", this->m_serialSession.portSettings().portName, label);
+            break;
+        case TriggerAction::Mark:
+            this->m_serialSession.markCapture(label);
+            break;
+        case TriggerAction::Respond:
+            this->m_serialSession.sendLine(trigger.argument);
+            break;
+        case TriggerAction::Run:
+            this->runHook(trigger);
+            break;
+    }
+}
+
+void TriggerEngine::runHook(const Trigger &trigger)
+{
+    const std::string &portName = this->m_serialSession.portSettings().portName;
+    this->reapHooks();
+    if (this->m_runningHooks.size() >= MAXIMUM_RUNNING_HOOKS) {
+        this->m_skippedHooksMetric.add();
+        LOG_WARN(TRIGGER_LOG_SUBSYSTEM) << TStringFormat(R"(Not running "{0}" for {1}, {2} hooks are still running)", trigger.argument, portName, this->m_runningHooks.size());
+        return;
+    }
+    /* The hook is told which port and pattern started it, and gets no stdin:
+     * the console's input belongs to the ports */
+    std::vector<std::string> environment{"SERIAL_PORT=" + portName, "SERIAL_TRIGGER=" + trigger.pattern};
+    for (char **it = environ; (it) && (*it); it++) {
+        environment.emplace_back(*it);
+    }
+    std::vector<char *> environmentPointers{};
+    for (auto &it : environment) {
+        environmentPointers.push_back(&it[0]);
+    }
+    environmentPointers.push_back(nullptr);
+    std::string command{trigger.argument};
+    char shellName[]{"/bin/sh"};
+    char commandFlag[]{"-c"};
+    char *arguments[]{shellName, commandFlag, &command[0], nullptr};
+
+    posix_spawn_file_actions_t fileActions;
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_addopen(&fileActions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    pid_t hookId{-1};
+    int result{posix_spawn(&hookId, shellName, &fileActions, nullptr, arguments, environmentPointers.data())};
+    posix_spawn_file_actions_destroy(&fileActions);
+    if (result != 0) {
+        LOG_WARN(TRIGGER_LOG_SUBSYSTEM) << TStringFormat(R"(Unable to run "{0}" for {1} ({2}))", trigger.argument, portName, strerror(result));
+        return;
+    }
+    LOG_DEBUG(TRIGGER_LOG_SUBSYSTEM) << TStringFormat(R"(Running "{0}" for {1} as process {2})", trigger.argument, portName, hookId);
+    this->m_runningHooks.push_back(hookId);
+    if (this->m_reapTimer == -1) {
+        this->m_reapTimer = this->m_serialSession.eventLoop().addTimer(HOOK_REAP_INTERVAL, [this]() {
+            this->reapHooks();
+        });
+    }
+}
+
+void TriggerEngine::reapHooks()
+{
+    for (auto it = this->m_runningHooks.begin(); it != this->m_runningHooks.end(); ) {
+        int status{0};
+        pid_t result{waitpid(*it, &status, WNOHANG)};
+        if ( (result == 0) || ( (result == -1) && (errno == EINTR) ) ) {
+            ++it;
+            continue;
+        }
+        if ( (result == *it) && ( (!WIFEXITED(status)) || (WEXITSTATUS(status) != 0) ) ) {
+            LOG_WARN(TRIGGER_LOG_SUBSYSTEM) << TStringFormat("Hook process {0} for {1} failed (status {2})", *it, this->m_serialSession.portSettings().portName, status);
+        }
+        it = this->m_runningHooks.erase(it);
+    }
+    /* The timer goes once nothing is left to reap; removing it from its own
+     * handler is safe, the loop defers destroying handlers */
+    if ( (this->m_runningHooks.empty()) && (this->m_reapTimer != -1) ) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_reapTimer);
+        this->m_reapTimer = -1;
+    }
+}
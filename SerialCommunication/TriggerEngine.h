@@ -0,0 +1,108 @@
+#ifndef SERIALCOMMUNICATION_TRIGGERENGINE_H
+#define SERIALCOMMUNICATION_TRIGGERENGINE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "MetricsRegistry.h"
+#include "TriggerAutomaton.h"
+
+class SerialSession;
+
+enum class TriggerAction {
+    /* Logs the argument, or the pattern, under the trigger subsystem */
+    Log,
+    /* Writes a Marker record with the argument, or the pattern, to the capture */
+    Mark,
+    /* Sends the argument to the port as a line */
+    Respond,
+    /* Runs the argument with /bin/sh -c, without waiting for it */
+    Run
+};
+
+struct Trigger
+{
+    std::string pattern;
+    TriggerAction action;
+    std::string argument;
+};
+
+/* A list of triggers compiled into one TriggerAutomaton, pattern i being
+ * trigger i. Built once and shared, read only, by every port's engine */
+class TriggerSet
+{
+public:
+    explicit TriggerSet(const std::vector<Trigger> &triggers, TriggerAutomaton::InstructionSet instructionSet = TriggerAutomaton::InstructionSet::Best);
+    TriggerSet(const TriggerSet &) = delete;
+    TriggerSet(TriggerSet &&) = delete;
+    TriggerSet &operator=(const TriggerSet &) = delete;
+    TriggerSet &operator=(TriggerSet &&) = delete;
+
+    const std::vector<Trigger> &triggers() const;
+    const TriggerAutomaton &automaton() const;
+    bool usesAction(TriggerAction action) const;
+
+    /* One trigger per line, "<pattern> => <action> [argument]", skipping
+     * blank lines and lines starting with #. The pattern is taken as it is
+     * up to the " => ", apart from the escapes \n, \r, \t, \\ and \xHH,
+     * which the argument understands too */
+    static std::vector<Trigger> load(const std::string &path);
+    static Trigger parse(const std::string &definition);
+    static const char *actionName(TriggerAction action);
+
+private:
+    std::vector<Trigger> m_triggers;
+    TriggerAutomaton m_automaton;
+
+    static std::vector<std::string> patternsOf(const std::vector<Trigger> &triggers);
+};
+
+/* Watches one session's received data for a TriggerSet, on the session's
+ * loop thread, and fires the action of every trigger whose pattern turns
+ * up, however the pattern is split across reads. Hooks started by Run are
+ * reaped from a timer that only exists while any are running; past
+ * MAXIMUM_RUNNING_HOOKS at once further ones are skipped */
+class TriggerEngine
+{
+public:
+    TriggerEngine(SerialSession &serialSession, const std::shared_ptr<const TriggerSet> &triggerSet);
+    ~TriggerEngine();
+    TriggerEngine(const TriggerEngine &) = delete;
+    TriggerEngine(TriggerEngine &&) = delete;
+    TriggerEngine &operator=(const TriggerEngine &) = delete;
+    TriggerEngine &operator=(TriggerEngine &&) = delete;
+
+    void handleReceive(const char *data, size_t length);
+    /* Forgets a pattern the stream was part way through, for a port that
+     * was reopened */
+    void reset();
+
+    uint64_t matchCount() const;
+    size_t runningHookCount() const;
+
+    static const size_t MAXIMUM_RUNNING_HOOKS{16};
+    static const std::chrono::milliseconds HOOK_REAP_INTERVAL;
+
+private:
+    SerialSession &m_serialSession;
+    std::shared_ptr<const TriggerSet> m_triggerSet;
+    TriggerAutomaton::MatchHandler m_matchHandler;
+    uint32_t m_state;
+    uint64_t m_matchCount;
+    std::vector<pid_t> m_runningHooks;
+    int m_reapTimer;
+    MetricCounter m_matchesMetric;
+    MetricCounter m_skippedHooksMetric;
+
+    void fire(const Trigger &trigger);
+    void runHook(const Trigger &trigger);
+    void reapHooks();
+};
+
+#endif //SERIALCOMMUNICATION_TRIGGERENGINE_H
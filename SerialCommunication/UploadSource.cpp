@@ -0,0 +1,233 @@
+#include "UploadSource.h"
+#include "GlobalDefinitions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace TMessageLogger;
+
+/* The offset of a reader that has been removed, it holds nothing back */
+static const uint64_t REMOVED_READER{std::numeric_limits<uint64_t>::max()};
+
+const size_t UploadSource::BLOCK_SIZE;
+
+UploadSource::UploadSource(const std::string &path) :
+    m_path{path},
+    m_fileDescriptor{-1},
+    m_ownsDescriptor{false},
+    m_mappedData{nullptr},
+    m_mappedLength{0},
+    m_stopDescriptor{-1},
+    m_readerThread{},
+    m_dataHandlers{},
+    m_blockMutex{},
+    m_blocks{},
+    m_releasedBlockCount{0},
+    m_readerOffsets{},
+    m_availableBytes{0},
+    m_finished{false}
+{
+    if (this->m_path == "-") {
+        this->m_fileDescriptor = STDIN_FILENO;
+    } else {
+        this->m_fileDescriptor = open(this->m_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (this->m_fileDescriptor == -1) {
+            throw std::runtime_error(TStringFormat(R"(Unable to open "{0}" for sending ({1}))", this->m_path, strerror(errno)));
+        }
+        this->m_ownsDescriptor = true;
+    }
+    struct stat fileStatus{};
+    if ( (fstat(this->m_fileDescriptor, &fileStatus) == 0) && (S_ISREG(fileStatus.st_mode)) ) {
+        this->m_mappedLength = static_cast<size_t>(fileStatus.st_size);
+        if (this->m_mappedLength > 0) {
+            void *mapping{mmap(nullptr, this->m_mappedLength, PROT_READ, MAP_PRIVATE, this->m_fileDescriptor, 0)};
+            if (mapping == MAP_FAILED) {
+                int errorNumber{errno};
+                if (this->m_ownsDescriptor) {
+                    close(this->m_fileDescriptor);
+                }
+                throw std::runtime_error(TStringFormat(R"(Unable to map "{0}" ({1}))", this->m_path, strerror(errorNumber)));
+            }
+            madvise(mapping, this->m_mappedLength, MADV_SEQUENTIAL);
+            this->m_mappedData = static_cast<const char *>(mapping);
+        }
+        this->m_availableBytes.store(this->m_mappedLength);
+        this->m_finished.store(true);
+    }
+}
+
+UploadSource::~UploadSource()
+{
+    this->stop();
+    if (this->m_mappedData) {
+        munmap(const_cast<char *>(this->m_mappedData), this->m_mappedLength);
+    }
+    if (this->m_ownsDescriptor) {
+        close(this->m_fileDescriptor);
+    }
+}
+
+void UploadSource::addDataHandler(const DataHandler &dataHandler)
+{
+    this->m_dataHandlers.push_back(dataHandler);
+}
+
+void UploadSource::start()
+{
+    if ( (this->isMapped()) || (this->m_finished.load()) || (this->m_readerThread.joinable()) ) {
+        return;
+    }
+    this->m_stopDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->m_stopDescriptor == -1) {
+        throw std::runtime_error(TStringFormat("Unable to create upload stop descriptor ({0})", strerror(errno)));
+    }
+    this->m_blocks.emplace_back(new char[BLOCK_SIZE]);
+    this->m_readerThread = std::thread{[this]() { this->readSource(); }};
+}
+
+void UploadSource::stop()
+{
+    if (!this->m_readerThread.joinable()) {
+        return;
+    }
+    uint64_t increment{1};
+    ssize_t writeResult{write(this->m_stopDescriptor, &increment, sizeof(increment))};
+    (void)writeResult;
+    this->m_readerThread.join();
+    close(this->m_stopDescriptor);
+    this->m_stopDescriptor = -1;
+}
+
+size_t UploadSource::addReader()
+{
+    std::lock_guard<std::mutex> blockLock{this->m_blockMutex};
+    this->m_readerOffsets.push_back(0);
+    return this->m_readerOffsets.size() - 1;
+}
+
+void UploadSource::advanceReader(size_t reader, uint64_t offset)
+{
+    if (this->isMapped()) {
+        return;
+    }
+    std::lock_guard<std::mutex> blockLock{this->m_blockMutex};
+    uint64_t &readerOffset = this->m_readerOffsets[reader];
+    /* Only crossing into a new block can free one */
+    bool crossedBlock{offset / BLOCK_SIZE != readerOffset / BLOCK_SIZE};
+    readerOffset = offset;
+    if (crossedBlock) {
+        this->releaseBlocks();
+    }
+}
+
+void UploadSource::removeReader(size_t reader)
+{
+    std::lock_guard<std::mutex> blockLock{this->m_blockMutex};
+    this->m_readerOffsets[reader] = REMOVED_READER;
+    this->releaseBlocks();
+}
+
+size_t UploadSource::peek(uint64_t offset, const char **data) const
+{
+    uint64_t availableBytes{this->m_availableBytes.load(std::memory_order_acquire)};
+    if (offset >= availableBytes) {
+        return 0;
+    }
+    if (this->m_mappedData) {
+        *data = this->m_mappedData + offset;
+        return static_cast<size_t>(availableBytes - offset);
+    }
+    size_t blockOffset{static_cast<size_t>(offset % BLOCK_SIZE)};
+    {
+        std::lock_guard<std::mutex> blockLock{this->m_blockMutex};
+        size_t blockIndex{static_cast<size_t>(offset / BLOCK_SIZE - this->m_releasedBlockCount)};
+        *data = this->m_blocks[blockIndex].get() + blockOffset;
+    }
+    return static_cast<size_t>(std::min<uint64_t>(availableBytes - offset, BLOCK_SIZE - blockOffset));
+}
+
+bool UploadSource::isFinishedAt(uint64_t offset) const
+{
+    /* Finished is read first, so the byte count is final once it is seen */
+    bool finished{this->m_finished.load(std::memory_order_acquire)};
+    return (finished) && (offset >= this->m_availableBytes.load(std::memory_order_acquire));
+}
+
+const std::string &UploadSource::path() const
+{
+    return this->m_path;
+}
+
+bool UploadSource::isMapped() const
+{
+    return this->m_mappedData != nullptr;
+}
+
+void UploadSource::readSource()
+{
+    char *block{this->m_blocks.back().get()};
+    size_t blockFill{0};
+    pollfd pollDescriptors[2]{{this->m_fileDescriptor, POLLIN, 0}, {this->m_stopDescriptor, POLLIN, 0}};
+    while (true) {
+        if (poll(pollDescriptors, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat(R"(Waiting for "{0}" failed ({1}), sending stops here)", this->m_path, strerror(errno));
+            break;
+        }
+        if (pollDescriptors[1].revents != 0) {
+            return;
+        }
+        if (blockFill == BLOCK_SIZE) {
+            std::lock_guard<std::mutex> blockLock{this->m_blockMutex};
+            /* With every reader gone, nothing else would free the blocks */
+            this->releaseBlocks();
+            this->m_blocks.emplace_back(new char[BLOCK_SIZE]);
+            block = this->m_blocks.back().get();
+            blockFill = 0;
+        }
+        ssize_t bytesRead{read(this->m_fileDescriptor, block + blockFill, BLOCK_SIZE - blockFill)};
+        if (bytesRead > 0) {
+            blockFill += static_cast<size_t>(bytesRead);
+            this->m_availableBytes.fetch_add(static_cast<uint64_t>(bytesRead), std::memory_order_release);
+            this->notifyDataHandlers();
+        } else if (bytesRead == 0) {
+            break;
+        } else if ( (errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK) ) {
+            LOG_WARN(SESSION_LOG_SUBSYSTEM) << TStringFormat(R"(Reading "{0}" failed ({1}), sending stops here)", this->m_path, strerror(errno));
+            break;
+        }
+    }
+    this->m_finished.store(true, std::memory_order_release);
+    this->notifyDataHandlers();
+}
+
+void UploadSource::notifyDataHandlers()
+{
+    for (const auto &it : this->m_dataHandlers) {
+        it();
+    }
+}
+
+void UploadSource::releaseBlocks()
+{
+    /* Called with the block mutex held. The last block is the one being
+     * filled, the reader thread keeps writing into it */
+    uint64_t slowestOffset{REMOVED_READER};
+    for (const auto &it : this->m_readerOffsets) {
+        slowestOffset = std::min(slowestOffset, it);
+    }
+    while ( (this->m_blocks.size() > 1) && ( (this->m_releasedBlockCount + 1) * BLOCK_SIZE <= slowestOffset) ) {
+        this->m_blocks.pop_front();
+        this->m_releasedBlockCount++;
+    }
+}
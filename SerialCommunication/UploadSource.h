@@ -0,0 +1,79 @@
+#ifndef SERIALCOMMUNICATION_UPLOADSOURCE_H
+#define SERIALCOMMUNICATION_UPLOADSOURCE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* The data behind --send, shared read-only by the uploads to every port.
+ * A regular file is mapped whole, so uploads write straight from the page
+ * cache. Anything else (stdin, a pipe, a FIFO) is read on a background
+ * thread with large sequential reads into fixed blocks that are never moved
+ * once written, so uploads can write straight from those as they fill. Every
+ * port sends from its own position, so each upload registers as a reader and
+ * a block is freed once the slowest reader has moved past it */
+class UploadSource
+{
+public:
+    using DataHandler = std::function<void()>;
+
+    /* "-" is stdin */
+    explicit UploadSource(const std::string &path);
+    ~UploadSource();
+    UploadSource(const UploadSource &) = delete;
+    UploadSource(UploadSource &&) = delete;
+    UploadSource &operator=(const UploadSource &) = delete;
+    UploadSource &operator=(UploadSource &&) = delete;
+
+    /* Runs on the reader thread after every read and at the end of the
+     * source; add all handlers before start() */
+    void addDataHandler(const DataHandler &dataHandler);
+    void start();
+    void stop();
+
+    /* Readers start at offset 0 and hold back the blocks they have not
+     * passed yet; add them before start(), so that none is freed too early,
+     * and remove them once they are done. Safe from any thread */
+    size_t addReader();
+    void advanceReader(size_t reader, uint64_t offset);
+    void removeReader(size_t reader);
+
+    /* Points data at the bytes available from offset and returns how many
+     * are contiguous there, 0 when none are yet. Safe from any thread */
+    size_t peek(uint64_t offset, const char **data) const;
+    /* True once offset has reached the end of a source that has ended */
+    bool isFinishedAt(uint64_t offset) const;
+
+    const std::string &path() const;
+    bool isMapped() const;
+
+    static const size_t BLOCK_SIZE{1024 * 1024};
+
+private:
+    std::string m_path;
+    int m_fileDescriptor;
+    bool m_ownsDescriptor;
+    const char *m_mappedData;
+    size_t m_mappedLength;
+    int m_stopDescriptor;
+    std::thread m_readerThread;
+    std::vector<DataHandler> m_dataHandlers;
+    mutable std::mutex m_blockMutex;
+    std::deque<std::unique_ptr<char[]>> m_blocks;
+    uint64_t m_releasedBlockCount;
+    std::vector<uint64_t> m_readerOffsets;
+    std::atomic<uint64_t> m_availableBytes;
+    std::atomic<bool> m_finished;
+
+    void readSource();
+    void notifyDataHandlers();
+    void releaseBlocks();
+};
+
+#endif //SERIALCOMMUNICATION_UPLOADSOURCE_H
@@ -0,0 +1,226 @@
+#include "Uploader.h"
+#include "EventLoop.h"
+#include "GlobalDefinitions.h"
+#include "PortChannel.h"
+#include "PortSettingsLookup.h"
+#include "SerialSession.h"
+#include "UploadSource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/ioctl.h>
+
+using namespace TMessageLogger;
+
+/* Upper bound on one write(); the kernel takes far less than this at a
+ * time anyway, it only keeps a huge mapped file from being offered whole */
+static const size_t MAXIMUM_WRITE_SIZE{1024 * 1024};
+
+/* How often a finished upload checks whether the port's output queue has
+ * drained, so the reported rate covers the bytes actually sent */
+static const std::chrono::milliseconds DRAIN_POLL_INTERVAL{1};
+
+Uploader::Uploader(SerialSession &serialSession, const std::shared_ptr<UploadSource> &uploadSource, size_t reader, const UploadPacing &pacing) :
+    m_serialSession(serialSession),
+    m_uploadSource{uploadSource},
+    m_reader{reader},
+    m_pacing(pacing),
+    m_finishedHandler{},
+    m_offset{0},
+    m_started{false},
+    m_finished{false},
+    m_waitingForWritable{false},
+    m_waitingForDeadline{false},
+    m_pacingTimer{-1},
+    m_startTime{},
+    m_nextDeadline{},
+    m_latenessMetric{}
+{
+    this->m_latenessMetric = MetricsRegistry::instance().histogram("port." + this->m_serialSession.portSettings().portName + ".upload_pacing_lateness_ns");
+}
+
+Uploader::~Uploader()
+{
+    this->m_serialSession.setWritableHandler(nullptr);
+    if (this->m_pacingTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_pacingTimer);
+    }
+    this->m_uploadSource->removeReader(this->m_reader);
+}
+
+void Uploader::setFinishedHandler(const FinishedHandler &finishedHandler)
+{
+    this->m_finishedHandler = finishedHandler;
+}
+
+void Uploader::start()
+{
+    if (this->m_started) {
+        return;
+    }
+    this->m_started = true;
+    this->m_startTime = std::chrono::steady_clock::now();
+    this->m_nextDeadline = this->m_startTime;
+    this->m_serialSession.setWritableHandler([this]() {
+        this->m_waitingForWritable = false;
+        this->pump();
+    });
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Sending {0} to {1}", this->m_uploadSource->path(), this->m_serialSession.portSettings().portName);
+    this->pump();
+}
+
+void Uploader::resume()
+{
+    if ( (this->m_started) && (!this->m_finished) ) {
+        this->pump();
+    }
+}
+
+bool Uploader::isFinished() const
+{
+    return this->m_finished;
+}
+
+uint64_t Uploader::bytesSent() const
+{
+    return this->m_offset;
+}
+
+void Uploader::pump()
+{
+    const bool bytePaced{this->m_pacing.byteDelay.count() > 0};
+    const bool linePaced{this->m_pacing.lineDelay.count() > 0};
+    while ( (!this->m_finished) && (!this->m_waitingForWritable) && (!this->m_waitingForDeadline) ) {
+        if (!this->m_serialSession.isOpen()) {
+            /* A port that is coming back picks up where it left off, the
+             * session runs the writable handler once it is reopened */
+            if (this->m_serialSession.isAwaitingReconnect()) {
+                this->m_waitingForWritable = true;
+                return;
+            }
+            this->finish();
+            return;
+        }
+        const char *data{nullptr};
+        size_t length{std::min(this->m_uploadSource->peek(this->m_offset, &data), MAXIMUM_WRITE_SIZE)};
+        if (length == 0) {
+            /* Otherwise the source's data handler resumes the upload */
+            if (this->m_uploadSource->isFinishedAt(this->m_offset)) {
+                this->finish();
+            }
+            return;
+        }
+        if (bytePaced) {
+            length = 1;
+        } else if (linePaced) {
+            const char *lineEnd{static_cast<const char *>(memchr(data, '\n', length))};
+            if (lineEnd) {
+                length = static_cast<size_t>(lineEnd - data) + 1;
+            }
+        }
+        size_t written{this->m_serialSession.sendSome(data, length)};
+        this->m_offset += written;
+        this->m_uploadSource->advanceReader(this->m_reader, this->m_offset);
+        if (written < length) {
+            this->m_waitingForWritable = true;
+            return;
+        }
+        bool endOfLine{data[length - 1] == '\n'};
+        if ( (bytePaced) || ( (linePaced) && (endOfLine) ) ) {
+            this->scheduleNext(linePaced && endOfLine);
+        }
+    }
+}
+
+void Uploader::scheduleNext(bool endOfLine)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (this->m_pacing.byteDelay.count() > 0) {
+        /* Byte deadlines follow on from each other; after a stall longer
+         * than one interval (flow control, a full output buffer) they start
+         * again from now instead of bursting to catch up */
+        this->m_nextDeadline += this->m_pacing.byteDelay;
+        if (this->m_nextDeadline + this->m_pacing.byteDelay < now) {
+            this->m_nextDeadline = now;
+        }
+    } else {
+        this->m_nextDeadline = now;
+    }
+    if (endOfLine) {
+        this->m_nextDeadline += this->m_pacing.lineDelay;
+    }
+    if (this->m_nextDeadline <= now) {
+        this->m_latenessMetric.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->m_nextDeadline).count()));
+        return;
+    }
+    this->m_waitingForDeadline = true;
+    if (this->m_pacingTimer == -1) {
+        this->m_pacingTimer = this->m_serialSession.eventLoop().addTimer(this->m_nextDeadline - now, [this]() { this->onDeadline(); }, false);
+    } else {
+        this->m_serialSession.eventLoop().rearmTimer(this->m_pacingTimer, this->m_nextDeadline);
+    }
+}
+
+void Uploader::onDeadline()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (this->m_finished) {
+        this->finish();
+        return;
+    }
+    this->m_latenessMetric.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->m_nextDeadline).count()));
+    this->m_waitingForDeadline = false;
+    this->pump();
+}
+
+void Uploader::finish()
+{
+    this->m_finished = true;
+    this->m_uploadSource->removeReader(this->m_reader);
+    /* The last bytes may still sit in the kernel's output queue; the upload
+     * only counts as done once they have gone out on the line */
+    int queuedBytes{0};
+    PortChannel *channel{this->m_serialSession.channel()};
+    if ( (this->m_serialSession.isOpen()) && (channel) && (ioctl(channel->fileDescriptor(), TIOCOUTQ, &queuedBytes) == 0) && (queuedBytes > 0) ) {
+        auto deadline = std::chrono::steady_clock::now() + DRAIN_POLL_INTERVAL;
+        if (this->m_pacingTimer == -1) {
+            this->m_pacingTimer = this->m_serialSession.eventLoop().addTimer(DRAIN_POLL_INTERVAL, [this]() { this->onDeadline(); }, false);
+        } else {
+            this->m_serialSession.eventLoop().rearmTimer(this->m_pacingTimer, deadline);
+        }
+        return;
+    }
+    if (this->m_pacingTimer != -1) {
+        this->m_serialSession.eventLoop().removeTimer(this->m_pacingTimer);
+        this->m_pacingTimer = -1;
+    }
+    this->logSummary();
+    if (this->m_finishedHandler) {
+        this->m_finishedHandler(*this);
+    }
+}
+
+void Uploader::logSummary() const
+{
+    const PortSettings &portSettings = this->m_serialSession.portSettings();
+    double seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - this->m_startTime).count()};
+    double bytesPerSecond{(seconds > 0.0) ? static_cast<double>(this->m_offset) / seconds : 0.0};
+    double lineRate{characterRate(portSettings)};
+    LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Sent {0} bytes of {1} to {2} in {3} s, {4} bytes/s ({5}% of the {6} bytes/s line rate)",
+                                                     this->m_offset,
+                                                     this->m_uploadSource->path(),
+                                                     portSettings.portName,
+                                                     seconds,
+                                                     static_cast<uint64_t>(bytesPerSecond),
+                                                     static_cast<uint64_t>(100.0 * bytesPerSecond / lineRate + 0.5),
+                                                     static_cast<uint64_t>(lineRate));
+    HistogramSummary lateness{MetricsRegistry::instance().summary(this->m_latenessMetric)};
+    if (lateness.count > 0) {
+        LOG_INFO(SESSION_LOG_SUBSYSTEM) << TStringFormat("Pacing on {0}: {1} deadlines, late by p50 {2} us, p99 {3} us, max {4} us",
+                                                         portSettings.portName,
+                                                         lateness.count,
+                                                         lateness.p50 / 1000,
+                                                         lateness.p99 / 1000,
+                                                         lateness.maximum / 1000);
+    }
+}
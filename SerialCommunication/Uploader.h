@@ -0,0 +1,74 @@
+#ifndef SERIALCOMMUNICATION_UPLOADER_H
+#define SERIALCOMMUNICATION_UPLOADER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "MetricsRegistry.h"
+
+class SerialSession;
+class UploadSource;
+
+/* Zero delays send as fast as the port takes the data */
+struct UploadPacing
+{
+    std::chrono::microseconds byteDelay;
+    std::chrono::milliseconds lineDelay;
+};
+
+/* Streams an UploadSource to one session, on the session's loop thread.
+ * Unpaced, every write() hands the port as much of the source as it will
+ * take, straight from the source's memory, and the upload then waits for
+ * the port to become writable again, so the kernel's output buffer never
+ * runs dry and flow control simply pauses the upload. Paced, bytes or whole
+ * lines are released at deadlines computed from the start of the upload
+ * rather than from the previous send, and how late each deadline was served
+ * is recorded in a port.<name>.upload_pacing_lateness_ns histogram */
+class Uploader
+{
+public:
+    using FinishedHandler = std::function<void(Uploader &)>;
+
+    /* reader comes from uploadSource->addReader(), the upload advances and
+     * removes it */
+    Uploader(SerialSession &serialSession, const std::shared_ptr<UploadSource> &uploadSource, size_t reader, const UploadPacing &pacing);
+    ~Uploader();
+    Uploader(const Uploader &) = delete;
+    Uploader(Uploader &&) = delete;
+    Uploader &operator=(const Uploader &) = delete;
+    Uploader &operator=(Uploader &&) = delete;
+
+    void setFinishedHandler(const FinishedHandler &finishedHandler);
+    void start();
+    /* Picks up data that arrived since the upload last ran dry */
+    void resume();
+
+    bool isFinished() const;
+    uint64_t bytesSent() const;
+
+private:
+    SerialSession &m_serialSession;
+    std::shared_ptr<UploadSource> m_uploadSource;
+    size_t m_reader;
+    UploadPacing m_pacing;
+    FinishedHandler m_finishedHandler;
+    uint64_t m_offset;
+    bool m_started;
+    bool m_finished;
+    bool m_waitingForWritable;
+    bool m_waitingForDeadline;
+    int m_pacingTimer;
+    std::chrono::steady_clock::time_point m_startTime;
+    std::chrono::steady_clock::time_point m_nextDeadline;
+    MetricHistogram m_latenessMetric;
+
+    void pump();
+    void scheduleNext(bool endOfLine);
+    void onDeadline();
+    void finish();
+    void logSummary() const;
+};
+
+#endif //SERIALCOMMUNICATION_UPLOADER_H
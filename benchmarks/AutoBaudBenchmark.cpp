@@ -0,0 +1,374 @@
+/* Checks --auto against devices with known settings, one pseudo-terminal
+ * each. Behind every master a device model sends text lines as a bit
+ * stream at its own baud rate, data bits, parity and stop bits, and a UART
+ * model reads that stream the way the slave side is set at that moment
+ * (following the detector from rate to rate), so what reaches the slave is
+ * what a real port would have received: wrong rates and framings turn into
+ * garbage and, with INPCK set, NULs for framing errors. Detects each device
+ * on its own, reporting the time it took and the score, then all of them at
+ * once through SessionManager::detectLineSettings(), against a target of
+ * 2 s for the slowest port. Exits with a failure status if any device is
+ * detected with the wrong settings or the target is missed */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "LineSettingsDetector.h"
+#include "MessageLogger.h"
+#include "PortSettingsLookup.h"
+#include "SessionManager.h"
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+const std::chrono::milliseconds DEVICE_TICK{1};
+const double TARGET_MILLISECONDS{2000.0};
+
+struct DeviceSettings
+{
+    BaudRate baudRate;
+    uint32_t bitsPerSecond;
+    DataBits dataBits;
+    Parity parity;
+    StopBits stopBits;
+};
+
+const DeviceSettings DEVICES[] {
+        {BaudRate::BAUD9600, 9600, DataBits::EIGHT, Parity::NONE, StopBits::ONE},
+        {BaudRate::BAUD115200, 115200, DataBits::EIGHT, Parity::NONE, StopBits::ONE},
+        {BaudRate::BAUD19200, 19200, DataBits::SEVEN, Parity::EVEN, StopBits::ONE},
+        {BaudRate::BAUD57600, 57600, DataBits::EIGHT, Parity::ODD, StopBits::ONE},
+        {BaudRate::BAUD2400, 2400, DataBits::SEVEN, Parity::ODD, StopBits::ONE},
+        {BaudRate::BAUD921600, 921600, DataBits::EIGHT, Parity::EVEN, StopBits::ONE},
+        {BaudRate::BAUD38400, 38400, DataBits::SEVEN, Parity::NONE, StopBits::TWO},
+        {BaudRate::BAUD1000000, 1000000, DataBits::EIGHT, Parity::NONE, StopBits::ONE},
+        {BaudRate::BAUD4800, 4800, DataBits::EIGHT, Parity::EVEN, StopBits::ONE}
+};
+
+std::string settingsSummary(BaudRate baudRate, DataBits dataBits, Parity parity, StopBits stopBits)
+{
+    static const char DATA_BITS[]{'5', '6', '7', '8'};
+    static const char PARITY[]{'N', 'E', 'O'};
+    std::string summary{baudRateToString(baudRate)};
+    summary.push_back(' ');
+    summary.push_back(DATA_BITS[static_cast<int>(dataBits)]);
+    summary.push_back(PARITY[static_cast<int>(parity)]);
+    summary.push_back((stopBits == StopBits::ONE) ? '1' : '2');
+    return summary;
+}
+
+uint32_t bitsPerSecond(speed_t speed)
+{
+    static const std::pair<speed_t, uint32_t> SPEEDS[] {
+            {B50, 50}, {B75, 75}, {B110, 110}, {B134, 134}, {B150, 150}, {B200, 200}, {B300, 300}, {B600, 600},
+            {B1200, 1200}, {B1800, 1800}, {B2400, 2400}, {B4800, 4800}, {B9600, 9600}, {B19200, 19200},
+            {B38400, 38400}, {B57600, 57600}, {B115200, 115200}, {B230400, 230400}, {B460800, 460800},
+            {B500000, 500000}, {B576000, 576000}, {B921600, 921600}, {B1000000, 1000000}, {B1152000, 1152000},
+            {B1500000, 1500000}, {B2000000, 2000000}, {B2500000, 2500000}, {B3000000, 3000000},
+            {B3500000, 3500000}, {B4000000, 4000000}
+    };
+    for (const auto &it : SPEEDS) {
+        if (it.first == speed) {
+            return it.second;
+        }
+    }
+    return 9600;
+}
+
+int characterSize(tcflag_t controlFlags)
+{
+    switch (controlFlags & CSIZE) {
+        case CS5:
+            return 5;
+        case CS6:
+            return 6;
+        case CS7:
+            return 7;
+        default:
+            return 8;
+    }
+}
+
+/* A device sending lines back to back at its settings, and the UART on
+ * the other end of the wire reading them at whatever the slave side of the
+ * pseudo-terminal is set to, both run against the wall clock */
+class DeviceModel
+{
+public:
+    DeviceModel(const DeviceSettings &deviceSettings, uint32_t seed) :
+        m_deviceSettings(deviceSettings),
+        m_master{-1},
+        m_slave{-1},
+        m_slaveName{""},
+        m_bits{},
+        m_firstBit{0},
+        m_lineNumber{seed},
+        m_receiverTime{0.0},
+        m_stopRequested{false},
+        m_thread{}
+    {
+        char slaveName[256]{};
+        if (openpty(&this->m_master, &this->m_slave, slaveName, nullptr, nullptr) == -1) {
+            throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+        }
+        fcntl(this->m_master, F_SETFL, fcntl(this->m_master, F_GETFL) | O_NONBLOCK);
+        this->m_slaveName = slaveName;
+    }
+
+    ~DeviceModel()
+    {
+        this->stop();
+        close(this->m_slave);
+        close(this->m_master);
+    }
+
+    void start()
+    {
+        this->m_thread = std::thread{[this]() {
+            this->run();
+        }};
+    }
+
+    void stop()
+    {
+        this->m_stopRequested.store(true);
+        if (this->m_thread.joinable()) {
+            this->m_thread.join();
+        }
+    }
+
+    const std::string &slaveName() const
+    {
+        return this->m_slaveName;
+    }
+
+private:
+    DeviceSettings m_deviceSettings;
+    int m_master;
+    int m_slave;
+    std::string m_slaveName;
+    /* The line level for every bit time from m_firstBit on */
+    std::deque<uint8_t> m_bits;
+    uint64_t m_firstBit;
+    uint32_t m_lineNumber;
+    double m_receiverTime;
+    std::atomic<bool> m_stopRequested;
+    std::thread m_thread;
+
+    void appendLine()
+    {
+        std::string line{TStringFormat("seq={0} temp={1}.{2} rh={3} status=OK\r\n", this->m_lineNumber, 18 + (this->m_lineNumber % 9),
+                                       this->m_lineNumber % 100, 30 + (this->m_lineNumber % 40))};
+        this->m_lineNumber++;
+        int dataBits{(this->m_deviceSettings.dataBits == DataBits::SEVEN) ? 7 : 8};
+        for (char character : line) {
+            uint8_t ones{0};
+            this->m_bits.push_back(0);
+            for (int i = 0; i < dataBits; i++) {
+                uint8_t bit{static_cast<uint8_t>((character >> i) & 1)};
+                ones += bit;
+                this->m_bits.push_back(bit);
+            }
+            if (this->m_deviceSettings.parity != Parity::NONE) {
+                this->m_bits.push_back(static_cast<uint8_t>((this->m_deviceSettings.parity == Parity::EVEN) ? (ones & 1) : !(ones & 1)));
+            }
+            this->m_bits.push_back(1);
+            if (this->m_deviceSettings.stopBits == StopBits::TWO) {
+                this->m_bits.push_back(1);
+            }
+        }
+        /* A little idle time between lines */
+        this->m_bits.insert(this->m_bits.end(), this->m_lineNumber % 5, 1);
+    }
+
+    uint8_t bitAt(uint64_t index)
+    {
+        if (index < this->m_firstBit) {
+            return 1;
+        }
+        while (index - this->m_firstBit >= this->m_bits.size()) {
+            this->appendLine();
+        }
+        return this->m_bits[static_cast<size_t>(index - this->m_firstBit)];
+    }
+
+    uint8_t levelAt(double time)
+    {
+        return this->bitAt(static_cast<uint64_t>(time * this->m_deviceSettings.bitsPerSecond));
+    }
+
+    /* Receives every character whose last bit is sampled before now */
+    void receiveUntil(double now, std::string &received)
+    {
+        termios settings{};
+        if (tcgetattr(this->m_master, &settings) == -1) {
+            return;
+        }
+        double receiverRate{static_cast<double>(bitsPerSecond(cfgetispeed(&settings)))};
+        int dataBits{characterSize(settings.c_cflag)};
+        bool parityEnabled{(settings.c_cflag & PARENB) != 0};
+        bool oddParity{(settings.c_cflag & PARODD) != 0};
+        bool inputChecked{(settings.c_iflag & INPCK) != 0};
+        bool parityChecked{(parityEnabled) && (inputChecked)};
+        double deviceRate{static_cast<double>(this->m_deviceSettings.bitsPerSecond)};
+        while (true) {
+            /* Idle until the line falls */
+            uint64_t edgeBit{static_cast<uint64_t>(this->m_receiverTime * deviceRate) + 1};
+            while ( (static_cast<double>(edgeBit) / deviceRate <= now) && ( (this->bitAt(edgeBit) != 0) || (this->bitAt(edgeBit - 1) != 1) ) ) {
+                edgeBit++;
+            }
+            double edgeTime{static_cast<double>(edgeBit) / deviceRate};
+            int frameBits{1 + dataBits + static_cast<int>(parityEnabled) + 1};
+            double stopTime{edgeTime + ((frameBits - 0.5) / receiverRate)};
+            if (stopTime > now) {
+                return;
+            }
+            if (this->levelAt(edgeTime + (0.5 / receiverRate)) != 0) {
+                this->m_receiverTime = edgeTime + (0.5 / receiverRate);
+                continue;
+            }
+            int character{0};
+            int ones{0};
+            for (int i = 0; i < dataBits; i++) {
+                int bit{this->levelAt(edgeTime + ((1.5 + i) / receiverRate))};
+                character |= bit << i;
+                ones += bit;
+            }
+            bool parityError{false};
+            if (parityEnabled) {
+                int parityBit{this->levelAt(edgeTime + ((1.5 + dataBits) / receiverRate))};
+                parityError = (parityChecked) && ( ((ones + parityBit) & 1) != static_cast<int>(oddParity) );
+            }
+            bool framingError{(inputChecked) && (this->levelAt(stopTime) == 0)};
+            /* As the tty layer hands over a bad character without IGNPAR or
+             * PARMRK; like the serial core, framing errors are only flagged
+             * with INPCK, otherwise the raw byte comes through */
+            received.push_back( (framingError || parityError) ? '\0' : static_cast<char>(character) );
+            this->m_receiverTime = stopTime;
+        }
+    }
+
+    void run()
+    {
+        auto started = std::chrono::steady_clock::now();
+        std::string received{""};
+        while (!this->m_stopRequested.load()) {
+            std::this_thread::sleep_for(DEVICE_TICK);
+            double now{std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count()};
+            received.clear();
+            this->receiveUntil(now, received);
+            if (!received.empty()) {
+                /* Like a UART's FIFO, what the reader is not taking is lost */
+                ssize_t written{write(this->m_master, received.data(), received.size())};
+                (void)written;
+            }
+            uint64_t consumedBits{static_cast<uint64_t>(this->m_receiverTime * this->m_deviceSettings.bitsPerSecond)};
+            while ( (this->m_firstBit + 16 < consumedBits) && (!this->m_bits.empty()) ) {
+                this->m_bits.pop_front();
+                this->m_firstBit++;
+            }
+        }
+    }
+};
+
+bool matches(const DeviceSettings &deviceSettings, BaudRate baudRate, DataBits dataBits, Parity parity, StopBits stopBits)
+{
+    /* Two stop bits only show as one more idle bit, and one stop bit with
+     * gaps between characters is read the same, so they are not told apart
+     * except for 7N2, where the second one stands in for the eighth bit */
+    bool stopBitsMatch{(deviceSettings.dataBits != DataBits::SEVEN) || (deviceSettings.parity != Parity::NONE) || (stopBits == deviceSettings.stopBits)};
+    return (baudRate == deviceSettings.baudRate) && (dataBits == deviceSettings.dataBits) && (parity == deviceSettings.parity) && (stopBitsMatch);
+}
+
+} //Global namespace
+
+int main()
+{
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Warn);
+
+    uint64_t errors{0};
+    double slowestMilliseconds{0.0};
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"AutoBaud\"," << std::endl;
+    std::cout << "  \"devices\": [" << std::endl;
+    size_t deviceCount{sizeof(DEVICES) / sizeof(DEVICES[0])};
+    for (size_t i = 0; i < deviceCount; i++) {
+        const DeviceSettings &deviceSettings = DEVICES[i];
+        DeviceModel deviceModel{deviceSettings, static_cast<uint32_t>(i * 1000)};
+        deviceModel.start();
+        auto started = std::chrono::steady_clock::now();
+        LineSettingsScore detected{};
+        {
+            LineSettingsDetector lineSettingsDetector{deviceModel.slaveName()};
+            detected = lineSettingsDetector.detect();
+        }
+        double milliseconds{std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count()};
+        deviceModel.stop();
+        bool correct{(LineSettingsDetector::isConfident(detected)) && (matches(deviceSettings, detected.baudRate, detected.dataBits, detected.parity, detected.stopBits))};
+        errors += !correct;
+        slowestMilliseconds = std::max(slowestMilliseconds, milliseconds);
+        std::cout << "    {\"settings\": \"" << settingsSummary(deviceSettings.baudRate, deviceSettings.dataBits, deviceSettings.parity, deviceSettings.stopBits)
+                  << "\", \"detected\": \"" << settingsSummary(detected.baudRate, detected.dataBits, detected.parity, detected.stopBits)
+                  << "\", \"correct\": " << (correct ? "true" : "false")
+                  << ", \"score\": " << detected.score
+                  << ", \"characters\": " << detected.characters
+                  << ", \"milliseconds\": " << milliseconds << "}"
+                  << ((i + 1 == deviceCount) ? "" : ",") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+
+    /* Every device at once, the way --auto runs */
+    std::vector<std::unique_ptr<DeviceModel>> deviceModels{};
+    SessionManager sessionManager{1};
+    for (size_t i = 0; i < deviceCount; i++) {
+        deviceModels.emplace_back(new DeviceModel{DEVICES[i], static_cast<uint32_t>(i * 1000)});
+        deviceModels.back()->start();
+        sessionManager.addSession(PortSettings{deviceModels.back()->slaveName(), BaudRate::BAUD9600, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None});
+    }
+    auto started = std::chrono::steady_clock::now();
+    sessionManager.detectLineSettings();
+    double parallelMilliseconds{std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count()};
+    for (auto &it : deviceModels) {
+        it->stop();
+    }
+    size_t parallelCorrect{0};
+    for (size_t i = 0; i < deviceCount; i++) {
+        const PortSettings &portSettings = sessionManager.portSettings()[i];
+        parallelCorrect += matches(DEVICES[i], portSettings.baudRate, portSettings.dataBits, portSettings.parity, portSettings.stopBits);
+    }
+    errors += deviceCount - parallelCorrect;
+    std::cout << "  \"parallel\": {\"ports\": " << deviceCount << ", \"correct\": " << parallelCorrect << ", \"milliseconds\": " << parallelMilliseconds << "}," << std::endl;
+    bool targetMet{(slowestMilliseconds < TARGET_MILLISECONDS) && (parallelMilliseconds < TARGET_MILLISECONDS)};
+    std::cout << "  \"target_ms\": " << TARGET_MILLISECONDS
+              << ", \"target_met\": " << (targetMet ? "true" : "false") << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (errors != 0) {
+        std::cerr << errors << " device(s) were detected with the wrong settings" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!targetMet) {
+        std::cerr << "Detection took longer than " << TARGET_MILLISECONDS << " ms" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/* Compares the text log file with the binary log format (--log-format
+ * binary) on a mix of records shaped like the ones this program logs: the
+ * bytes each format writes per record, and the cost of GlobalLogSink
+ * append() plus commit() per record with the console disabled, committing
+ * in batches the way AsyncLogHandler drains, in the fastest of a few
+ * rounds. Then decodes the binary log with BinaryLogReader, reporting
+ * decode throughput. Exits with a failure status unless the decoded text
+ * matches the text log exactly and the binary log is at least
+ * SIZE_RATIO_TARGET times smaller and WRITE_COST_RATIO_TARGET times cheaper
+ * to write */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "ApplicationUtilities.h"
+#include "BinaryLogReader.h"
+#include "BinaryLogWriter.h"
+#include "LogFile.h"
+#include "MessageLogger.h"
+#include "TimestampFormatter.h"
+
+using namespace TMessageLogger;
+
+namespace {
+
+const size_t BATCH_SIZE{64};
+const size_t ROUNDS{3};
+const double SIZE_RATIO_TARGET{4.0};
+const double WRITE_COST_RATIO_TARGET{2.0};
+
+struct SampleRecord
+{
+    LogLevel logLevel;
+    LogContext logContext;
+    std::string message;
+};
+
+std::vector<SampleRecord> makeSampleRecords(size_t count)
+{
+    const LogContext contexts[]{
+        {"SerialCommunication/SessionManager.cpp", "reportTransferRates", 281},
+        {"SerialCommunication/SerialSession.cpp", "handleReceive", 142},
+        {"SerialCommunication/Uploader.cpp", "logSummary", 199},
+        {"SerialCommunication/CommandEngine.cpp", "finishIfDone", 252},
+        {"SerialCommunication/PortChannel.cpp", "handleReadable", 97}
+    };
+    std::vector<SampleRecord> sampleRecords{};
+    for (size_t i = 0; i < count; i++) {
+        size_t kind{i % 5};
+        SampleRecord sampleRecord{(kind == 1) ? LogLevel::Debug : LogLevel::Info, contexts[kind], ""};
+        switch (kind) {
+            case 0:
+                sampleRecord.message = TStringFormat("/dev/ttyUSB{0}: RX {1} B/s, TX {2} B/s", i % 4, 11520 - (i % 97), i % 13);
+                break;
+            case 1:
+                sampleRecord.message = TStringFormat("Read {0} bytes from /dev/ttyUSB{1}", 1 + (i % 64), i % 4);
+                break;
+            case 2:
+                sampleRecord.message = TStringFormat("Pacing on /dev/ttyUSB{0}: {1} deadlines", i % 4, i);
+                break;
+            case 3:
+                sampleRecord.message = TStringFormat("Command #{0} ok in {1} us", i, 3200 + (i % 311));
+                break;
+            default:
+                sampleRecord.message = "Port became writable";
+                break;
+        }
+        sampleRecords.push_back(sampleRecord);
+    }
+    return sampleRecords;
+}
+
+uint64_t fileSize(const std::string &path)
+{
+    struct stat fileStatus{};
+    return (stat(path.c_str(), &fileStatus) == 0) ? static_cast<uint64_t>(fileStatus.st_size) : 0;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Runs every record through the sink ROUNDS times; returns nanoseconds
+ * per record in the fastest round */
+double writeRecords(ApplicationUtilities::GlobalLogSink &logSink, const std::vector<SampleRecord> &sampleRecords)
+{
+    double fastestSeconds{0.0};
+    for (size_t round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < sampleRecords.size(); i++) {
+            logSink.append(sampleRecords[i].logLevel, sampleRecords[i].logContext, sampleRecords[i].message);
+            if ( ((i + 1) % BATCH_SIZE == 0) || (i + 1 == sampleRecords.size()) ) {
+                logSink.commit();
+            }
+        }
+        double seconds{secondsSince(start)};
+        fastestSeconds = ( (round == 0) || (seconds < fastestSeconds) ) ? seconds : fastestSeconds;
+    }
+    return fastestSeconds * 1e9 / static_cast<double>(sampleRecords.size());
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t recordCount{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 300000};
+    MessageLogger::initializeInstance();
+    std::vector<SampleRecord> sampleRecords{makeSampleRecords(recordCount)};
+    LogFileSettings logFileSettings{0, std::chrono::seconds{0}, 1, LogSyncPolicy::Never, LogFile::DEFAULT_SYNC_INTERVAL};
+
+    /* The text sink writes to the global log file, a new file per run */
+    std::shared_ptr<LogFile> textLogFile{ApplicationUtilities::globalLogFile()};
+    textLogFile->setSettings(logFileSettings);
+    uint64_t textStartSize{fileSize(textLogFile->path())};
+    ApplicationUtilities::GlobalLogSink textSink{};
+    textSink.setConsoleEnabled(false);
+    double textNanoseconds{writeRecords(textSink, sampleRecords)};
+    uint64_t textBytes{fileSize(textLogFile->path()) - textStartSize};
+
+    std::string binaryPath{textLogFile->path() + ".benchmark.blog"};
+    ApplicationUtilities::deleteFile(binaryPath);
+    double binaryNanoseconds{0.0};
+    {
+        std::shared_ptr<LogFile> binaryLogFile{std::make_shared<LogFile>(binaryPath)};
+        binaryLogFile->setSettings(logFileSettings);
+        ApplicationUtilities::GlobalLogSink binarySink{};
+        binarySink.setConsoleEnabled(false);
+        binarySink.setBinaryLogWriter(std::make_shared<BinaryLogWriter>(binaryLogFile));
+        binaryNanoseconds = writeRecords(binarySink, sampleRecords);
+    }
+    uint64_t binaryBytes{fileSize(binaryPath)};
+
+    /* Both sinks stamped each record with its own clock reading, so the
+     * comparison skips the time of day */
+    std::string decodedText{""};
+    decodedText.reserve(textBytes);
+    auto decodeStart = std::chrono::steady_clock::now();
+    BinaryLogReader binaryLogReader{binaryPath};
+    uint64_t decodedCount{binaryLogReader.renderText([&decodedText](const char *text, size_t length) {
+        decodedText.append(text, length);
+    })};
+    double decodeSeconds{secondsSince(decodeStart)};
+
+    std::string textLog{""};
+    {
+        std::ifstream textFile{textLogFile->path()};
+        std::stringstream textStream{};
+        textStream << textFile.rdbuf();
+        textLog = textStream.str().substr(textStartSize);
+    }
+    bool matches{ (decodedCount == recordCount * ROUNDS) && (decodedText.size() == textLog.size()) };
+    size_t column{0};
+    for (size_t i = 0; (matches) && (i < textLog.size()); i++) {
+        bool inTimeOfDay{ (column >= 1) && (column <= TimestampFormatter::LENGTH) };
+        if ( (!inTimeOfDay) && (textLog[i] != decodedText[i]) ) {
+            matches = false;
+        }
+        column = (textLog[i] == '\n') ? 0 : column + 1;
+    }
+    ApplicationUtilities::deleteFile(binaryPath);
+    ApplicationUtilities::deleteFile(textLogFile->path());
+
+    double sizeRatio{static_cast<double>(textBytes) / static_cast<double>(binaryBytes)};
+    double writeCostRatio{textNanoseconds / binaryNanoseconds};
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"BinaryLog\"," << std::endl;
+    std::cout << "  \"records\": " << recordCount << "," << std::endl;
+    std::cout << "  \"text_bytes_per_record\": " << static_cast<double>(textBytes) / static_cast<double>(recordCount * ROUNDS) << "," << std::endl;
+    std::cout << "  \"binary_bytes_per_record\": " << static_cast<double>(binaryBytes) / static_cast<double>(recordCount * ROUNDS) << "," << std::endl;
+    std::cout << "  \"size_ratio\": " << sizeRatio << ", \"target\": " << SIZE_RATIO_TARGET << "," << std::endl;
+    std::cout << "  \"text_ns_per_record\": " << textNanoseconds << "," << std::endl;
+    std::cout << "  \"binary_ns_per_record\": " << binaryNanoseconds << "," << std::endl;
+    std::cout << "  \"write_cost_ratio\": " << writeCostRatio << ", \"target\": " << WRITE_COST_RATIO_TARGET << "," << std::endl;
+    std::cout << "  \"decode_mb_per_second\": " << static_cast<double>(decodedText.size()) / decodeSeconds / 1e6 << "," << std::endl;
+    std::cout << "  \"decoded_text_matches\": " << (matches ? "true" : "false") << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!matches) {
+        std::cerr << "Decoded binary log differs from the text log" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (sizeRatio < SIZE_RATIO_TARGET) {
+        std::cerr << "Binary log is less than " << SIZE_RATIO_TARGET << "x smaller than the text log" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (writeCostRatio < WRITE_COST_RATIO_TARGET) {
+        std::cerr << "Binary log is less than " << WRITE_COST_RATIO_TARGET << "x cheaper to write than the text log" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
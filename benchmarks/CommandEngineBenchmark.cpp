@@ -0,0 +1,226 @@
+/* Runs a command script against a simulated device on the master side of a
+ * pseudo-terminal, the same way --script does, once per window size. The
+ * device answers each line with "OK" in the order the lines arrived, after
+ * a fixed link latency (the round trip through a USB serial adapter, which
+ * the adapter's latency timer dominates) plus a per-command processing time
+ * during which it handles nothing else. Reports commands per second, the
+ * speedup over the lock-step window of 1 and round trip percentiles. Exits
+ * with a failure status if any command fails or is answered out of order */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CommandEngine.h"
+#include "MessageLogger.h"
+#include "SerialSession.h"
+#include "SessionManager.h"
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+const std::chrono::microseconds LINK_LATENCY{2000};
+const std::chrono::microseconds PROCESSING_TIME{250};
+const size_t WINDOW_SIZES[]{1, 2, 4, 8, 16};
+
+uint64_t monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+struct PseudoTerminal
+{
+    int master;
+    int slave;
+    std::string slaveName;
+};
+
+PseudoTerminal openPseudoTerminal()
+{
+    PseudoTerminal pseudoTerminal{-1, -1, ""};
+    char slaveName[256]{};
+    if (openpty(&pseudoTerminal.master, &pseudoTerminal.slave, slaveName, nullptr, nullptr) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+    }
+    for (int descriptor : {pseudoTerminal.master, pseudoTerminal.slave}) {
+        termios terminalSettings{};
+        tcgetattr(descriptor, &terminalSettings);
+        cfmakeraw(&terminalSettings);
+        tcsetattr(descriptor, TCSANOW, &terminalSettings);
+    }
+    fcntl(pseudoTerminal.master, F_SETFL, fcntl(pseudoTerminal.master, F_GETFL) | O_NONBLOCK);
+    pseudoTerminal.slaveName = slaveName;
+    return pseudoTerminal;
+}
+
+/* Answers every line written to the master with "OK", one command at a
+ * time, until stopped */
+void simulateDevice(int master, const std::atomic<bool> &stopped)
+{
+    std::string pending{""};
+    std::deque<uint64_t> responseTimes{};
+    uint64_t deviceFreeAt{0};
+    char buffer[4096];
+    while (!stopped.load(std::memory_order_acquire)) {
+        uint64_t now{monotonicNanoseconds()};
+        int timeout{1};
+        if ( (!responseTimes.empty()) && (responseTimes.front() <= now) ) {
+            timeout = 0;
+        }
+        pollfd pollDescriptor{master, POLLIN, 0};
+        if (poll(&pollDescriptor, 1, timeout) > 0) {
+            ssize_t bytesRead{read(master, buffer, sizeof(buffer))};
+            now = monotonicNanoseconds();
+            for (ssize_t i = 0; i < bytesRead; i++) {
+                if (buffer[i] != '\n') {
+                    continue;
+                }
+                /* Half the link latency on the way in, half on the way out */
+                uint64_t arrival{now + static_cast<uint64_t>(std::chrono::nanoseconds{LINK_LATENCY}.count() / 2)};
+                deviceFreeAt = std::max(deviceFreeAt, arrival) + static_cast<uint64_t>(std::chrono::nanoseconds{PROCESSING_TIME}.count());
+                responseTimes.push_back(deviceFreeAt + static_cast<uint64_t>(std::chrono::nanoseconds{LINK_LATENCY}.count() / 2));
+            }
+        }
+        now = monotonicNanoseconds();
+        while ( (!responseTimes.empty()) && (responseTimes.front() <= now) ) {
+            pending.append("OK\n");
+            responseTimes.pop_front();
+        }
+        if (!pending.empty()) {
+            ssize_t written{write(master, pending.data(), pending.size())};
+            if (written > 0) {
+                pending.erase(0, static_cast<size_t>(written));
+            }
+        }
+    }
+}
+
+struct WindowResult
+{
+    size_t window;
+    size_t commands;
+    size_t failures;
+    double seconds;
+    double p50Microseconds;
+    double p99Microseconds;
+};
+
+double percentile(std::vector<uint64_t> &samples, double fraction)
+{
+    if (samples.empty()) {
+        return 0.0;
+    }
+    size_t index{std::min(samples.size() - 1, static_cast<size_t>(fraction * static_cast<double>(samples.size())))};
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(index), samples.end());
+    return static_cast<double>(samples[index]) / 1000.0;
+}
+
+WindowResult runScript(const std::vector<std::string> &commands, size_t window)
+{
+    PseudoTerminal pseudoTerminal{openPseudoTerminal()};
+    PortSettings portSettings{pseudoTerminal.slaveName, BaudRate::BAUD115200, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None};
+    std::atomic<bool> deviceStopped{false};
+    std::thread deviceThread{[&pseudoTerminal, &deviceStopped]() { simulateDevice(pseudoTerminal.master, deviceStopped); }};
+
+    std::vector<uint64_t> roundTrips{};
+    size_t failures{0};
+    size_t expectedIndex{0};
+    std::atomic<bool> finished{false};
+    CommandOptions commandOptions{window, std::chrono::milliseconds{1000}, 0, CommandEngine::DEFAULT_RESPONSE_PATTERN, CommandEngine::DEFAULT_ERROR_PATTERN, false};
+    SessionManager sessionManager{1};
+    sessionManager.addSession(portSettings);
+    /* Both handlers run on the session's worker thread */
+    sessionManager.setCommandScript(commands, commandOptions, [&](SerialSession &, const CommandResult &commandResult) {
+        if ( (commandResult.status != CommandStatus::Ok) || (commandResult.index != expectedIndex) ) {
+            failures++;
+        }
+        expectedIndex++;
+        roundTrips.push_back(static_cast<uint64_t>(commandResult.roundTrip.count()));
+    }, [&finished]() {
+        finished.store(true, std::memory_order_release);
+    });
+
+    uint64_t startTime{monotonicNanoseconds()};
+    sessionManager.start();
+    while (!finished.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    uint64_t endTime{monotonicNanoseconds()};
+    sessionManager.stop();
+    deviceStopped.store(true, std::memory_order_release);
+    deviceThread.join();
+    close(pseudoTerminal.master);
+    close(pseudoTerminal.slave);
+
+    failures += commands.size() - std::min(commands.size(), roundTrips.size());
+    double p50{percentile(roundTrips, 0.50)};
+    double p99{percentile(roundTrips, 0.99)};
+    return WindowResult{window, commands.size(), failures, static_cast<double>(endTime - startTime) / 1e9, p50, p99};
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t commandCount{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 500};
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Warn);
+
+    std::vector<std::string> commands{};
+    for (size_t i = 0; i < commandCount; i++) {
+        commands.push_back("AT+READ=" + std::to_string(i));
+    }
+
+    size_t totalFailures{0};
+    double lockStepRate{0.0};
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"CommandEngine\"," << std::endl;
+    std::cout << "  \"commands\": " << commandCount << "," << std::endl;
+    std::cout << "  \"link_latency_us\": " << LINK_LATENCY.count() << "," << std::endl;
+    std::cout << "  \"processing_time_us\": " << PROCESSING_TIME.count() << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    const size_t windowCount{sizeof(WINDOW_SIZES) / sizeof(WINDOW_SIZES[0])};
+    for (size_t i = 0; i < windowCount; i++) {
+        WindowResult result{runScript(commands, WINDOW_SIZES[i])};
+        totalFailures += result.failures;
+        double commandsPerSecond{static_cast<double>(result.commands) / result.seconds};
+        if (result.window == 1) {
+            lockStepRate = commandsPerSecond;
+        }
+        std::cout << "    {\"window\": " << result.window
+                  << ", \"commands_per_second\": " << commandsPerSecond
+                  << ", \"speedup\": " << ((lockStepRate > 0.0) ? commandsPerSecond / lockStepRate : 0.0)
+                  << ", \"round_trip_p50_us\": " << result.p50Microseconds
+                  << ", \"round_trip_p99_us\": " << result.p99Microseconds
+                  << ", \"failures\": " << result.failures
+                  << "}" << ((i + 1 == windowCount) ? "" : ",") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (totalFailures != 0) {
+        std::cerr << totalFailures << " command(s) failed, timed out or completed out of order" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
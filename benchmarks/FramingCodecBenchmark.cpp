@@ -0,0 +1,136 @@
+/* Round-trips random frames (rich in the bytes each codec has to escape)
+ * through every built-in FramingCodec, delivering the encoded stream in
+ * random sized reads, then measures encode and decode throughput. Exits
+ * with a failure status if any frame comes back different */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "FramingCodec.h"
+
+namespace {
+
+volatile size_t benchmarkSink{0};
+
+std::vector<std::string> makeFrames(size_t count, size_t maximumLength, std::mt19937 &randomEngine)
+{
+    static const unsigned char SPECIAL_BYTES[]{0x00, 0x0A, 0xC0, 0xDB, 0xDC, 0xDD, 0xFF};
+    std::uniform_int_distribution<size_t> frameLength{1, maximumLength};
+    std::uniform_int_distribution<int> anyByte{0, 255};
+    std::uniform_int_distribution<int> special{0, 15};
+    std::vector<std::string> frames{};
+    for (size_t i = 0; i < count; i++) {
+        std::string frame(frameLength(randomEngine), '\0');
+        for (auto &byte : frame) {
+            int choice{special(randomEngine)};
+            byte = static_cast<char>((choice < 7) ? SPECIAL_BYTES[choice] : anyByte(randomEngine));
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+std::string encodeAll(const FramingCodec &framingCodec, const std::vector<std::string> &frames)
+{
+    std::string stream{};
+    for (const auto &frame : frames) {
+        size_t offset{stream.size()};
+        stream.resize(offset + framingCodec.maximumEncodedLength(frame.size()));
+        stream.resize(offset + framingCodec.encode(frame.data(), frame.size(), &stream[offset]));
+    }
+    return stream;
+}
+
+bool verify(const std::string &specification, const std::vector<std::string> &frames, std::mt19937 &randomEngine)
+{
+    std::unique_ptr<FramingCodec> framingCodec{FramingCodec::create(specification, "\n")};
+    std::string stream{encodeAll(*framingCodec, frames)};
+    std::vector<std::string> decoded{};
+    framingCodec->setFrameHandler([&decoded](const char *data, size_t length) { decoded.emplace_back(data, length); });
+    std::uniform_int_distribution<size_t> readLength{1, 700};
+    for (size_t offset = 0; offset < stream.size(); ) {
+        size_t length{std::min(readLength(randomEngine), stream.size() - offset)};
+        framingCodec->decode(&stream[offset], length);
+        offset += length;
+    }
+    return (decoded == frames) && (framingCodec->errorCount() == 0);
+}
+
+struct Throughput
+{
+    double encodeMegabytesPerSecond;
+    double decodeMegabytesPerSecond;
+};
+
+Throughput measure(const std::string &specification, const std::vector<std::string> &frames, size_t iterations)
+{
+    std::unique_ptr<FramingCodec> framingCodec{FramingCodec::create(specification, "\n")};
+    size_t payloadBytes{0};
+    for (const auto &frame : frames) {
+        payloadBytes += frame.size();
+    }
+
+    std::string stream{};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        stream = encodeAll(*framingCodec, frames);
+    }
+    double encodeSeconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count()};
+
+    /* Decoding may unescape in place, so every pass works on a fresh copy,
+     * fed in 64 KiB reads like PortChannel delivers them */
+    size_t decodedBytes{0};
+    framingCodec->setFrameHandler([&decodedBytes](const char *, size_t length) { decodedBytes += length; });
+    const size_t readSize{64 * 1024};
+    std::string receiveBuffer{};
+    double decodeSeconds{0.0};
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        receiveBuffer = stream;
+        startTime = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < receiveBuffer.size(); offset += readSize) {
+            framingCodec->decode(&receiveBuffer[offset], std::min(readSize, receiveBuffer.size() - offset));
+        }
+        decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
+    benchmarkSink = benchmarkSink + decodedBytes;
+    return Throughput{static_cast<double>(payloadBytes * iterations) / encodeSeconds / 1e6,
+                      static_cast<double>(payloadBytes * iterations) / decodeSeconds / 1e6};
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 20};
+    const std::vector<std::string> specifications{"cobs", "slip", "length:u8", "length:u16le", "length:u16be", "length:u32le", "length:u32be"};
+    std::mt19937 randomEngine{12345};
+    bool allMatched{true};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"FramingCodec\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    for (size_t i = 0; i < specifications.size(); i++) {
+        /* length:u8 cannot carry frames over 255 bytes */
+        size_t maximumLength{(specifications[i] == "length:u8") ? 255u : 1500u};
+        bool matched{verify(specifications[i], makeFrames(2000, maximumLength, randomEngine), randomEngine)};
+        allMatched = allMatched && matched;
+        Throughput throughput{measure(specifications[i], makeFrames(20000, maximumLength, randomEngine), iterations)};
+        std::cout << "    {\"codec\": \"" << specifications[i] << "\", \"round_trip_ok\": " << (matched ? "true" : "false")
+                  << ", \"encode_mb_per_second\": " << throughput.encodeMegabytesPerSecond
+                  << ", \"decode_mb_per_second\": " << throughput.decodeMegabytesPerSecond << "}"
+                  << ((i + 1 < specifications.size()) ? "," : "") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!allMatched) {
+        std::cerr << "A framing codec did not round-trip its frames" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
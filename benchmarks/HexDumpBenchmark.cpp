@@ -0,0 +1,154 @@
+/* Checks HexDumper against a snprintf based reference for every instruction
+ * set the CPU supports, over random data, lengths and offsets (including
+ * ones that need the wide offset column), then measures dump throughput per
+ * instruction set next to the std::ostringstream formatting it replaces.
+ * Exits with a failure status on any mismatch */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HexDumper.h"
+
+namespace {
+
+volatile size_t benchmarkSink{0};
+
+std::string referenceDump(const std::string &prefix, uint64_t offset, const std::string &data)
+{
+    bool wideOffset{(!data.empty()) && (offset + (data.size() - 1) > 0xFFFFFFFFull)};
+    std::string dump{""};
+    char field[32];
+    for (size_t row = 0; row < data.size(); row += HexDumper::BYTES_PER_ROW) {
+        dump.append(prefix);
+        snprintf(field, sizeof(field), wideOffset ? "%016llx  " : "%08llx  ", static_cast<unsigned long long>(offset + row));
+        dump.append(field);
+        for (size_t i = 0; i < HexDumper::BYTES_PER_ROW; i++) {
+            if (i == HexDumper::BYTES_PER_ROW / 2) {
+                dump.push_back(' ');
+            }
+            if (row + i < data.size()) {
+                snprintf(field, sizeof(field), "%02x ", static_cast<unsigned char>(data[row + i]));
+                dump.append(field);
+            } else {
+                dump.append("   ");
+            }
+        }
+        dump.append(" |");
+        for (size_t i = row; (i < row + HexDumper::BYTES_PER_ROW) && (i < data.size()); i++) {
+            unsigned char byte{static_cast<unsigned char>(data[i])};
+            dump.push_back( (byte >= 0x20) && (byte < 0x7F) ? static_cast<char>(byte) : '.');
+        }
+        dump.append("|\n");
+    }
+    return dump;
+}
+
+std::string makeData(size_t length, std::mt19937 &randomEngine)
+{
+    std::uniform_int_distribution<int> byte{0, 255};
+    std::string data(length, '\0');
+    for (auto &it : data) {
+        it = static_cast<char>(byte(randomEngine));
+    }
+    return data;
+}
+
+bool verify(HexDumper::InstructionSet instructionSet, std::mt19937 &randomEngine)
+{
+    HexDumper hexDumper{instructionSet};
+    std::uniform_int_distribution<size_t> length{0, 300};
+    std::uniform_int_distribution<uint64_t> offset{0, 0xFFFFFFFFull + 4096};
+    for (int i = 0; i < 2000; i++) {
+        std::string data{makeData(length(randomEngine), randomEngine)};
+        uint64_t dataOffset{offset(randomEngine)};
+        std::string prefix{(i % 2 == 0) ? "/dev/ttyUSB0: " : ""};
+        size_t textLength{hexDumper.dump(prefix, dataOffset, data.data(), data.size())};
+        if (std::string(hexDumper.text(), textLength) != referenceDump(prefix, dataOffset, data)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double measureGigabytesPerSecond(const std::string &data, HexDumper::InstructionSet instructionSet, size_t iterations)
+{
+    HexDumper hexDumper{instructionSet};
+    const std::string prefix{"/dev/ttyUSB0: "};
+    /* 64 KiB reads, the size PortChannel reads with */
+    const size_t readSize{64 * 1024};
+    size_t textLength{0};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t offset = 0; offset < data.size(); offset += readSize) {
+            textLength += hexDumper.dump(prefix, offset, data.data() + offset, std::min(readSize, data.size() - offset));
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    benchmarkSink = benchmarkSink + textLength;
+    return static_cast<double>(data.size() * iterations) / std::chrono::duration<double>(elapsed).count() / 1e9;
+}
+
+double measureStreamGigabytesPerSecond(const std::string &data, size_t iterations)
+{
+    std::ostringstream outputStream{};
+    outputStream << std::hex << std::setfill('0');
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t row = 0; row < data.size(); row += HexDumper::BYTES_PER_ROW) {
+            outputStream.str("");
+            outputStream << "/dev/ttyUSB0: " << std::setw(8) << row << "  ";
+            for (size_t i = row; (i < row + HexDumper::BYTES_PER_ROW) && (i < data.size()); i++) {
+                outputStream << std::setw(2) << static_cast<unsigned>(static_cast<unsigned char>(data[i])) << ' ';
+            }
+            benchmarkSink = benchmarkSink + outputStream.str().size();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return static_cast<double>(data.size() * iterations) / std::chrono::duration<double>(elapsed).count() / 1e9;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 20};
+    const std::vector<HexDumper::InstructionSet> instructionSets{HexDumper::InstructionSet::Ssse3, HexDumper::InstructionSet::Scalar};
+    std::mt19937 randomEngine{12345};
+    std::string benchmarkData{makeData(16 * 1024 * 1024, randomEngine)};
+    bool allMatched{true};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"HexDump\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"ostringstream_gigabytes_per_second\": " << measureStreamGigabytesPerSecond(benchmarkData, 1) << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    bool firstResult{true};
+    for (auto instructionSet : instructionSets) {
+        if (!HexDumper::isSupported(instructionSet)) {
+            continue;
+        }
+        bool matched{verify(instructionSet, randomEngine)};
+        allMatched = allMatched && matched;
+        double throughput{measureGigabytesPerSecond(benchmarkData, instructionSet, iterations)};
+        std::cout << (firstResult ? "" : ",\n") << "    {\"instruction_set\": \"" << HexDumper::instructionSetName(instructionSet)
+                  << "\", \"matches_reference\": " << (matched ? "true" : "false")
+                  << ", \"gigabytes_per_second\": " << throughput << "}";
+        firstResult = false;
+    }
+    std::cout << std::endl << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!allMatched) {
+        std::cerr << "HexDumper output differs from the reference dump" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/* Checks LineFramer against a naive splitter for every instruction set the
+ * CPU supports, feeding the same stream in random sized reads so lines and
+ * delimiters straddle buffer boundaries, then measures splitting throughput
+ * per instruction set and delimiter. Exits with a failure status on any
+ * mismatch */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "LineFramer.h"
+
+namespace {
+
+volatile size_t benchmarkSink{0};
+
+std::string makeStream(size_t length, const std::string &delimiter, std::mt19937 &randomEngine)
+{
+    /* Printable text with line lengths typical of serial consoles, and the
+     * occasional lone delimiter byte to exercise the candidate check */
+    std::uniform_int_distribution<int> lineLength{0, 120};
+    std::uniform_int_distribution<int> printable{32, 126};
+    std::uniform_int_distribution<int> stray{0, 63};
+    std::string stream{};
+    stream.reserve(length + 256);
+    while (stream.size() < length) {
+        int characters{lineLength(randomEngine)};
+        for (int i = 0; i < characters; i++) {
+            stream.push_back(stray(randomEngine) == 0 ? delimiter[0] : static_cast<char>(printable(randomEngine)));
+        }
+        stream.append(delimiter);
+    }
+    return stream;
+}
+
+std::vector<std::string> referenceSplit(const std::string &stream, const std::string &delimiter, std::string &tail)
+{
+    std::vector<std::string> lines{};
+    size_t lineStart{0};
+    for (size_t position = stream.find(delimiter); position != std::string::npos; position = stream.find(delimiter, lineStart)) {
+        lines.push_back(stream.substr(lineStart, position - lineStart));
+        lineStart = position + delimiter.size();
+    }
+    tail = stream.substr(lineStart);
+    return lines;
+}
+
+bool verify(const std::string &stream, const std::string &delimiter, LineFramer::InstructionSet instructionSet, std::mt19937 &randomEngine)
+{
+    std::string expectedTail{""};
+    std::vector<std::string> expected{referenceSplit(stream, delimiter, expectedTail)};
+    std::vector<std::string> actual{};
+    LineFramer lineFramer{delimiter, 1 << 20, instructionSet};
+    lineFramer.setLineHandler([&actual](const char *data, size_t length) { actual.emplace_back(data, length); });
+    std::uniform_int_distribution<size_t> readLength{1, 300};
+    for (size_t offset = 0; offset < stream.size(); ) {
+        size_t length{std::min(readLength(randomEngine), stream.size() - offset)};
+        lineFramer.feed(stream.data() + offset, length);
+        offset += length;
+    }
+    std::string actualTail(lineFramer.pendingBytes(), '\0');
+    lineFramer.setLineHandler([&actualTail](const char *data, size_t length) { actualTail.assign(data, length); });
+    lineFramer.flush();
+    return (actual == expected) && (actualTail == expectedTail);
+}
+
+double measureGigabytesPerSecond(const std::string &stream, const std::string &delimiter, LineFramer::InstructionSet instructionSet, size_t iterations)
+{
+    LineFramer lineFramer{delimiter, LineFramer::DEFAULT_MAXIMUM_LINE_LENGTH, instructionSet};
+    size_t lineCount{0};
+    lineFramer.setLineHandler([&lineCount](const char *, size_t length) { lineCount += length + 1; });
+    /* 64 KiB reads, the size PortChannel reads with */
+    const size_t readSize{64 * 1024};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t offset = 0; offset < stream.size(); offset += readSize) {
+            lineFramer.feed(stream.data() + offset, std::min(readSize, stream.size() - offset));
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    benchmarkSink = benchmarkSink + lineCount;
+    return static_cast<double>(stream.size() * iterations) / std::chrono::duration<double>(elapsed).count() / 1e9;
+}
+
+std::string escape(const std::string &delimiter)
+{
+    std::string escaped{""};
+    for (char c : delimiter) {
+        escaped += (c == '\n') ? "\\n" : (c == '\r') ? "\\r" : std::string(1, c);
+    }
+    return escaped;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 20};
+    const std::vector<std::string> delimiters{"\n", "\r\n", "\r", "END"};
+    const std::vector<LineFramer::InstructionSet> instructionSets{LineFramer::InstructionSet::Avx2, LineFramer::InstructionSet::Sse2, LineFramer::InstructionSet::Scalar};
+    std::mt19937 randomEngine{12345};
+    bool allMatched{true};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"LineFramer\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    bool firstResult{true};
+    for (const auto &delimiter : delimiters) {
+        std::string verificationStream{makeStream(256 * 1024, delimiter, randomEngine)};
+        std::string benchmarkStream{makeStream(16 * 1024 * 1024, delimiter, randomEngine)};
+        for (auto instructionSet : instructionSets) {
+            if (!LineFramer::isSupported(instructionSet)) {
+                continue;
+            }
+            bool matched{verify(verificationStream, delimiter, instructionSet, randomEngine)};
+            allMatched = allMatched && matched;
+            double throughput{measureGigabytesPerSecond(benchmarkStream, delimiter, instructionSet, iterations)};
+            std::cout << (firstResult ? "" : ",\n") << "    {\"delimiter\": \"" << escape(delimiter) << "\", \"instruction_set\": \""
+                      << LineFramer::instructionSetName(instructionSet) << "\", \"matches_reference\": " << (matched ? "true" : "false")
+                      << ", \"gigabytes_per_second\": " << throughput << "}";
+            firstResult = false;
+        }
+    }
+    std::cout << std::endl << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!allMatched) {
+        std::cerr << "LineFramer output differs from the reference splitter" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
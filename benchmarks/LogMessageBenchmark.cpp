@@ -0,0 +1,173 @@
+/* Counts heap allocations and measures the cost of LOG_INFO statements, both
+ * streamed and built with TStringFormat, through an installed handler that
+ * feeds a sink formatting each record the way GlobalLogSink does (without
+ * writing it anywhere), synchronously and through an AsyncLogHandler. Exits
+ * with a failure status if a steady-state streamed line allocates, or a
+ * TStringFormat line allocates more than the string it returns */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "GlobalDefinitions.h"
+#include "MessageLogger.h"
+#include "AsyncLogHandler.h"
+#include "ApplicationUtilities.h"
+#include "BinaryLogWriter.h"
+
+using namespace TMessageLogger;
+
+namespace {
+    std::atomic<uint64_t> allocationCount{0};
+} //Global namespace
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *memory{std::malloc(size ? size : 1)};
+    if (!memory) {
+        throw std::bad_alloc{};
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace {
+
+volatile size_t benchmarkSink{0};
+
+/* Formats and batches records like GlobalLogSink, then drops the batch
+ * instead of writing it. Room for a full queue's worth is reserved up front,
+ * so a batch longer than any before it does not count as a line allocating */
+class FormattingLogSink : public LogSink
+{
+public:
+    FormattingLogSink() : m_batch{} { this->m_batch.reserve(AsyncLogHandler::DEFAULT_CAPACITY * RECORD_RESERVATION); }
+    void append(LogLevel logLevel, const LogContext &logContext, const std::string &str) override
+    {
+        ApplicationUtilities::formatLogRecord(this->m_batch, logLevel, logContext, BinaryLogWriter::realtimeNanoseconds(), str.data(), str.size());
+    }
+    void commit() override
+    {
+        benchmarkSink = benchmarkSink + this->m_batch.size();
+        this->m_batch.clear();
+    }
+
+private:
+    static const size_t RECORD_RESERVATION{128};
+    std::string m_batch;
+};
+
+void logOneLine(size_t i)
+{
+    std::string portName{"/dev/ttyUSB0"};
+    LOG_INFO(SERIAL_LOG_SUBSYSTEM) << "port " << portName << " read " << i << " bytes in " << 0.125 << " ms, status " << -3;
+}
+
+void formatOneLine(size_t i)
+{
+    std::string portName{"/dev/ttyUSB0"};
+    LOG_INFO(SERIAL_LOG_SUBSYSTEM) << TStringFormat("port {0} read {1} bytes in {2} ms, status {3}", portName, i, 0.125, -3);
+}
+
+/* The streaming approach LogMessage used before, kept for comparison */
+template <typename T> std::string legacyToStdString(const T &t) { std::ostringstream outputStream{}; outputStream << t; return outputStream.str(); }
+
+void legacyLogOneLine(size_t i)
+{
+    std::string portName{"/dev/ttyUSB0"};
+    std::string logMessage{""};
+    logMessage += legacyToStdString("port ");
+    logMessage += legacyToStdString(portName);
+    logMessage += legacyToStdString(" read ");
+    logMessage += legacyToStdString(i);
+    logMessage += legacyToStdString(" bytes in ");
+    logMessage += legacyToStdString(0.125);
+    logMessage += legacyToStdString(" ms, status ");
+    logMessage += legacyToStdString(-3);
+    benchmarkSink = benchmarkSink + logMessage.size();
+}
+
+struct Measurement
+{
+    double nanosecondsPerLine;
+    double allocationsPerLine;
+};
+
+template <typename Function>
+Measurement measure(size_t iterations, Function function)
+{
+    for (size_t i = 0; i < 1000; i++) {
+        function(i);
+    }
+    uint64_t allocationsBefore{allocationCount.load()};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        function(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    uint64_t allocations{allocationCount.load() - allocationsBefore};
+    return Measurement{std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations),
+                       static_cast<double>(allocations) / static_cast<double>(iterations)};
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 1000000};
+
+    /* Like globalLogHandler, one append and commit per record */
+    FormattingLogSink synchronousSink{};
+    MessageLogger::initializeInstance([&synchronousSink](LogLevel logLevel, LogContext logContext, const std::string &str) {
+        synchronousSink.append(logLevel, logContext, str);
+        synchronousSink.commit();
+    });
+    ApplicationUtilities::registerLogSubsystems();
+    MessageLogger::setLogLevel(LogLevel::Info);
+    Measurement legacy{measure(iterations, legacyLogOneLine)};
+    Measurement synchronous{measure(iterations, logOneLine)};
+    Measurement synchronousFormat{measure(iterations, formatOneLine)};
+
+    AsyncLogHandler asyncLogHandler{std::make_shared<FormattingLogSink>(), AsyncLogHandler::DEFAULT_CAPACITY, OverflowPolicy::Block};
+    MessageLogger::installLogHandler(asyncLogHandler);
+    Measurement asynchronous{measure(iterations, logOneLine)};
+    Measurement asynchronousFormat{measure(iterations, formatOneLine)};
+    asyncLogHandler.flush();
+    MessageLogger::installLogHandler([](LogLevel, LogContext, const std::string &) { });
+    asyncLogHandler.shutdown();
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"LogMessage\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"legacy_streaming\": {\"ns_per_line\": " << legacy.nanosecondsPerLine << ", \"allocations_per_line\": " << legacy.allocationsPerLine << "}," << std::endl;
+    std::cout << "  \"synchronous_handler\": {\"ns_per_line\": " << synchronous.nanosecondsPerLine << ", \"allocations_per_line\": " << synchronous.allocationsPerLine << "}," << std::endl;
+    std::cout << "  \"synchronous_handler_tstringformat\": {\"ns_per_line\": " << synchronousFormat.nanosecondsPerLine << ", \"allocations_per_line\": " << synchronousFormat.allocationsPerLine << "}," << std::endl;
+    std::cout << "  \"async_handler\": {\"ns_per_line\": " << asynchronous.nanosecondsPerLine << ", \"allocations_per_line\": " << asynchronous.allocationsPerLine << "}," << std::endl;
+    std::cout << "  \"async_handler_tstringformat\": {\"ns_per_line\": " << asynchronousFormat.nanosecondsPerLine << ", \"allocations_per_line\": " << asynchronousFormat.allocationsPerLine << "}" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if ( (synchronous.allocationsPerLine > 0.0) || (asynchronous.allocationsPerLine > 0.0) ) {
+        std::cerr << "LogMessage allocated on the steady-state path" << std::endl;
+        return EXIT_FAILURE;
+    }
+    /* TStringFormat returns its result by value, which is all it may allocate */
+    if ( (synchronousFormat.allocationsPerLine > 1.0) || (asynchronousFormat.allocationsPerLine > 1.0) ) {
+        std::cerr << "TStringFormat allocated more than its result on the steady-state path" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
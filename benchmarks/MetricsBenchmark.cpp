@@ -0,0 +1,106 @@
+/* Measures what a MetricsRegistry update costs on a hot path: counter adds
+ * and histogram records from one thread and from several threads updating
+ * the same metric at once, next to a shared atomic fetch_add for scale.
+ * Exits with a failure status if the registry's totals do not match the
+ * number of updates made */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#include "MetricsRegistry.h"
+
+namespace {
+
+std::atomic<uint64_t> sharedCounter{0};
+
+/* CPU time rather than wall time, so threads sharing a core are not charged
+ * for each other's time slices */
+double threadCpuSeconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + (static_cast<double>(now.tv_nsec) / 1e9);
+}
+
+template <typename Function>
+double nanosecondsPerOperation(size_t threadCount, size_t iterations, const Function &function)
+{
+    std::atomic<size_t> readyThreads{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads{};
+    std::vector<double> threadSeconds(threadCount, 0.0);
+    for (size_t thread = 0; thread < threadCount; thread++) {
+        threads.emplace_back([&, thread]() {
+            /* Warm up, which also creates this thread's shard */
+            function(0);
+            readyThreads.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            double startSeconds{threadCpuSeconds()};
+            for (size_t i = 0; i < iterations; i++) {
+                function(i);
+            }
+            threadSeconds[thread] = threadCpuSeconds() - startSeconds;
+        });
+    }
+    while (readyThreads.load() != threadCount) {
+        std::this_thread::yield();
+    }
+    go.store(true);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return *std::max_element(threadSeconds.begin(), threadSeconds.end()) * 1e9 / static_cast<double>(iterations);
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 50000000};
+    size_t threadCount{std::max<size_t>(2, std::thread::hardware_concurrency())};
+    MetricsRegistry &metricsRegistry = MetricsRegistry::instance();
+    MetricCounter singleCounter{metricsRegistry.counter("benchmark.single_counter")};
+    MetricCounter sharedShardedCounter{metricsRegistry.counter("benchmark.shared_counter")};
+    MetricHistogram singleHistogram{metricsRegistry.histogram("benchmark.single_histogram")};
+    MetricHistogram sharedHistogram{metricsRegistry.histogram("benchmark.shared_histogram")};
+
+    double counterNanoseconds{nanosecondsPerOperation(1, iterations, [&](size_t) { singleCounter.add(); })};
+    double histogramNanoseconds{nanosecondsPerOperation(1, iterations, [&](size_t i) { singleHistogram.record(i & 0xFFFF); })};
+    double shardedNanoseconds{nanosecondsPerOperation(threadCount, iterations, [&](size_t) { sharedShardedCounter.add(); })};
+    double shardedHistogramNanoseconds{nanosecondsPerOperation(threadCount, iterations, [&](size_t i) { sharedHistogram.record(i & 0xFFFF); })};
+    double atomicNanoseconds{nanosecondsPerOperation(threadCount, iterations, [&](size_t) { sharedCounter.fetch_add(1, std::memory_order_relaxed); })};
+
+    /* Every timed run also made one warm-up update per thread */
+    bool totalsMatch{(metricsRegistry.value(singleCounter) == iterations + 1) &&
+                     (metricsRegistry.value(sharedShardedCounter) == (iterations + 1) * threadCount) &&
+                     (metricsRegistry.summary(singleHistogram).count == iterations + 1) &&
+                     (metricsRegistry.summary(sharedHistogram).count == (iterations + 1) * threadCount) &&
+                     (sharedCounter.load() == (iterations + 1) * threadCount)};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"Metrics\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"threads\": " << threadCount << "," << std::endl;
+    std::cout << "  \"totals_match\": " << (totalsMatch ? "true" : "false") << "," << std::endl;
+    std::cout << "  \"counter_add_ns\": " << counterNanoseconds << "," << std::endl;
+    std::cout << "  \"histogram_record_ns\": " << histogramNanoseconds << "," << std::endl;
+    std::cout << "  \"contended_counter_add_ns\": " << shardedNanoseconds << "," << std::endl;
+    std::cout << "  \"contended_histogram_record_ns\": " << shardedHistogramNanoseconds << "," << std::endl;
+    std::cout << "  \"contended_atomic_fetch_add_ns\": " << atomicNanoseconds << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!totalsMatch) {
+        std::cerr << "Metric totals do not match the number of updates" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,502 @@
+/* Serves the slave side of a pseudo-terminal with a SessionManager in daemon
+ * mode, exactly as --daemon does, and feeds the master at the rate of a
+ * 1 Mbaud port (100 bytes every millisecond) while 0, 1, 10 and 100 local
+ * clients read the socket. Reports the CPU time the daemon spends per
+ * second of traffic (the process total minus the feeder and client
+ * threads) and how much each client count adds over no clients, against a
+ * target of 5% of one CPU for 100 clients. Then checks that lines sent by
+ * several clients at once reach the port whole, and that a client which
+ * stops reading is disconnected while another keeps every byte. Exits with
+ * a failure status if any client misses or garbles a byte or a line */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MessageLogger.h"
+#include "PortServer.h"
+#include "SessionManager.h"
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+const size_t BYTES_PER_MILLISECOND{100};
+const size_t TARGET_CLIENT_COUNT{100};
+const double TARGET_ADDED_CPU_PERCENT{5.0};
+const size_t TRANSMIT_CLIENT_COUNT{4};
+const size_t LINES_PER_TRANSMIT_CLIENT{500};
+const size_t STALL_QUEUE_LIMIT{64 * 1024};
+const size_t STALL_STREAM_BYTES{4 * 1024 * 1024};
+
+uint64_t monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+double threadCpuSeconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + (static_cast<double>(now.tv_nsec) / 1e9);
+}
+
+double processCpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+}
+
+/* Byte n of the received stream, so every client can check what it got
+ * without keeping a copy */
+char patternByte(uint64_t offset)
+{
+    return static_cast<char>('a' + (offset % 23));
+}
+
+struct PseudoTerminal
+{
+    int master;
+    int slave;
+    std::string slaveName;
+};
+
+PseudoTerminal openPseudoTerminal()
+{
+    PseudoTerminal pseudoTerminal{-1, -1, ""};
+    char slaveName[256]{};
+    if (openpty(&pseudoTerminal.master, &pseudoTerminal.slave, slaveName, nullptr, nullptr) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+    }
+    for (int descriptor : {pseudoTerminal.master, pseudoTerminal.slave}) {
+        termios terminalSettings{};
+        tcgetattr(descriptor, &terminalSettings);
+        cfmakeraw(&terminalSettings);
+        tcsetattr(descriptor, TCSANOW, &terminalSettings);
+    }
+    fcntl(pseudoTerminal.master, F_SETFL, fcntl(pseudoTerminal.master, F_GETFL) | O_NONBLOCK);
+    pseudoTerminal.slaveName = slaveName;
+    return pseudoTerminal;
+}
+
+/* Writes everything unless the deadline passes first */
+bool writeUntil(int descriptor, const char *data, size_t length, uint64_t deadlineNanoseconds)
+{
+    while (length > 0) {
+        ssize_t written{write(descriptor, data, length)};
+        if (written > 0) {
+            data += written;
+            length -= static_cast<size_t>(written);
+            continue;
+        }
+        if ( (written == -1) && (errno != EAGAIN) && (errno != EINTR) ) {
+            return false;
+        }
+        if (monotonicNanoseconds() > deadlineNanoseconds) {
+            return false;
+        }
+        pollfd pollDescriptor{descriptor, POLLOUT, 0};
+        poll(&pollDescriptor, 1, 10);
+    }
+    return true;
+}
+
+int connectClient(const std::string &socketPath)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    uint64_t deadline{monotonicNanoseconds() + 5000000000ULL};
+    for (;;) {
+        int descriptor{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        if (connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+            fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+            return descriptor;
+        }
+        close(descriptor);
+        if (monotonicNanoseconds() > deadline) {
+            throw std::runtime_error(TStringFormat("Unable to connect to {0} ({1})", socketPath, strerror(errno)));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+}
+
+/* A SessionManager sharing one pty in a scratch directory */
+class DaemonFixture
+{
+public:
+    explicit DaemonFixture(size_t clientQueueLimit) :
+        m_pseudoTerminal{openPseudoTerminal()},
+        m_socketDirectory{""},
+        m_sessionManager{1}
+    {
+        char directoryTemplate[]{"/tmp/PortServerBenchmark.XXXXXX"};
+        if (!mkdtemp(directoryTemplate)) {
+            throw std::runtime_error(TStringFormat("Unable to create a socket directory ({0})", strerror(errno)));
+        }
+        this->m_socketDirectory = directoryTemplate;
+        PortSettings portSettings{this->m_pseudoTerminal.slaveName, BaudRate::BAUD1000000, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None};
+        this->m_sessionManager.addSession(portSettings);
+        this->m_sessionManager.setPortServers(PortServerOptions{this->m_socketDirectory, clientQueueLimit});
+        this->m_sessionManager.start();
+    }
+
+    ~DaemonFixture()
+    {
+        this->m_sessionManager.stop();
+        close(this->m_pseudoTerminal.master);
+        close(this->m_pseudoTerminal.slave);
+        rmdir(this->m_socketDirectory.c_str());
+    }
+
+    int master() const
+    {
+        return this->m_pseudoTerminal.master;
+    }
+
+    std::string socketPath() const
+    {
+        return PortServer::socketPathFor(this->m_socketDirectory, this->m_pseudoTerminal.slaveName);
+    }
+
+private:
+    PseudoTerminal m_pseudoTerminal;
+    std::string m_socketDirectory;
+    SessionManager m_sessionManager;
+};
+
+struct BroadcastResult
+{
+    size_t clientCount;
+    uint64_t bytesFed;
+    uint64_t errors;
+    double daemonCpuPercent;
+};
+
+BroadcastResult runBroadcast(size_t clientCount, std::chrono::milliseconds duration)
+{
+    DaemonFixture daemonFixture{PortServer::DEFAULT_CLIENT_QUEUE_LIMIT};
+    std::vector<int> clients{};
+    for (size_t i = 0; i < clientCount; i++) {
+        clients.push_back(connectClient(daemonFixture.socketPath()));
+    }
+    /* Give the daemon time to accept everyone before the stream starts, so
+     * every client is owed every byte */
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+
+    std::atomic<bool> feeding{true};
+    std::vector<uint64_t> receivedBytes(clientCount, 0);
+    uint64_t errors{0};
+    double clientCpuSeconds{0.0};
+    uint64_t fedBytes{0};
+    double feederCpuSeconds{0.0};
+
+    std::thread clientThread{[&]() {
+        double startCpuSeconds{threadCpuSeconds()};
+        int epollDescriptor{epoll_create1(EPOLL_CLOEXEC)};
+        for (size_t i = 0; i < clients.size(); i++) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, clients[i], &event);
+        }
+        char buffer[65536];
+        epoll_event events[64];
+        uint64_t idleSince{0};
+        for (;;) {
+            int ready{epoll_wait(epollDescriptor, events, 64, 10)};
+            if (ready <= 0) {
+                uint64_t now{monotonicNanoseconds()};
+                if (feeding.load()) {
+                    idleSince = 0;
+                } else if (idleSince == 0) {
+                    idleSince = now;
+                } else if (now - idleSince > 300000000ULL) {
+                    break;
+                }
+                continue;
+            }
+            idleSince = 0;
+            for (int i = 0; i < ready; i++) {
+                size_t client{static_cast<size_t>(events[i].data.u64)};
+                ssize_t bytesRead{read(clients[client], buffer, sizeof(buffer))};
+                if (bytesRead <= 0) {
+                    if ( (bytesRead == -1) && (errno == EAGAIN) ) {
+                        continue;
+                    }
+                    errors++;
+                    epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, clients[client], nullptr);
+                    continue;
+                }
+                for (ssize_t j = 0; j < bytesRead; j++) {
+                    if (buffer[j] != patternByte(receivedBytes[client] + static_cast<uint64_t>(j))) {
+                        errors++;
+                        break;
+                    }
+                }
+                receivedBytes[client] += static_cast<uint64_t>(bytesRead);
+            }
+        }
+        close(epollDescriptor);
+        clientCpuSeconds = threadCpuSeconds() - startCpuSeconds;
+    }};
+
+    double startCpuSeconds{processCpuSeconds()};
+    uint64_t startTime{monotonicNanoseconds()};
+    std::thread feederThread{[&]() {
+        double startCpuSeconds{threadCpuSeconds()};
+        char chunk[BYTES_PER_MILLISECOND];
+        auto nextTick = std::chrono::steady_clock::now();
+        uint64_t ticks{static_cast<uint64_t>(duration.count())};
+        for (uint64_t tick = 0; tick < ticks; tick++) {
+            for (size_t i = 0; i < sizeof(chunk); i++) {
+                chunk[i] = patternByte(fedBytes + i);
+            }
+            if (!writeUntil(daemonFixture.master(), chunk, sizeof(chunk), monotonicNanoseconds() + 1000000000ULL)) {
+                break;
+            }
+            fedBytes += sizeof(chunk);
+            nextTick += std::chrono::milliseconds{1};
+            std::this_thread::sleep_until(nextTick);
+        }
+        feederCpuSeconds = threadCpuSeconds() - startCpuSeconds;
+    }};
+    feederThread.join();
+    double elapsedSeconds{static_cast<double>(monotonicNanoseconds() - startTime) / 1e9};
+    /* Measured over the feed only, what is still in flight is drained after */
+    double daemonCpuSeconds{processCpuSeconds() - startCpuSeconds - feederCpuSeconds};
+    feeding.store(false);
+    clientThread.join();
+    daemonCpuSeconds -= clientCpuSeconds;
+
+    for (size_t i = 0; i < clientCount; i++) {
+        if (receivedBytes[i] != fedBytes) {
+            errors++;
+        }
+        close(clients[i]);
+    }
+    return BroadcastResult{clientCount, fedBytes, errors, std::max(0.0, daemonCpuSeconds) * 100.0 / elapsedSeconds};
+}
+
+/* Every client sends its lines in fragments, interleaved with the others;
+ * the port must see each line whole and every line exactly once */
+uint64_t runTransmitCheck()
+{
+    DaemonFixture daemonFixture{PortServer::DEFAULT_CLIENT_QUEUE_LIMIT};
+    std::vector<int> clients{};
+    for (size_t i = 0; i < TRANSMIT_CLIENT_COUNT; i++) {
+        clients.push_back(connectClient(daemonFixture.socketPath()));
+    }
+    std::thread senderThread{[&]() {
+        for (size_t line = 0; line < LINES_PER_TRANSMIT_CLIENT; line++) {
+            for (size_t client = 0; client < clients.size(); client++) {
+                std::string text{TStringFormat("client {0} line {1} {2}\n", client, line, std::string(line % 97, 'z'))};
+                size_t half{text.size() / 2};
+                writeUntil(clients[client], text.data(), half, monotonicNanoseconds() + 5000000000ULL);
+            }
+            for (size_t client = 0; client < clients.size(); client++) {
+                std::string text{TStringFormat("client {0} line {1} {2}\n", client, line, std::string(line % 97, 'z'))};
+                size_t half{text.size() / 2};
+                writeUntil(clients[client], text.data() + half, text.size() - half, monotonicNanoseconds() + 5000000000ULL);
+            }
+        }
+    }};
+
+    std::map<std::string, size_t> seenLines{};
+    std::string partialLine{};
+    size_t expectedLines{TRANSMIT_CLIENT_COUNT * LINES_PER_TRANSMIT_CLIENT};
+    size_t receivedLines{0};
+    uint64_t deadline{monotonicNanoseconds() + 20000000000ULL};
+    char buffer[4096];
+    while ( (receivedLines < expectedLines) && (monotonicNanoseconds() < deadline) ) {
+        pollfd pollDescriptor{daemonFixture.master(), POLLIN, 0};
+        poll(&pollDescriptor, 1, 10);
+        ssize_t bytesRead{read(daemonFixture.master(), buffer, sizeof(buffer))};
+        if (bytesRead <= 0) {
+            continue;
+        }
+        partialLine.append(buffer, static_cast<size_t>(bytesRead));
+        size_t lineStart{0};
+        size_t lineEnd{partialLine.find('\n')};
+        while (lineEnd != std::string::npos) {
+            seenLines[partialLine.substr(lineStart, lineEnd - lineStart)]++;
+            receivedLines++;
+            lineStart = lineEnd + 1;
+            lineEnd = partialLine.find('\n', lineStart);
+        }
+        partialLine.erase(0, lineStart);
+    }
+    senderThread.join();
+    for (int client : clients) {
+        close(client);
+    }
+
+    uint64_t errors{0};
+    for (size_t line = 0; line < LINES_PER_TRANSMIT_CLIENT; line++) {
+        for (size_t client = 0; client < TRANSMIT_CLIENT_COUNT; client++) {
+            auto it = seenLines.find(TStringFormat("client {0} line {1} {2}", client, line, std::string(line % 97, 'z')));
+            if ( (it == seenLines.end()) || (it->second != 1) ) {
+                errors++;
+            }
+        }
+    }
+    if (seenLines.size() != expectedLines) {
+        errors += (seenLines.size() > expectedLines) ? (seenLines.size() - expectedLines) : (expectedLines - seenLines.size());
+    }
+    std::cout << "  \"transmit\": {\"clients\": " << TRANSMIT_CLIENT_COUNT
+              << ", \"lines\": " << receivedLines
+              << ", \"errors\": " << errors << "}," << std::endl;
+    return errors;
+}
+
+/* One client never reads, the other drains; the stalled one must be cut off
+ * once its queue passes the limit, the other must keep every byte */
+uint64_t runStallCheck()
+{
+    DaemonFixture daemonFixture{STALL_QUEUE_LIMIT};
+    int stalledClient{connectClient(daemonFixture.socketPath())};
+    int readingClient{connectClient(daemonFixture.socketPath())};
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+
+    uint64_t readBytes{0};
+    uint64_t errors{0};
+    std::thread feederThread{[&]() {
+        std::vector<char> chunk(4096);
+        for (uint64_t offset = 0; offset < STALL_STREAM_BYTES; offset += chunk.size()) {
+            for (size_t i = 0; i < chunk.size(); i++) {
+                chunk[i] = patternByte(offset + i);
+            }
+            writeUntil(daemonFixture.master(), chunk.data(), chunk.size(), monotonicNanoseconds() + 5000000000ULL);
+        }
+    }};
+    char buffer[65536];
+    uint64_t deadline{monotonicNanoseconds() + 20000000000ULL};
+    while ( (readBytes < STALL_STREAM_BYTES) && (monotonicNanoseconds() < deadline) ) {
+        pollfd pollDescriptor{readingClient, POLLIN, 0};
+        poll(&pollDescriptor, 1, 10);
+        ssize_t bytesRead{read(readingClient, buffer, sizeof(buffer))};
+        if (bytesRead == 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < bytesRead; i++) {
+            if (buffer[i] != patternByte(readBytes + static_cast<uint64_t>(i))) {
+                errors++;
+                break;
+            }
+        }
+        readBytes += static_cast<uint64_t>(std::max<ssize_t>(0, bytesRead));
+    }
+    feederThread.join();
+    if (readBytes != STALL_STREAM_BYTES) {
+        errors++;
+    }
+
+    /* Whatever reached the stalled client before it was cut off must be
+     * an unbroken prefix of the stream, followed by end of file */
+    uint64_t stalledBytes{0};
+    bool disconnected{false};
+    deadline = monotonicNanoseconds() + 5000000000ULL;
+    while ( (!disconnected) && (monotonicNanoseconds() < deadline) ) {
+        pollfd pollDescriptor{stalledClient, POLLIN, 0};
+        poll(&pollDescriptor, 1, 10);
+        ssize_t bytesRead{read(stalledClient, buffer, sizeof(buffer))};
+        if ( (bytesRead == 0) || ( (bytesRead == -1) && (errno != EAGAIN) ) ) {
+            disconnected = true;
+        } else if (bytesRead > 0) {
+            for (ssize_t i = 0; i < bytesRead; i++) {
+                if (buffer[i] != patternByte(stalledBytes + static_cast<uint64_t>(i))) {
+                    errors++;
+                    break;
+                }
+            }
+            stalledBytes += static_cast<uint64_t>(bytesRead);
+        }
+    }
+    if ( (!disconnected) || (stalledBytes >= STALL_STREAM_BYTES) ) {
+        errors++;
+    }
+    close(stalledClient);
+    close(readingClient);
+    std::cout << "  \"stall\": {\"queue_limit\": " << STALL_QUEUE_LIMIT
+              << ", \"reader_bytes\": " << readBytes
+              << ", \"stalled_bytes_before_disconnect\": " << stalledBytes
+              << ", \"stalled_disconnected\": " << (disconnected ? "true" : "false")
+              << ", \"errors\": " << errors << "}" << std::endl;
+    return errors;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    std::chrono::milliseconds duration{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 3000};
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Warn);
+    /* As in the tool, a client that went away shows up as EPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t totalErrors{0};
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"PortServer\"," << std::endl;
+    std::cout << "  \"milliseconds_per_point\": " << duration.count() << "," << std::endl;
+    std::cout << "  \"bytes_per_second\": " << BYTES_PER_MILLISECOND * 1000 << "," << std::endl;
+    std::cout << "  \"broadcast\": [" << std::endl;
+    double baselineCpuPercent{0.0};
+    double targetAddedCpuPercent{0.0};
+    std::vector<size_t> clientCounts{0, 1, 10, TARGET_CLIENT_COUNT};
+    for (size_t i = 0; i < clientCounts.size(); i++) {
+        BroadcastResult result{runBroadcast(clientCounts[i], duration)};
+        totalErrors += result.errors;
+        if (result.clientCount == 0) {
+            baselineCpuPercent = result.daemonCpuPercent;
+        }
+        double addedCpuPercent{result.daemonCpuPercent - baselineCpuPercent};
+        if (result.clientCount == TARGET_CLIENT_COUNT) {
+            targetAddedCpuPercent = addedCpuPercent;
+        }
+        std::cout << "    {\"clients\": " << result.clientCount
+                  << ", \"bytes_fed\": " << result.bytesFed
+                  << ", \"errors\": " << result.errors
+                  << ", \"daemon_cpu_percent\": " << result.daemonCpuPercent
+                  << ", \"added_cpu_percent\": " << addedCpuPercent << "}"
+                  << ((i + 1 == clientCounts.size()) ? "" : ",") << std::endl;
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"target_added_cpu_percent\": " << TARGET_ADDED_CPU_PERCENT
+              << ", \"target_met\": " << ((targetAddedCpuPercent < TARGET_ADDED_CPU_PERCENT) ? "true" : "false") << "," << std::endl;
+    totalErrors += runTransmitCheck();
+    totalErrors += runStallCheck();
+    std::cout << "}" << std::endl;
+
+    if (totalErrors != 0) {
+        std::cerr << totalErrors << " byte stream(s) or line(s) were lost, garbled or not cut off" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
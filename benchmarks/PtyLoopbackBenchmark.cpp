@@ -0,0 +1,385 @@
+/* Pushes newline terminated frames into the master side of a pseudo-terminal
+ * while a SessionManager serves the slave side exactly as the tool does with
+ * --lines: PortChannel reads, the line codec splits, and every line is
+ * formatted as the console shows it and handed to a ConsoleOutput (writing
+ * to /dev/null here). Sweeps every baud rate, data
+ * bits and parity setting the command line accepts, then frame sizes from
+ * 1 B to 64 KiB, reporting throughput, RX-to-consumer latency percentiles and
+ * receive side CPU time per MB. Latency runs from the write() into the
+ * master to the line reaching its handler, with the pty kept saturated, so
+ * it includes the time spent queued behind earlier frames. Exits with a
+ * failure status if any frame is lost or split */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ConsoleOutput.h"
+#include "MessageLogger.h"
+#include "PortSettingsLookup.h"
+#include "SerialSession.h"
+#include "SessionManager.h"
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+const size_t SETTINGS_SWEEP_FRAME_SIZE{64};
+const size_t MINIMUM_BATCH_SIZE{4096};
+const size_t MAXIMUM_WRITE_RECORDS{1 << 20};
+const size_t MAXIMUM_LATENCY_SAMPLES{1 << 22};
+const char WARM_UP_LINE[]{"w\n"};
+
+uint64_t monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+double threadCpuSeconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + (static_cast<double>(now.tv_nsec) / 1e9);
+}
+
+double processCpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+}
+
+/* Keeps every sample until full, then every other one of those and every
+ * second one from then on, and so on, so memory stays bounded while the
+ * samples still cover the whole run evenly */
+class LatencySamples
+{
+public:
+    LatencySamples() :
+        m_samples{},
+        m_stride{1},
+        m_skipped{0}
+    {
+        this->m_samples.reserve(MAXIMUM_LATENCY_SAMPLES);
+    }
+
+    void add(uint64_t latencyNanoseconds)
+    {
+        if (++this->m_skipped < this->m_stride) {
+            return;
+        }
+        this->m_skipped = 0;
+        if (this->m_samples.size() == MAXIMUM_LATENCY_SAMPLES) {
+            for (size_t i = 0; i < MAXIMUM_LATENCY_SAMPLES / 2; i++) {
+                this->m_samples[i] = this->m_samples[i * 2];
+            }
+            this->m_samples.resize(MAXIMUM_LATENCY_SAMPLES / 2);
+            this->m_stride *= 2;
+        }
+        this->m_samples.push_back(latencyNanoseconds);
+    }
+
+    double percentileMicroseconds(double percentile)
+    {
+        if (this->m_samples.empty()) {
+            return 0.0;
+        }
+        size_t index{std::min(this->m_samples.size() - 1, static_cast<size_t>(percentile * static_cast<double>(this->m_samples.size())))};
+        std::nth_element(this->m_samples.begin(), this->m_samples.begin() + static_cast<std::ptrdiff_t>(index), this->m_samples.end());
+        return static_cast<double>(this->m_samples[index]) / 1e3;
+    }
+
+private:
+    std::vector<uint64_t> m_samples;
+    size_t m_stride;
+    size_t m_skipped;
+};
+
+struct PseudoTerminal
+{
+    int master;
+    int slave;
+    std::string slaveName;
+};
+
+PseudoTerminal openPseudoTerminal()
+{
+    PseudoTerminal pseudoTerminal{-1, -1, ""};
+    char slaveName[256]{};
+    if (openpty(&pseudoTerminal.master, &pseudoTerminal.slave, slaveName, nullptr, nullptr) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+    }
+    /* The slave descriptor stays open so the raw settings outlive the
+     * session reopening the port, and so nothing written is lost in between */
+    for (int descriptor : {pseudoTerminal.master, pseudoTerminal.slave}) {
+        termios terminalSettings{};
+        tcgetattr(descriptor, &terminalSettings);
+        cfmakeraw(&terminalSettings);
+        tcsetattr(descriptor, TCSANOW, &terminalSettings);
+    }
+    fcntl(pseudoTerminal.master, F_SETFL, fcntl(pseudoTerminal.master, F_GETFL) | O_NONBLOCK);
+    pseudoTerminal.slaveName = slaveName;
+    return pseudoTerminal;
+}
+
+/* Writes everything unless the deadline passes first */
+bool writeUntil(int descriptor, const char *data, size_t length, uint64_t deadlineNanoseconds)
+{
+    while (length > 0) {
+        ssize_t written{write(descriptor, data, length)};
+        if (written > 0) {
+            data += written;
+            length -= static_cast<size_t>(written);
+            continue;
+        }
+        if ( (written == -1) && (errno != EAGAIN) && (errno != EINTR) ) {
+            return false;
+        }
+        if (monotonicNanoseconds() > deadlineNanoseconds) {
+            return false;
+        }
+        pollfd pollDescriptor{descriptor, POLLOUT, 0};
+        poll(&pollDescriptor, 1, 10);
+    }
+    return true;
+}
+
+struct WriteRecord
+{
+    uint64_t endLine;
+    uint64_t timestamp;
+};
+
+struct LoopbackResult
+{
+    PortSettings portSettings;
+    size_t frameSize;
+    uint64_t frames;
+    uint64_t errors;
+    double bytesPerSecond;
+    double linesPerSecond;
+    double p50Microseconds;
+    double p99Microseconds;
+    double p999Microseconds;
+    double cpuMillisecondsPerMegabyte;
+};
+
+LoopbackResult runLoopback(PortSettings portSettings, size_t frameSize, std::chrono::milliseconds duration)
+{
+    PseudoTerminal pseudoTerminal{openPseudoTerminal()};
+    portSettings.portName = pseudoTerminal.slaveName;
+    portSettings.lineEnding = "\n";
+
+    int outputDescriptor{open("/dev/null", O_WRONLY | O_CLOEXEC)};
+    ConsoleOutput consoleOutput{outputDescriptor};
+    consoleOutput.start();
+    std::vector<WriteRecord> writeRecords(MAXIMUM_WRITE_RECORDS);
+    std::atomic<size_t> publishedRecords{0};
+    std::atomic<bool> warmedUp{false};
+    std::atomic<uint64_t> consumedLines{0};
+    uint64_t errors{0};
+    size_t recordCursor{0};
+    LatencySamples latencySamples{};
+
+    /* Runs on the session's worker thread */
+    auto frameHandler = [&](SerialSession &serialSession, const char *line, size_t length) {
+        uint64_t now{monotonicNanoseconds()};
+        if ( (length == 1) && (line[0] == WARM_UP_LINE[0]) ) {
+            warmedUp.store(true, std::memory_order_release);
+            return;
+        }
+        uint64_t lineIndex{consumedLines.load(std::memory_order_relaxed)};
+        if (length != frameSize - 1) {
+            errors++;
+        }
+        size_t availableRecords{publishedRecords.load(std::memory_order_acquire)};
+        while ( (recordCursor < availableRecords) && (writeRecords[recordCursor].endLine <= lineIndex) ) {
+            recordCursor++;
+        }
+        if (recordCursor < availableRecords) {
+            latencySamples.add(now - writeRecords[recordCursor].timestamp);
+        } else {
+            errors++;
+        }
+        thread_local std::string outputLine{};
+        outputLine.clear();
+        ConsoleOutput::appendLine(outputLine, serialSession.portSettings().portName, serialSession.receiveTimestamp(), false, line, length);
+        consoleOutput.write(outputLine.data(), outputLine.size());
+        consumedLines.store(lineIndex + 1, std::memory_order_release);
+    };
+
+    SessionManager sessionManager{1};
+    sessionManager.addSession(portSettings);
+    sessionManager.setFraming("line", frameHandler);
+    sessionManager.start();
+
+    uint64_t warmUpDeadline{monotonicNanoseconds() + 5000000000ULL};
+    while (!warmedUp.load(std::memory_order_acquire)) {
+        if ( (monotonicNanoseconds() > warmUpDeadline) || (sessionManager.activeSessionCount() == 0) ) {
+            sessionManager.stop();
+            throw std::runtime_error(TStringFormat("Session on {0} never started reading", pseudoTerminal.slaveName));
+        }
+        writeUntil(pseudoTerminal.master, WARM_UP_LINE, sizeof(WARM_UP_LINE) - 1, warmUpDeadline);
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    /* Let any warm-up lines still in flight drain before measuring */
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+
+    size_t framesPerBatch{std::max<size_t>(1, MINIMUM_BATCH_SIZE / frameSize)};
+    std::string batch{};
+    for (size_t i = 0; i < framesPerBatch; i++) {
+        batch.append(frameSize - 1, 'x');
+        batch.push_back('\n');
+    }
+
+    uint64_t writtenLines{0};
+    double writerCpuSeconds{0.0};
+    double startCpuSeconds{processCpuSeconds()};
+    uint64_t startTime{monotonicNanoseconds()};
+    std::thread writerThread{[&]() {
+        double writerStartCpuSeconds{threadCpuSeconds()};
+        uint64_t stopTime{startTime + static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count())};
+        for (size_t record = 0; record < MAXIMUM_WRITE_RECORDS; record++) {
+            uint64_t now{monotonicNanoseconds()};
+            if (now >= stopTime) {
+                break;
+            }
+            /* Published before the write, so the reader can never see a line
+             * whose record is not there yet */
+            writeRecords[record] = WriteRecord{writtenLines + framesPerBatch, now};
+            publishedRecords.store(record + 1, std::memory_order_release);
+            if (!writeUntil(pseudoTerminal.master, batch.data(), batch.size(), stopTime + 1000000000ULL)) {
+                break;
+            }
+            writtenLines += framesPerBatch;
+        }
+        writerCpuSeconds = threadCpuSeconds() - writerStartCpuSeconds;
+    }};
+    writerThread.join();
+
+    uint64_t drainDeadline{monotonicNanoseconds() + 5000000000ULL};
+    while ( (consumedLines.load(std::memory_order_acquire) < writtenLines) && (monotonicNanoseconds() < drainDeadline) ) {
+        std::this_thread::sleep_for(std::chrono::microseconds{200});
+    }
+    double elapsedSeconds{static_cast<double>(monotonicNanoseconds() - startTime) / 1e9};
+    double receiveCpuSeconds{processCpuSeconds() - startCpuSeconds - writerCpuSeconds};
+    sessionManager.stop();
+    consoleOutput.stop();
+    close(pseudoTerminal.master);
+    close(pseudoTerminal.slave);
+    close(outputDescriptor);
+
+    uint64_t frames{consumedLines.load()};
+    if (frames != writtenLines) {
+        errors += (writtenLines > frames) ? (writtenLines - frames) : (frames - writtenLines);
+    }
+    double megabytes{static_cast<double>(frames * frameSize) / 1e6};
+    return LoopbackResult{portSettings,
+                          frameSize,
+                          frames,
+                          errors,
+                          static_cast<double>(frames * frameSize) / elapsedSeconds,
+                          static_cast<double>(frames) / elapsedSeconds,
+                          latencySamples.percentileMicroseconds(0.50),
+                          latencySamples.percentileMicroseconds(0.99),
+                          latencySamples.percentileMicroseconds(0.999),
+                          (megabytes > 0.0) ? (receiveCpuSeconds * 1e3 / megabytes) : 0.0};
+}
+
+void printResult(const LoopbackResult &result, bool last)
+{
+    std::cout << "    {\"baud_rate\": " << baudRateToString(result.portSettings.baudRate)
+              << ", \"data_bits\": \"" << dataBitsToString(result.portSettings.dataBits) << "\""
+              << ", \"parity\": \"" << parityToString(result.portSettings.parity) << "\""
+              << ", \"frame_bytes\": " << result.frameSize
+              << ", \"frames\": " << result.frames
+              << ", \"errors\": " << result.errors
+              << ", \"bytes_per_second\": " << result.bytesPerSecond
+              << ", \"lines_per_second\": " << result.linesPerSecond
+              << ", \"latency_p50_us\": " << result.p50Microseconds
+              << ", \"latency_p99_us\": " << result.p99Microseconds
+              << ", \"latency_p999_us\": " << result.p999Microseconds
+              << ", \"cpu_ms_per_mb\": " << result.cpuMillisecondsPerMegabyte << "}"
+              << (last ? "" : ",") << std::endl;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    std::chrono::milliseconds duration{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 100};
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Warn);
+
+    /* Several names can share one setting (576000 used to), so sweep each
+     * distinct value once */
+    std::vector<BaudRate> baudRates{};
+    for (const auto &it : baudRateLookup) {
+        if (std::find(baudRates.begin(), baudRates.end(), it.second) == baudRates.end()) {
+            baudRates.push_back(it.second);
+        }
+    }
+    std::sort(baudRates.begin(), baudRates.end(), [](BaudRate first, BaudRate second) {
+        return std::strtoul(baudRateToString(first).c_str(), nullptr, 10) < std::strtoul(baudRateToString(second).c_str(), nullptr, 10);
+    });
+
+    uint64_t totalErrors{0};
+    PortSettings defaultSettings{"", BaudRate::BAUD115200, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None};
+    std::vector<PortSettings> settingsSweep{};
+    for (const auto &baudRate : baudRates) {
+        for (const auto &dataBits : dataBitsLookup) {
+            for (const auto &parity : parityLookup) {
+                PortSettings portSettings{defaultSettings};
+                portSettings.baudRate = baudRate;
+                portSettings.dataBits = dataBits.second;
+                portSettings.parity = parity.second;
+                settingsSweep.push_back(portSettings);
+            }
+        }
+    }
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"PtyLoopback\"," << std::endl;
+    std::cout << "  \"milliseconds_per_point\": " << duration.count() << "," << std::endl;
+    std::cout << "  \"settings_sweep\": [" << std::endl;
+    for (size_t i = 0; i < settingsSweep.size(); i++) {
+        LoopbackResult result{runLoopback(settingsSweep[i], SETTINGS_SWEEP_FRAME_SIZE, duration)};
+        totalErrors += result.errors;
+        printResult(result, i + 1 == settingsSweep.size());
+    }
+    std::cout << "  ]," << std::endl;
+    std::cout << "  \"frame_size_sweep\": [" << std::endl;
+    for (size_t frameSize = 1; frameSize <= 64 * 1024; frameSize *= 2) {
+        LoopbackResult result{runLoopback(defaultSettings, frameSize, duration)};
+        totalErrors += result.errors;
+        printResult(result, frameSize == 64 * 1024);
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (totalErrors != 0) {
+        std::cerr << totalErrors << " frame(s) were lost, split or unaccounted for" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
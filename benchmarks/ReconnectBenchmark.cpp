@@ -0,0 +1,226 @@
+/* Serves a port through a symbolic link to the slave side of a
+ * pseudo-terminal with a SessionManager in --reconnect mode, then unplugs
+ * and replugs it over and over: the master is closed, a line is sent while
+ * the port is away, and a new pseudo-terminal is put behind the link the
+ * way udev replaces a /dev/serial/by-id link (a new link renamed over the
+ * old one). Reports how long the held line takes to come out of the new
+ * master after the rename (which includes the kernel passing it through
+ * the pseudo-terminal), and the process CPU time spent while the port is
+ * away, against targets of 10 ms at the median and 1% of one CPU. Exits
+ * with a failure status if a line sent either way, or held, is lost */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MessageLogger.h"
+#include "SerialSession.h"
+#include "SessionManager.h"
+
+using namespace CppSerialPort;
+using namespace TMessageLogger;
+
+namespace {
+
+const std::chrono::milliseconds ABSENT_PERIOD{200};
+const std::chrono::milliseconds LINE_TIMEOUT{2000};
+const double TARGET_MEDIAN_MILLISECONDS{10.0};
+const double TARGET_ABSENT_CPU_PERCENT{1.0};
+
+uint64_t monotonicNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+double processCpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+}
+
+/* Only the master is kept, as with an adapter nothing else holds open */
+int openPseudoTerminal(std::string &slaveName)
+{
+    int master{-1};
+    int slave{-1};
+    char name[256]{};
+    if (openpty(&master, &slave, name, nullptr, nullptr) == -1) {
+        throw std::runtime_error(TStringFormat("Unable to open a pseudo-terminal ({0})", strerror(errno)));
+    }
+    for (int descriptor : {master, slave}) {
+        termios terminalSettings{};
+        tcgetattr(descriptor, &terminalSettings);
+        cfmakeraw(&terminalSettings);
+        tcsetattr(descriptor, TCSANOW, &terminalSettings);
+    }
+    close(slave);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    slaveName = name;
+    return master;
+}
+
+/* Points linkPath at target in one step, as udev does */
+void replaceLink(const std::string &target, const std::string &linkPath)
+{
+    std::string temporaryPath{linkPath + ".new"};
+    unlink(temporaryPath.c_str());
+    if ( (symlink(target.c_str(), temporaryPath.c_str()) == -1) || (rename(temporaryPath.c_str(), linkPath.c_str()) == -1) ) {
+        throw std::runtime_error(TStringFormat("Unable to link {0} to {1} ({2})", linkPath, target, strerror(errno)));
+    }
+}
+
+/* Reads the master until line has come out, or the deadline passes */
+bool awaitMasterLine(int master, const std::string &line, uint64_t deadlineNanoseconds)
+{
+    std::string received{""};
+    char buffer[256];
+    while (received.find(line) == std::string::npos) {
+        if (monotonicNanoseconds() > deadlineNanoseconds) {
+            return false;
+        }
+        pollfd pollDescriptor{master, POLLIN, 0};
+        poll(&pollDescriptor, 1, 1);
+        /* EIO until the slave is open again */
+        ssize_t bytesRead{read(master, buffer, sizeof(buffer))};
+        if (bytesRead > 0) {
+            received.append(buffer, static_cast<size_t>(bytesRead));
+        }
+    }
+    return true;
+}
+
+class ReceivedLines
+{
+public:
+    ReceivedLines() :
+        m_mutex{},
+        m_received{""}
+    {
+
+    }
+
+    void append(const char *data, size_t length)
+    {
+        std::lock_guard<std::mutex> receivedLock{this->m_mutex};
+        this->m_received.append(data, length);
+    }
+
+    bool await(const std::string &line, uint64_t deadlineNanoseconds)
+    {
+        while (monotonicNanoseconds() < deadlineNanoseconds) {
+            {
+                std::lock_guard<std::mutex> receivedLock{this->m_mutex};
+                if (this->m_received.find(line) != std::string::npos) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        return false;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::string m_received;
+};
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t cycles{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 20};
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Warn);
+
+    char directoryTemplate[]{"/tmp/ReconnectBenchmark.XXXXXX"};
+    if (!mkdtemp(directoryTemplate)) {
+        std::cerr << "Unable to create a directory for the port link (" << strerror(errno) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string linkPath{std::string{directoryTemplate} + "/port"};
+    std::string slaveName{""};
+    int master{openPseudoTerminal(slaveName)};
+    replaceLink(slaveName, linkPath);
+
+    ReceivedLines receivedLines{};
+    SessionManager sessionManager{1};
+    sessionManager.setReceiveHandler([&receivedLines](SerialSession &, char *data, size_t length) {
+        receivedLines.append(data, length);
+    });
+    sessionManager.setReconnect(true);
+    sessionManager.addSession(PortSettings{linkPath, BaudRate::BAUD115200, DataBits::EIGHT, StopBits::ONE, Parity::NONE, "\n", FlowControl::None});
+    sessionManager.start();
+
+    uint64_t errors{0};
+    std::vector<double> reconnectMilliseconds{};
+    double absentCpuSeconds{0.0};
+    for (size_t i = 0; i < cycles; i++) {
+        std::string receiveLine{TStringFormat("rx-{0}\n", i)};
+        if ( (write(master, receiveLine.data(), receiveLine.size()) != static_cast<ssize_t>(receiveLine.size())) ||
+             (!receivedLines.await(receiveLine, monotonicNanoseconds() + std::chrono::duration_cast<std::chrono::nanoseconds>(LINE_TIMEOUT).count())) ) {
+            errors++;
+        }
+
+        close(master);
+        double cpuStart{processCpuSeconds()};
+        std::this_thread::sleep_for(ABSENT_PERIOD);
+        absentCpuSeconds += processCpuSeconds() - cpuStart;
+        std::string heldLine{TStringFormat("held-{0}", i)};
+        sessionManager.broadcastLine(heldLine);
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+        master = openPseudoTerminal(slaveName);
+        uint64_t replugged{monotonicNanoseconds()};
+        replaceLink(slaveName, linkPath);
+        if (!awaitMasterLine(master, heldLine + "\n", replugged + std::chrono::duration_cast<std::chrono::nanoseconds>(LINE_TIMEOUT).count())) {
+            errors++;
+            continue;
+        }
+        reconnectMilliseconds.push_back(static_cast<double>(monotonicNanoseconds() - replugged) / 1e6);
+    }
+    sessionManager.stop();
+    close(master);
+    unlink(linkPath.c_str());
+    rmdir(directoryTemplate);
+
+    std::sort(reconnectMilliseconds.begin(), reconnectMilliseconds.end());
+    double medianMilliseconds{reconnectMilliseconds.empty() ? 0.0 : reconnectMilliseconds[reconnectMilliseconds.size() / 2]};
+    double maximumMilliseconds{reconnectMilliseconds.empty() ? 0.0 : reconnectMilliseconds.back()};
+    double absentCpuPercent{(cycles == 0) ? 0.0 : (absentCpuSeconds * 100.0) / (static_cast<double>(cycles) * std::chrono::duration<double>(ABSENT_PERIOD).count())};
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"Reconnect\"," << std::endl;
+    std::cout << "  \"cycles\": " << cycles << "," << std::endl;
+    std::cout << "  \"errors\": " << errors << "," << std::endl;
+    std::cout << "  \"reconnect_median_ms\": " << medianMilliseconds << "," << std::endl;
+    std::cout << "  \"reconnect_max_ms\": " << maximumMilliseconds << "," << std::endl;
+    std::cout << "  \"absent_cpu_percent\": " << absentCpuPercent << "," << std::endl;
+    std::cout << "  \"target_median_ms\": " << TARGET_MEDIAN_MILLISECONDS << ", \"target_absent_cpu_percent\": " << TARGET_ABSENT_CPU_PERCENT
+              << ", \"target_met\": " << ( ( (medianMilliseconds < TARGET_MEDIAN_MILLISECONDS) && (absentCpuPercent < TARGET_ABSENT_CPU_PERCENT) ) ? "true" : "false") << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (errors != 0) {
+        std::cerr << errors << " line(s) were lost across reconnects" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
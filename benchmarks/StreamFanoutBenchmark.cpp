@@ -0,0 +1,333 @@
+/* Publishes a known byte stream through a StreamFanout to 1 to 8 FIFOs, each
+ * drained by its own reader thread, for small (serial sized) and large
+ * reads, and reports the publishing thread's CPU time per MB next to a
+ * plain write() to every FIFO. Then checks backpressure isolation: with one
+ * FIFO that nobody reads, a drop and a buffer sink must both leave the
+ * other sink with every byte and never stall publishing. Exits with a
+ * failure status if any reader sees a wrong or missing byte */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "EventLoop.h"
+#include "MessageLogger.h"
+#include "StreamFanout.h"
+
+using namespace TMessageLogger;
+
+namespace {
+
+const size_t SINK_COUNTS[]{1, 2, 4, 8};
+const size_t READ_SIZES[]{256, 65536};
+
+char patternByte(uint64_t position)
+{
+    return static_cast<char>((position * 131) + (position >> 9));
+}
+
+double threadCpuSeconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<double>(now.tv_sec) + (static_cast<double>(now.tv_nsec) / 1e9);
+}
+
+/* Reads one FIFO to the end, checking every byte against the pattern */
+class PatternReader
+{
+public:
+    PatternReader() :
+        m_pipe{-1, -1},
+        m_bytesRead{0},
+        m_mismatches{0},
+        m_thread{}
+    {
+        if (pipe2(this->m_pipe, O_CLOEXEC) == -1) {
+            throw std::runtime_error("Unable to create a pipe");
+        }
+        this->m_thread = std::thread{[this]() { this->run(); }};
+    }
+
+    ~PatternReader()
+    {
+        this->closeWriteEnd();
+        if (this->m_thread.joinable()) {
+            this->m_thread.join();
+        }
+        close(this->m_pipe[0]);
+    }
+
+    PatternReader(const PatternReader &) = delete;
+    PatternReader &operator=(const PatternReader &) = delete;
+
+    int writeEnd() const
+    {
+        return this->m_pipe[1];
+    }
+
+    void closeWriteEnd()
+    {
+        if (this->m_pipe[1] != -1) {
+            close(this->m_pipe[1]);
+            this->m_pipe[1] = -1;
+        }
+    }
+
+    /* Waits for end of file */
+    void join()
+    {
+        this->closeWriteEnd();
+        this->m_thread.join();
+    }
+
+    uint64_t bytesRead() const
+    {
+        return this->m_bytesRead.load();
+    }
+
+    uint64_t mismatches() const
+    {
+        return this->m_mismatches.load();
+    }
+
+private:
+    int m_pipe[2];
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<uint64_t> m_mismatches;
+    std::thread m_thread;
+
+    void run()
+    {
+        std::vector<char> buffer(65536);
+        uint64_t position{0};
+        uint64_t mismatches{0};
+        for (;;) {
+            ssize_t bytesRead{read(this->m_pipe[0], buffer.data(), buffer.size())};
+            if ( (bytesRead == -1) && (errno == EINTR) ) {
+                continue;
+            }
+            if (bytesRead <= 0) {
+                break;
+            }
+            for (ssize_t i = 0; i < bytesRead; i++, position++) {
+                mismatches += (buffer[static_cast<size_t>(i)] != patternByte(position)) ? 1 : 0;
+            }
+            this->m_bytesRead.store(position);
+        }
+        this->m_mismatches.store(mismatches);
+    }
+};
+
+/* Room for the whole stream, so a reader that falls behind for a while
+ * (its thread not being scheduled) is never dropped from */
+size_t readerQueueLimit(const std::vector<char> &stream)
+{
+    return std::max(StreamFanout::DEFAULT_QUEUE_LIMIT, stream.size());
+}
+
+std::vector<char> makeStream(size_t totalBytes)
+{
+    std::vector<char> stream(totalBytes);
+    for (size_t i = 0; i < totalBytes; i++) {
+        stream[i] = patternByte(i);
+    }
+    return stream;
+}
+
+/* Publishes the stream read by read from the loop, giving the loop a turn
+ * between batches so queued sinks get flushed, and stops once every sink
+ * has everything; returns the loop thread's CPU seconds */
+double publishStream(EventLoop &eventLoop, StreamFanout &streamFanout, const std::vector<char> &stream, size_t readSize)
+{
+    size_t offset{0};
+    double cpuSeconds{0.0};
+    std::function<void()> publishBatch{};
+    publishBatch = [&]() {
+        double startCpu{threadCpuSeconds()};
+        for (int i = 0; (i < 64) && (offset < stream.size()); i++) {
+            size_t length{std::min(readSize, stream.size() - offset)};
+            streamFanout.publish(stream.data() + offset, length);
+            offset += length;
+        }
+        cpuSeconds += threadCpuSeconds() - startCpu;
+        if (offset < stream.size()) {
+            eventLoop.post(publishBatch);
+        }
+    };
+    eventLoop.post(publishBatch);
+    int doneTimer{eventLoop.addTimer(std::chrono::milliseconds{1}, [&]() {
+        if ( (offset == stream.size()) && (streamFanout.queuedBytes() == 0) ) {
+            eventLoop.stop();
+        }
+    })};
+    eventLoop.run();
+    eventLoop.removeTimer(doneTimer);
+    return cpuSeconds;
+}
+
+/* What a fan-out without shared buffers or tee() does: a blocking write()
+ * of every read to every sink in turn */
+double writeStream(const std::vector<int> &fileDescriptors, const std::vector<char> &stream, size_t readSize)
+{
+    double startCpu{threadCpuSeconds()};
+    for (size_t offset = 0; offset < stream.size(); offset += readSize) {
+        size_t length{std::min(readSize, stream.size() - offset)};
+        for (int fileDescriptor : fileDescriptors) {
+            for (size_t written = 0; written < length; ) {
+                ssize_t result{write(fileDescriptor, stream.data() + offset + written, length - written)};
+                if (result > 0) {
+                    written += static_cast<size_t>(result);
+                }
+            }
+        }
+    }
+    return threadCpuSeconds() - startCpu;
+}
+
+struct IsolationResult
+{
+    bool passed;
+    uint64_t droppedBytes;
+    double seconds;
+};
+
+IsolationResult checkIsolation(const std::vector<char> &stream, SinkBackpressure backpressure, size_t queueLimit)
+{
+    EventLoop eventLoop{};
+    PatternReader fastReader{};
+    int stuckPipe[2]{-1, -1};
+    if (pipe2(stuckPipe, O_CLOEXEC) == -1) {
+        throw std::runtime_error("Unable to create a pipe");
+    }
+    IsolationResult result{false, 0, 0.0};
+    {
+        StreamFanout streamFanout{eventLoop, "isolation"};
+        streamFanout.addSink(fastReader.writeEnd(), StreamSinkSettings{"fast", SinkBackpressure::Buffer, readerQueueLimit(stream)});
+        streamFanout.addSink(stuckPipe[1], StreamSinkSettings{"stuck", backpressure, queueLimit});
+        auto start = std::chrono::steady_clock::now();
+        size_t offset{0};
+        std::function<void()> publishBatch{};
+        publishBatch = [&]() {
+            for (int i = 0; (i < 64) && (offset < stream.size()); i++) {
+                size_t length{std::min<size_t>(4096, stream.size() - offset)};
+                streamFanout.publish(stream.data() + offset, length);
+                offset += length;
+            }
+            if (offset < stream.size()) {
+                eventLoop.post(publishBatch);
+            }
+        };
+        eventLoop.post(publishBatch);
+        /* The stuck sink never drains, so done is everything published and
+         * all that is still queued belonging to it */
+        eventLoop.addTimer(std::chrono::milliseconds{1}, [&]() {
+            if ( (offset == stream.size()) && (fastReader.bytesRead() == stream.size()) ) {
+                eventLoop.stop();
+            }
+        });
+        eventLoop.run();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.droppedBytes = streamFanout.droppedBytes();
+        size_t stuckQueued{static_cast<size_t>(streamFanout.queuedBytes())};
+        size_t allowedQueue{(backpressure == SinkBackpressure::Drop) ? 4096 : queueLimit};
+        result.passed = (result.droppedBytes > 0) && (stuckQueued <= allowedQueue);
+    }
+    fastReader.join();
+    result.passed = (result.passed) && (fastReader.bytesRead() == stream.size()) && (fastReader.mismatches() == 0);
+    close(stuckPipe[0]);
+    close(stuckPipe[1]);
+    return result;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes{(argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 64};
+    MessageLogger::initializeInstance();
+    MessageLogger::setLogLevel(LogLevel::Fatal);
+    std::vector<char> stream{makeStream(megabytes * 1024 * 1024)};
+    double megabyteCount{static_cast<double>(stream.size()) / (1024.0 * 1024.0)};
+    uint64_t failures{0};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"StreamFanout\"," << std::endl;
+    std::cout << "  \"megabytes\": " << megabyteCount << "," << std::endl;
+    std::cout << "  \"tee_minimum_read\": " << StreamFanout::MINIMUM_TEE_LENGTH << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    const size_t sinkCounts{sizeof(SINK_COUNTS) / sizeof(SINK_COUNTS[0])};
+    const size_t readSizes{sizeof(READ_SIZES) / sizeof(READ_SIZES[0])};
+    for (size_t r = 0; r < readSizes; r++) {
+        for (size_t s = 0; s < sinkCounts; s++) {
+            double fanoutSeconds{0.0};
+            {
+                EventLoop eventLoop{};
+                std::vector<std::unique_ptr<PatternReader>> readers{};
+                {
+                    StreamFanout streamFanout{eventLoop, "benchmark"};
+                    for (size_t i = 0; i < SINK_COUNTS[s]; i++) {
+                        readers.emplace_back(new PatternReader{});
+                        streamFanout.addSink(readers.back()->writeEnd(), StreamSinkSettings{"reader", SinkBackpressure::Buffer, readerQueueLimit(stream)});
+                    }
+                    fanoutSeconds = publishStream(eventLoop, streamFanout, stream, READ_SIZES[r]);
+                }
+                for (auto &reader : readers) {
+                    reader->join();
+                    failures += ( (reader->bytesRead() != stream.size()) || (reader->mismatches() != 0) ) ? 1 : 0;
+                }
+            }
+            double writeSeconds{0.0};
+            {
+                std::vector<std::unique_ptr<PatternReader>> readers{};
+                std::vector<int> fileDescriptors{};
+                for (size_t i = 0; i < SINK_COUNTS[s]; i++) {
+                    readers.emplace_back(new PatternReader{});
+                    fileDescriptors.push_back(readers.back()->writeEnd());
+                }
+                writeSeconds = writeStream(fileDescriptors, stream, READ_SIZES[r]);
+                for (auto &reader : readers) {
+                    reader->join();
+                }
+            }
+            std::cout << "    {\"read_size\": " << READ_SIZES[r]
+                      << ", \"sinks\": " << SINK_COUNTS[s]
+                      << ", \"fanout_cpu_ms_per_mb\": " << (fanoutSeconds * 1e3) / megabyteCount
+                      << ", \"write_cpu_ms_per_mb\": " << (writeSeconds * 1e3) / megabyteCount
+                      << ", \"cpu_ratio\": " << ((fanoutSeconds > 0.0) ? writeSeconds / fanoutSeconds : 0.0)
+                      << "}" << ( (r + 1 == readSizes) && (s + 1 == sinkCounts) ? "" : ",") << std::endl;
+        }
+    }
+    std::cout << "  ]," << std::endl;
+
+    IsolationResult dropResult{checkIsolation(stream, SinkBackpressure::Drop, 0)};
+    IsolationResult bufferResult{checkIsolation(stream, SinkBackpressure::Buffer, 1024 * 1024)};
+    failures += (dropResult.passed ? 0 : 1) + (bufferResult.passed ? 0 : 1);
+    std::cout << "  \"isolation\": [" << std::endl;
+    std::cout << "    {\"stuck_sink\": \"drop\", \"dropped_bytes\": " << dropResult.droppedBytes << ", \"seconds\": " << dropResult.seconds
+              << ", \"passed\": " << (dropResult.passed ? "true" : "false") << "}," << std::endl;
+    std::cout << "    {\"stuck_sink\": \"buffer\", \"dropped_bytes\": " << bufferResult.droppedBytes << ", \"seconds\": " << bufferResult.seconds
+              << ", \"passed\": " << (bufferResult.passed ? "true" : "false") << "}" << std::endl;
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (failures != 0) {
+        std::cerr << failures << " sink(s) lost or corrupted data, or stalled behind a stuck sink" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
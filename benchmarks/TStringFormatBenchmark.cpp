@@ -0,0 +1,192 @@
+/* Compares TStringFormat against the regex based implementation it
+ * replaced, first for identical output and then for speed */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MessageLogger.h"
+
+using namespace TMessageLogger;
+
+namespace LegacyStringFormat {
+
+template <typename T> std::string toLegacyTStringFormatString(T t) { std::ostringstream outputStream{}; outputStream << t; return outputStream.str(); }
+
+/*Base case to break recursion*/
+inline std::string LegacyTStringFormat(const char *formatting) { return formatting; }
+
+/*C# style String.Format()*/
+template <typename First, typename ... Args>
+std::string LegacyTStringFormat(const char *formatting, First &&first, Args&& ... args)
+{
+    /* Match exactly one opening brace, one or more numeric digit,
+    * then exactly one closing brace, identifying a token */
+    static const std::regex targetRegex{R"(\{[0-9]+\})"};
+    std::smatch match;
+
+    /* Copy the formatting string to a std::string, to
+    * make for easier processing, which will eventually
+    * be used (the .c_str() method) to pass the remainder
+    * of the formatting recursively */
+    std::string returnString{formatting};
+
+    /* Copy the formatting string to another std::string, which
+    * will get modified in the regex matching loop, to remove the
+    * current match from the string and find the next match */
+    std::string copyString{formatting};
+
+    /* std::tuple to hold the current smallest valued brace token,
+    * wrapped in a std::vector because there can be multiple brace
+    * tokens with the same value. For example, in the following format string:
+    * "There were {0} books found matching the title {1}, {0}/{2}",
+    * this pass will save the locations of the first and second {0} */
+    using TokenInformation = std::tuple<int, size_t, size_t>;
+    std::vector<TokenInformation> smallestValueInformation{std::make_tuple(-1, 0, 0)};
+
+    /*Iterate through string, finding position and lengths of all matches {x}*/
+    while(std::regex_search(copyString, match, targetRegex)) {
+        /*Get the absolute position of the match in the original return string*/
+        size_t foundPosition{match.position() + (returnString.length() - copyString.length())};
+        int regexMatchNumericValue{0};
+        /*Convert the integer value between the opening and closing braces to an int to compare */
+        regexMatchNumericValue = std::stoi(returnString.substr(foundPosition + 1, (foundPosition + match.str().length())));
+
+        /*Do not allow negative numbers, although this should never get picked up the regex anyway*/
+        if (regexMatchNumericValue < 0) {
+            throw std::runtime_error(LegacyTStringFormat("ERROR: In LegacyTStringFormat() - Formatted string is invalid (formatting = {0})", formatting));
+        }
+        /* If the numeric value in the curly brace token is smaller than
+        * the current smallest (or if the smallest value has not yet been set,
+        * ie it is the first match), set the corresponding smallestX variables
+        * and wrap them up into a TokenInformation and add it to the std::vector */
+        int smallestValue{std::get<0>(smallestValueInformation.at(0))};
+        if ((smallestValue == -1) || (regexMatchNumericValue < smallestValue)) {
+            smallestValueInformation.clear();
+            smallestValueInformation.push_back(std::make_tuple(regexMatchNumericValue,
+                                                               foundPosition,
+                                                               match.str().length()));
+        } else if (regexMatchNumericValue == smallestValue) {
+            smallestValueInformation.push_back(std::make_tuple(regexMatchNumericValue,
+                                                               foundPosition,
+                                                               match.str().length()));
+        }
+        copyString = match.suffix();
+    }
+    int smallestValue{std::get<0>(smallestValueInformation.at(0))};
+    if (smallestValue == -1) {
+        throw std::runtime_error(LegacyTStringFormat("ERROR: In LegacyTStringFormat() - Formatted string is invalid (formatting = {0})", formatting));
+    }
+    /* Set the returnString to be up to the brace token, then the string
+    * representation of current argument in line (first), then the remainder
+    * of the format string, effectively removing the token and replacing it
+    * with the requested item in the final string, then pass it off recursively */
+
+    std::string firstString{toLegacyTStringFormatString(first)};
+    int index{0};
+    for (const auto &it : smallestValueInformation) {
+        size_t smallestValueLength{std::get<2>(it)};
+
+        /* Since the original string will be modified, the adjusted position must be
+        calculated for any repeated brace tokens, kept track of by index.
+        The length of string representation of first mutiplied by which the iterationn count
+        is added, and the length of the brace token multiplied by the iteration count is
+        subtracted, resulting in the correct starting position of the current brace token */
+        size_t lengthOfTokenBracesRemoved{index * smallestValueLength};
+        size_t lengthOfStringAdded{index * firstString.length()};
+        size_t smallestValueAdjustedPosition{std::get<1>(it) + lengthOfStringAdded - lengthOfTokenBracesRemoved};
+        returnString = returnString.substr(0, smallestValueAdjustedPosition)
+                       + firstString
+                       + returnString.substr(smallestValueAdjustedPosition + smallestValueLength);
+        index++;
+    }
+    return LegacyTStringFormat(returnString.c_str(), std::forward<Args>(args)...);
+}
+
+
+} //namespace LegacyStringFormat
+
+namespace {
+
+volatile size_t benchmarkSink{0};
+
+template <typename Function>
+double nanosecondsPerCall(size_t iterations, Function function)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        benchmarkSink = benchmarkSink + function(i).size();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+bool checkSame(const std::string &expected, const std::string &actual)
+{
+    if (expected != actual) {
+        std::cerr << "MISMATCH: expected \"" << expected << "\", got \"" << actual << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 200000};
+    using LegacyStringFormat::LegacyTStringFormat;
+
+    bool allSame{true};
+    std::string portName{"/dev/ttyUSB0"};
+    allSame &= checkSame(LegacyTStringFormat("Using PortName {0}", portName), TStringFormat("Using PortName {0}", portName));
+    allSame &= checkSame(LegacyTStringFormat("{0}, v{1}.{2}.{3}", "SerialCommunication", 0, 1, 0), TStringFormat("{0}, v{1}.{2}.{3}", "SerialCommunication", 0, 1, 0));
+    allSame &= checkSame(LegacyTStringFormat("There were {0} books matching {1}, {0}/{2}", 12, "title", 40), TStringFormat("There were {0} books matching {1}, {0}/{2}", 12, "title", 40));
+    allSame &= checkSame(LegacyTStringFormat("{3} before {1}", 'a', 'b'), TStringFormat("{3} before {1}", 'a', 'b'));
+    allSame &= checkSame(LegacyTStringFormat("{0} {1} {2}", -42, 3.14159265, true), TStringFormat("{0} {1} {2}", -42, 3.14159265, true));
+    allSame &= checkSame(LegacyTStringFormat("{0} {1} {2}", 18446744073709551615ULL, 1e-7, 2.5f), TStringFormat("{0} {1} {2}", 18446744073709551615ULL, 1e-7, 2.5f));
+    allSame &= checkSame(LegacyTStringFormat("{{0}} {x} {1}", 7), TStringFormat("{{0}} {x} {1}", 7));
+    allSame &= checkSame(LegacyTStringFormat("unused {0} {1}", 1), TStringFormat("unused {0} {1}", 1));
+    if (!allSame) {
+        return EXIT_FAILURE;
+    }
+
+    struct Case
+    {
+        const char *name;
+        double legacyNanoseconds;
+        double currentNanoseconds;
+    };
+    std::vector<Case> cases{};
+    cases.push_back(Case{"one string argument",
+        nanosecondsPerCall(iterations, [&](size_t) { return LegacyTStringFormat("Using PortName {0}", portName); }),
+        nanosecondsPerCall(iterations, [&](size_t) { return TStringFormat("Using PortName {0}", portName); })});
+    cases.push_back(Case{"four mixed arguments",
+        nanosecondsPerCall(iterations, [&](size_t i) { return LegacyTStringFormat("{0}, v{1}.{2}.{3}", "SerialCommunication", i, 1, 0); }),
+        nanosecondsPerCall(iterations, [&](size_t i) { return TStringFormat("{0}, v{1}.{2}.{3}", "SerialCommunication", i, 1, 0); })});
+    cases.push_back(Case{"repeated tokens",
+        nanosecondsPerCall(iterations, [&](size_t i) { return LegacyTStringFormat("There were {0} books matching {1}, {0}/{2}", i, "title", 40); }),
+        nanosecondsPerCall(iterations, [&](size_t i) { return TStringFormat("There were {0} books matching {1}, {0}/{2}", i, "title", 40); })});
+    cases.push_back(Case{"log line",
+        nanosecondsPerCall(iterations, [&](size_t i) { return LegacyTStringFormat("[{0}] - {1} {2}", "12-30-45", "{  Info  }: ", i); }),
+        nanosecondsPerCall(iterations, [&](size_t i) { return TStringFormat("[{0}] - {1} {2}", "12-30-45", "{  Info  }: ", i); })});
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"TStringFormat\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"cases\": [" << std::endl;
+    for (size_t i = 0; i < cases.size(); i++) {
+        std::cout << "    {\"name\": \"" << cases[i].name << "\", "
+                  << "\"legacy_ns\": " << cases[i].legacyNanoseconds << ", "
+                  << "\"current_ns\": " << cases[i].currentNanoseconds << ", "
+                  << "\"speedup\": " << (cases[i].legacyNanoseconds / cases[i].currentNanoseconds) << "}"
+                  << ((i + 1 < cases.size()) ? "," : "") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/* Checks TimestampFormatter against a localtime_r/strftime reference for
+ * times either side of many second boundaries, and from several threads at
+ * once, then times it next to the std::localtime and std::put_time approach
+ * log records used before. Exits with a failure status on a mismatch or if
+ * formatting allocates */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TimestampFormatter.h"
+
+namespace {
+    std::atomic<uint64_t> allocationCount{0};
+} //Global namespace
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *memory{std::malloc(size ? size : 1)};
+    if (!memory) {
+        throw std::bad_alloc{};
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace {
+
+const size_t THREAD_COUNT{4};
+const uint64_t NANOSECONDS_PER_SECOND{1000000000ULL};
+
+volatile size_t benchmarkSink{0};
+
+std::string referenceText(uint64_t realtimeNanoseconds)
+{
+    time_t seconds{static_cast<time_t>(realtimeNanoseconds / NANOSECONDS_PER_SECOND)};
+    struct tm localTime{};
+    localtime_r(&seconds, &localTime);
+    char text[32]{};
+    size_t length{strftime(text, sizeof(text), "%H-%M-%S", &localTime)};
+    snprintf(text + length, sizeof(text) - length, ".%06u", static_cast<unsigned>((realtimeNanoseconds % NANOSECONDS_PER_SECOND) / 1000));
+    return std::string{text};
+}
+
+/* Times just before, at and just after second boundaries, walking forwards
+ * and then jumping back, so the cached second is both reused and replaced */
+std::vector<uint64_t> sampleTimes(uint64_t start, size_t count)
+{
+    std::vector<uint64_t> times{};
+    uint64_t second{start / NANOSECONDS_PER_SECOND};
+    const uint64_t offsets[]{0, 1, 999, 1000, 999999, 1000000, 123456789, 999999000, 999999999};
+    for (size_t i = 0; i < count; i++) {
+        uint64_t base{(second + (i % 97) * 3607) * NANOSECONDS_PER_SECOND};
+        for (auto offset : offsets) {
+            times.push_back(base + offset);
+        }
+    }
+    return times;
+}
+
+size_t countMismatches(const std::vector<uint64_t> &times, const std::vector<std::string> &expected)
+{
+    size_t mismatches{0};
+    char text[TimestampFormatter::LENGTH];
+    for (size_t i = 0; i < times.size(); i++) {
+        TimestampFormatter::format(times[i], text);
+        if (expected[i].compare(0, std::string::npos, text, sizeof(text)) != 0) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+uint64_t realtimeNanoseconds()
+{
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (static_cast<uint64_t>(now.tv_sec) * NANOSECONDS_PER_SECOND) + static_cast<uint64_t>(now.tv_nsec);
+}
+
+/* How ApplicationUtilities::currentTime() built the time of a log record */
+std::string legacyCurrentTime()
+{
+    auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+    return dynamic_cast<std::ostringstream &>(std::ostringstream{}.flush() << std::put_time(&tm, "%H-%M-%S")).str();
+}
+
+struct Measurement
+{
+    double nanosecondsPerCall;
+    double allocationsPerCall;
+};
+
+template <typename Function>
+Measurement measure(size_t iterations, Function function)
+{
+    for (size_t i = 0; i < 1000; i++) {
+        function();
+    }
+    uint64_t allocationsBefore{allocationCount.load()};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        function();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    uint64_t allocations{allocationCount.load() - allocationsBefore};
+    return Measurement{std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations),
+                       static_cast<double>(allocations) / static_cast<double>(iterations)};
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 1000000};
+
+    std::vector<uint64_t> times{sampleTimes(realtimeNanoseconds(), 2000)};
+    std::vector<std::string> expected{};
+    for (auto it : times) {
+        expected.push_back(referenceText(it));
+    }
+    uint64_t allocationsBefore{allocationCount.load()};
+    size_t mismatches{countMismatches(times, expected)};
+    uint64_t checkAllocations{allocationCount.load() - allocationsBefore};
+
+    std::atomic<size_t> threadMismatches{0};
+    std::vector<std::thread> threads{};
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        threads.emplace_back([&times, &expected, &threadMismatches]() {
+            for (size_t pass = 0; pass < 20; pass++) {
+                threadMismatches += countMismatches(times, expected);
+            }
+        });
+    }
+    for (auto &it : threads) {
+        it.join();
+    }
+
+    Measurement legacy{measure(iterations, []() {
+        benchmarkSink = benchmarkSink + legacyCurrentTime().size();
+    })};
+    Measurement cached{measure(iterations, []() {
+        char text[TimestampFormatter::LENGTH];
+        TimestampFormatter::format(realtimeNanoseconds(), text);
+        benchmarkSink = benchmarkSink + static_cast<size_t>(text[TimestampFormatter::LENGTH - 1]);
+    })};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"TimestampFormatter\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"checked_times\": " << times.size() << "," << std::endl;
+    std::cout << "  \"mismatches\": " << mismatches << "," << std::endl;
+    std::cout << "  \"threads\": " << THREAD_COUNT << "," << std::endl;
+    std::cout << "  \"thread_mismatches\": " << threadMismatches.load() << "," << std::endl;
+    std::cout << "  \"legacy_put_time\": {\"ns_per_call\": " << legacy.nanosecondsPerCall << ", \"allocations_per_call\": " << legacy.allocationsPerCall << "}," << std::endl;
+    std::cout << "  \"cached_formatter\": {\"ns_per_call\": " << cached.nanosecondsPerCall << ", \"allocations_per_call\": " << cached.allocationsPerCall << "}" << std::endl;
+    std::cout << "}" << std::endl;
+
+    if ( (mismatches != 0) || (threadMismatches.load() != 0) ) {
+        std::cerr << "TimestampFormatter differs from the strftime reference" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if ( (checkAllocations != 0) || (cached.allocationsPerCall > 0.0) ) {
+        std::cerr << "TimestampFormatter allocated" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
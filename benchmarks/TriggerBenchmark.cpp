@@ -0,0 +1,205 @@
+/* Compiles a few hundred error strings and event markers into a
+ * TriggerAutomaton and checks, for every instruction set the CPU supports,
+ * that it reports exactly the occurrences a std::string::find per pattern
+ * finds in a console log stream fed in random sized reads, so patterns
+ * straddle read boundaries. Then measures scanning throughput per
+ * instruction set next to one std::regex alternation of the same patterns,
+ * and how many ports at 12 Mbaud one core keeps up with, against a target
+ * of 16. Exits with a failure status on any mismatch */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TriggerAutomaton.h"
+
+namespace {
+
+const double PORT_BYTES_PER_SECOND{12e6 / 10};
+const double TARGET_PORTS{16.0};
+const size_t REGEX_SAMPLE_LENGTH{64 * 1024};
+
+volatile size_t benchmarkSink{0};
+
+const std::vector<std::string> SUBSYSTEMS{"usb", "spi", "i2c", "dma", "flash", "eth", "wifi", "modem", "gps", "adc",
+                                          "pwm", "can", "uart", "rtc", "nvm", "sensor", "fs", "net", "ota", "boot"};
+const std::vector<std::string> CONDITIONS{"timeout", "overrun", "crc error", "underflow", "not responding", "reset",
+                                          "brownout", "stalled", "lost arbitration", "bad checksum", "failed", "disconnected"};
+const std::vector<std::string> WORDS{"device", "number", "using", "new", "high-speed", "registered", "link", "up", "down",
+                                     "speed", "mode", "detected", "attached", "interface", "driver", "probe", "ok", "ready",
+                                     "config", "value", "status", "queue", "buffer", "channel", "start", "done", "INFO:",
+                                     "DEBUG:", "OK", "rx", "tx", "irq", "clock", "voltage", "temp", "level", "login", "user"};
+
+std::vector<std::string> makePatterns()
+{
+    /* Leveled error strings, plus markers a console prints on its own */
+    std::vector<std::string> patterns{};
+    const std::vector<std::string> levels{"ERROR: ", "FATAL: "};
+    for (const auto &level : levels) {
+        for (const auto &subsystem : SUBSYSTEMS) {
+            for (const auto &condition : CONDITIONS) {
+                patterns.push_back(level + subsystem + " " + condition);
+            }
+        }
+    }
+    const std::vector<std::string> markers{"Kernel panic", "Watchdog reset", "Booting", "login: ", "Password: ", "Segmentation fault",
+                                           "Call trace:", "Oops", "BUG: ", "Hard fault", "Assertion failed", "\x1b[31m", "\x1b[0m",
+                                           "OK\r\n", "panic", "#PWR", ">>> READY", "stack overflow", "out of memory", "\x02\x10"};
+    patterns.insert(patterns.end(), markers.begin(), markers.end());
+    return patterns;
+}
+
+std::string makeStream(size_t length, const std::vector<std::string> &patterns, std::mt19937 &randomEngine)
+{
+    /* Timestamped console lines of lowercase words, a pattern in about one
+     * line out of a hundred */
+    std::uniform_int_distribution<size_t> wordCount{3, 12};
+    std::uniform_int_distribution<size_t> word{0, WORDS.size() - 1};
+    std::uniform_int_distribution<size_t> subsystem{0, SUBSYSTEMS.size() - 1};
+    std::uniform_int_distribution<size_t> pattern{0, patterns.size() - 1};
+    std::uniform_int_distribution<int> percent{0, 99};
+    std::uniform_int_distribution<int> number{0, 99999};
+    std::string stream{};
+    stream.reserve(length + 256);
+    while (stream.size() < length) {
+        stream += "[" + std::to_string(number(randomEngine)) + "." + std::to_string(number(randomEngine)) + "] " + SUBSYSTEMS[subsystem(randomEngine)];
+        size_t words{wordCount(randomEngine)};
+        for (size_t i = 0; i < words; i++) {
+            stream += " " + WORDS[word(randomEngine)];
+            if (percent(randomEngine) < 10) {
+                stream += " " + std::to_string(number(randomEngine));
+            }
+        }
+        if (percent(randomEngine) == 0) {
+            stream += " " + patterns[pattern(randomEngine)];
+        }
+        stream += "\r\n";
+    }
+    return stream;
+}
+
+/* Every (pattern, end offset) pair, overlapping occurrences included */
+std::vector<std::pair<size_t, size_t>> referenceMatches(const std::string &stream, const std::vector<std::string> &patterns)
+{
+    std::vector<std::pair<size_t, size_t>> matches{};
+    for (size_t i = 0; i < patterns.size(); i++) {
+        for (size_t position = stream.find(patterns[i]); position != std::string::npos; position = stream.find(patterns[i], position + 1)) {
+            matches.emplace_back(i, position + patterns[i].size());
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+bool verify(const std::string &stream, const std::vector<std::string> &patterns, const std::vector<std::pair<size_t, size_t>> &expected,
+            TriggerAutomaton::InstructionSet instructionSet, std::mt19937 &randomEngine)
+{
+    TriggerAutomaton automaton{patterns, instructionSet};
+    std::vector<std::pair<size_t, size_t>> actual{};
+    size_t offset{0};
+    TriggerAutomaton::MatchHandler matchHandler{[&actual, &offset](size_t patternIndex, size_t matchEnd) {
+        actual.emplace_back(patternIndex, offset + matchEnd);
+    }};
+    /* Mostly reads as a serial port delivers them, some past the prefilter's block size */
+    std::uniform_int_distribution<size_t> readLength{1, 300};
+    uint32_t state{TriggerAutomaton::START_STATE};
+    while (offset < stream.size()) {
+        size_t length{std::min(readLength(randomEngine), stream.size() - offset)};
+        state = automaton.scan(state, stream.data() + offset, length, matchHandler);
+        offset += length;
+    }
+    std::sort(actual.begin(), actual.end());
+    return actual == expected;
+}
+
+double measureBytesPerSecond(const std::string &stream, const std::vector<std::string> &patterns, TriggerAutomaton::InstructionSet instructionSet, size_t iterations)
+{
+    TriggerAutomaton automaton{patterns, instructionSet};
+    size_t matchCount{0};
+    TriggerAutomaton::MatchHandler matchHandler{[&matchCount](size_t, size_t) { matchCount++; }};
+    /* 4 KiB reads, what a busy port hands over at a time */
+    const size_t readSize{4096};
+    uint32_t state{TriggerAutomaton::START_STATE};
+    auto startTime = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t offset = 0; offset < stream.size(); offset += readSize) {
+            state = automaton.scan(state, stream.data() + offset, std::min(readSize, stream.size() - offset), matchHandler);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    benchmarkSink = benchmarkSink + matchCount;
+    return static_cast<double>(stream.size() * iterations) / std::chrono::duration<double>(elapsed).count();
+}
+
+double measureRegexBytesPerSecond(const std::string &stream, const std::vector<std::string> &patterns)
+{
+    std::string alternation{""};
+    for (const auto &pattern : patterns) {
+        alternation += (alternation.empty() ? "" : "|") + std::regex_replace(pattern, std::regex{R"([.^$|()\[\]{}*+?\\])"}, R"(\$&)");
+    }
+    std::regex expression{alternation, std::regex::optimize};
+    std::string sample{stream.substr(0, REGEX_SAMPLE_LENGTH)};
+    size_t matchCount{0};
+    auto startTime = std::chrono::steady_clock::now();
+    for (std::sregex_iterator it{sample.begin(), sample.end(), expression}, end{}; it != end; ++it) {
+        matchCount++;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    benchmarkSink = benchmarkSink + matchCount;
+    return static_cast<double>(sample.size()) / std::chrono::duration<double>(elapsed).count();
+}
+
+} //Global namespace
+
+int main(int argc, char *argv[])
+{
+    size_t iterations{(argc > 1) ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10)) : 10};
+    const std::vector<TriggerAutomaton::InstructionSet> instructionSets{TriggerAutomaton::InstructionSet::Avx2, TriggerAutomaton::InstructionSet::Ssse3,
+                                                                       TriggerAutomaton::InstructionSet::Scalar};
+    std::mt19937 randomEngine{12345};
+    std::vector<std::string> patterns{makePatterns()};
+    std::string verificationStream{makeStream(2 * 1024 * 1024, patterns, randomEngine)};
+    std::string benchmarkStream{makeStream(32 * 1024 * 1024, patterns, randomEngine)};
+    std::vector<std::pair<size_t, size_t>> expected{referenceMatches(verificationStream, patterns)};
+    TriggerAutomaton automaton{patterns};
+    bool allMatched{true};
+    double bestBytesPerSecond{0.0};
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"benchmark\": \"Trigger\"," << std::endl;
+    std::cout << "  \"iterations\": " << iterations << "," << std::endl;
+    std::cout << "  \"patterns\": " << patterns.size() << ", \"states\": " << automaton.stateCount() << ", \"start_bytes\": " << automaton.startByteCount()
+              << ", \"reference_matches\": " << expected.size() << "," << std::endl;
+    std::cout << "  \"results\": [" << std::endl;
+    bool firstResult{true};
+    for (auto instructionSet : instructionSets) {
+        if (!TriggerAutomaton::isSupported(instructionSet)) {
+            continue;
+        }
+        bool matched{verify(verificationStream, patterns, expected, instructionSet, randomEngine)};
+        allMatched = allMatched && matched;
+        double bytesPerSecond{measureBytesPerSecond(benchmarkStream, patterns, instructionSet, iterations)};
+        bestBytesPerSecond = std::max(bestBytesPerSecond, bytesPerSecond);
+        std::cout << (firstResult ? "" : ",\n") << "    {\"instruction_set\": \"" << TriggerAutomaton::instructionSetName(instructionSet)
+                  << "\", \"matches_reference\": " << (matched ? "true" : "false") << ", \"megabytes_per_second\": " << bytesPerSecond / 1e6 << "}";
+        firstResult = false;
+    }
+    std::cout << std::endl << "  ]," << std::endl;
+    std::cout << "  \"regex_megabytes_per_second\": " << measureRegexBytesPerSecond(benchmarkStream, patterns) / 1e6 << "," << std::endl;
+    double portsPerCore{bestBytesPerSecond / PORT_BYTES_PER_SECOND};
+    std::cout << "  \"ports_at_12mbaud_per_core\": " << portsPerCore << ", \"target_ports\": " << TARGET_PORTS
+              << ", \"target_met\": " << ( (portsPerCore >= TARGET_PORTS) ? "true" : "false") << std::endl;
+    std::cout << "}" << std::endl;
+
+    if (!allMatched) {
+        std::cerr << "TriggerAutomaton matches differ from the reference search" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}